@@ -0,0 +1,245 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard 
+//
+
+#include "pch.h"
+#include "AsyncFileIO.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+using namespace std;
+using Utility::ByteArray;
+using Utility::NullFile;
+
+namespace
+{
+    struct ReadRequest
+    {
+        AsyncFileIO::RequestHandle Handle;
+        wstring FileName;
+        AsyncFileIO::CompletionCallback OnComplete;
+        atomic<bool> Canceled;
+    };
+
+    mutex s_Mutex;
+    condition_variable s_WorkAvailable;
+    condition_variable s_SpaceAvailable;
+    deque<shared_ptr<ReadRequest>> s_Queues[AsyncFileIO::kNumPriorities];
+    unordered_map<AsyncFileIO::RequestHandle, shared_ptr<ReadRequest>> s_Outstanding;
+    vector<thread> s_Threads;
+    uint32_t s_MaxPendingRequests = 0;
+    uint32_t s_NumPending = 0;
+    AsyncFileIO::RequestHandle s_NextHandle = 1;
+    bool s_ShuttingDown = false;
+
+    // Reads are issued in pieces so that cancellation takes effect in the middle of large files
+    const DWORD kReadChunkSize = 4 * 1024 * 1024;
+
+    // Positional reads of a whole file, checking for cancellation between chunks
+    ByteArray ReadWholeFile( const wstring& FileName, const atomic<bool>& Canceled )
+    {
+        HANDLE File = CreateFileW(FileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (File == INVALID_HANDLE_VALUE)
+            return NullFile;
+
+        LARGE_INTEGER FileSize;
+        if (!GetFileSizeEx(File, &FileSize))
+        {
+            CloseHandle(File);
+            return NullFile;
+        }
+
+        ByteArray Data = make_shared<vector<byte>>((size_t)FileSize.QuadPart);
+        uint64_t Offset = 0;
+
+        while (Offset < (uint64_t)FileSize.QuadPart && !Canceled)
+        {
+            OVERLAPPED Position = {};
+            Position.Offset = (DWORD)Offset;
+            Position.OffsetHigh = (DWORD)(Offset >> 32);
+
+            uint64_t Remaining = (uint64_t)FileSize.QuadPart - Offset;
+            DWORD BytesToRead = Remaining < kReadChunkSize ? (DWORD)Remaining : kReadChunkSize;
+            DWORD BytesRead = 0;
+
+            if (!::ReadFile(File, Data->data() + Offset, BytesToRead, &BytesRead, &Position) || BytesRead == 0)
+                break;
+
+            Offset += BytesRead;
+        }
+
+        CloseHandle(File);
+
+        return Offset == (uint64_t)FileSize.QuadPart && !Canceled ? Data : NullFile;
+    }
+
+    ByteArray ReadOrInflateFile( const wstring& FileName, const atomic<bool>& Canceled )
+    {
+        const wstring ZippedFileName = FileName + L".gz";
+
+        if (GetFileAttributesW(ZippedFileName.c_str()) != INVALID_FILE_ATTRIBUTES)
+        {
+            ByteArray Data = make_shared<vector<byte>>();
+            Data->reserve(Utility::GetInflatedSize(ZippedFileName));
+
+            bool Succeeded = Utility::InflateFile(ZippedFileName, [&](const byte* Chunk, size_t Size)
+            {
+                Data->insert(Data->end(), Chunk, Chunk + Size);
+                return !Canceled;
+            });
+
+            return Succeeded && Data->size() > 0 ? Data : NullFile;
+        }
+
+        return ReadWholeFile(FileName, Canceled);
+    }
+
+    void WorkerThread( void )
+    {
+        for (;;)
+        {
+            shared_ptr<ReadRequest> Request;
+
+            {
+                unique_lock<mutex> Lock(s_Mutex);
+                s_WorkAvailable.wait(Lock, []
+                {
+                    if (s_ShuttingDown)
+                        return true;
+                    for (auto& Queue : s_Queues)
+                        if (!Queue.empty())
+                            return true;
+                    return false;
+                });
+
+                for (auto& Queue : s_Queues)
+                {
+                    if (!Queue.empty())
+                    {
+                        Request = Queue.front();
+                        Queue.pop_front();
+                        break;
+                    }
+                }
+
+                if (Request == nullptr)
+                    return;     // Shutting down with nothing left to do
+
+                --s_NumPending;
+            }
+
+            s_SpaceAvailable.notify_one();
+
+            ByteArray Result = Request->Canceled ? NullFile : ReadOrInflateFile(Request->FileName, Request->Canceled);
+
+            {
+                // Cancel() only succeeds while the request is outstanding, so checking under the same lock
+                // as the erase guarantees that a successful Cancel() always yields NullFile
+                lock_guard<mutex> Lock(s_Mutex);
+                if (Request->Canceled)
+                    Result = NullFile;
+                s_Outstanding.erase(Request->Handle);
+            }
+
+            Request->OnComplete(Result);
+        }
+    }
+}
+
+void AsyncFileIO::Initialize( uint32_t NumThreads, uint32_t MaxPendingRequests )
+{
+    lock_guard<mutex> Lock(s_Mutex);
+
+    if (!s_Threads.empty())
+        return;
+
+    ASSERT(NumThreads > 0 && MaxPendingRequests > 0);
+
+    s_ShuttingDown = false;
+    s_MaxPendingRequests = MaxPendingRequests;
+
+    for (uint32_t i = 0; i < NumThreads; ++i)
+        s_Threads.emplace_back(WorkerThread);
+}
+
+void AsyncFileIO::Shutdown( void )
+{
+    {
+        lock_guard<mutex> Lock(s_Mutex);
+
+        if (s_Threads.empty())
+            return;
+
+        s_ShuttingDown = true;
+
+        // Let the workers drain the queues quickly by failing whatever hasn't started
+        for (auto& Request : s_Outstanding)
+            Request.second->Canceled = true;
+    }
+
+    s_WorkAvailable.notify_all();
+    s_SpaceAvailable.notify_all();
+
+    for (thread& Worker : s_Threads)
+        Worker.join();
+
+    s_Threads.clear();
+}
+
+AsyncFileIO::RequestHandle AsyncFileIO::QueueRead( const wstring& FileName, CompletionCallback OnComplete, Priority Pri )
+{
+    Initialize();
+
+    shared_ptr<ReadRequest> Request = make_shared<ReadRequest>();
+    Request->FileName = FileName;
+    Request->OnComplete = std::move(OnComplete);
+    Request->Canceled = false;
+
+    {
+        unique_lock<mutex> Lock(s_Mutex);
+        s_SpaceAvailable.wait(Lock, [] { return s_NumPending < s_MaxPendingRequests || s_ShuttingDown; });
+
+        if (s_ShuttingDown)
+        {
+            Lock.unlock();
+            Request->OnComplete(NullFile);
+            return kInvalidRequest;
+        }
+
+        Request->Handle = s_NextHandle++;
+        s_Outstanding[Request->Handle] = Request;
+        s_Queues[Pri].push_back(Request);
+        ++s_NumPending;
+    }
+
+    s_WorkAvailable.notify_one();
+
+    return Request->Handle;
+}
+
+bool AsyncFileIO::Cancel( RequestHandle Handle )
+{
+    lock_guard<mutex> Lock(s_Mutex);
+
+    auto Iter = s_Outstanding.find(Handle);
+    if (Iter == s_Outstanding.end())
+        return false;
+
+    // Queued requests are completed when a worker reaches them; in-flight reads stop at the next chunk
+    Iter->second->Canceled = true;
+    return true;
+}
@@ -0,0 +1,61 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard 
+//
+// A small pool of I/O threads servicing a bounded, prioritized queue of whole-file reads.  Requests can be
+// canceled until they complete, and completion is reported through a callback on the I/O thread.
+//
+
+#pragma once
+
+#include "FileUtility.h"
+#include <functional>
+
+namespace AsyncFileIO
+{
+    enum Priority
+    {
+        kPriorityHigh,      // e.g. textures that are visible right now
+        kPriorityNormal,
+        kPriorityLow,       // e.g. prefetching
+
+        kNumPriorities
+    };
+
+    typedef uint64_t RequestHandle;
+    static const RequestHandle kInvalidRequest = 0;
+
+    // Receives the file contents, or Utility::NullFile if the read failed or was canceled.  Runs on an I/O
+    // thread, so it should hand off heavy work and must not queue new reads while the queue could be full.
+    typedef std::function<void (Utility::ByteArray)> CompletionCallback;
+
+    // Optional.  The first request starts the default configuration if this hasn't been called.
+    void Initialize( uint32_t NumThreads = 4, uint32_t MaxPendingRequests = 1024 );
+
+    // Cancels everything still queued and waits for in-flight reads to finish.  Must be called before the
+    // application exits (GameCore does this) rather than leaving the threads to static destruction.
+    void Shutdown( void );
+
+    // Queues a read of an entire file.  As with ReadFileSync, a ".gz" version of the file is preferred and
+    // decompressed if it exists.  Blocks while the queue is full.
+    RequestHandle QueueRead( const std::wstring& FileName, CompletionCallback OnComplete, Priority Pri = kPriorityNormal );
+
+    // Cancels a queued or in-flight read.  Its callback still runs, with Utility::NullFile.  Returns false if
+    // the request has already completed.
+    bool Cancel( RequestHandle Request );
+}
+
+namespace Utility
+{
+    // ReadFileAsync() at the given priority.  Request receives the handle to pass to AsyncFileIO::Cancel(),
+    // which completes the task with NullFile.
+    task<ByteArray> ReadFileAsync( const wstring& fileName, AsyncFileIO::Priority priority, AsyncFileIO::RequestHandle& request );
+}
@@ -13,6 +13,7 @@
 
 #include "pch.h"
 #include "FileUtility.h"
+#include "AsyncFileIO.h"
 #include <fstream>
 #include <mutex>
 #include <zlib.h> // From NuGet package 
@@ -55,55 +56,81 @@ ByteArray ReadFileHelperEx( shared_ptr<wstring> fileName)
     return ReadFileHelper(*fileName);
 }
 
-ByteArray Inflate(ByteArray CompressedSource, int& err, uint32_t ChunkSize = 0x100000 ) 
+// Deflate cannot expand its input by more than this, so larger size hints must come from corrupt data
+static const size_t kMaxInflateRatio = 1032;
+
+// Size hints are read from the file and cannot be trusted.  Anything bigger is handled by growing the buffer.
+static size_t ClampSizeHint(size_t sizeHint, size_t sourceSize)
 {
-    // Create a dynamic buffer to hold compressed blocks
-    vector<unique_ptr<byte> > blocks;
+    return std::min(sizeHint, sourceSize * kMaxInflateRatio);
+}
 
-    z_stream strm  = {};
-    strm.data_type = Z_BINARY;
-    strm.total_in  = strm.avail_in  = (uInt)CompressedSource->size();
-    strm.next_in   = CompressedSource->data();
+// Returns the uncompressed size recorded in the trailer of a gzip stream, or 0 if the data is not gzip.
+// ISIZE is only the size modulo 2^32, so it is a hint rather than a guarantee.
+static size_t GetGzipSizeHint(const byte* data, size_t size)
+{
+    if (size < 18 || data[0] != 0x1f || data[1] != 0x8b)
+        return 0;
 
-    err = inflateInit2(&strm, (15 + 32)); //15 window bits, and the +32 tells zlib to to detect if using gzip or zlib
+    const byte* trailer = data + size - 4;
+    return (size_t)trailer[0] | (size_t)trailer[1] << 8 | (size_t)trailer[2] << 16 | (size_t)trailer[3] << 24;
+}
 
-    while (err == Z_OK || err == Z_BUF_ERROR)
-    {
-        strm.avail_out = ChunkSize;
-        strm.next_out = (byte*)malloc(ChunkSize);
-        blocks.emplace_back(strm.next_out);
-        err = inflate(&strm, Z_NO_FLUSH);
-    }
+// Inflates a gzip or zlib stream directly into the returned buffer.  The buffer is sized up front from the
+// size hint or the gzip trailer, and only grows if that turns out to be too small.
+ByteArray Inflate(const byte* source, size_t sourceSize, int& err, size_t sizeHint = 0)
+{
+    if (sizeHint == 0)
+        sizeHint = GetGzipSizeHint(source, sourceSize);
+    if (sizeHint == 0)
+        sizeHint = sourceSize * 4;
 
-    if (err != Z_STREAM_END) 
-    {
-        inflateEnd(&strm);
-        return NullFile;
-    }
+    sizeHint = ClampSizeHint(sizeHint, sourceSize);
+
+    Utility::ByteArray byteArray = make_shared<vector<byte> >( sizeHint > 0 ? sizeHint : 1 );
+
+    z_stream strm  = {};
+    strm.data_type = Z_BINARY;
 
-    ASSERT(strm.total_out > 0, "Nothing to decompress");
+    // avail_in is 32 bits, so sources over 4 GB are fed to zlib in pieces
+    const byte* nextIn = source;
+    size_t remainingIn = sourceSize;
 
-    Utility::ByteArray byteArray = make_shared<vector<byte> >( strm.total_out );
+    err = inflateInit2(&strm, (15 + 32)); //15 window bits, and the +32 tells zlib to to detect if using gzip or zlib
+    if (err != Z_OK)
+        return NullFile;
 
-    // Allocate actual memory for this.
-    // copy the bits into that RAM.
-    // Free everything else up!!
-    void* curDest = byteArray->data();
-    size_t remaining = byteArray->size();
+    size_t totalOut = 0;
 
-    for (size_t i = 0; i < blocks.size(); ++i)
+    while (err == Z_OK || err == Z_BUF_ERROR && strm.avail_out == 0)
     {
-        ASSERT(remaining > 0);
+        // Out of room means the hint was wrong (or the file is over 4 GB).  Keep going in a bigger buffer.
+        if (totalOut == byteArray->size())
+            byteArray->resize(byteArray->size() * 2);
+
+        const size_t remaining = byteArray->size() - totalOut;
+        strm.next_out = byteArray->data() + totalOut;
+        strm.avail_out = remaining < 0xFFFFFFFF ? (uInt)remaining : 0xFFFFFFFF;
+        uInt availOut = strm.avail_out;
 
-        size_t CopySize = remaining < ChunkSize ? remaining : ChunkSize;
+        if (strm.avail_in == 0 && remainingIn > 0)
+        {
+            strm.next_in = (Bytef*)nextIn;
+            strm.avail_in = remainingIn < 0xFFFFFFFF ? (uInt)remainingIn : 0xFFFFFFFF;
+            nextIn += strm.avail_in;
+            remainingIn -= strm.avail_in;
+        }
 
-        memcpy(curDest, blocks[i].get(), CopySize);
-        curDest = (byte*)curDest + CopySize;
-        remaining -= CopySize;
+        err = inflate(&strm, Z_NO_FLUSH);
+        totalOut += availOut - strm.avail_out;
     }
 
     inflateEnd(&strm);
 
+    if (err != Z_STREAM_END || totalOut == 0)
+        return NullFile;
+
+    byteArray->resize(totalOut);
     return byteArray;
 }
 
@@ -114,7 +141,7 @@ ByteArray DecompressZippedFile( wstring& fileName )
         return NullFile;
 
     int error;
-    ByteArray DecompressedFile = Inflate(CompressedFile, error);
+    ByteArray DecompressedFile = Inflate(CompressedFile->data(), CompressedFile->size(), error);
     if (DecompressedFile->size() == 0)
     {
         LOG_ERRORF("Couldn't unzip file %s:  Error = %d.", Utility::WideStringToUTF8(fileName).c_str(), error);
@@ -131,6 +158,178 @@ ByteArray Utility::ReadFileSync( const wstring& fileName)
 
 task<ByteArray> Utility::ReadFileAsync(const wstring& fileName)
 {
-    shared_ptr<wstring> SharedPtr = make_shared<wstring>(fileName);
-    return create_task( [=] { return ReadFileHelperEx(SharedPtr); } );
+    AsyncFileIO::RequestHandle request;
+    return ReadFileAsync(fileName, AsyncFileIO::kPriorityNormal, request);
+}
+
+task<ByteArray> Utility::ReadFileAsync(const wstring& fileName, AsyncFileIO::Priority priority, AsyncFileIO::RequestHandle& request)
+{
+    task_completion_event<ByteArray> completion;
+    request = AsyncFileIO::QueueRead(fileName, [completion](ByteArray data) { completion.set(data); }, priority);
+    return create_task(completion);
+}
+
+size_t Utility::GetInflatedSize(const wstring& fileName)
+{
+    ifstream file( fileName, ios::in | ios::binary | ios::ate );
+    if (!file)
+        return 0;
+
+    const streamoff fileSize = file.tellg();
+    if (fileSize < 18)
+        return 0;
+
+    byte header[2];
+    byte trailer[4];
+    file.seekg(0);
+    file.read((char*)header, sizeof(header));
+    file.seekg(fileSize - 4);
+    file.read((char*)trailer, sizeof(trailer));
+    if (!file || header[0] != 0x1f || header[1] != 0x8b)
+        return 0;
+
+    const size_t sizeHint = (size_t)trailer[0] | (size_t)trailer[1] << 8 | (size_t)trailer[2] << 16 | (size_t)trailer[3] << 24;
+    return ClampSizeHint(sizeHint, (size_t)fileSize);
+}
+
+bool Utility::InflateFile(const wstring& fileName, const InflateSink& sink, uint32_t chunkSize)
+{
+    ifstream file( fileName, ios::in | ios::binary );
+    if (!file)
+        return false;
+
+    unique_ptr<byte[]> inputChunk(new byte[chunkSize]);
+    unique_ptr<byte[]> outputChunk(new byte[chunkSize]);
+
+    z_stream strm = {};
+    strm.data_type = Z_BINARY;
+
+    int err = inflateInit2(&strm, (15 + 32));
+    if (err != Z_OK)
+        return false;
+
+    while (err != Z_STREAM_END)
+    {
+        if (strm.avail_in == 0)
+        {
+            file.read((char*)inputChunk.get(), chunkSize);
+            strm.next_in = inputChunk.get();
+            strm.avail_in = (uInt)file.gcount();
+
+            // Truncated stream
+            if (strm.avail_in == 0)
+                break;
+        }
+
+        strm.next_out = outputChunk.get();
+        strm.avail_out = chunkSize;
+
+        err = inflate(&strm, Z_NO_FLUSH);
+        if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
+            break;
+
+        const size_t produced = chunkSize - strm.avail_out;
+        if (produced > 0 && !sink(outputChunk.get(), produced))
+            break;
+    }
+
+    inflateEnd(&strm);
+
+    if (err != Z_STREAM_END)
+    {
+        LOG_ERRORF("Couldn't unzip file %s:  Error = %d.", Utility::WideStringToUTF8(fileName).c_str(), err);
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t Utility::ComputeCrc32(const void* data, size_t size, uint32_t crc)
+{
+    // zlib takes 32-bit lengths
+    const byte* ptr = (const byte*)data;
+    while (size > 0)
+    {
+        uInt chunk = size > 0x40000000 ? 0x40000000 : (uInt)size;
+        crc = (uint32_t)crc32(crc, ptr, chunk);
+        ptr += chunk;
+        size -= chunk;
+    }
+    return crc;
+}
+
+ByteArray Utility::CompressBuffer(const void* source, size_t sourceSize)
+{
+    if (sourceSize == 0 || sourceSize > 0xFFFFFFFF)
+        return NullFile;
+
+    uLongf compressedSize = compressBound((uLong)sourceSize);
+    ByteArray compressed = make_shared<vector<byte> >(compressedSize);
+    if (compress2(compressed->data(), &compressedSize, (const Bytef*)source, (uLong)sourceSize, Z_BEST_SPEED) != Z_OK)
+        return NullFile;
+
+    if (compressedSize >= sourceSize)
+        return NullFile;
+
+    compressed->resize(compressedSize);
+    return compressed;
+}
+
+bool Utility::DecompressBuffer(const void* source, size_t sourceSize, void* dest, size_t destSize)
+{
+    if (sourceSize > 0xFFFFFFFF || destSize > 0xFFFFFFFF)
+        return false;
+
+    uLongf decompressedSize = (uLongf)destSize;
+    int err = uncompress((Bytef*)dest, &decompressedSize, (const Bytef*)source, (uLong)sourceSize);
+    return err == Z_OK && decompressedSize == destSize;
+}
+
+bool MappedFile::Open(const wstring& fileName, bool copyOnWrite)
+{
+    Close();
+
+    m_File = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_File == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_File, &fileSize) || fileSize.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+
+    m_Mapping = CreateFileMappingW(m_File, nullptr, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+    if (m_Mapping == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    m_Data = (byte*)MapViewOfFile(m_Mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    if (m_Data == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    m_Size = (size_t)fileSize.QuadPart;
+    return true;
+}
+
+void MappedFile::Close(void)
+{
+    if (m_Data != nullptr)
+        UnmapViewOfFile(m_Data);
+    if (m_Mapping != nullptr)
+        CloseHandle(m_Mapping);
+    if (m_File != INVALID_HANDLE_VALUE)
+        CloseHandle(m_File);
+
+    m_File = INVALID_HANDLE_VALUE;
+    m_Mapping = nullptr;
+    m_Data = nullptr;
+    m_Size = 0;
 }
@@ -31,7 +31,57 @@ namespace Utility
     // This operation blocks until the entire file is read.
     ByteArray ReadFileSync(const wstring& fileName);
 
-    // Same as previous except that it does not block but instead returns a task.
+    // Same as previous except that it does not block but instead returns a task.  The read is serviced by
+    // the AsyncFileIO thread pool at normal priority.  AsyncFileIO.h has a version that takes a priority
+    // and can be canceled.
     task<ByteArray> ReadFileAsync(const wstring& fileName);
 
+    // Receives decompressed data in order, one chunk at a time.  Return false to stop decompressing.
+    typedef function<bool (const byte* data, size_t size)> InflateSink;
+
+    // Decompresses a gzip or zlib file through a sink, so neither the compressed nor decompressed data ever
+    // has to be fully resident.  Returns false if the file can't be read, is corrupt, or the sink stops early.
+    bool InflateFile(const wstring& fileName, const InflateSink& sink, uint32_t chunkSize = 0x100000);
+
+    // Returns the decompressed size of a .gz file from its trailer (modulo 4 GB), or 0 if it isn't gzip.
+    // The size is capped at the most the file could inflate to, so it is safe to reserve.
+    size_t GetInflatedSize(const wstring& fileName);
+
+    // Returns the CRC-32 of a block of memory.  Pass a previous result as 'crc' to continue a running checksum.
+    uint32_t ComputeCrc32(const void* data, size_t size, uint32_t crc = 0);
+
+    // Compresses a block of memory into a zlib stream.  Returns NullFile if compression fails or does not
+    // make the data any smaller, in which case it should be stored raw.
+    ByteArray CompressBuffer(const void* source, size_t sourceSize);
+
+    // Decompresses a zlib stream into a buffer that must be exactly the size of the decompressed data.
+    bool DecompressBuffer(const void* source, size_t sourceSize, void* dest, size_t destSize);
+
+    // A copy-on-write view of an entire file.  Pages are faulted in on first access rather than read up
+    // front, and only pages that are written to receive private copies, so the file on disk is never
+    // modified and loaded structures can still be patched in place.  A read-only view avoids reserving
+    // commit for those private copies, but writing to it faults.
+    class MappedFile
+    {
+    public:
+        MappedFile() : m_File(INVALID_HANDLE_VALUE), m_Mapping(nullptr), m_Data(nullptr), m_Size(0) {}
+        ~MappedFile() { Close(); }
+
+        bool Open(const wstring& fileName, bool copyOnWrite = true);
+        void Close(void);
+
+        bool IsOpen(void) const { return m_Data != nullptr; }
+        byte* GetData(void) const { return m_Data; }
+        size_t GetSize(void) const { return m_Size; }
+
+    private:
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        HANDLE m_File;
+        HANDLE m_Mapping;
+        byte* m_Data;
+        size_t m_Size;
+    };
+
 } // namespace Utility
@@ -25,6 +25,7 @@
 #include "Display.h"
 #include "Util/CommandLineArg.h"
 #include "ImGuiModule.h"
+#include "AsyncFileIO.h"
 #include <shellapi.h>
 #include <VersionHelpers.h>
 #include <ShellScalingApi.h>
@@ -62,6 +63,7 @@ namespace GameCore
 
         game.Cleanup();
 
+        AsyncFileIO::Shutdown();
         GameInput::Shutdown();
     }
 
@@ -15,78 +15,182 @@
 #include "Model.h"
 #include "../Core/Utility.h"
 #include "../Core/Math/Common.h"
-#include "../Core/Math/Quaternion.h"
 
-using Math::Quaternion;
-using Math::Vector4;
+#include <algorithm>
+#include <ppl.h>
 
-static inline float ToFloat(const int8_t x) { return Math::Max(x / 127.0f, -1.0f); }
-static inline float ToFloat(const uint8_t x) { return x / 255.0f; }
-static inline float ToFloat(const int16_t x) { return Math::Max(x / 32767.0f, -1.0f); }
-static inline float ToFloat(const uint16_t x) { return x / 65535.0f; }
-
-static inline void Lerp3(float* Dest, const float* Key1, const float* Key2, float T)
+// Rebuilds a quaternion from its "smallest three" encoding.  The three stored components lie
+// in [-1/sqrt(2), 1/sqrt(2)], and the dropped one is the largest and always positive.
+static inline void DecodeRotation(const uint16_t* key, float* q)
 {
-    Dest[0] = Math::Lerp(Key1[0], Key2[0], T);
-    Dest[1] = Math::Lerp(Key1[1], Key2[1], T);
-    Dest[2] = Math::Lerp(Key1[2], Key2[2], T);
-}
+    const uint64_t bits = key[0] | (uint64_t)key[1] << 16 | (uint64_t)key[2] << 32;
+    const uint32_t largest = (uint32_t)(bits >> 45) & 3;
 
-template <typename T>
-static inline Quaternion ToQuat(const T* rot)
-{
-    return (Quaternion)Vector4(ToFloat(rot[0]), ToFloat(rot[1]), ToFloat(rot[2]), ToFloat(rot[3]));
+    float sumSq = 0.0f;
+    for (uint32_t i = 0, j = 0; i < 4; ++i)
+    {
+        if (i == largest)
+            continue;
+        const float c = (float)(bits >> (15 * j++) & 0x7FFF) * (1.41421356f / 32767.0f) - 0.70710678f;
+        q[i] = c;
+        sumSq += c * c;
+    }
+    q[largest] = sqrtf(Math::Max(1.0f - sumSq, 0.0f));
 }
 
-static inline Quaternion ToQuat(const float* rot)
+static inline void Dequantize3(const AnimationCurve& curve, const uint16_t* key, float* value)
 {
-    return Quaternion(XMLoadFloat4((const XMFLOAT4*)rot));
+    value[0] = curve.rangeBias[0] + curve.rangeScale[0] * key[0];
+    value[1] = curve.rangeBias[1] + curve.rangeScale[1] * key[1];
+    value[2] = curve.rangeBias[2] + curve.rangeScale[2] * key[2];
 }
 
-static inline void Slerp(float* Dest, const void* Key1, const void* Key2, float T, uint32_t Format)
+void SampleAnimationCurve(const AnimationCurve& curve, const uint16_t* key1, const uint16_t* key2, float t, float* value)
 {
-    switch (Format)
-    {
-    case AnimationCurve::kSNorm8:
+    if (curve.interpolation == AnimationCurve::kStep)
+        t = 0.0f;
+
+    if (curve.targetPath == AnimationCurve::kRotation)
     {
-        const int8_t* key1 = (const int8_t*)Key1;
-        const int8_t* key2 = (const int8_t*)Key2;
-        XMStoreFloat4((XMFLOAT4*)Dest, (FXMVECTOR)Math::Slerp(ToQuat(key1), ToQuat(key2), T));
-        break;
+        // Frames are close together, so a normalized lerp along the shorter arc is indistinguishable
+        // from a slerp (and the build measures its error against the source curve anyway).
+        float q1[4], q2[4];
+        DecodeRotation(key1, q1);
+        DecodeRotation(key2, q2);
+        const float dot = q1[0] * q2[0] + q1[1] * q2[1] + q1[2] * q2[2] + q1[3] * q2[3];
+        const float t2 = dot < 0.0f ? -t : t;
+        const float t1 = 1.0f - t;
+
+        float lenSq = 0.0f;
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            value[i] = q1[i] * t1 + q2[i] * t2;
+            lenSq += value[i] * value[i];
+        }
+        const float invLen = 1.0f / sqrtf(lenSq);
+        for (uint32_t i = 0; i < 4; ++i)
+            value[i] *= invLen;
     }
-    case AnimationCurve::kUNorm8:
+    else
     {
-        const uint8_t* key1 = (const uint8_t*)Key1;
-        const uint8_t* key2 = (const uint8_t*)Key2;
-        XMStoreFloat4((XMFLOAT4*)Dest, (FXMVECTOR)Math::Slerp(ToQuat(key1), ToQuat(key2), T));
-        break;
+        float v1[3], v2[3];
+        Dequantize3(curve, key1, v1);
+        Dequantize3(curve, key2, v2);
+        value[0] = Math::Lerp(v1[0], v2[0], t);
+        value[1] = Math::Lerp(v1[1], v2[1], t);
+        value[2] = Math::Lerp(v1[2], v2[2], t);
     }
-    case AnimationCurve::kSNorm16:
+}
+
+// Decodes four "smallest three" rotation keys into SoA form (x, y, z, and w of each lane).  Only
+// the bit extraction is scalar.  Lanes past 'count' repeat the last key.
+static void DecodeRotations4(const byte* frame, const AnimationCurve* curves, uint32_t count, XMVECTOR q[4])
+{
+    __declspec(align(16)) uint32_t codes[3][4];
+    __declspec(align(16)) uint32_t largest[4];
+
+    for (uint32_t lane = 0; lane < 4; ++lane)
     {
-        const int16_t* key1 = (const int16_t*)Key1;
-        const int16_t* key2 = (const int16_t*)Key2;
-        XMStoreFloat4((XMFLOAT4*)Dest, (FXMVECTOR)Math::Slerp(ToQuat(key1), ToQuat(key2), T));
-        break;
+        const uint16_t* key = (const uint16_t*)(frame + curves[std::min(lane, count - 1)].keyOffset);
+        const uint64_t bits = key[0] | (uint64_t)key[1] << 16 | (uint64_t)key[2] << 32;
+        codes[0][lane] = (uint32_t)bits & 0x7FFF;
+        codes[1][lane] = (uint32_t)(bits >> 15) & 0x7FFF;
+        codes[2][lane] = (uint32_t)(bits >> 30) & 0x7FFF;
+        largest[lane] = (uint32_t)(bits >> 45) & 3;
     }
-    case AnimationCurve::kUNorm16:
+
+    const XMVECTOR scale = XMVectorReplicate(1.41421356f / 32767.0f);
+    const XMVECTOR bias = XMVectorReplicate(-0.70710678f);
+    const XMVECTOR a = XMVectorMultiplyAdd(XMConvertVectorUIntToFloat(XMLoadUInt4A((const XMUINT4A*)codes[0]), 0), scale, bias);
+    const XMVECTOR b = XMVectorMultiplyAdd(XMConvertVectorUIntToFloat(XMLoadUInt4A((const XMUINT4A*)codes[1]), 0), scale, bias);
+    const XMVECTOR c = XMVectorMultiplyAdd(XMConvertVectorUIntToFloat(XMLoadUInt4A((const XMUINT4A*)codes[2]), 0), scale, bias);
+    const XMVECTOR sumSq = XMVectorMultiplyAdd(a, a, XMVectorMultiplyAdd(b, b, XMVectorMultiply(c, c)));
+    const XMVECTOR d = XMVectorSqrt(XMVectorMax(XMVectorSubtract(g_XMOne, sumSq), XMVectorZero()));
+
+    // The stored components fill the slots other than the largest, in order
+    const XMVECTOR index = XMLoadUInt4A((const XMUINT4A*)largest);
+    const XMVECTOR is0 = XMVectorEqualInt(index, XMVectorZero());
+    const XMVECTOR is1 = XMVectorEqualInt(index, XMVectorSplatConstantInt(1));
+    const XMVECTOR is2 = XMVectorEqualInt(index, XMVectorSplatConstantInt(2));
+    const XMVECTOR is3 = XMVectorEqualInt(index, XMVectorSplatConstantInt(3));
+    q[0] = XMVectorSelect(a, d, is0);
+    q[1] = XMVectorSelect(XMVectorSelect(b, d, is1), a, is0);
+    q[2] = XMVectorSelect(XMVectorSelect(c, d, is2), b, XMVectorOrInt(is0, is1));
+    q[3] = XMVectorSelect(c, d, is3);
+}
+
+// Samples the animated rotation curves four at a time, interpolating along the shorter arc
+static void SampleRotations(const AnimationCurve* curves, uint32_t numCurves, const byte* frame1, const byte* frame2,
+    float lerpT, GraphNode* animGraph)
+{
+    for (uint32_t first = 0; first < numCurves; first += 4)
     {
-        const uint16_t* key1 = (const uint16_t*)Key1;
-        const uint16_t* key2 = (const uint16_t*)Key2;
-        XMStoreFloat4((XMFLOAT4*)Dest, (FXMVECTOR)Math::Slerp(ToQuat(key1), ToQuat(key2), T));
-        break;
+        const uint32_t count = std::min(numCurves - first, 4u);
+
+        XMVECTOR q1[4], q2[4];
+        DecodeRotations4(frame1, curves + first, count, q1);
+        DecodeRotations4(frame2, curves + first, count, q2);
+
+        __declspec(align(16)) float lerpTs[4];
+        for (uint32_t lane = 0; lane < 4; ++lane)
+            lerpTs[lane] = curves[first + std::min(lane, count - 1)].interpolation == AnimationCurve::kStep ? 0.0f : lerpT;
+
+        const XMVECTOR t = XMLoadFloat4A((const XMFLOAT4A*)lerpTs);
+        XMVECTOR dot = XMVectorMultiply(q1[0], q2[0]);
+        dot = XMVectorMultiplyAdd(q1[1], q2[1], dot);
+        dot = XMVectorMultiplyAdd(q1[2], q2[2], dot);
+        dot = XMVectorMultiplyAdd(q1[3], q2[3], dot);
+        const XMVECTOR t1 = XMVectorSubtract(g_XMOne, t);
+        const XMVECTOR t2 = XMVectorSelect(t, XMVectorNegate(t), XMVectorLess(dot, XMVectorZero()));
+
+        XMVECTOR q[4];
+        XMVECTOR lenSq = XMVectorZero();
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            q[i] = XMVectorMultiplyAdd(q1[i], t1, XMVectorMultiply(q2[i], t2));
+            lenSq = XMVectorMultiplyAdd(q[i], q[i], lenSq);
+        }
+        const XMVECTOR invLen = XMVectorReciprocalSqrt(lenSq);
+
+        // Back to one quaternion per register
+        const XMMATRIX rotations = XMMatrixTranspose(XMMATRIX(
+            XMVectorMultiply(q[0], invLen), XMVectorMultiply(q[1], invLen),
+            XMVectorMultiply(q[2], invLen), XMVectorMultiply(q[3], invLen)));
+
+        for (uint32_t lane = 0; lane < count; ++lane)
+        {
+            GraphNode& node = animGraph[curves[first + lane].targetNode];
+            node.rotation = Math::Quaternion(rotations.r[lane]);
+            node.staleMatrix = true;
+        }
     }
-    case AnimationCurve::kFloat:
+}
+
+// Samples animated translation and scale curves, one vector per curve
+static void SampleVectors(const AnimationCurve* curves, uint32_t numCurves, const byte* frame1, const byte* frame2,
+    float lerpT, GraphNode* animGraph)
+{
+    for (uint32_t j = 0; j < numCurves; ++j)
     {
-        const float* key1 = (const float*)Key1;
-        const float* key2 = (const float*)Key2;
-        XMStoreFloat4((XMFLOAT4*)Dest, (FXMVECTOR)Math::Slerp(ToQuat(key1), ToQuat(key2), T));
-        break;
-    }
-    default:
-        ASSERT(0, "Unexpected animation key frame data format");
-        break;
+        const AnimationCurve& curve = curves[j];
+        const uint16_t* key1 = (const uint16_t*)(frame1 + curve.keyOffset);
+        const uint16_t* key2 = (const uint16_t*)(frame2 + curve.keyOffset);
+
+        const XMVECTOR bias = XMLoadFloat3((const XMFLOAT3*)curve.rangeBias);
+        const XMVECTOR scale = XMLoadFloat3((const XMFLOAT3*)curve.rangeScale);
+        const XMVECTOR v1 = XMVectorMultiplyAdd(XMVectorSet(key1[0], key1[1], key1[2], 0.0f), scale, bias);
+        const XMVECTOR v2 = XMVectorMultiplyAdd(XMVectorSet(key2[0], key2[1], key2[2], 0.0f), scale, bias);
+        const XMVECTOR v = XMVectorLerp(v1, v2, curve.interpolation == AnimationCurve::kStep ? 0.0f : lerpT);
+
+        GraphNode& node = animGraph[curve.targetNode];
+        node.staleMatrix = true;
+        if (curve.targetPath == AnimationCurve::kTranslation)
+            XMStoreFloat3((XMFLOAT3*)((float*)&node.xform + 12), v);
+        else
+            XMStoreFloat3(&node.scale, v);
     }
 }
+
 void ModelInstance::UpdateAnimations(float deltaTime)
 {
     uint32_t NumAnimations = m_Model->m_NumAnimations;
@@ -112,37 +216,44 @@ void ModelInstance::UpdateAnimations(float deltaTime)
             anim.state = AnimationState::kStopped;
         }
 
-        const AnimationCurve* firstCurve = m_Model->m_CurveData.get() + animation.firstCurve;
+        // Every curve shares the same frames, so the position within the animation is found once
+        ASSERT(animation.numFrames >= 2);
+        const float lastFrame = (float)(animation.numFrames - 1);
+        const float progress = Math::Clamp(anim.time * animation.frameRate, 0.0f, lastFrame);
+        const uint32_t frame = (uint32_t)Math::Min(progress, lastFrame - 1.0f);
+        const float lerpT = progress - (float)frame;
 
-        // Update animation nodes
-        for (uint32_t j = 0; j < animation.numCurves; ++j)
-        {
-            const AnimationCurve& curve = firstCurve[j];
-            ASSERT(curve.numSegments > 0);
+        const byte* frame1 = m_Model->m_KeyFrameData + animation.keyFrameOffset + animation.frameStride * frame;
+        const byte* frame2 = frame1 + animation.frameStride;
+        const byte* constantKeys = m_Model->m_KeyFrameData + animation.constantKeyOffset;
+
+        const AnimationCurve* curves = m_Model->m_CurveData + animation.firstCurve;
+        const uint32_t numVectors = animation.numTranslations + animation.numScales;
+        const uint32_t numAnimated = animation.numRotations + numVectors;
 
-            const float progress = Math::Clamp((anim.time - curve.startTime) * curve.rangeScale, 0.0f, curve.numSegments);
-            const uint32_t segment = (uint32_t)progress;
-            const float lerpT = progress - (float)segment;
+        SampleRotations(curves, animation.numRotations, frame1, frame2, lerpT, animGraph);
+        SampleVectors(curves + animation.numRotations, numVectors, frame1, frame2, lerpT, animGraph);
 
-            const size_t stride = curve.keyFrameStride * 4;
-            const byte* key1 = m_Model->m_KeyFrameData.get() + curve.keyFrameOffset + stride * segment;
-            const byte* key2 = key1 + stride;
+        // Constant curves still have to be applied in case another animation moved the same node
+        for (uint32_t j = numAnimated; j < animation.numCurves; ++j)
+        {
+            const AnimationCurve& curve = curves[j];
+            const uint16_t* key = (const uint16_t*)(constantKeys + curve.keyOffset);
             GraphNode& node = animGraph[curve.targetNode];
 
             switch (curve.targetPath)
             {
             case AnimationCurve::kTranslation:
-                ASSERT(curve.keyFrameFormat == AnimationCurve::kFloat);
-                Lerp3((float*)&node.xform + 12, (const float*)key1, (const float*)key2, lerpT);
+                node.staleMatrix = true;
+                SampleAnimationCurve(curve, key, key, 0.0f, (float*)&node.xform + 12);
                 break;
             case AnimationCurve::kRotation:
                 node.staleMatrix = true;
-                Slerp((float*)&node.rotation, key1, key2, lerpT, curve.keyFrameFormat);
+                SampleAnimationCurve(curve, key, key, 0.0f, (float*)&node.rotation);
                 break;
             case AnimationCurve::kScale:
-                ASSERT(curve.keyFrameFormat == AnimationCurve::kFloat);
                 node.staleMatrix = true;
-                Lerp3((float*)&node.scale, (const float*)key1, (const float*)key2, lerpT);
+                SampleAnimationCurve(curve, key, key, 0.0f, (float*)&node.scale);
                 break;
             default:
             case AnimationCurve::kWeights:
@@ -151,6 +262,35 @@ void ModelInstance::UpdateAnimations(float deltaTime)
             }
         }
     }
+
+    for (uint32_t i = 0; i < m_Model->m_NumNodes; ++i)
+    {
+        GraphNode& node = animGraph[i];
+
+        // Regenerate the 3x3 matrix of every animated node, and let UpdateTransforms() know it moved
+        if (node.staleMatrix)
+        {
+            node.staleMatrix = false;
+            node.xform.Set3x3(Math::Matrix3(node.rotation) * Math::Matrix3::MakeScale(node.scale));
+            m_NodeDirty[i] = 1;
+            m_TransformsDirty = true;
+        }
+    }
+}
+
+void ModelInstance::UpdateAnimations(ModelInstance* const* instances, size_t numInstances, float deltaTime)
+{
+    // Instances of the same model read the same key frames, so keep them next to each other.  The
+    // parallel_for partitions contiguous ranges, which lets each worker stay within a few clips.
+    std::vector<ModelInstance*> sorted(instances, instances + numInstances);
+    std::sort(sorted.begin(), sorted.end(), [](const ModelInstance* a, const ModelInstance* b) { return a->m_Model.get() < b->m_Model.get(); });
+
+    Concurrency::parallel_for(size_t(0), sorted.size(), [&](size_t i)
+    {
+        ModelInstance& instance = *sorted[i];
+        if (instance.m_AnimGraph)
+            instance.UpdateAnimations(deltaTime);
+    });
 }
 
 void ModelInstance::PlayAnimation(uint32_t animIdx, bool loop)
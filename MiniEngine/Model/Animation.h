@@ -19,36 +19,52 @@
 //
 // An animation curve describes how a value (or values) change over time.
 // Key frames punctuate the curve, and times inbetween key frames are interpolated
-// using the selected method.  Note that a curve does not have to be defined for
-// the entire animation.  Some property might only be animated for a portion of time.
+// using the selected method.  Curves are resampled when the model is built so that
+// every curve of an animation shares the same evenly spaced frames.
+//
+// Each key is three 16-bit words.  Rotations use the "smallest three" encoding:
+// the largest quaternion component is dropped (and rebuilt from the unit length),
+// its index takes two bits, and the other three are stored with 15 bits each.
+// Translations and scales are 16-bit UNORM within the range of the curve.
 //
 struct AnimationCurve
 {
     enum { kTranslation, kRotation, kScale, kWeights }; // targetPath
     enum { kLinear, kStep, kCatmullRomSpline, kCubicSpline }; // interpolation
-    enum { kSNorm8, kUNorm8, kSNorm16, kUNorm16, kFloat }; // format
+    enum { kKeySize = 6 };              // Bytes per key
 
     uint32_t targetNode : 28;           // Which node is being animated
     uint32_t targetPath : 2;            // What aspect of the transform is animated
-    uint32_t interpolation : 2;         // The method of interpolation
-    uint32_t keyFrameOffset : 26;       // Byte offset to first key frame
-    uint32_t keyFrameFormat : 3;        // Data format for the key frames
-    uint32_t keyFrameStride : 3;        // Number of 4-byte words for one key frame
-    float numSegments;                  // Number of evenly-spaced gaps between keyframes
-    float startTime;                    // Time stamp of the first key frame
-    float rangeScale;                   // numSegments / (endTime - startTime)
+    uint32_t interpolation : 2;         // kLinear or kStep (splines are resampled)
+    uint32_t keyOffset : 31;            // Byte offset of this curve's key within a frame (or the constant keys)
+    uint32_t isConstant : 1;            // The curve never changes, so its one key is stored apart from the frames
+    float rangeBias[3];                 // Translation and scale:  value = rangeBias + rangeScale * key
+    float rangeScale[3];
 };
 
 //
-// An animation is composed of multiple animation curves.
+// An animation is composed of multiple animation curves.  The keys of all animated
+// curves are interleaved frame by frame, so sampling an animation reads two
+// contiguous frames regardless of how many curves it has.
 //
 struct AnimationSet
 {
     float duration;             // Time to play entire animation
     uint32_t firstCurve;        // Index of the first curve in this set (stored separately)
     uint32_t numCurves;         // Number of curves in this set
+    uint32_t numRotations;      // The animated curves come first, grouped by path:  rotations, then
+    uint32_t numTranslations;   // translations, then scales.  Constant curves follow them.
+    uint32_t numScales;
+    uint32_t numFrames;         // Number of evenly spaced frames (at least two)
+    float frameRate;            // (numFrames - 1) / duration
+    uint32_t frameStride;       // Bytes per frame
+    uint32_t keyFrameOffset;    // Byte offset to the first frame
+    uint32_t constantKeyOffset; // Byte offset to the keys of constant curves
 };
 
+// Interpolates between two keys of a curve, writing three floats (or four for rotations)
+void SampleAnimationCurve( const AnimationCurve& curve, const uint16_t* key1, const uint16_t* key2, float t, float* value );
+
 //
 // Animation state indicates whether an animation is playing and keeps track of current
 // position within the animation's playback.
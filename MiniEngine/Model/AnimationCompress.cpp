@@ -0,0 +1,465 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+
+#include "AnimationCompress.h"
+#include "../Core/Utility.h"
+
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <DirectXMath.h>
+
+using namespace DirectX;
+
+namespace
+{
+    // Irregularly spaced keys are resampled at the rate of their closest pair, up to this limit
+    const float kMaxFrameRate = 120.0f;
+
+    // The largest acceptable difference between a compressed curve and its source
+    const float kTranslationTolerance = 0.001f;                     // Model units
+    const float kRotationTolerance = 0.1f * XM_PI / 180.0f;        // Radians
+    const float kScaleTolerance = 0.001f;
+
+    // Candidate reductions of the base frame rate, largest first
+    const uint32_t kRateDivisors[] = { 8, 6, 5, 4, 3, 2, 1 };
+
+    struct SourceCurve
+    {
+        const glTF::AnimChannel* channel;
+        uint32_t interpolation;
+        std::vector<float> times;
+        std::vector<float> values;      // Four floats per element.  Splines store in-tangent, value, out-tangent.
+
+        // The source evaluated at the base frame rate and at its own key times
+        std::vector<float> refTimes;
+        std::vector<float> refValues;
+        float rangeMin[3];
+        float rangeMax[3];
+        bool isConstant;
+    };
+}
+
+static size_t ComponentSize(uint32_t componentType)
+{
+    switch (componentType)
+    {
+    case glTF::Accessor::kByte:
+    case glTF::Accessor::kUnsignedByte:
+        return 1;
+    case glTF::Accessor::kShort:
+    case glTF::Accessor::kUnsignedShort:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+// Normalized integers are allowed for rotations (KHR_mesh_quantization)
+static float ReadComponent(const uint8_t* src, uint32_t componentType)
+{
+    switch (componentType)
+    {
+    case glTF::Accessor::kByte:          return std::max(*(const int8_t*)src / 127.0f, -1.0f);
+    case glTF::Accessor::kUnsignedByte:  return *(const uint8_t*)src / 255.0f;
+    case glTF::Accessor::kShort:         return std::max(*(const int16_t*)src / 32767.0f, -1.0f);
+    case glTF::Accessor::kUnsignedShort: return *(const uint16_t*)src / 65535.0f;
+    case glTF::Accessor::kUnsignedInt:   return (float)*(const uint32_t*)src;
+    default:                             return *(const float*)src;
+    }
+}
+
+// Reads every element of an accessor into 'width' floats, returning the number of bytes read
+static size_t ReadAccessor(const glTF::Accessor& accessor, uint32_t width, std::vector<float>& values)
+{
+    const uint32_t numComponents = accessor.type + 1u;
+    const size_t componentSize = ComponentSize(accessor.componentType);
+    const size_t stride = accessor.stride != 0 ? accessor.stride : numComponents * componentSize;
+
+    values.assign((size_t)accessor.count * width, 0.0f);
+    for (uint32_t i = 0; i < accessor.count; ++i)
+    {
+        const uint8_t* element = accessor.dataPtr + i * stride;
+        for (uint32_t c = 0; c < std::min(numComponents, width); ++c)
+            values[i * width + c] = ReadComponent(element + c * componentSize, accessor.componentType);
+    }
+    return accessor.count * numComponents * componentSize;
+}
+
+static void NormalizeQuaternion(float* q)
+{
+    const float lenSq = q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3];
+    const float invLen = lenSq > 0.0f ? 1.0f / sqrtf(lenSq) : 0.0f;
+    for (uint32_t i = 0; i < 4; ++i)
+        q[i] *= invLen;
+}
+
+// Evaluates a source curve at time t the way glTF defines its interpolation
+static void SampleSource(const SourceCurve& curve, float t, float* value)
+{
+    const bool isRotation = curve.channel->m_path == glTF::AnimChannel::kRotation;
+    const bool isSpline = curve.interpolation == glTF::AnimSampler::kCubicSpline;
+    const std::vector<float>& times = curve.times;
+    const uint32_t numKeys = (uint32_t)times.size();
+
+    auto Element = [&](uint32_t key, uint32_t part) { return &curve.values[(isSpline ? key * 3 + part : key) * 4]; };
+
+    if (numKeys == 1 || t <= times.front())
+    {
+        std::copy_n(Element(0, 1), 4, value);
+        return;
+    }
+    if (t >= times.back())
+    {
+        std::copy_n(Element(numKeys - 1, 1), 4, value);
+        return;
+    }
+
+    const uint32_t key = (uint32_t)(std::upper_bound(times.begin(), times.end(), t) - times.begin()) - 1;
+    const float dt = times[key + 1] - times[key];
+    const float s = dt > 0.0f ? (t - times[key]) / dt : 0.0f;
+
+    switch (curve.interpolation)
+    {
+    case glTF::AnimSampler::kStep:
+        std::copy_n(Element(key, 1), 4, value);
+        break;
+
+    case glTF::AnimSampler::kCubicSpline:
+    {
+        // Hermite spline with the out-tangent of the first key and the in-tangent of the second
+        const float s2 = s * s, s3 = s2 * s;
+        const float* v0 = Element(key, 1);
+        const float* b0 = Element(key, 2);
+        const float* v1 = Element(key + 1, 1);
+        const float* a1 = Element(key + 1, 0);
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            value[i] = (2.0f * s3 - 3.0f * s2 + 1.0f) * v0[i] + (s3 - 2.0f * s2 + s) * dt * b0[i] +
+                (-2.0f * s3 + 3.0f * s2) * v1[i] + (s3 - s2) * dt * a1[i];
+        }
+        break;
+    }
+
+    default:
+    {
+        const float* v0 = Element(key, 1);
+        const float* v1 = Element(key + 1, 1);
+        if (isRotation)
+        {
+            XMStoreFloat4((XMFLOAT4*)value, XMQuaternionSlerp(
+                XMLoadFloat4((const XMFLOAT4*)v0), XMLoadFloat4((const XMFLOAT4*)v1), s));
+        }
+        else
+        {
+            for (uint32_t i = 0; i < 4; ++i)
+                value[i] = v0[i] + (v1[i] - v0[i]) * s;
+        }
+        break;
+    }
+    }
+
+    if (isRotation)
+        NormalizeQuaternion(value);
+}
+
+static float Tolerance(uint32_t targetPath)
+{
+    switch (targetPath)
+    {
+    case AnimationCurve::kTranslation: return kTranslationTolerance;
+    case AnimationCurve::kRotation: return kRotationTolerance;
+    default: return kScaleTolerance;
+    }
+}
+
+// Translations are compared by distance, rotations by angle, and scales per component
+static float KeyError(uint32_t targetPath, const float* a, const float* b)
+{
+    switch (targetPath)
+    {
+    case AnimationCurve::kRotation:
+    {
+        const float dot = fabsf(a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]);
+        return 2.0f * acosf(std::min(dot, 1.0f));
+    }
+    case AnimationCurve::kTranslation:
+    {
+        const float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+        return sqrtf(dx * dx + dy * dy + dz * dz);
+    }
+    default:
+        return std::max(std::max(fabsf(a[0] - b[0]), fabsf(a[1] - b[1])), fabsf(a[2] - b[2]));
+    }
+}
+
+// "Smallest three" encoding:  drop the largest component (making it positive), store its index
+// in bits 45-46, and store the other three in 15 bits each.
+static void EncodeRotation(const float* q, uint16_t* key)
+{
+    uint32_t largest = 0;
+    for (uint32_t i = 1; i < 4; ++i)
+    {
+        if (fabsf(q[i]) > fabsf(q[largest]))
+            largest = i;
+    }
+    const float sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+
+    uint64_t bits = (uint64_t)largest << 45;
+    for (uint32_t i = 0, j = 0; i < 4; ++i)
+    {
+        if (i == largest)
+            continue;
+        const float code = roundf((q[i] * sign + 0.70710678f) * (32767.0f / 1.41421356f));
+        bits |= (uint64_t)std::min(std::max(code, 0.0f), 32767.0f) << (15 * j++);
+    }
+
+    key[0] = (uint16_t)bits;
+    key[1] = (uint16_t)(bits >> 16);
+    key[2] = (uint16_t)(bits >> 32);
+}
+
+static void EncodeKey(const AnimationCurve& curve, const float* value, uint16_t* key)
+{
+    if (curve.targetPath == AnimationCurve::kRotation)
+    {
+        EncodeRotation(value, key);
+        return;
+    }
+
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        const float unorm = curve.rangeScale[i] > 0.0f ? (value[i] - curve.rangeBias[i]) / curve.rangeScale[i] : 0.0f;
+        key[i] = (uint16_t)std::min(std::max(roundf(unorm), 0.0f), 65535.0f);
+    }
+}
+
+// Resamples a curve into numSegments + 1 keys and measures the worst error against its reference samples
+static float EncodeFrames(const SourceCurve& source, const AnimationCurve& curve, float duration,
+    uint32_t numSegments, std::vector<uint16_t>& keys)
+{
+    keys.resize((numSegments + 1) * 3);
+
+    float value[4];
+    for (uint32_t f = 0; f <= numSegments; ++f)
+    {
+        SampleSource(source, duration * f / numSegments, value);
+        EncodeKey(curve, value, &keys[f * 3]);
+    }
+
+    float maxError = 0.0f;
+    const float frameRate = duration > 0.0f ? numSegments / duration : 0.0f;
+    for (size_t i = 0; i < source.refTimes.size(); ++i)
+    {
+        const float progress = std::min(std::max(source.refTimes[i] * frameRate, 0.0f), (float)numSegments);
+        const uint32_t frame = std::min((uint32_t)progress, numSegments - 1);
+        SampleAnimationCurve(curve, &keys[frame * 3], &keys[frame * 3 + 3], progress - (float)frame, value);
+        maxError = std::max(maxError, KeyError(curve.targetPath, value, &source.refValues[i * 4]));
+    }
+    return maxError;
+}
+
+size_t CompressAnimation(const glTF::Animation& anim, AnimationSet& animSet,
+    std::vector<AnimationCurve>& curves, std::vector<uint8_t>& keyFrameData)
+{
+    std::vector<SourceCurve> sources;
+    sources.reserve(anim.m_channels.size());
+
+    size_t sourceBytes = 0;
+    float duration = 0.0f;
+    float baseRate = 1.0f;
+
+    for (const glTF::AnimChannel& channel : anim.m_channels)
+    {
+        const glTF::AnimSampler& sampler = *channel.m_sampler;
+
+        // Morph target weights are not animated by the runtime
+        if (channel.m_path == glTF::AnimChannel::kWeights)
+            continue;
+
+        ASSERT(channel.m_target->linearIdx >= 0);
+
+        sources.push_back(SourceCurve());
+        SourceCurve& source = sources.back();
+        source.channel = &channel;
+        source.interpolation = sampler.m_interpolation;
+        sourceBytes += ReadAccessor(*sampler.m_input, 1, source.times);
+        sourceBytes += ReadAccessor(*sampler.m_output, 4, source.values);
+
+        const size_t numKeys = source.times.size();
+        const size_t elementsPerKey = source.interpolation == glTF::AnimSampler::kCubicSpline ? 3 : 1;
+        if (numKeys == 0 || source.values.size() < numKeys * elementsPerKey * 4)
+        {
+            LOG_WARN("Skipping an animation channel with mismatched key times and values");
+            sources.pop_back();
+            continue;
+        }
+
+        duration = std::max(duration, source.times.back());
+        for (size_t k = 1; k < numKeys; ++k)
+        {
+            const float gap = source.times[k] - source.times[k - 1];
+            if (gap > 1e-4f)
+                baseRate = std::max(baseRate, 1.0f / gap);
+        }
+    }
+    baseRate = std::min(baseRate, kMaxFrameRate);
+
+    const uint32_t numBaseSegments = std::max(1u, (uint32_t)roundf(duration * baseRate));
+
+    std::vector<AnimationCurve> newCurves(sources.size());
+    uint32_t numAnimated = 0;
+
+    for (size_t c = 0; c < sources.size(); ++c)
+    {
+        SourceCurve& source = sources[c];
+        AnimationCurve& curve = newCurves[c];
+        curve = AnimationCurve();
+        curve.targetNode = source.channel->m_target->linearIdx;
+        curve.targetPath = source.channel->m_path;
+        curve.interpolation = source.interpolation == glTF::AnimSampler::kStep ? AnimationCurve::kStep : AnimationCurve::kLinear;
+
+        source.refTimes = source.times;
+        for (uint32_t f = 0; f <= numBaseSegments; ++f)
+            source.refTimes.push_back(duration * f / numBaseSegments);
+
+        source.refValues.resize(source.refTimes.size() * 4);
+        for (size_t i = 0; i < source.refTimes.size(); ++i)
+            SampleSource(source, source.refTimes[i], &source.refValues[i * 4]);
+
+        const float tolerance = Tolerance(curve.targetPath);
+        source.isConstant = true;
+        for (uint32_t i = 0; i < 3; ++i)
+            source.rangeMin[i] = source.rangeMax[i] = source.refValues[i];
+
+        for (size_t i = 0; i < source.refTimes.size(); ++i)
+        {
+            const float* value = &source.refValues[i * 4];
+            source.isConstant &= KeyError(curve.targetPath, value, &source.refValues[0]) <= tolerance;
+            for (uint32_t j = 0; j < 3; ++j)
+            {
+                source.rangeMin[j] = std::min(source.rangeMin[j], value[j]);
+                source.rangeMax[j] = std::max(source.rangeMax[j], value[j]);
+            }
+        }
+
+        // A constant translation or scale is stored exactly as the range bias
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            curve.rangeBias[i] = source.isConstant ? source.refValues[i] : source.rangeMin[i];
+            curve.rangeScale[i] = source.isConstant ? 0.0f : (source.rangeMax[i] - source.rangeMin[i]) / 65535.0f;
+        }
+
+        curve.isConstant = source.isConstant;
+    }
+
+    // Group the animated curves by path (rotations, translations, then scales) and put the constant
+    // curves last, so that the runtime can sample each group in batches
+    auto Group = [](const AnimationCurve& curve)
+    {
+        if (curve.isConstant)
+            return 3u;
+        return curve.targetPath == AnimationCurve::kRotation ? 0u : curve.targetPath == AnimationCurve::kTranslation ? 1u : 2u;
+    };
+
+    std::vector<uint32_t> order(sources.size());
+    for (uint32_t i = 0; i < (uint32_t)order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return Group(newCurves[a]) < Group(newCurves[b]); });
+
+    std::vector<SourceCurve> sortedSources(sources.size());
+    std::vector<AnimationCurve> sortedCurves(sources.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        sortedSources[i] = std::move(sources[order[i]]);
+        sortedCurves[i] = newCurves[order[i]];
+    }
+    sources.swap(sortedSources);
+    newCurves.swap(sortedCurves);
+
+    uint32_t numPerGroup[4] = {};
+    for (AnimationCurve& curve : newCurves)
+    {
+        ++numPerGroup[Group(curve)];
+        if (!curve.isConstant)
+            curve.keyOffset = AnimationCurve::kKeySize * numAnimated++;
+    }
+
+    // Find the lowest frame rate at which every animated curve stays within tolerance.  The base
+    // rate is always accepted because it already matches (or exceeds) the density of the source keys.
+    std::vector<std::vector<uint16_t>> frameKeys(sources.size());
+    uint32_t numSegments = numBaseSegments;
+
+    for (uint32_t divisor : kRateDivisors)
+    {
+        numSegments = std::max(1u, (numBaseSegments + divisor / 2) / divisor);
+
+        bool withinTolerance = true;
+        for (size_t c = 0; c < sources.size() && (withinTolerance || divisor == 1); ++c)
+        {
+            if (sources[c].isConstant)
+                continue;
+            const float error = EncodeFrames(sources[c], newCurves[c], duration, numSegments, frameKeys[c]);
+            withinTolerance &= error <= Tolerance(newCurves[c].targetPath);
+        }
+
+        if (withinTolerance || divisor == 1)
+            break;
+    }
+
+    animSet.duration = duration;
+    animSet.firstCurve = (uint32_t)curves.size();
+    animSet.numCurves = (uint32_t)newCurves.size();
+    animSet.numRotations = numPerGroup[0];
+    animSet.numTranslations = numPerGroup[1];
+    animSet.numScales = numPerGroup[2];
+    animSet.numFrames = numSegments + 1;
+    animSet.frameRate = duration > 0.0f ? numSegments / duration : 0.0f;
+    animSet.frameStride = AnimationCurve::kKeySize * numAnimated;
+    animSet.keyFrameOffset = (uint32_t)keyFrameData.size();
+
+    // Interleave the animated curves frame by frame
+    keyFrameData.resize(keyFrameData.size() + animSet.numFrames * animSet.frameStride);
+    uint8_t* dest = keyFrameData.data() + animSet.keyFrameOffset;
+    for (uint32_t f = 0; f < animSet.numFrames; ++f)
+    {
+        for (size_t c = 0; c < sources.size(); ++c)
+        {
+            if (sources[c].isConstant)
+                continue;
+            memcpy(dest, &frameKeys[c][f * 3], AnimationCurve::kKeySize);
+            dest += AnimationCurve::kKeySize;
+        }
+    }
+
+    animSet.constantKeyOffset = (uint32_t)keyFrameData.size();
+    uint32_t constantKeyOffset = 0;
+    for (size_t c = 0; c < sources.size(); ++c)
+    {
+        if (!sources[c].isConstant)
+            continue;
+
+        uint16_t key[3];
+        EncodeKey(newCurves[c], &sources[c].refValues[0], key);
+        keyFrameData.insert(keyFrameData.end(), (const uint8_t*)key, (const uint8_t*)key + AnimationCurve::kKeySize);
+        newCurves[c].keyOffset = constantKeyOffset;
+        constantKeyOffset += AnimationCurve::kKeySize;
+    }
+
+    curves.insert(curves.end(), newCurves.begin(), newCurves.end());
+
+    return sourceBytes;
+}
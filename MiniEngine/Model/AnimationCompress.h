@@ -0,0 +1,46 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+
+#pragma once
+
+#include "Animation.h"
+#include "glTF.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//  CompressAnimation
+//-----------------------------------------------------------------------------
+//  Converts the channels of a glTF animation to the runtime format described
+//  in Animation.h.  Every curve is resampled at one evenly spaced frame rate,
+//  which honors the source key times whether or not they were uniform.  The
+//  rate is then lowered for as long as every curve stays within tolerance of
+//  its source, curves that never change are reduced to a single key, and the
+//  remaining keys are quantized and interleaved frame by frame.
+//
+//  Parameters:
+//      anim
+//          the source animation
+//      animSet
+//          receives the animation's frame layout and duration
+//      curves
+//          the animation's curves are appended here
+//      keyFrameData
+//          the animation's frames and constant keys are appended here
+//
+//  Returns the number of source bytes (key times and values) consumed.
+//-----------------------------------------------------------------------------
+size_t CompressAnimation(const glTF::Animation& anim, AnimationSet& animSet,
+    std::vector<AnimationCurve>& curves, std::vector<uint8_t>& keyFrameData);
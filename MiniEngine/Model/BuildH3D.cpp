@@ -140,15 +140,29 @@ bool ModelH3D::BuildModel(ModelData& model, const std::wstring& basePath) const
     }
 
     ASSERT(model.m_TextureOptions.size() == model.m_TextureNames.size());
+    std::vector<TextureCookRequest> cookRequests(model.m_TextureNames.size());
     for (size_t ti = 0; ti < model.m_TextureNames.size(); ++ti)
     {
-        std::wstring fullPath = basePath + Utility::UTF8ToWideString(model.m_TextureNames[ti]);
-        CompileTextureOnDemand(fullPath, model.m_TextureOptions[ti]);
+        cookRequests[ti].originalFile = basePath + Utility::UTF8ToWideString(model.m_TextureNames[ti]);
+        cookRequests[ti].flags = model.m_TextureOptions[ti];
     }
+    CompileTexturesOnDemand(cookRequests);
 
     model.m_BoundingSphere = BoundingSphere(kZero);
     model.m_BoundingBox = AxisAlignedBox(kZero);
 
+    // Every mesh hangs off of the one scene graph node, so they share a quantization range
+    AxisAlignedBox quantizationBounds(kZero);
+    for (uint32_t i = 0; i < m_Header.meshCount; ++i)
+    {
+        const Mesh& mesh = GetMesh(i);
+        for (uint32_t v = 0; v < mesh.vertexCount; ++v)
+        {
+            const uint8_t* vertex = m_pVertexData + mesh.vertexDataByteOffset + v * mesh.vertexStride;
+            quantizationBounds.AddPoint(Vector3(*(const XMFLOAT3*)vertex));
+        }
+    }
+
     // We're going to piggy-back off of the work to compile glTF meshes by pretending that's what
     // we have.
     for (uint32_t i = 0; i < m_Header.meshCount; ++i)
@@ -205,7 +219,8 @@ bool ModelH3D::BuildModel(ModelData& model, const std::wstring& basePath) const
 
         BoundingSphere sphereOS;
         AxisAlignedBox boxOS;
-        Renderer::CompileMesh(model.m_Meshes, model.m_GeometryData, gltfMesh, 0, Matrix4(kIdentity), sphereOS, boxOS); 
+        Renderer::CompileMesh(model.m_Meshes, model.m_Clusters, model.m_GeometryData, gltfMesh, 0, Matrix4(kIdentity), sphereOS, boxOS,
+            model.m_VertexQuantization, quantizationBounds, model.m_QuantizationReport);
         model.m_BoundingSphere = model.m_BoundingSphere.Union(sphereOS);
         model.m_BoundingBox.AddBoundingBox(boxOS);
     }
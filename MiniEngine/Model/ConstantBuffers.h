@@ -24,7 +24,9 @@ __declspec(align(16)) struct MeshConstants
 {
     Math::Matrix4 World;         // Object to world
     Math::Matrix3 WorldIT;       // Object normal to world normal, 3x4-float memory footprint
-    float padding[36];           // Padding so the constant buffer is 256-byte aligned.
+    Math::Vector3 PosScale;      // Decodes quantized positions (see Mesh::posScale)
+    Math::Vector3 PosBias;
+    float padding[28];           // Padding so the constant buffer is 256-byte aligned.
 };
 
 // The order of textures for PBR materials
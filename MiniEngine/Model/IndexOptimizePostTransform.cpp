@@ -22,6 +22,10 @@
 #include <ASSERT.h>
 #include <math.h>
 #include <algorithm>
+#include <vector>
+#include <ppl.h>
+#include <intrin.h>
+#include <emmintrin.h>
 
 #include "IndexOptimizePostTransform.h"
 
@@ -108,6 +112,58 @@ namespace
     }
     bool s_vertexScoresComputed = ComputeVertexScores();
 
+    // Fixed-point versions of the scores above, used by OptimizeFacesClustered() so that faces can be kept
+    // in buckets by score.  The cache score tops out at 1 and the valence score at 2.
+    enum
+    {
+        kScoreScale = 256,
+        kMaxQuantizedVertexScore = 3 * kScoreScale,
+        kMaxQuantizedFaceScore = 3 * kMaxQuantizedVertexScore
+    };
+
+    int s_quantizedCacheScores[kMaxVertexCacheSize+1][kMaxVertexCacheSize];
+    int s_quantizedValenceScores[kMaxPrecomputedVertexValenceScores];
+
+    int QuantizeScore(float score)
+    {
+        return (int)(score * kScoreScale + 0.5f);
+    }
+
+    bool ComputeQuantizedVertexScores()
+    {
+        for (uint32_t cacheSize = 0; cacheSize <= kMaxVertexCacheSize; ++cacheSize)
+        {
+            for (uint32_t cachePos = 0; cachePos < cacheSize; ++cachePos)
+            {
+                s_quantizedCacheScores[cacheSize][cachePos] = QuantizeScore(ComputeVertexCacheScore(cachePos, cacheSize));
+            }
+        }
+
+        s_quantizedValenceScores[0] = 0;
+        for (uint32_t valence = 1; valence < kMaxPrecomputedVertexValenceScores; ++valence)
+        {
+            s_quantizedValenceScores[valence] = QuantizeScore(ComputeVertexValenceScore(valence));
+        }
+
+        return true;
+    }
+    bool s_quantizedVertexScoresComputed = ComputeQuantizedVertexScores();
+
+    // Low enough that a vertex with no faces left scores zero once its cache score is added and the sum is
+    // clamped, which is how the SIMD rescoring handles such vertices without branching
+    const int kNoActiveFaces = -2 * kScoreScale;
+
+    // A vertex's score is max(cache score + valence score, 0)
+    inline int FindQuantizedValenceScore(uint32_t numActiveFaces)
+    {
+        if (numActiveFaces == 0)
+            return kNoActiveFaces;
+        else if (numActiveFaces < kMaxPrecomputedVertexValenceScores)
+            return s_quantizedValenceScores[numActiveFaces];
+        else
+            return QuantizeScore(ComputeVertexValenceScore(numActiveFaces));
+    }
+
     inline float FindVertexCacheScore(size_t cachePosition, size_t maxSizeVertexCache)
     {
         return s_vertexCacheScores[maxSizeVertexCache][cachePosition];
@@ -448,3 +504,266 @@ void OptimizeFaces(const SrcIndexType* indexList, size_t indexCount, DstIndexTyp
         entriesInCache0 = std::min(entriesInCache1, lruCacheSize);
     }
 }
+
+//-----------------------------------------------------------------------------
+//  Clustered optimizer
+//-----------------------------------------------------------------------------
+
+namespace
+{
+    // Doubly-linked lists of faces, one per quantized score, so the best face is found without searching
+    class FaceBuckets
+    {
+    public:
+        FaceBuckets(size_t faceCount) : m_head(kMaxQuantizedFaceScore + 1, -1), m_next(faceCount), m_prev(faceCount),
+            m_score(faceCount), m_maxScore(0) {}
+
+        void Insert(uint32_t face, int score)
+        {
+            ASSERT(score >= 0 && score <= kMaxQuantizedFaceScore);
+            m_score[face] = score;
+            m_prev[face] = -1;
+            m_next[face] = m_head[score];
+            if (m_head[score] >= 0)
+                m_prev[m_head[score]] = face;
+            m_head[score] = face;
+            m_maxScore = std::max(m_maxScore, score);
+        }
+
+        void Remove(uint32_t face)
+        {
+            const int score = m_score[face];
+            if (m_prev[face] >= 0)
+                m_next[m_prev[face]] = m_next[face];
+            else
+                m_head[score] = m_next[face];
+            if (m_next[face] >= 0)
+                m_prev[m_next[face]] = m_prev[face];
+        }
+
+        // Moves a face to the bucket for its current score.  Scores are always recomputed in full rather than
+        // adjusted by deltas so that clamping can never make them drift.
+        void SetScore(uint32_t face, int score)
+        {
+            score = std::min(std::max(score, 0), (int)kMaxQuantizedFaceScore);
+            if (score == m_score[face])
+                return;
+            Remove(face);
+            Insert(face, score);
+        }
+
+        // The caller must ensure there is at least one face remaining
+        uint32_t PopBest(void)
+        {
+            while (m_head[m_maxScore] < 0)
+                --m_maxScore;
+            uint32_t face = m_head[m_maxScore];
+            Remove(face);
+            return face;
+        }
+
+    private:
+        std::vector<int32_t> m_head;
+        std::vector<int32_t> m_next;
+        std::vector<int32_t> m_prev;
+        std::vector<int32_t> m_score;
+        int m_maxScore;
+    };
+
+    void OptimizeCluster(const uint32_t* indexList, size_t faceCount, uint32_t* newIndexList, size_t lruCacheSize)
+    {
+        const size_t indexCount = faceCount * 3;
+
+        // Assign dense local IDs to the vertices referenced by this cluster
+        std::vector<uint32_t> localIndex(indexCount);
+        uint32_t vertexCount = 0;
+        {
+            std::vector<uint64_t> keys(indexCount);
+            for (size_t i = 0; i < indexCount; ++i)
+                keys[i] = (uint64_t)indexList[i] << 32 | i;
+            std::sort(keys.begin(), keys.end());
+
+            for (size_t i = 0; i < indexCount; ++i)
+            {
+                if (i > 0 && (keys[i] >> 32) != (keys[i - 1] >> 32))
+                    ++vertexCount;
+                localIndex[(uint32_t)keys[i]] = vertexCount;
+            }
+            ++vertexCount;
+        }
+
+        // Per-vertex lists of faces that still need to be emitted
+        std::vector<uint32_t> activeFaceCount(vertexCount, 0);
+        std::vector<uint32_t> activeFaceStart(vertexCount);
+        std::vector<uint32_t> activeFaceList(indexCount);
+
+        for (size_t i = 0; i < indexCount; ++i)
+            activeFaceCount[localIndex[i]]++;
+
+        for (uint32_t v = 0, start = 0; v < vertexCount; ++v)
+        {
+            activeFaceStart[v] = start;
+            start += activeFaceCount[v];
+            activeFaceCount[v] = 0;
+        }
+
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            uint32_t v = localIndex[i];
+            activeFaceList[activeFaceStart[v] + activeFaceCount[v]++] = (uint32_t)(i / 3);
+        }
+
+        std::vector<int32_t> valenceScore(vertexCount);
+        std::vector<int32_t> vertexScore(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; ++v)
+        {
+            valenceScore[v] = FindQuantizedValenceScore(activeFaceCount[v]);
+            vertexScore[v] = std::max(valenceScore[v], 0);
+        }
+
+        // Cache scores by position, padded with zeros for the entries being evicted and for a whole last vector
+        int32_t cacheScores[kMaxVertexCacheSize + 8] = {};
+        std::copy(s_quantizedCacheScores[lruCacheSize], s_quantizedCacheScores[lruCacheSize] + lruCacheSize, cacheScores);
+
+        FaceBuckets buckets(faceCount);
+        for (uint32_t f = 0; f < faceCount; ++f)
+        {
+            buckets.Insert(f, vertexScore[localIndex[f * 3 + 0]] +
+                vertexScore[localIndex[f * 3 + 1]] + vertexScore[localIndex[f * 3 + 2]]);
+        }
+
+        uint32_t cache[kMaxVertexCacheSize + 3];
+        uint32_t newCache[kMaxVertexCacheSize + 8];
+        size_t cacheCount = 0;
+
+        // Stores a vertex's new score and moves its faces to their new buckets
+        auto RescoreVertex = [&](uint32_t v, int score)
+        {
+            vertexScore[v] = score;
+            for (uint32_t j = 0; j < activeFaceCount[v]; ++j)
+            {
+                const uint32_t f = activeFaceList[activeFaceStart[v] + j];
+                buckets.SetScore(f, vertexScore[localIndex[f * 3 + 0]] +
+                    vertexScore[localIndex[f * 3 + 1]] + vertexScore[localIndex[f * 3 + 2]]);
+            }
+        };
+
+        for (size_t out = 0; out < faceCount; ++out)
+        {
+            const uint32_t face = buckets.PopBest();
+            const uint32_t* faceVerts = &localIndex[face * 3];
+
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                newIndexList[out * 3 + k] = indexList[face * 3 + k];
+
+                // Retire this face from the vertex's active list
+                uint32_t v = faceVerts[k];
+                uint32_t* begin = &activeFaceList[activeFaceStart[v]];
+                uint32_t* end = begin + activeFaceCount[v];
+                uint32_t* it = std::find(begin, end, face);
+                ASSERT(it != end);
+                std::swap(*it, *(end - 1));
+                --activeFaceCount[v];
+                valenceScore[v] = FindQuantizedValenceScore(activeFaceCount[v]);
+            }
+
+            // The face's vertices move to the front of the LRU cache, pushing the others back
+            size_t newCount = 0;
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                if (std::find(newCache, newCache + newCount, faceVerts[k]) == newCache + newCount)
+                    newCache[newCount++] = faceVerts[k];
+            }
+            for (size_t c = 0; c < cacheCount; ++c)
+            {
+                if (cache[c] != faceVerts[0] && cache[c] != faceVerts[1] && cache[c] != faceVerts[2])
+                    newCache[newCount++] = cache[c];
+            }
+
+            // Rescore every vertex whose cache position or valence may have changed, four at a time, and
+            // rebucket the faces of the few whose score did change.  Entries past the end of the cache have
+            // just been evicted.  Padding repeats a real vertex so the gathers stay in bounds.
+            const size_t paddedCount = (newCount + 3) & ~3;
+            for (size_t c = newCount; c < paddedCount; ++c)
+                newCache[c] = newCache[0];
+
+            const __m128i zero = _mm_setzero_si128();
+            for (size_t c = 0; c < paddedCount; c += 4)
+            {
+                const uint32_t* v = &newCache[c];
+
+                __m128i score = _mm_add_epi32(_mm_loadu_si128((const __m128i*)&cacheScores[c]),
+                    _mm_setr_epi32(valenceScore[v[0]], valenceScore[v[1]], valenceScore[v[2]], valenceScore[v[3]]));
+                score = _mm_and_si128(score, _mm_cmpgt_epi32(score, zero));
+
+                const __m128i oldScore = _mm_setr_epi32(vertexScore[v[0]], vertexScore[v[1]], vertexScore[v[2]], vertexScore[v[3]]);
+                uint32_t changed = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(score, oldScore))) & 0xF;
+                if (c + 4 > newCount)
+                    changed &= (1u << (newCount - c)) - 1;
+                if (changed == 0)
+                    continue;
+
+                int32_t scores[4];
+                _mm_storeu_si128((__m128i*)scores, score);
+
+                for (; changed != 0; changed &= changed - 1)
+                {
+                    unsigned long k;
+                    _BitScanForward(&k, changed);
+                    RescoreVertex(v[k], scores[k]);
+                }
+            }
+
+            cacheCount = std::min(newCount, lruCacheSize);
+            std::copy(newCache, newCache + cacheCount, cache);
+        }
+    }
+}
+
+void OptimizeFacesClustered(const uint32_t* indexList, size_t indexCount, uint32_t* newIndexList, size_t lruCacheSize, size_t clusterFaceCount)
+{
+    ASSERT(lruCacheSize <= kMaxVertexCacheSize);
+    ASSERT(clusterFaceCount > 0);
+
+    const size_t faceCount = indexCount / 3;
+    const size_t clusterCount = (faceCount + clusterFaceCount - 1) / clusterFaceCount;
+
+    concurrency::parallel_for(size_t(0), clusterCount, [&](size_t cluster)
+    {
+        const size_t firstFace = cluster * clusterFaceCount;
+        const size_t numFaces = std::min(clusterFaceCount, faceCount - firstFace);
+        OptimizeCluster(indexList + firstFace * 3, numFaces, newIndexList + firstFace * 3, lruCacheSize);
+    });
+}
+
+VertexCacheStatistics AnalyzeVertexCache(const uint32_t* indexList, size_t indexCount, size_t cacheSize)
+{
+    VertexCacheStatistics stats = { 0.0f, 0.0f };
+    if (indexCount < 3)
+        return stats;
+
+    const uint32_t maxIndex = *std::max_element(indexList, indexList + indexCount);
+
+    // The time at which each vertex entered the FIFO, offset by one so that zero means never
+    std::vector<size_t> insertTime(maxIndex + 1, 0);
+    size_t misses = 0;
+    size_t uniqueVertices = 0;
+
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        size_t& entered = insertTime[indexList[i]];
+        if (entered == 0)
+            ++uniqueVertices;
+
+        if (entered == 0 || misses - entered >= cacheSize)
+        {
+            ++misses;
+            entered = misses;
+        }
+    }
+
+    stats.acmr = (float)misses / (float)(indexCount / 3);
+    stats.atvr = (float)misses / (float)uniqueVertices;
+    return stats;
+}
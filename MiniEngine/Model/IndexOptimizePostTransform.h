@@ -49,3 +49,23 @@ template void OptimizeFaces<uint32_t, uint32_t>(const uint32_t* indexList, size_
 
 template void OptimizeFaces<float, uint16_t>(const float* indexList, size_t indexCount, uint16_t* newIndexList, size_t lruCacheSize);
 template void OptimizeFaces<float, uint32_t>(const float* indexList, size_t indexCount, uint32_t* newIndexList, size_t lruCacheSize);
+
+//-----------------------------------------------------------------------------
+//  OptimizeFacesClustered
+//-----------------------------------------------------------------------------
+//  A faster variant for large index buffers.  Faces are split into clusters
+//  of clusterFaceCount consecutive faces which are optimized in parallel, and
+//  scores are fixed point so that faces can be kept in buckets by score rather
+//  than searched for.  Cache efficiency is close to OptimizeFaces; a few
+//  misses are added at cluster boundaries.
+//-----------------------------------------------------------------------------
+void OptimizeFacesClustered(const uint32_t* indexList, size_t indexCount, uint32_t* newIndexList, size_t lruCacheSize, size_t clusterFaceCount = 16384);
+
+struct VertexCacheStatistics
+{
+    float acmr; // Average cache miss ratio:  vertices transformed per triangle (0.5 to 3, lower is better)
+    float atvr; // Average transform to vertex ratio:  vertices transformed per unique vertex (1 is ideal)
+};
+
+// Simulates a FIFO post-transform cache of the given size
+VertexCacheStatistics AnalyzeVertexCache(const uint32_t* indexList, size_t indexCount, size_t cacheSize = 32);
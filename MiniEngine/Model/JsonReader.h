@@ -0,0 +1,345 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+// A pull parser that walks JSON text in place.  Nothing is allocated unless a decoded std::string is
+// requested, so callers can read straight into their own structures instead of building a DOM first.
+// The text must be null terminated.  On malformed input the reader flags an error and jumps to the end
+// of the text, which makes every pending NextMember()/NextElement() loop terminate.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+class JsonReader
+{
+public:
+    // Raw view of a string's characters between the quotes.  Escapes are not decoded.
+    struct StringRef
+    {
+        const char* str;
+        uint32_t length;
+
+        template <size_t N>
+        bool operator==( const char (&literal)[N] ) const
+        {
+            return length == N - 1 && memcmp(str, literal, N - 1) == 0;
+        }
+
+        bool Equals( const char* s ) const
+        {
+            return strncmp(str, s, length) == 0 && s[length] == '\0';
+        }
+    };
+
+    JsonReader( const char* text, size_t length ) : m_Pos(text), m_End(text + length), m_Error(false) {}
+
+    bool HasError( void ) const { return m_Error; }
+    const char* GetPosition( void ) const { return m_Pos; }
+    void SetPosition( const char* pos ) { m_Pos = pos; }
+
+    // Enter an object or array.  Returns false (and flags an error) if the next value is something else.
+    bool BeginObject( void ) { return Expect('{'); }
+    bool BeginArray( void ) { return Expect('['); }
+
+    // Advance to the next member of the current object, reading its key.  Returns false after consuming
+    // the closing brace.  The member's value must be read or skipped before calling again.
+    bool NextMember( StringRef& key )
+    {
+        SkipWhitespace();
+        if (*m_Pos == '}')
+        {
+            ++m_Pos;
+            return false;
+        }
+        if (*m_Pos == ',')
+        {
+            ++m_Pos;
+            SkipWhitespace();
+        }
+        if (*m_Pos != '"')
+        {
+            SetError();
+            return false;
+        }
+        key = ReadStringRef();
+        return Expect(':');
+    }
+
+    // Advance to the next element of the current array.  Returns false after consuming the closing bracket.
+    bool NextElement( void )
+    {
+        SkipWhitespace();
+        if (*m_Pos == ']')
+        {
+            ++m_Pos;
+            return false;
+        }
+        if (*m_Pos == ',')
+            ++m_Pos;
+        SkipWhitespace();
+        if (m_Pos >= m_End)
+        {
+            SetError();
+            return false;
+        }
+        return true;
+    }
+
+    bool ReadBool( void )
+    {
+        SkipWhitespace();
+        const bool value = *m_Pos == 't';
+        SkipLiteral();
+        return value;
+    }
+
+    uint32_t ReadUInt( void )
+    {
+        SkipWhitespace();
+        const char* start = m_Pos;
+        uint32_t value = 0;
+        while (*m_Pos >= '0' && *m_Pos <= '9')
+            value = value * 10 + (*m_Pos++ - '0');
+
+        // Integers are occasionally written with a fraction or an exponent
+        if (m_Pos == start || *m_Pos == '.' || *m_Pos == 'e' || *m_Pos == 'E')
+        {
+            m_Pos = start;
+            return (uint32_t)ReadDouble();
+        }
+        return value;
+    }
+
+    int32_t ReadInt( void )
+    {
+        SkipWhitespace();
+        if (*m_Pos == '-')
+            return (int32_t)ReadDouble();
+        return (int32_t)ReadUInt();
+    }
+
+    float ReadFloat( void ) { return (float)ReadDouble(); }
+
+    double ReadDouble( void )
+    {
+        SkipWhitespace();
+        char* end;
+        const double value = strtod(m_Pos, &end);
+        if (end == m_Pos)
+            SetError();
+        else
+            m_Pos = end;
+        return value;
+    }
+
+    // Read an array of numbers into 'values'.  Elements past maxCount are skipped.  Returns the number
+    // of elements in the array.
+    template <typename T>
+    uint32_t ReadNumbers( T* values, uint32_t maxCount )
+    {
+        uint32_t count = 0;
+        if (!BeginArray())
+            return 0;
+        while (NextElement())
+        {
+            if (count < maxCount)
+                values[count] = (T)ReadDouble();
+            else
+                SkipValue();
+            ++count;
+        }
+        return count;
+    }
+
+    uint32_t ReadFloats( float* values, uint32_t maxCount ) { return ReadNumbers(values, maxCount); }
+
+    StringRef ReadStringRef( void )
+    {
+        StringRef ref = { "", 0 };
+        if (!Expect('"'))
+            return ref;
+
+        const char* start = m_Pos;
+        while (*m_Pos != '"')
+        {
+            if (*m_Pos == '\\' && m_Pos[1] != '\0')
+                ++m_Pos;
+            if (m_Pos >= m_End)
+            {
+                SetError();
+                return ref;
+            }
+            ++m_Pos;
+        }
+        ref.str = start;
+        ref.length = (uint32_t)(m_Pos - start);
+        ++m_Pos;
+        return ref;
+    }
+
+    // Read a string and decode its escape sequences (including \u escapes) to UTF-8
+    std::string ReadString( void )
+    {
+        const StringRef ref = ReadStringRef();
+        std::string result;
+        result.reserve(ref.length);
+
+        for (const char* c = ref.str, *end = ref.str + ref.length; c < end; ++c)
+        {
+            if (*c != '\\' || c + 1 == end)
+            {
+                result.push_back(*c);
+                continue;
+            }
+
+            switch (*++c)
+            {
+            case 'b': result.push_back('\b'); break;
+            case 'f': result.push_back('\f'); break;
+            case 'n': result.push_back('\n'); break;
+            case 'r': result.push_back('\r'); break;
+            case 't': result.push_back('\t'); break;
+            case 'u':
+            {
+                if (end - c < 5)
+                    return result;
+                uint32_t cp = (uint32_t)strtoul(std::string(c + 1, 4).c_str(), nullptr, 16);
+                c += 4;
+
+                // Surrogate pair
+                if (cp >= 0xD800 && cp < 0xDC00 && end - c >= 7 && c[1] == '\\' && c[2] == 'u')
+                {
+                    const uint32_t low = (uint32_t)strtoul(std::string(c + 3, 4).c_str(), nullptr, 16);
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    c += 6;
+                }
+
+                if (cp < 0x80)
+                    result.push_back((char)cp);
+                else if (cp < 0x800)
+                {
+                    result.push_back((char)(0xC0 | cp >> 6));
+                    result.push_back((char)(0x80 | (cp & 0x3F)));
+                }
+                else if (cp < 0x10000)
+                {
+                    result.push_back((char)(0xE0 | cp >> 12));
+                    result.push_back((char)(0x80 | (cp >> 6 & 0x3F)));
+                    result.push_back((char)(0x80 | (cp & 0x3F)));
+                }
+                else
+                {
+                    result.push_back((char)(0xF0 | cp >> 18));
+                    result.push_back((char)(0x80 | (cp >> 12 & 0x3F)));
+                    result.push_back((char)(0x80 | (cp >> 6 & 0x3F)));
+                    result.push_back((char)(0x80 | (cp & 0x3F)));
+                }
+                break;
+            }
+            default: result.push_back(*c); break; // \" \\ \/
+            }
+        }
+        return result;
+    }
+
+    // Skip over the next value, however deeply nested
+    void SkipValue( void )
+    {
+        SkipWhitespace();
+        StringRef key;
+        switch (*m_Pos)
+        {
+        case '{':
+            ++m_Pos;
+            while (NextMember(key))
+                SkipValue();
+            break;
+        case '[':
+            SkipArray();
+            break;
+        case '"':
+            ReadStringRef();
+            break;
+        case 't':
+        case 'f':
+        case 'n':
+            SkipLiteral();
+            break;
+        default:
+            ReadDouble();
+            break;
+        }
+    }
+
+    // Skip over an array, returning the number of elements it held
+    uint32_t SkipArray( void )
+    {
+        uint32_t count = 0;
+        if (!BeginArray())
+            return 0;
+        while (NextElement())
+        {
+            SkipValue();
+            ++count;
+        }
+        return count;
+    }
+
+    // Count the elements of the upcoming array without consuming it
+    uint32_t CountElements( void )
+    {
+        const char* start = m_Pos;
+        const uint32_t count = SkipArray();
+        if (!m_Error)
+            m_Pos = start;
+        return count;
+    }
+
+private:
+    void SkipWhitespace( void )
+    {
+        while (*m_Pos == ' ' || *m_Pos == '\n' || *m_Pos == '\r' || *m_Pos == '\t')
+            ++m_Pos;
+    }
+
+    void SkipLiteral( void )
+    {
+        while (*m_Pos >= 'a' && *m_Pos <= 'z')
+            ++m_Pos;
+    }
+
+    bool Expect( char c )
+    {
+        SkipWhitespace();
+        if (*m_Pos != c)
+        {
+            SetError();
+            return false;
+        }
+        ++m_Pos;
+        return true;
+    }
+
+    void SetError( void )
+    {
+        m_Error = true;
+        m_Pos = m_End;
+    }
+
+    const char* m_Pos;
+    const char* m_End;
+    bool m_Error;
+};
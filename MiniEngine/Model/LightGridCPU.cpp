@@ -0,0 +1,675 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+
+#include "LightGridCPU.h"
+#include "SphereCulling.h"
+#include "../Core/Camera.h"
+#include "../Core/SystemTime.h"
+#include "../Core/Utility.h"
+#include "../Core/Math/Random.h"
+
+#include <intrin.h>
+#include <immintrin.h>
+#include <ppl.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace Math;
+using Lighting::MaxLights;
+using LightGridCPU::kTileSize;
+using LightGridCPU::kTileMaskSize;
+
+namespace
+{
+    inline float AsFloat( uint32_t u ) { float f; std::memcpy(&f, &u, sizeof(f)); return f; }
+    inline uint32_t AsUInt( float f ) { uint32_t u; std::memcpy(&u, &f, sizeof(u)); return u; }
+
+    // Everything about the viewport and camera that FillLightGridCS.hlsli reads from its constants
+    struct GridSetup
+    {
+        float rows[4][4];       // The view-projection matrix as the shader sees it (column vectors)
+        float tilesPerViewX;    // Viewport size in tiles, as floats
+        float tilesPerViewY;
+        float rcpZMagic;        // Turns 1 / linear depth - 1 into reversed-Z depth
+        const float* depth;     // nullptr when tiles are not bounded in depth
+        uint32_t width, height, tileDim;
+        uint32_t tileCountX, tileCountY;
+
+        GridSetup( const Camera& camera, uint32_t viewportWidth, uint32_t viewportHeight, uint32_t tileDimension,
+            const float* linearDepth, bool transparent )
+            : width(viewportWidth), height(viewportHeight), tileDim(tileDimension)
+        {
+            ASSERT(tileDim > 0 && width > 0 && height > 0, "Empty light grid");
+
+            XMFLOAT4X4 viewProj;
+            XMStoreFloat4x4(&viewProj, XMMatrixTranspose(camera.GetViewProjMatrix()));
+            std::memcpy(rows, viewProj.m, sizeof(rows));
+
+            const float invTileDim = 1.0f / tileDim;
+            tilesPerViewX = width * invTileDim;
+            tilesPerViewY = height * invTileDim;
+            rcpZMagic = camera.GetNearClip() / (camera.GetFarClip() - camera.GetNearClip());
+
+            // The shader puts transparent tiles' near plane at infinity, which leaves both depth planes NaN
+            // and unable to cull anything, so just leave them out
+            depth = transparent ? nullptr : linearDepth;
+
+            tileCountX = Math::DivideByMultiple(width, tileDim);
+            tileCountY = Math::DivideByMultiple(height, tileDim);
+        }
+    };
+
+    // Lights as a structure of arrays, padded with zeros to a whole number of AVX vectors
+    struct LightSet
+    {
+        float x[MaxLights], y[MaxLights], z[MaxLights], radius[MaxLights];
+        uint32_t typeMask[3][kTileMaskSize];    // Sphere, cone, and shadowed cone lights
+        uint32_t validMask[kTileMaskSize];      // The lights that exist
+        uint32_t paddedCount;
+
+        LightSet( const LightData* lights, uint32_t numLights )
+        {
+            ASSERT(numLights <= MaxLights, "Too many lights (%u)", numLights);
+
+            std::memset(this, 0, sizeof(*this));
+            paddedCount = (numLights + 7) & ~7u;
+
+            for (uint32_t i = 0; i < numLights; ++i)
+            {
+                x[i] = lights[i].pos[0];
+                y[i] = lights[i].pos[1];
+                z[i] = lights[i].pos[2];
+                radius[i] = std::sqrt(lights[i].radiusSq);
+
+                const uint32_t bit = 1u << (i % 32);
+                validMask[i / 32] |= bit;
+                if (lights[i].type < 3)
+                    typeMask[lights[i].type][i / 32] |= bit;
+            }
+        }
+    };
+}
+
+// The smallest and largest linear depth of a tile as the bit patterns the shader compares
+static void TileDepthBoundsScalar( const GridSetup& setup, uint32_t gx, uint32_t gy, uint32_t& minDepth, uint32_t& maxDepth )
+{
+    const uint32_t x0 = gx * setup.tileDim, x1 = std::min(x0 + setup.tileDim, setup.width);
+    const uint32_t y0 = gy * setup.tileDim, y1 = std::min(y0 + setup.tileDim, setup.height);
+
+    minDepth = 0xffffffff;
+    maxDepth = 0;
+
+    for (uint32_t y = y0; y < y1; ++y)
+    {
+        for (uint32_t x = x0; x < x1; ++x)
+        {
+            const uint32_t depth = AsUInt(setup.depth[y * setup.width + x]);
+            minDepth = std::min(minDepth, depth);
+            maxDepth = std::max(maxDepth, depth);
+        }
+    }
+}
+
+// The same with four pixels at a time.  Linear depth is never negative, so comparing the values as floats
+// orders them the same as comparing their bits.
+static void TileDepthBoundsSSE( const GridSetup& setup, uint32_t gx, uint32_t gy, uint32_t& minDepth, uint32_t& maxDepth )
+{
+    const uint32_t x0 = gx * setup.tileDim, x1 = std::min(x0 + setup.tileDim, setup.width);
+    const uint32_t y0 = gy * setup.tileDim, y1 = std::min(y0 + setup.tileDim, setup.height);
+
+    __m128 minVec = _mm_set1_ps(setup.depth[y0 * setup.width + x0]);
+    __m128 maxVec = minVec;
+
+    for (uint32_t y = y0; y < y1; ++y)
+    {
+        const float* row = setup.depth + y * setup.width;
+        uint32_t x = x0;
+        for (; x + 4 <= x1; x += 4)
+        {
+            const __m128 depth = _mm_loadu_ps(row + x);
+            minVec = _mm_min_ps(minVec, depth);
+            maxVec = _mm_max_ps(maxVec, depth);
+        }
+        for (; x < x1; ++x)
+        {
+            const __m128 depth = _mm_set_ss(row[x]);
+            minVec = _mm_min_ss(minVec, depth);
+            maxVec = _mm_max_ss(maxVec, depth);
+        }
+    }
+
+    minVec = _mm_min_ps(minVec, _mm_shuffle_ps(minVec, minVec, _MM_SHUFFLE(2, 3, 0, 1)));
+    minVec = _mm_min_ps(minVec, _mm_movehl_ps(minVec, minVec));
+    maxVec = _mm_max_ps(maxVec, _mm_shuffle_ps(maxVec, maxVec, _MM_SHUFFLE(2, 3, 0, 1)));
+    maxVec = _mm_max_ps(maxVec, _mm_movehl_ps(maxVec, maxVec));
+
+    minDepth = AsUInt(_mm_cvtss_f32(minVec));
+    maxDepth = AsUInt(_mm_cvtss_f32(maxVec));
+}
+
+// Extracts the world space planes of a tile's frustum exactly as FillLightGridCS.hlsli does, except that
+// the normals are scaled by a true reciprocal square root.  Returns the number of planes.
+static uint32_t BuildTilePlanes( const GridSetup& setup, uint32_t gx, uint32_t gy, uint32_t minDepth, uint32_t maxDepth, float planes[6][4] )
+{
+    const float (&R)[4][4] = setup.rows;
+
+    const float biasX = -2.0f * float(gx) + setup.tilesPerViewX - 1.0f;
+    const float biasY = -2.0f * float(gy) + setup.tilesPerViewY - 1.0f;
+
+    for (int c = 0; c < 4; ++c)
+    {
+        const float tileX = setup.tilesPerViewX * R[0][c] + biasX * R[3][c];
+        const float tileY = -setup.tilesPerViewY * R[1][c] + biasY * R[3][c];
+        planes[0][c] = R[3][c] + tileX;
+        planes[1][c] = R[3][c] - tileX;
+        planes[2][c] = R[3][c] + tileY;
+        planes[3][c] = R[3][c] - tileY;
+    }
+
+    uint32_t numPlanes = 4;
+
+    if (setup.depth != nullptr)
+    {
+        const float tileMinDepth = (1.0f / AsFloat(maxDepth) - 1.0f) * setup.rcpZMagic;
+        const float tileMaxDepth = (1.0f / AsFloat(minDepth) - 1.0f) * setup.rcpZMagic;
+        const float invTileDepthRange = 1.0f / std::max(tileMaxDepth - tileMinDepth, FLT_MIN);
+        const float biasZ = -tileMinDepth * invTileDepthRange;
+
+        for (int c = 0; c < 4; ++c)
+        {
+            const float tileZ = invTileDepthRange * R[2][c] + biasZ * R[3][c];
+            planes[4][c] = R[3][c] + tileZ;
+            planes[5][c] = R[3][c] - tileZ;
+        }
+
+        numPlanes = 6;
+    }
+
+    for (uint32_t n = 0; n < numPlanes; ++n)
+    {
+        const float scale = 1.0f / std::sqrt(planes[n][0] * planes[n][0] + planes[n][1] * planes[n][1] + planes[n][2] * planes[n][2]);
+        for (int c = 0; c < 4; ++c)
+            planes[n][c] *= scale;
+    }
+
+    return numPlanes;
+}
+
+// A light misses the tile when it lies more than its radius behind any plane.  All paths evaluate the
+// distance in this order so that they agree on lights that touch a plane.
+static void OverlapSSE( const LightSet& lights, const float planes[6][4], uint32_t numPlanes, uint32_t* mask )
+{
+    std::memset(mask, 0, kTileMaskSize * sizeof(uint32_t));
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+
+    for (uint32_t i = 0; i < lights.paddedCount; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(&lights.x[i]);
+        const __m128 y = _mm_loadu_ps(&lights.y[i]);
+        const __m128 z = _mm_loadu_ps(&lights.z[i]);
+        const __m128 negRadius = _mm_xor_ps(_mm_loadu_ps(&lights.radius[i]), signBit);
+
+        __m128 culled = _mm_setzero_ps();
+        for (uint32_t p = 0; p < numPlanes; ++p)
+        {
+            __m128 d = _mm_mul_ps(_mm_set1_ps(planes[p][0]), x);
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes[p][1]), y));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes[p][2]), z));
+            d = _mm_add_ps(d, _mm_set1_ps(planes[p][3]));
+            culled = _mm_or_ps(culled, _mm_cmplt_ps(d, negRadius));
+        }
+
+        mask[i / 32] |= (~(uint32_t)_mm_movemask_ps(culled) & 0xF) << (i % 32);
+    }
+
+    for (uint32_t w = 0; w < kTileMaskSize; ++w)
+        mask[w] &= lights.validMask[w];
+}
+
+static void OverlapAVX( const LightSet& lights, const float planes[6][4], uint32_t numPlanes, uint32_t* mask )
+{
+    std::memset(mask, 0, kTileMaskSize * sizeof(uint32_t));
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+    __m256 px[6], py[6], pz[6], pw[6];
+    for (uint32_t p = 0; p < numPlanes; ++p)
+    {
+        px[p] = _mm256_set1_ps(planes[p][0]);
+        py[p] = _mm256_set1_ps(planes[p][1]);
+        pz[p] = _mm256_set1_ps(planes[p][2]);
+        pw[p] = _mm256_set1_ps(planes[p][3]);
+    }
+
+    for (uint32_t i = 0; i < lights.paddedCount; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(&lights.x[i]);
+        const __m256 y = _mm256_loadu_ps(&lights.y[i]);
+        const __m256 z = _mm256_loadu_ps(&lights.z[i]);
+        const __m256 negRadius = _mm256_xor_ps(_mm256_loadu_ps(&lights.radius[i]), signBit);
+
+        __m256 culled = _mm256_setzero_ps();
+        for (uint32_t p = 0; p < numPlanes; ++p)
+        {
+            __m256 d = _mm256_mul_ps(px[p], x);
+            d = _mm256_add_ps(d, _mm256_mul_ps(py[p], y));
+            d = _mm256_add_ps(d, _mm256_mul_ps(pz[p], z));
+            d = _mm256_add_ps(d, pw[p]);
+            culled = _mm256_or_ps(culled, _mm256_cmp_ps(d, negRadius, _CMP_LT_OQ));
+        }
+
+        mask[i / 32] |= (~(uint32_t)_mm256_movemask_ps(culled) & 0xFF) << (i % 32);
+    }
+
+    // Avoid the penalty for mixing AVX with the SSE code that follows
+    _mm256_zeroupper();
+
+    for (uint32_t w = 0; w < kTileMaskSize; ++w)
+        mask[w] &= lights.validMask[w];
+}
+
+// Writes a tile's counts and index lists from its overlap mask, one kind of light at a time
+static void WriteTile( const LightSet& lights, const uint32_t* mask, uint32_t* tileGrid, uint32_t* tileBitMask )
+{
+    uint32_t* indices = tileGrid + 1;
+    uint32_t counts[3];
+
+    for (uint32_t type = 0; type < 3; ++type)
+    {
+        uint32_t* first = indices;
+        for (uint32_t w = 0; w < kTileMaskSize; ++w)
+        {
+            for (uint32_t bits = mask[w] & lights.typeMask[type][w]; bits != 0; bits &= bits - 1)
+            {
+                unsigned long bit;
+                _BitScanForward(&bit, bits);
+                *indices++ = w * 32 + bit;
+            }
+        }
+        counts[type] = (uint32_t)(indices - first);
+    }
+
+    tileGrid[0] = (counts[0] & 0xff) | ((counts[1] & 0xff) << 8) | ((counts[2] & 0xff) << 16);
+    std::memcpy(tileBitMask, mask, kTileMaskSize * sizeof(uint32_t));
+}
+
+void LightGridCPU::FillLightGrid( const LightData* lights, uint32_t numLights, const Camera& camera,
+    uint32_t width, uint32_t height, uint32_t tileDim, const float* linearDepth, bool transparent,
+    uint32_t* lightGrid, uint32_t* lightGridBitMask )
+{
+    const GridSetup setup(camera, width, height, tileDim, linearDepth, transparent);
+    const LightSet lightSet(lights, numLights);
+    const bool useAVX = SphereCulling::UsesAVX();
+
+    Concurrency::parallel_for(0u, setup.tileCountY, [&](uint32_t gy)
+    {
+        for (uint32_t gx = 0; gx < setup.tileCountX; ++gx)
+        {
+            uint32_t minDepth = 0, maxDepth = 0;
+            if (setup.depth != nullptr)
+                TileDepthBoundsSSE(setup, gx, gy, minDepth, maxDepth);
+
+            float planes[6][4];
+            const uint32_t numPlanes = BuildTilePlanes(setup, gx, gy, minDepth, maxDepth, planes);
+
+            uint32_t mask[kTileMaskSize];
+            if (useAVX)
+                OverlapAVX(lightSet, planes, numPlanes, mask);
+            else
+                OverlapSSE(lightSet, planes, numPlanes, mask);
+
+            const uint32_t tileIndex = gy * setup.tileCountX + gx;
+            WriteTile(lightSet, mask, lightGrid + tileIndex * kTileSize, lightGridBitMask + tileIndex * kTileMaskSize);
+        }
+    });
+}
+
+void LightGridCPU::FillLightGridScalar( const LightData* lights, uint32_t numLights, const Camera& camera,
+    uint32_t width, uint32_t height, uint32_t tileDim, const float* linearDepth, bool transparent,
+    uint32_t* lightGrid, uint32_t* lightGridBitMask )
+{
+    ASSERT(numLights <= MaxLights, "Too many lights (%u)", numLights);
+
+    const GridSetup setup(camera, width, height, tileDim, linearDepth, transparent);
+
+    for (uint32_t gy = 0; gy < setup.tileCountY; ++gy)
+    {
+        for (uint32_t gx = 0; gx < setup.tileCountX; ++gx)
+        {
+            uint32_t minDepth = 0, maxDepth = 0;
+            if (setup.depth != nullptr)
+                TileDepthBoundsScalar(setup, gx, gy, minDepth, maxDepth);
+
+            float planes[6][4];
+            const uint32_t numPlanes = BuildTilePlanes(setup, gx, gy, minDepth, maxDepth, planes);
+
+            uint32_t indices[3][MaxLights];
+            uint32_t counts[3] = { 0, 0, 0 };
+            uint32_t mask[kTileMaskSize] = {};
+
+            for (uint32_t lightIndex = 0; lightIndex < numLights; ++lightIndex)
+            {
+                const LightData& light = lights[lightIndex];
+                const float radius = std::sqrt(light.radiusSq);
+
+                bool overlapping = true;
+                for (uint32_t p = 0; p < numPlanes; ++p)
+                {
+                    const float d = planes[p][0] * light.pos[0] + planes[p][1] * light.pos[1] + planes[p][2] * light.pos[2] + planes[p][3];
+                    if (d < -radius)
+                        overlapping = false;
+                }
+
+                if (!overlapping)
+                    continue;
+
+                if (light.type < 3)
+                    indices[light.type][counts[light.type]++] = lightIndex;
+
+                mask[lightIndex / 32] |= 1u << (lightIndex % 32);
+            }
+
+            const uint32_t tileIndex = gy * setup.tileCountX + gx;
+            uint32_t* tileGrid = lightGrid + tileIndex * kTileSize;
+
+            tileGrid[0] = (counts[0] & 0xff) | ((counts[1] & 0xff) << 8) | ((counts[2] & 0xff) << 16);
+            uint32_t* store = tileGrid + 1;
+            for (uint32_t type = 0; type < 3; ++type)
+            {
+                for (uint32_t n = 0; n < counts[type]; ++n)
+                    *store++ = indices[type][n];
+            }
+
+            std::memcpy(lightGridBitMask + tileIndex * kTileMaskSize, mask, sizeof(mask));
+        }
+    }
+}
+
+namespace
+{
+    const uint32_t kTestWidth = 1920;
+    const uint32_t kTestHeight = 1080;
+    const uint32_t kTileDims[] = { 8, 16, 24, 32 };
+
+    // A camera looking across a ground plane strewn with boxy occluders, and random lights of all kinds
+    // above the ground.  Light 0 surrounds the whole view and so touches every tile; light 1 is far behind
+    // the camera and touches none.
+    void MakeTestScene( Camera& camera, std::vector<LightData>& lights, std::vector<float>& linearDepth )
+    {
+        const float kFarClip = 1000.0f;
+        const float kFovY = XM_PIDIV4;
+
+        camera.SetEyeAtUp(Vector3(0.0f, 20.0f, 0.0f), Vector3(100.0f, 0.0f, 100.0f), Vector3(kYUnitVector));
+        camera.SetPerspectiveMatrix(kFovY, (float)kTestHeight / kTestWidth, 1.0f, kFarClip);
+        camera.Update();
+
+        RandomNumberGenerator rng(1);
+
+        // Linear depth is view space depth over the far clip distance, and 1 where nothing was drawn
+        const Vector3 eye = camera.GetPosition();
+        const Vector3 forward = camera.GetForwardVec();
+        const Vector3 right = camera.GetRightVec() * std::tan(kFovY * 0.5f) * ((float)kTestWidth / kTestHeight);
+        const Vector3 up = camera.GetUpVec() * std::tan(kFovY * 0.5f);
+
+        const float eyeHeight = eye.GetY();
+        linearDepth.resize(kTestWidth * kTestHeight);
+        for (uint32_t y = 0; y < kTestHeight; ++y)
+        {
+            for (uint32_t x = 0; x < kTestWidth; ++x)
+            {
+                const float ndcX = (x + 0.5f) * 2.0f / kTestWidth - 1.0f;
+                const float ndcY = 1.0f - (y + 0.5f) * 2.0f / kTestHeight;
+                const Vector3 ray = forward + right * ndcX + up * ndcY;
+                const float rayY = ray.GetY();
+
+                // Distance along the forward axis to the ground, where the ray's forward component is 1
+                const float viewZ = rayY < 0.0f ? -eyeHeight / rayY : kFarClip;
+                linearDepth[y * kTestWidth + x] = std::min(viewZ / kFarClip, 1.0f);
+            }
+        }
+
+        for (uint32_t n = 0; n < 200; ++n)
+        {
+            const uint32_t x0 = rng.NextInt(kTestWidth - 1), y0 = rng.NextInt(kTestHeight - 1);
+            const uint32_t x1 = std::min(x0 + 8 + rng.NextInt(120), kTestWidth);
+            const uint32_t y1 = std::min(y0 + 8 + rng.NextInt(120), kTestHeight);
+            const float depth = rng.NextFloat(0.01f, 0.5f);
+            for (uint32_t y = y0; y < y1; ++y)
+            {
+                for (uint32_t x = x0; x < x1; ++x)
+                    linearDepth[y * kTestWidth + x] = std::min(linearDepth[y * kTestWidth + x], depth);
+            }
+        }
+
+        lights.resize(MaxLights);
+        std::memset(lights.data(), 0, lights.size() * sizeof(LightData));
+
+        for (uint32_t i = 0; i < MaxLights; ++i)
+        {
+            const float radius = rng.NextFloat(2.0f, 40.0f);
+            lights[i].pos[0] = rng.NextFloat(-100.0f, 400.0f);
+            lights[i].pos[1] = rng.NextFloat(0.0f, 30.0f);
+            lights[i].pos[2] = rng.NextFloat(-100.0f, 400.0f);
+            lights[i].radiusSq = radius * radius;
+            lights[i].type = rng.NextInt(2);
+        }
+
+        const Vector3 behind = eye - forward * 5000.0f;
+        lights[0].pos[0] = eye.GetX();
+        lights[0].pos[1] = eye.GetY();
+        lights[0].pos[2] = eye.GetZ();
+        lights[0].radiusSq = 4.0f * kFarClip * kFarClip;
+        lights[1].pos[0] = behind.GetX();
+        lights[1].pos[1] = behind.GetY();
+        lights[1].pos[2] = behind.GetZ();
+        lights[1].radiusSq = 1.0f;
+    }
+
+    // Whether a light sits so close to the edge of a tile that rounding could put it on either side
+    bool IsBorderline( const LightData& light, const float planes[6][4], uint32_t numPlanes )
+    {
+        const double radius = std::sqrt((double)light.radiusSq);
+        double margin = DBL_MAX, magnitude = 1.0;
+
+        for (uint32_t p = 0; p < numPlanes; ++p)
+        {
+            const double d = (double)planes[p][0] * light.pos[0] + (double)planes[p][1] * light.pos[1] +
+                (double)planes[p][2] * light.pos[2] + planes[p][3] + radius;
+            if (d < margin)
+            {
+                margin = d;
+                magnitude = 1.0 + radius + std::fabs(planes[p][3]) + std::fabs(planes[p][0] * light.pos[0]) +
+                    std::fabs(planes[p][1] * light.pos[1]) + std::fabs(planes[p][2] * light.pos[2]);
+            }
+        }
+
+        return std::fabs(margin) <= 1e-5 * magnitude;
+    }
+
+    // Checks that a tile's lists agree with its bit mask: every listed light is of the listed kind, its
+    // bit is set, each list is in ascending order, and no light in the mask is missing
+    bool IsTileConsistent( const LightData* lights, const uint32_t* tileGrid, const uint32_t* tileBitMask )
+    {
+        const uint32_t counts[3] = { tileGrid[0] & 0xff, (tileGrid[0] >> 8) & 0xff, (tileGrid[0] >> 16) & 0xff };
+
+        uint32_t numInMask = 0;
+        for (uint32_t w = 0; w < kTileMaskSize; ++w)
+            numInMask += __popcnt(tileBitMask[w]);
+
+        if (counts[0] + counts[1] + counts[2] != numInMask)
+            return false;
+
+        const uint32_t* index = tileGrid + 1;
+        for (uint32_t type = 0; type < 3; ++type)
+        {
+            for (uint32_t n = 0; n < counts[type]; ++n, ++index)
+            {
+                if (*index >= MaxLights || lights[*index].type != type ||
+                    (tileBitMask[*index / 32] & (1u << (*index % 32))) == 0 ||
+                    (n > 0 && index[-1] >= *index))
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+}
+
+void LightGridCPU::Validate( void )
+{
+    Camera camera;
+    std::vector<LightData> lights;
+    std::vector<float> linearDepth;
+    MakeTestScene(camera, lights, linearDepth);
+
+    uint32_t numFailures = 0;
+
+    for (uint32_t tileDim : kTileDims)
+    {
+        for (bool transparent : { false, true })
+        {
+            const GridSetup setup(camera, kTestWidth, kTestHeight, tileDim, linearDepth.data(), transparent);
+            const uint32_t numTiles = TileCount(kTestWidth, kTestHeight, tileDim);
+
+            std::vector<uint32_t> grid(numTiles * kTileSize), bitMask(numTiles * kTileMaskSize);
+            std::vector<uint32_t> scalarGrid(numTiles * kTileSize), scalarBitMask(numTiles * kTileMaskSize);
+
+            FillLightGrid(lights.data(), MaxLights, camera, kTestWidth, kTestHeight, tileDim, linearDepth.data(),
+                transparent, grid.data(), bitMask.data());
+            FillLightGridScalar(lights.data(), MaxLights, camera, kTestWidth, kTestHeight, tileDim, linearDepth.data(),
+                transparent, scalarGrid.data(), scalarBitMask.data());
+
+            uint32_t numLightTiles = 0, numBorderline = 0, numMismatched = 0, numInconsistent = 0, numMisplaced = 0;
+
+            for (uint32_t tile = 0; tile < numTiles; ++tile)
+            {
+                const uint32_t* tileGrid = &grid[tile * kTileSize];
+                const uint32_t* tileMask = &bitMask[tile * kTileMaskSize];
+                const uint32_t* scalarTileGrid = &scalarGrid[tile * kTileSize];
+                const uint32_t* scalarTileMask = &scalarBitMask[tile * kTileMaskSize];
+
+                if (!IsTileConsistent(lights.data(), tileGrid, tileMask) || !IsTileConsistent(lights.data(), scalarTileGrid, scalarTileMask))
+                    ++numInconsistent;
+
+                if ((tileMask[0] & 3) != 1)
+                    ++numMisplaced;
+
+                uint32_t numDifferent = 0;
+                for (uint32_t w = 0; w < kTileMaskSize; ++w)
+                {
+                    numLightTiles += __popcnt(tileMask[w]);
+                    numDifferent += __popcnt(tileMask[w] ^ scalarTileMask[w]);
+                }
+
+                if (numDifferent == 0)
+                {
+                    const uint32_t numIndices = __popcnt(tileMask[0]) + __popcnt(tileMask[1]) + __popcnt(tileMask[2]) + __popcnt(tileMask[3]);
+                    if (std::memcmp(tileGrid, scalarTileGrid, (1 + numIndices) * sizeof(uint32_t)) != 0)
+                        ++numMismatched;
+                    continue;
+                }
+
+                // Differences are only acceptable for lights that graze the tile
+                const uint32_t gx = tile % setup.tileCountX, gy = tile / setup.tileCountX;
+                uint32_t minDepth = 0, maxDepth = 0;
+                if (setup.depth != nullptr)
+                    TileDepthBoundsScalar(setup, gx, gy, minDepth, maxDepth);
+
+                float planes[6][4];
+                const uint32_t numPlanes = BuildTilePlanes(setup, gx, gy, minDepth, maxDepth, planes);
+
+                for (uint32_t w = 0; w < kTileMaskSize; ++w)
+                {
+                    for (uint32_t bits = tileMask[w] ^ scalarTileMask[w]; bits != 0; bits &= bits - 1)
+                    {
+                        unsigned long bit;
+                        _BitScanForward(&bit, bits);
+                        if (IsBorderline(lights[w * 32 + bit], planes, numPlanes))
+                            ++numBorderline;
+                        else
+                            ++numMismatched;
+                    }
+                }
+            }
+
+            const bool passed = numMismatched == 0 && numInconsistent == 0 && numMisplaced == 0;
+            numFailures += passed ? 0 : 1;
+
+            if (passed)
+            {
+                LOG_INFOF("Light grid %ux%u%s:  %u tiles, %.1f lights per tile, %u borderline differences",
+                    tileDim, tileDim, transparent ? " (transparent)" : "", numTiles, (float)numLightTiles / numTiles, numBorderline);
+            }
+            else
+            {
+                LOG_WARNF("Light grid %ux%u%s failed:  %u mismatches, %u inconsistent tiles, %u tiles with wrong test lights",
+                    tileDim, tileDim, transparent ? " (transparent)" : "", numMismatched, numInconsistent, numMisplaced);
+            }
+        }
+    }
+
+    if (numFailures == 0)
+        LOG_INFO("CPU light grid validation passed");
+    else
+        LOG_WARNF("CPU light grid validation failed for %u configurations", numFailures);
+}
+
+void LightGridCPU::Benchmark( uint32_t iterations )
+{
+    if (iterations == 0)
+        return;
+
+    Camera camera;
+    std::vector<LightData> lights;
+    std::vector<float> linearDepth;
+    MakeTestScene(camera, lights, linearDepth);
+
+    static const uint32_t kLightCounts[] = { 16, 32, 64, 128 };
+
+    for (uint32_t numLights : kLightCounts)
+    {
+        for (uint32_t tileDim : kTileDims)
+        {
+            const uint32_t numTiles = TileCount(kTestWidth, kTestHeight, tileDim);
+            std::vector<uint32_t> grid(numTiles * kTileSize), bitMask(numTiles * kTileMaskSize);
+
+            int64_t startTick = SystemTime::GetCurrentTick();
+            for (uint32_t i = 0; i < iterations; ++i)
+            {
+                FillLightGridScalar(lights.data(), numLights, camera, kTestWidth, kTestHeight, tileDim, linearDepth.data(),
+                    false, grid.data(), bitMask.data());
+            }
+            const double scalarMs = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - startTick) / iterations;
+
+            startTick = SystemTime::GetCurrentTick();
+            for (uint32_t i = 0; i < iterations; ++i)
+            {
+                FillLightGrid(lights.data(), numLights, camera, kTestWidth, kTestHeight, tileDim, linearDepth.data(),
+                    false, grid.data(), bitMask.data());
+            }
+            const double simdMs = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - startTick) / iterations;
+
+            uint32_t numLightTiles = 0;
+            for (uint32_t w : bitMask)
+                numLightTiles += __popcnt(w);
+
+            LOG_INFOF("Light grid of %u lights in %ux%u tiles (%.1f lights per tile):  scalar %.3f ms, threaded %s %.3f ms (%.1fx)",
+                numLights, tileDim, tileDim, (float)numLightTiles / numTiles, scalarMs,
+                SphereCulling::UsesAVX() ? "AVX" : "SSE", simdMs, scalarMs / simdMs);
+        }
+    }
+}
@@ -0,0 +1,63 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+// Forward+ light grid binning on the CPU.  Produces the same tiles as FillLightGridCS.hlsli, laid out
+// like m_LightGrid and m_LightGridBitMask, so grid sizes can be tuned and light queries answered
+// without a GPU.  Lights are tested four (SSE) or eight (AVX) at a time and tile rows run in parallel.
+//
+
+#pragma once
+
+#include "LightManager.h"
+#include "../Core/Math/Common.h"
+
+#include <cstdint>
+
+namespace Math
+{
+    class Camera;
+}
+
+namespace LightGridCPU
+{
+    // 32-bit words per tile: the packed light counts followed by the light indices
+    static const uint32_t kTileSize = 1 + Lighting::MaxLights;
+
+    // 32-bit words per tile of the bit mask
+    static const uint32_t kTileMaskSize = Lighting::MaxLights / 32;
+
+    inline uint32_t TileCount( uint32_t width, uint32_t height, uint32_t tileDim )
+    {
+        return Math::DivideByMultiple(width, tileDim) * Math::DivideByMultiple(height, tileDim);
+    }
+
+    // Bins up to MaxLights lights into tileDim x tileDim pixel tiles.  lightGrid needs kTileSize and
+    // lightGridBitMask kTileMaskSize words for each of TileCount() tiles, in row-major tile order.  Each
+    // tile holds its sphere, cone, and shadowed cone counts in bits 0, 8, and 16 of the first word, then
+    // the indices of each kind in ascending order.  linearDepth is the width x height g_LinearDepth image
+    // bounding each tile in depth; without it, or for transparent geometry, only the tile's sides cull.
+    void FillLightGrid( const LightData* lights, uint32_t numLights, const Math::Camera& camera,
+        uint32_t width, uint32_t height, uint32_t tileDim, const float* linearDepth, bool transparent,
+        uint32_t* lightGrid, uint32_t* lightGridBitMask );
+
+    // One light and one tile at a time, kept for validation and benchmarking
+    void FillLightGridScalar( const LightData* lights, uint32_t numLights, const Math::Camera& camera,
+        uint32_t width, uint32_t height, uint32_t tileDim, const float* linearDepth, bool transparent,
+        uint32_t* lightGrid, uint32_t* lightGridBitMask );
+
+    // Checks the grids of random lights over a synthetic depth buffer for every tile size, comparing the
+    // two paths and the consistency of each tile, and logs the results
+    void Validate( void );
+
+    // Times both paths for 16 to 128 lights and each Forward+ tile size at 1920x1080 and logs the results
+    void Benchmark( uint32_t iterations );
+}
@@ -31,22 +31,6 @@
 using namespace Math;
 using namespace Graphics;
 
-// must keep in sync with HLSL
-__declspec(align(16)) struct LightData
-{
-    float pos[3];
-    float radiusSq;
-    float color[3];
-
-    uint32_t type;
-    float coneDir[3];
-    float coneAngles[2];
-
-    float shadowTextureMatrix[16];
-
-    float padding[3]; // Padding so the structure is 16-byte aligned.
-};
-
 enum { kMinLightGridDim = 8 };
 
 namespace Lighting
@@ -72,6 +56,8 @@ namespace Lighting
     ColorBuffer m_LightShadowArray;
     ShadowBuffer m_LightShadowTempBuffer;
     Matrix4 m_LightShadowMatrix[MaxLights];
+    Math::Camera m_LightShadowCamera[MaxLights];
+    uint32_t m_ShadowVersion = 0;
 
     void InitializeResources(void);
     void CreateRandomLights(const Vector3 minBound, const Vector3 maxBound);
@@ -114,15 +100,29 @@ void Lighting::InitializeResources( void )
 
     m_LightShadowArray.CreateArray(L"m_LightShadowArray", shadowDim, shadowDim, MaxLights, DXGI_FORMAT_R16_UNORM);
     m_LightShadowTempBuffer.Create(L"m_LightShadowTempBuffer", shadowDim, shadowDim);
+    ++m_ShadowVersion;
 
     m_LightBuffer.Create(L"m_LightBuffer", MaxLights, sizeof(LightData));
 }
 
+const Math::Camera& Lighting::GetShadowCamera( uint32_t lightIndex )
+{
+    ASSERT(lightIndex < MaxLights);
+    return m_LightShadowCamera[lightIndex];
+}
+
+uint32_t Lighting::GetShadowVersion( void )
+{
+    return m_ShadowVersion;
+}
+
 void Lighting::CreateRandomLights( const Vector3 minBound, const Vector3 maxBound )
 {
     Vector3 posScale = maxBound - minBound;
     Vector3 posBias = minBound;
 
+    ++m_ShadowVersion;
+
     // todo: replace this with MT
     srand(12645);
     auto randUint = []() -> uint32_t
@@ -204,6 +204,7 @@ void Lighting::CreateRandomLights( const Vector3 minBound, const Vector3 maxBoun
         shadowCamera.SetPerspectiveMatrix(coneOuter * 2, 1.0f, lightRadius * .05f, lightRadius * 1.0f);
         shadowCamera.Update();
         m_LightShadowMatrix[n] = shadowCamera.GetViewProjMatrix();
+        m_LightShadowCamera[n] = shadowCamera;
         Matrix4 shadowTextureMatrix = Matrix4(AffineTransform(Matrix3::MakeScale( 0.5f, -0.5f, 1.0f ), Vector3(0.5f, 0.5f, 0.0f))) * m_LightShadowMatrix[n];
 
         m_LightData[n].pos[0] = pos.GetX();
@@ -32,6 +32,22 @@ namespace Math
     class Camera;
 }
 
+// must keep in sync with HLSL
+__declspec(align(16)) struct LightData
+{
+    float pos[3];
+    float radiusSq;
+    float color[3];
+
+    std::uint32_t type;
+    float coneDir[3];
+    float coneAngles[2];
+
+    float shadowTextureMatrix[16];
+
+    float padding[3]; // Padding so the structure is 16-byte aligned.
+};
+
 namespace Lighting
 {
     extern IntVar LightGridDim;
@@ -54,6 +70,12 @@ namespace Lighting
     extern ShadowBuffer m_LightShadowTempBuffer;
     extern Math::Matrix4 m_LightShadowMatrix[MaxLights];
 
+    // The camera that m_LightShadowMatrix[lightIndex] was made from, for culling the light's shadow casters
+    const Math::Camera& GetShadowCamera(std::uint32_t lightIndex);
+
+    // Changes whenever the lights or m_LightShadowArray are created again, discarding every shadow map
+    std::uint32_t GetShadowVersion(void);
+
     void InitializeResources(void);
     void CreateRandomLights(const Math::Vector3 minBound, const Math::Vector3 maxBound);
     void FillLightGrid(GraphicsContext& gfxContext, const Math::Camera& camera, bool transparent);
@@ -22,7 +22,9 @@
 #include "glTF.h"
 #include "Model.h"
 #include "IndexOptimizePostTransform.h"
+#include "MeshSimplify.h"
 #include "../Core/VectorMath.h"
+#include "../Core/Hash.h"
 #include "DirectXMesh.h"
 
 using namespace DirectX;
@@ -41,24 +43,45 @@ static DXGI_FORMAT JointIndexFormat(const Accessor& accessor)
     }
 }
 
+// The input format of a vertex attribute.  Beyond floats this covers the integer types KHR_mesh_quantization
+// allows.  Three-component 8- and 16-bit attributes are read as four components, which is safe because
+// glTF pads every such element to a multiple of four bytes.
 static DXGI_FORMAT AccessorFormat(const Accessor& accessor)
 {
+    static const DXGI_FORMAT kIntegerFormats[4][2][3] =
+    {
+        // kByte
+        {
+            { DXGI_FORMAT_R8_SINT, DXGI_FORMAT_R8G8_SINT, DXGI_FORMAT_R8G8B8A8_SINT },
+            { DXGI_FORMAT_R8_SNORM, DXGI_FORMAT_R8G8_SNORM, DXGI_FORMAT_R8G8B8A8_SNORM },
+        },
+        // kUnsignedByte
+        {
+            { DXGI_FORMAT_R8_UINT, DXGI_FORMAT_R8G8_UINT, DXGI_FORMAT_R8G8B8A8_UINT },
+            { DXGI_FORMAT_R8_UNORM, DXGI_FORMAT_R8G8_UNORM, DXGI_FORMAT_R8G8B8A8_UNORM },
+        },
+        // kShort
+        {
+            { DXGI_FORMAT_R16_SINT, DXGI_FORMAT_R16G16_SINT, DXGI_FORMAT_R16G16B16A16_SINT },
+            { DXGI_FORMAT_R16_SNORM, DXGI_FORMAT_R16G16_SNORM, DXGI_FORMAT_R16G16B16A16_SNORM },
+        },
+        // kUnsignedShort
+        {
+            { DXGI_FORMAT_R16_UINT, DXGI_FORMAT_R16G16_UINT, DXGI_FORMAT_R16G16B16A16_UINT },
+            { DXGI_FORMAT_R16_UNORM, DXGI_FORMAT_R16G16_UNORM, DXGI_FORMAT_R16G16B16A16_UNORM },
+        },
+    };
+
     switch (accessor.componentType)
     {
+    case Accessor::kByte:
     case Accessor::kUnsignedByte:
-        switch (accessor.type)
-        {
-        case Accessor::kScalar: return DXGI_FORMAT_R8_UNORM;
-        case Accessor::kVec2:   return DXGI_FORMAT_R8G8_UNORM;
-        default:                return DXGI_FORMAT_R8G8B8A8_UNORM;
-        }
+    case Accessor::kShort:
     case Accessor::kUnsignedShort:
-        switch (accessor.type)
-        {
-        case Accessor::kScalar: return DXGI_FORMAT_R16_UNORM;
-        case Accessor::kVec2:   return DXGI_FORMAT_R16G16_UNORM;
-        default:                return DXGI_FORMAT_R16G16B16A16_UNORM;
-        }
+    {
+        const uint32_t components = accessor.type == Accessor::kScalar ? 0 : accessor.type == Accessor::kVec2 ? 1 : 2;
+        return kIntegerFormats[accessor.componentType][accessor.normalized ? 1 : 0][components];
+    }
     case Accessor::kFloat:
         switch (accessor.type)
         {
@@ -73,178 +96,455 @@ static DXGI_FORMAT AccessorFormat(const Accessor& accessor)
     }
 }
 
-uint32_t GetMaxIndex(const glTF::Primitive& inPrim)
+// The formats of the interleaved vertex stream for a set of PSOFlags.  Renderer::GetPSO() builds the
+// matching input layouts.
+static void GetVertexElements(uint16_t psoFlags, std::vector<D3D12_INPUT_ELEMENT_DESC>& elements)
+{
+    using namespace PSOFlags;
+
+    const DXGI_FORMAT positionFormat = (psoFlags & kQuantizedPosition) ?
+        DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R32G32B32_FLOAT;
+    const DXGI_FORMAT texcoordFormat = (psoFlags & kUNormTexcoord) ? DXGI_FORMAT_R16G16_UNORM : DXGI_FORMAT_R16G16_FLOAT;
+
+    elements.clear();
+    elements.push_back({"POSITION", 0, positionFormat, 0, D3D12_APPEND_ALIGNED_ELEMENT});
+    if (psoFlags & kOctahedralNormal)
+    {
+        // The tangent, if any, is packed into the same element
+        elements.push_back({"NORMAL", 0, DXGI_FORMAT_R8G8B8A8_SNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT});
+    }
+    else
+    {
+        elements.push_back({"NORMAL", 0, DXGI_FORMAT_R10G10B10A2_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT});
+        if (psoFlags & kHasTangent)
+            elements.push_back({"TANGENT", 0, DXGI_FORMAT_R10G10B10A2_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT});
+    }
+    if (psoFlags & kHasUV0)
+        elements.push_back({"TEXCOORD", 0, texcoordFormat, 0, D3D12_APPEND_ALIGNED_ELEMENT});
+    if (psoFlags & kHasUV1)
+        elements.push_back({"TEXCOORD", 1, texcoordFormat, 0, D3D12_APPEND_ALIGNED_ELEMENT});
+    if (psoFlags & kHasSkin)
+    {
+        elements.push_back({ "BLENDINDICES", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
+        elements.push_back({ "BLENDWEIGHT", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT });
+    }
+}
+
+// The formats of the depth-only vertex stream.  These match the fixed depth PSOs created by Renderer::Initialize(),
+// so only the position format varies.
+static void GetDepthVertexElements(uint16_t psoFlags, std::vector<D3D12_INPUT_ELEMENT_DESC>& elements)
 {
-    uint32_t maxIndex = 0;
+    using namespace PSOFlags;
 
-    const uint32_t& indexCount = inPrim.indices->count;
+    const DXGI_FORMAT positionFormat = (psoFlags & kQuantizedPosition) ?
+        DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R32G32B32_FLOAT;
 
-    uint16_t compType = inPrim.indices->componentType;
+    elements.clear();
+    elements.push_back({"POSITION", 0, positionFormat, 0, D3D12_APPEND_ALIGNED_ELEMENT});
+    if (psoFlags & kAlphaTest)
+        elements.push_back({"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT});
+    if (psoFlags & kHasSkin)
+    {
+        elements.push_back({ "BLENDINDICES", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
+        elements.push_back({ "BLENDWEIGHT", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT });
+    }
+}
+
+// Primitives with at least this many indices use the clustered optimizer
+static const size_t kClusteredOptimizeThreshold = 3 * 16384;
 
-    if (compType == Accessor::kByte)
+template <typename IndexType>
+static void WidenIndices(const void* src, size_t indexCount, uint32_t* dst)
+{
+    for (size_t i = 0; i < indexCount; ++i)
+        dst[i] = static_cast<uint32_t>(((const IndexType*)src)[i]);
+}
+
+// Reads the primitive's indices, or generates them for a non-indexed primitive, and expands strips and
+// fans into a triangle list.  Degenerate triangles (which strips use for stitching) and triangles with
+// out-of-range indices are dropped.  glTF forbids primitive restart values, but some exporters emit them
+// anyway, so a restart value ends the current strip or fan.  Returns false for non-triangle topologies.
+static bool BuildTriangleList(const glTF::Primitive& inPrim, uint32_t vertexCount, std::vector<uint32_t>& triangles,
+    uint32_t& maxIndex)
+{
+    const uint32_t mode = inPrim.mode;
+    if (mode < 4 || mode > 6)
     {
-        int8_t* ib = (int8_t*)inPrim.indices->dataPtr;
-        for (uint32_t k = 0; k < indexCount; ++k)
-            maxIndex = std::max<uint32_t>(ib[k], maxIndex);
+        LOG_ERROR("Found unsupported primitive topology.");
+        return false;
     }
-    else if (compType == Accessor::kUnsignedByte)
+
+    std::vector<uint32_t> source;
+    uint32_t restartIndex = 0xFFFFFFFF;
+
+    if (inPrim.indices == nullptr)
     {
-        uint8_t* ib = (uint8_t*)inPrim.indices->dataPtr;
-        for (uint32_t k = 0; k < indexCount; ++k)
-            maxIndex = std::max<uint32_t>(ib[k], maxIndex);
+        source.resize(vertexCount);
+        for (uint32_t i = 0; i < vertexCount; ++i)
+            source[i] = i;
     }
-    else if (compType == Accessor::kShort)
+    else
     {
-        int16_t* ib = (int16_t*)inPrim.indices->dataPtr;
-        for (uint32_t k = 0; k < indexCount; ++k)
-            maxIndex = std::max<uint32_t>(ib[k], maxIndex);
+        const size_t indexCount = inPrim.indices->count;
+        const void* srcData = inPrim.indices->dataPtr;
+
+        source.resize(indexCount);
+        switch (inPrim.indices->componentType)
+        {
+        case Accessor::kByte:           WidenIndices<int8_t>(srcData, indexCount, source.data()); break;
+        case Accessor::kUnsignedByte:   WidenIndices<uint8_t>(srcData, indexCount, source.data()); restartIndex = 0xFF; break;
+        case Accessor::kShort:          WidenIndices<int16_t>(srcData, indexCount, source.data()); break;
+        case Accessor::kUnsignedShort:  WidenIndices<uint16_t>(srcData, indexCount, source.data()); restartIndex = 0xFFFF; break;
+        case Accessor::kUnsignedInt:    WidenIndices<uint32_t>(srcData, indexCount, source.data()); break;
+        case Accessor::kFloat:          WidenIndices<float>(srcData, indexCount, source.data()); break;
+        default:
+            LOG_ERROR("Unsupported component type for mesh index.");
+            return false;
+        }
     }
-    else if (compType == Accessor::kUnsignedShort)
+
+    triangles.clear();
+    triangles.reserve(mode == 4 ? source.size() : source.size() * 3);
+    maxIndex = 0;
+
+    size_t outOfRange = 0;
+    auto AddTriangle = [&](uint32_t a, uint32_t b, uint32_t c)
     {
-        uint16_t* ib = (uint16_t*)inPrim.indices->dataPtr;
-        for (uint32_t k = 0; k < indexCount; ++k)
-            maxIndex = std::max<uint32_t>(ib[k], maxIndex);
+        if (a >= vertexCount || b >= vertexCount || c >= vertexCount)
+        {
+            ++outOfRange;
+            return;
+        }
+        if (a == b || b == c || c == a)
+            return;
+
+        triangles.push_back(a);
+        triangles.push_back(b);
+        triangles.push_back(c);
+        maxIndex = std::max(maxIndex, std::max(a, std::max(b, c)));
+    };
+
+    if (mode == 4)
+    {
+        for (size_t i = 0; i + 2 < source.size(); i += 3)
+            AddTriangle(source[i], source[i + 1], source[i + 2]);
     }
-    else if (compType == Accessor::kUnsignedInt)
+    else
     {
-        uint32_t* ib = (uint32_t*)inPrim.indices->dataPtr;
-        for (uint32_t k = 0; k < indexCount; ++k)
-            maxIndex = std::max<uint32_t>(ib[k], maxIndex);
+        for (size_t start = 0; start < source.size(); )
+        {
+            size_t end = start;
+            while (end < source.size() && source[end] != restartIndex)
+                ++end;
+
+            const uint32_t* v = source.data() + start;
+            const size_t count = end - start;
+
+            if (mode == 5)
+            {
+                // Every other triangle of a strip is flipped to keep the winding consistent
+                for (size_t i = 0; i + 2 < count; ++i)
+                {
+                    if (i & 1)
+                        AddTriangle(v[i], v[i + 2], v[i + 1]);
+                    else
+                        AddTriangle(v[i], v[i + 1], v[i + 2]);
+                }
+            }
+            else
+            {
+                for (size_t i = 1; i + 1 < count; ++i)
+                    AddTriangle(v[i], v[i + 1], v[0]);
+            }
+
+            start = end + 1;
+        }
     }
-    else if (compType == Accessor::kFloat)
+
+    if (outOfRange > 0)
+        LOG_WARNF("Dropped %zu triangles with out of range vertex indices.", outOfRange);
+
+    return !triangles.empty();
+}
+
+static void OptimizePrimitiveFaces(const std::vector<uint32_t>& triangles, bool b32BitIndices, Renderer::Primitive& outPrim)
+{
+    const size_t indexCount = triangles.size();
+
+    std::vector<uint32_t> newIndices;
+    uint32_t* dstIndices = (uint32_t*)outPrim.IB->data();
+    if (!b32BitIndices && indexCount >= kClusteredOptimizeThreshold)
     {
-        float* ib = (float*)inPrim.indices->dataPtr;
-        for (uint32_t k = 0; k < indexCount; ++k)
-            maxIndex = std::max((uint32_t)ib[k], maxIndex);
+        newIndices.resize(indexCount);
+        dstIndices = newIndices.data();
+    }
+
+    if (indexCount >= kClusteredOptimizeThreshold)
+    {
+        OptimizeFacesClustered(triangles.data(), indexCount, dstIndices, 64);
+
+        const VertexCacheStatistics before = AnalyzeVertexCache(triangles.data(), indexCount);
+        const VertexCacheStatistics after = AnalyzeVertexCache(dstIndices, indexCount);
+        LOG_INFOF("Optimized %zu triangles:  ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", indexCount / 3,
+            before.acmr, after.acmr, before.atvr, after.atvr);
+
+        if (!b32BitIndices)
+        {
+            uint16_t* dst16 = (uint16_t*)outPrim.IB->data();
+            for (size_t i = 0; i < indexCount; ++i)
+                dst16[i] = (uint16_t)dstIndices[i];
+        }
+    }
+    else if (b32BitIndices)
+    {
+        OptimizeFaces(triangles.data(), indexCount, dstIndices, 64);
     }
     else
     {
-        LOG_ERROR("Invalid component type when looking for max index.");
+        OptimizeFaces(triangles.data(), indexCount, (uint16_t*)outPrim.IB->data(), 64);
     }
+}
 
-    return maxIndex;
+static void ReadIndexBuffer(const Utility::ByteArray& indexBuffer, bool b32BitIndices, std::vector<uint32_t>& indices)
+{
+    if (b32BitIndices)
+    {
+        const uint32_t* src = (const uint32_t*)indexBuffer->data();
+        indices.assign(src, src + indexBuffer->size() / 4);
+    }
+    else
+    {
+        const uint16_t* src = (const uint16_t*)indexBuffer->data();
+        indices.assign(src, src + indexBuffer->size() / 2);
+    }
 }
 
-void OptimizePrimitiveFaces(const glTF::Primitive& inPrim, bool b32BitIndices, Renderer::Primitive& outPrim)
+static Utility::ByteArray WriteIndexBuffer(const std::vector<uint32_t>& indices, bool b32BitIndices)
 {
-    switch (inPrim.indices->componentType)
+    Utility::ByteArray indexBuffer = std::make_shared<std::vector<byte>>(indices.size() * (b32BitIndices ? 4 : 2));
+    if (b32BitIndices)
     {
-    case Accessor::kByte:
-        if (b32BitIndices)
-            OptimizeFaces((int8_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint32_t*)outPrim.IB->data(), 64);
-        else
-            OptimizeFaces((int8_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint16_t*)outPrim.IB->data(), 64);
-        break;
-    case Accessor::kUnsignedByte:
-        if (b32BitIndices)
-            OptimizeFaces((uint8_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint32_t*)outPrim.IB->data(), 64);
-        else
-            OptimizeFaces((uint8_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint16_t*)outPrim.IB->data(), 64);
-        break;
-    case Accessor::kShort:
-        if (b32BitIndices)
-            OptimizeFaces((int16_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint32_t*)outPrim.IB->data(), 64);
-        else
-            OptimizeFaces((int16_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint16_t*)outPrim.IB->data(), 64);
-        break;
-    case Accessor::kUnsignedShort:
-        if (b32BitIndices)
-            OptimizeFaces((uint16_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint32_t*)outPrim.IB->data(), 64);
-        else
-            OptimizeFaces((uint16_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint16_t*)outPrim.IB->data(), 64);
-        break;
-    case Accessor::kUnsignedInt:
-        if (b32BitIndices)
-            OptimizeFaces((uint32_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint32_t*)outPrim.IB->data(), 64);
-        else
-            OptimizeFaces((uint32_t*)inPrim.indices->dataPtr, inPrim.indices->count, (uint16_t*)outPrim.IB->data(), 64);
-        break;
-    case Accessor::kFloat:
-        if (b32BitIndices)
-            OptimizeFaces((float*)inPrim.indices->dataPtr, inPrim.indices->count, (uint32_t*)outPrim.IB->data(), 64);
-        else
-            OptimizeFaces((float*)inPrim.indices->dataPtr, inPrim.indices->count, (uint16_t*)outPrim.IB->data(), 64);
-        break;
-    default:
-        LOG_ERROR("Unsupported component type for mesh index.");
-        return;
+        std::memcpy(indexBuffer->data(), indices.data(), indexBuffer->size());
     }
+    else
+    {
+        uint16_t* dst = (uint16_t*)indexBuffer->data();
+        for (size_t i = 0; i < indices.size(); ++i)
+            dst[i] = (uint16_t)indices[i];
+    }
+    return indexBuffer;
 }
 
-void OptimizeMesh(Renderer::Primitive& outPrim, const glTF::Primitive& inPrim, const Math::Matrix4& localToObject)
+// Merges vertices whose encoded bytes are identical, then moves the survivors into the order in which the
+// index list first references them so that vertex fetch walks the buffer front to back.  Vertices that are
+// never referenced are dropped.  Both the vertex data and the indices are rewritten.
+static void WeldAndReorderVertices(Utility::ByteArray& vertexData, uint32_t stride, std::vector<uint32_t>& indices)
 {
-    ASSERT(inPrim.attributes[0] != nullptr, "Must have POSITION");
-    uint32_t vertexCount = inPrim.attributes[0]->count;
+    ASSERT((stride & 3) == 0, "Vertices are hashed as 32-bit words");
 
-    void* indices = nullptr;
-    uint32_t indexCount;
-    bool b32BitIndices;
-    //uint32_t maxIndex = inPrim.maxIndex;
+    const uint32_t vertexCount = (uint32_t)(vertexData->size() / stride);
+    const byte* src = vertexData->data();
 
-    if (inPrim.indices == nullptr)
+    // Open addressing table of the first vertex seen with each encoding
+    size_t tableSize = 1;
+    while (tableSize < vertexCount * 2)
+        tableSize <<= 1;
+
+    const uint32_t kEmpty = 0xFFFFFFFF;
+    std::vector<uint32_t> table(tableSize, kEmpty);
+    std::vector<uint32_t> canonical(vertexCount);
+
+    for (uint32_t v = 0; v < vertexCount; ++v)
     {
-        ASSERT(inPrim.mode == 4, "Impossible primitive topology when lacking indices");
+        const byte* vertex = src + v * stride;
+        size_t slot = Utility::HashRange((const uint32_t*)vertex, (const uint32_t*)(vertex + stride), 2166136261U) & (tableSize - 1);
 
-        indexCount = vertexCount * 3;
-        //maxIndex = indexCount - 1;
-        if (indexCount > 0xFFFF)
+        for (;;)
         {
-            b32BitIndices = true;
-            outPrim.IB = std::make_shared<std::vector<byte>>(4 * indexCount);
-            indices = outPrim.IB->data();
-            uint32_t* tmp = (uint32_t*)indices;
-            for (uint32_t i = 0; i < indexCount; ++i)
-                tmp[i] = i;
+            if (table[slot] == kEmpty)
+            {
+                table[slot] = v;
+                canonical[v] = v;
+                break;
+            }
+            if (std::memcmp(src + table[slot] * stride, vertex, stride) == 0)
+            {
+                canonical[v] = table[slot];
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
         }
-        else
+    }
+
+    // Assign new positions in order of first use
+    std::vector<uint32_t> newPosition(vertexCount, kEmpty);
+    uint32_t usedCount = 0;
+    for (uint32_t& index : indices)
+    {
+        uint32_t& position = newPosition[canonical[index]];
+        if (position == kEmpty)
+            position = usedCount++;
+        index = position;
+    }
+
+    Utility::ByteArray reordered = std::make_shared<std::vector<byte>>((size_t)usedCount * stride);
+    for (uint32_t v = 0; v < vertexCount; ++v)
+    {
+        if (canonical[v] == v && newPosition[v] != kEmpty)
+            std::memcpy(reordered->data() + newPosition[v] * stride, src + v * stride, stride);
+    }
+
+    vertexData = reordered;
+}
+
+// Cluster limits.  These match what mesh shaders favor, so the same clusters could later feed a meshlet path.
+static const size_t kMaxClusterVertices = 64;
+static const size_t kMaxClusterTriangles = 124;
+
+// Splits the primitive into clusters of nearby triangles and regroups the index list so that each cluster
+// is a contiguous run.  Each cluster gets a bounding sphere and a backface cone in object space so that the
+// renderer can reject it on the CPU.  Primitives that fit in a single cluster are left alone.
+static void BuildClusters(Renderer::Primitive& outPrim, std::vector<uint32_t>& indices,
+    const XMFLOAT3* positions, uint32_t vertexCount, const Math::Matrix4& localToObject)
+{
+    outPrim.clusters.clear();
+
+    if (indices.size() <= kMaxClusterTriangles * 3)
+        return;
+
+    std::vector<XMFLOAT3> positionsOS(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; ++v)
+        XMStoreFloat3(&positionsOS[v], localToObject * Vector4(Vector3(positions[v])));
+
+    std::vector<Meshlet> meshlets;
+    std::vector<uint8_t> uniqueVertexIB;
+    std::vector<MeshletTriangle> primitiveIndices;
+    if (FAILED(ComputeMeshlets(indices.data(), indices.size() / 3, positionsOS.data(), vertexCount, nullptr,
+        meshlets, uniqueVertexIB, primitiveIndices, kMaxClusterVertices, kMaxClusterTriangles)))
+    {
+        LOG_WARN("Unable to split a primitive into clusters");
+        return;
+    }
+
+    const uint32_t* uniqueVertexIndices = (const uint32_t*)uniqueVertexIB.data();
+    const size_t numUniqueVertexIndices = uniqueVertexIB.size() / sizeof(uint32_t);
+
+    std::vector<CullData> cullData(meshlets.size());
+    if (FAILED(ComputeCullData(positionsOS.data(), vertexCount, meshlets.data(), meshlets.size(),
+        uniqueVertexIndices, numUniqueVertexIndices, primitiveIndices.data(), primitiveIndices.size(), cullData.data())))
+    {
+        LOG_WARN("Unable to compute cluster culling data");
+        return;
+    }
+
+    // The generator drops degenerate triangles, so the new list may be a little shorter
+    std::vector<uint32_t> clusteredIndices;
+    clusteredIndices.reserve(indices.size());
+    outPrim.clusters.resize(meshlets.size());
+
+    for (size_t i = 0; i < meshlets.size(); ++i)
+    {
+        const Meshlet& m = meshlets[i];
+        const CullData& c = cullData[i];
+        MeshCluster& cluster = outPrim.clusters[i];
+
+        cluster.startIndex = (uint32_t)clusteredIndices.size();
+        cluster.primCount = (uint16_t)(m.PrimCount * 3);
+        cluster.drawIdx = 0;
+
+        for (uint32_t p = 0; p < m.PrimCount; ++p)
         {
-            b32BitIndices = false;
-            outPrim.IB = std::make_shared<std::vector<byte>>(2 * indexCount);
-            indices = outPrim.IB->data();
-            uint16_t* tmp = (uint16_t*)indices;
-            for (uint16_t i = 0; i < indexCount; ++i)
-                tmp[i] = i;
+            const MeshletTriangle& tri = primitiveIndices[m.PrimOffset + p];
+            clusteredIndices.push_back(uniqueVertexIndices[m.VertOffset + tri.i0]);
+            clusteredIndices.push_back(uniqueVertexIndices[m.VertOffset + tri.i1]);
+            clusteredIndices.push_back(uniqueVertexIndices[m.VertOffset + tri.i2]);
+        }
+
+        cluster.bounds[0] = c.BoundingSphere.Center.x;
+        cluster.bounds[1] = c.BoundingSphere.Center.y;
+        cluster.bounds[2] = c.BoundingSphere.Center.z;
+        cluster.bounds[3] = c.BoundingSphere.Radius;
+
+        // Unpack the quantized cone.  A full cutoff marks a cone too wide to ever be back-facing.
+        const float axis[3] =
+        {
+            ((int)c.NormalCone.x - 128) / 127.0f,
+            ((int)c.NormalCone.y - 128) / 127.0f,
+            ((int)c.NormalCone.z - 128) / 127.0f,
+        };
+        cluster.coneCutoff = c.NormalCone.w == 255 ? 2.0f : c.NormalCone.w / 255.0f;
+        for (int j = 0; j < 3; ++j)
+        {
+            cluster.coneAxis[j] = axis[j];
+            cluster.coneApex[j] = cluster.bounds[j] - axis[j] * c.ApexOffset;
         }
     }
-    else
+
+    indices.swap(clusteredIndices);
+}
+
+// LODs stop once they would drop below this many triangles or fail to shrink by at least this much
+static const size_t kMinLODTriangles = 32;
+static const float kMinLODReduction = 0.75f;
+
+// Builds successively coarser index lists with 1/2, 1/4, and 1/8 of the full detail triangles and appends them
+// to 'indices' after the full detail list.  Every level indexes the same vertex buffer.
+static void BuildLODs(Renderer::Primitive& outPrim, std::vector<uint32_t>& indices, const byte* vertexData,
+    size_t vertexCount, uint32_t stride)
+{
+    std::memset(outPrim.lodPrimCount, 0, sizeof(outPrim.lodPrimCount));
+
+    // Targets are fractions of the full detail list, not of 'indices', which grows with every level
+    const size_t fullIndexCount = indices.size();
+    std::vector<uint32_t> previous(indices);
+    std::vector<uint32_t> simplified;
+    std::vector<uint32_t> optimized;
+
+    for (uint32_t level = 1; level < Mesh::kNumLODs; ++level)
     {
-        switch (inPrim.mode)
+        const size_t targetIndexCount = (fullIndexCount / 3 >> level) * 3;
+        if (targetIndexCount < kMinLODTriangles * 3)
+            break;
+
+        // Positions are the first element of every vertex
+        SimplifyMesh(previous.data(), previous.size(), vertexData, vertexCount, stride, targetIndexCount, simplified);
+        if (simplified.size() > previous.size() * kMinLODReduction)
         {
-        default:
-        case 0: // POINT LIST
-        case 1: // LINE LIST
-        case 2: // LINE LOOP
-        case 3: // LINE STRIP
-            LOG_ERROR("Found unsupported primitive topology.");
-            return;
-        case 4: // TRIANGLE LIST
+            LOG_DEBUGF("LOD %u of %zu triangles stopped at %zu of %zu target triangles", level, fullIndexCount / 3,
+                simplified.size() / 3, targetIndexCount / 3);
             break;
-        case 5: // TODO: Convert TRIANGLE STRIP
-        case 6: // TODO: Convert TRIANGLE FAN
-            LOG_ERROR("Found an index buffer that needs to be converted to a triangle list.");
-            return;
         }
 
-        indices = inPrim.indices->dataPtr;
-        indexCount = inPrim.indices->count;
+        LOG_DEBUGF("LOD %u of %zu triangles:  %zu triangles for a target of %zu", level, fullIndexCount / 3,
+            simplified.size() / 3, targetIndexCount / 3);
 
-        //if (maxIndex == 0)
-        //{
-        //    maxIndex = GetMaxIndex(inPrim);
-        //}
+        optimized.resize(simplified.size());
+        OptimizeFaces(simplified.data(), simplified.size(), optimized.data(), 32);
 
-        //b32BitIndices = maxIndex > 0xFFFF;
-        b32BitIndices = indexCount > 0xFFFF;
-        uint32_t indexSize = b32BitIndices ? 4 : 2;
+        outPrim.lodPrimCount[level - 1] = (uint32_t)optimized.size();
+        indices.insert(indices.end(), optimized.begin(), optimized.end());
+        previous.swap(optimized);
+    }
+}
 
-        outPrim.IB = std::make_shared<std::vector<byte>>(indexSize * indexCount);
+void OptimizeMesh(Renderer::Primitive& outPrim, const glTF::Primitive& inPrim, const Math::Matrix4& localToObject)
+{
+    ASSERT(inPrim.attributes[0] != nullptr, "Must have POSITION");
+    uint32_t vertexCount = inPrim.attributes[0]->count;
 
-        OptimizePrimitiveFaces(inPrim, b32BitIndices, outPrim);
+    std::vector<uint32_t> triangles;
+    uint32_t maxIndex;
+    if (!BuildTriangleList(inPrim, vertexCount, triangles, maxIndex))
+        return;
 
-        indices = outPrim.IB->data();
-    }
+    // The index width only depends on how many vertices are addressed, not how many indices there are
+    const uint32_t indexCount = (uint32_t)triangles.size();
+    const bool b32BitIndices = maxIndex > 0xFFFF;
+    outPrim.IB = std::make_shared<std::vector<byte>>((b32BitIndices ? 4 : 2) * indexCount);
+    OptimizePrimitiveFaces(triangles, b32BitIndices, outPrim);
+    triangles = std::vector<uint32_t>();
 
-    //ASSERT(maxIndex > 0);
+    const void* indices = outPrim.IB->data();
 
     const bool HasNormals = inPrim.attributes[glTF::Primitive::kNormal] != nullptr;
     const bool HasTangents = inPrim.attributes[glTF::Primitive::kTangent] != nullptr;
@@ -255,14 +555,20 @@ void OptimizeMesh(Renderer::Primitive& outPrim, const glTF::Primitive& inPrim, c
     const bool HasSkin = HasJoints && HasWeights;
     
     std::vector<D3D12_INPUT_ELEMENT_DESC> InputElements;
-    InputElements.push_back({"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, glTF::Primitive::kPosition});
+    InputElements.push_back({"POSITION", 0,
+        AccessorFormat(*inPrim.attributes[glTF::Primitive::kPosition]),
+        glTF::Primitive::kPosition });
     if (HasNormals)
     {
-        InputElements.push_back({"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, glTF::Primitive::kNormal });
+        InputElements.push_back({"NORMAL", 0,
+            AccessorFormat(*inPrim.attributes[glTF::Primitive::kNormal]),
+            glTF::Primitive::kNormal });
     }
     if (HasTangents)
     {
-        InputElements.push_back({"TANGENT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT,  glTF::Primitive::kTangent });
+        InputElements.push_back({"TANGENT", 0,
+            AccessorFormat(*inPrim.attributes[glTF::Primitive::kTangent]),
+            glTF::Primitive::kTangent });
     }
     if (HasUV0)
     {
@@ -373,7 +679,7 @@ void OptimizeMesh(Renderer::Primitive& outPrim, const glTF::Primitive& inPrim, c
     }
     else
     {
-        //ASSERT(maxIndex < vertexCount);
+        ASSERT(maxIndex < vertexCount);
         ASSERT(indexCount % 3 == 0);
 
         HRESULT hr = S_OK;
@@ -418,33 +724,15 @@ void OptimizeMesh(Renderer::Primitive& outPrim, const glTF::Primitive& inPrim, c
         ASSERT_SUCCEEDED(vbr.Read(weights.get(), "BLENDWEIGHT", 0, vertexCount));
     }
 
-    // Use VBWriter to generate a new, interleaved and compressed vertex buffer
-    std::vector<D3D12_INPUT_ELEMENT_DESC> OutputElements;
-
     outPrim.psoFlags = PSOFlags::kHasPosition | PSOFlags::kHasNormal;
-    OutputElements.push_back({"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT});
-    OutputElements.push_back({"NORMAL", 0, DXGI_FORMAT_R10G10B10A2_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT});
     if (tangent.get())
-    {
-        OutputElements.push_back({"TANGENT", 0, DXGI_FORMAT_R10G10B10A2_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT});
         outPrim.psoFlags |= PSOFlags::kHasTangent;
-    }
     if (texcoord0.get())
-    {
-        OutputElements.push_back({"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT});
         outPrim.psoFlags |= PSOFlags::kHasUV0;
-    }
     if (texcoord1.get())
-    {
-        OutputElements.push_back({"TEXCOORD", 1, DXGI_FORMAT_R16G16_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT});
         outPrim.psoFlags |= PSOFlags::kHasUV1;
-    }
     if (HasSkin)
-    {
-        OutputElements.push_back({ "BLENDINDICES", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
-        OutputElements.push_back({ "BLENDWEIGHT", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT });
         outPrim.psoFlags |= PSOFlags::kHasSkin;
-    }
     if (material.alphaBlend)
         outPrim.psoFlags |= PSOFlags::kAlphaBlend;
     if (material.alphaTest)
@@ -452,12 +740,16 @@ void OptimizeMesh(Renderer::Primitive& outPrim, const glTF::Primitive& inPrim, c
     if (material.twoSided)
         outPrim.psoFlags |= PSOFlags::kTwoSided;
 
+    // Use VBWriter to generate a new, interleaved and compressed vertex buffer
+    std::vector<D3D12_INPUT_ELEMENT_DESC> OutputElements;
+    GetVertexElements(outPrim.psoFlags, OutputElements);
+
     D3D12_INPUT_LAYOUT_DESC layout = {OutputElements.data(), (uint32_t)OutputElements.size()};
 
     VBWriter vbw;
     vbw.Initialize(layout);
 
-    uint32_t offsets[10];
+    uint32_t offsets[D3D12_IA_VERTEX_INPUT_STRUCTURE_ELEMENT_COUNT];
     uint32_t strides[D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
     ComputeInputLayout(layout, offsets, strides);
     uint32_t stride = strides[0];
@@ -480,23 +772,15 @@ void OptimizeMesh(Renderer::Primitive& outPrim, const glTF::Primitive& inPrim, c
     }
 
     // Now write a VB for positions only (or positions and UV when alpha testing)
-    uint32_t depthStride = 12;
     std::vector<D3D12_INPUT_ELEMENT_DESC> DepthElements;
-    DepthElements.push_back({"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT});
-    if (material.alphaTest)
-    {
-        depthStride += 4;
-        DepthElements.push_back({"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT});
-    }
-    if (HasSkin)
-    {
-        depthStride += 16;
-        DepthElements.push_back({ "BLENDINDICES", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
-        DepthElements.push_back({ "BLENDWEIGHT", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT });
-    }
+    GetDepthVertexElements(outPrim.psoFlags, DepthElements);
+
+    D3D12_INPUT_LAYOUT_DESC depthLayout = {DepthElements.data(), (uint32_t)DepthElements.size()};
+    ComputeInputLayout(depthLayout, offsets, strides);
+    uint32_t depthStride = strides[0];
 
     VBWriter dvbw;
-    dvbw.Initialize({DepthElements.data(), (uint32_t)DepthElements.size()});
+    dvbw.Initialize(depthLayout);
 
     outPrim.DepthVB = std::make_shared<std::vector<byte>>(depthStride * vertexCount);
     ASSERT_SUCCEEDED(dvbw.AddStream(outPrim.DepthVB->data(), vertexCount, 0, depthStride));
@@ -515,11 +799,344 @@ void OptimizeMesh(Renderer::Primitive& outPrim, const glTF::Primitive& inPrim, c
     ASSERT(material.index < 0x8000, "Only 15-bit material indices allowed");
 
     outPrim.vertexStride = (uint16_t)stride;
+    outPrim.depthVertexStride = (uint16_t)depthStride;
     outPrim.index32 = b32BitIndices ? 1 : 0;
     outPrim.materialIdx = material.index;
 
     outPrim.primCount = indexCount;
 
-    // TODO:  Generate optimized depth-only streams
+    // Both streams were written for every source vertex.  Weld and reorder each one against the optimized
+    // triangle order.  The depth stream has fewer attributes, so it welds across normal and UV seams and
+    // gets its own index buffer.
+    std::vector<uint32_t> optimizedIndices;
+    ReadIndexBuffer(outPrim.IB, b32BitIndices, optimizedIndices);
+
+    BuildClusters(outPrim, optimizedIndices, position.get(), vertexCount, localToObject);
+    outPrim.primCount = (uint32_t)optimizedIndices.size();
+
+    std::vector<uint32_t> depthIndices = optimizedIndices;
+    WeldAndReorderVertices(outPrim.VB, stride, optimizedIndices);
+    WeldAndReorderVertices(outPrim.DepthVB, depthStride, depthIndices);
+
+    // Both lists describe the same triangles, so they pair every full vertex with its depth vertex.  That
+    // lets the LODs, which are built against the full vertex buffer, be translated for the depth stream.
+    std::vector<uint32_t> fullToDepth(outPrim.VB->size() / stride);
+    for (size_t i = 0; i < optimizedIndices.size(); ++i)
+        fullToDepth[optimizedIndices[i]] = depthIndices[i];
+
+    BuildLODs(outPrim, optimizedIndices, outPrim.VB->data(), fullToDepth.size(), stride);
+    for (size_t i = depthIndices.size(); i < optimizedIndices.size(); ++i)
+        depthIndices.push_back(fullToDepth[optimizedIndices[i]]);
+
+    outPrim.IB = WriteIndexBuffer(optimizedIndices, b32BitIndices);
+    outPrim.DepthIB = WriteIndexBuffer(depthIndices, b32BitIndices);
+}
+
+
+// Octahedral encoding of unit vectors, after Cigolle et al., "A Survey of Efficient Representations for
+// Independent Unit Vectors" (JCGT 2014).  The decode must match OctahedralDecode() in Common.hlsli.
+static XMFLOAT2 OctahedralWrap(FXMVECTOR v)
+{
+    XMFLOAT3 n;
+    XMStoreFloat3(&n, v);
+    const float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    if (l1 == 0.0f)
+        return XMFLOAT2(0.0f, 0.0f);
+
+    const float invL1 = 1.0f / l1;
+    float x = n.x * invL1;
+    float y = n.y * invL1;
+    if (n.z < 0.0f)
+    {
+        const float wx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        const float wy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = wx;
+        y = wy;
+    }
+    return XMFLOAT2(x, y);
+}
+
+static XMVECTOR OctahedralUnwrap(float x, float y)
+{
+    const float z = 1.0f - fabsf(x) - fabsf(y);
+    const float t = std::max(-z, 0.0f);
+    x += x >= 0.0f ? -t : t;
+    y += y >= 0.0f ? -t : t;
+    return XMVector3Normalize(XMVectorSet(x, y, z, 0.0f));
+}
+
+// Quantizes the octahedral coordinates of v to xSteps and ySteps intervals across [-1, 1].  Of the four
+// codes surrounding the exact coordinates, this keeps the one that decodes closest to v, which is noticeably
+// better than rounding each coordinate on its own.
+static XMVECTOR EncodeOctahedral(FXMVECTOR v, uint32_t xSteps, uint32_t ySteps, uint32_t& codeX, uint32_t& codeY)
+{
+    const XMFLOAT2 f = OctahedralWrap(v);
+    const uint32_t baseX = std::min((uint32_t)((f.x + 1.0f) * 0.5f * xSteps), xSteps);
+    const uint32_t baseY = std::min((uint32_t)((f.y + 1.0f) * 0.5f * ySteps), ySteps);
+
+    XMVECTOR best = XMVectorZero();
+    float bestDot = -2.0f;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        const uint32_t x = std::min(baseX + (i & 1), xSteps);
+        const uint32_t y = std::min(baseY + (i >> 1), ySteps);
+        const XMVECTOR decoded = OctahedralUnwrap(x * 2.0f / xSteps - 1.0f, y * 2.0f / ySteps - 1.0f);
+        const float d = XMVectorGetX(XMVector3Dot(v, decoded));
+        if (d > bestDot)
+        {
+            bestDot = d;
+            best = decoded;
+            codeX = x;
+            codeY = y;
+        }
+    }
+    return best;
+}
+
+static float AngleInDegrees(FXMVECTOR a, FXMVECTOR b)
+{
+    const float d = std::min(std::max(XMVectorGetX(XMVector3Dot(a, b)), -1.0f), 1.0f);
+    return XMConvertToDegrees(acosf(d));
+}
+
+// Positions become 16-bit fractions of the bounding box, decoded as code / 65535 * extent + min
+static void QuantizePositions(const XMFLOAT3* positions, size_t count, const AxisAlignedBox& bounds,
+    std::vector<uint16_t>& codes, float& maxError)
+{
+    const XMVECTOR minPos = bounds.GetMin();
+    const XMVECTOR extent = bounds.GetDimensions();
+
+    // Flat axes always get a code of zero
+    const XMVECTOR invExtent = XMVectorSelect(XMVectorReciprocal(extent), XMVectorZero(),
+        XMVectorEqual(extent, XMVectorZero()));
+
+    codes.resize(count * 4);
+    for (size_t v = 0; v < count; ++v)
+    {
+        const XMVECTOR p = XMLoadFloat3(&positions[v]);
+        const XMVECTOR q = XMVectorRound(XMVectorScale(XMVectorSaturate(XMVectorMultiply(XMVectorSubtract(p, minPos), invExtent)), 65535.0f));
+
+        XMFLOAT3 code;
+        XMStoreFloat3(&code, q);
+        codes[v * 4 + 0] = (uint16_t)code.x;
+        codes[v * 4 + 1] = (uint16_t)code.y;
+        codes[v * 4 + 2] = (uint16_t)code.z;
+        codes[v * 4 + 3] = 0;
+
+        const XMVECTOR decoded = XMVectorMultiplyAdd(XMVectorScale(q, 1.0f / 65535.0f), extent, minPos);
+        maxError = std::max(maxError, XMVectorGetX(XMVector3Length(XMVectorSubtract(decoded, p))));
+    }
+}
+
+static uint32_t ElementSize(DXGI_FORMAT format)
+{
+    switch (format)
+    {
+    case DXGI_FORMAT_R32G32B32_FLOAT:    return 12;
+    case DXGI_FORMAT_R16G16B16A16_UNORM:
+    case DXGI_FORMAT_R16G16B16A16_UINT:  return 8;
+    default:                             return 4;
+    }
+}
+
+// An element of a rewritten vertex stream that was encoded ahead of time, one tightly packed value per vertex
+struct EncodedElement
+{
+    const char* semantic;
+    uint32_t semanticIndex;
+    const void* data;
+};
+
+// Builds a vertex stream in a new layout.  Elements listed in 'encoded' come from there and every other element is
+// copied unchanged from the source stream.
+static Utility::ByteArray RewriteVertices(const std::vector<byte>& source,
+    const std::vector<D3D12_INPUT_ELEMENT_DESC>& sourceElements, const std::vector<D3D12_INPUT_ELEMENT_DESC>& destElements,
+    const std::vector<EncodedElement>& encoded, uint32_t& destStride)
+{
+    uint32_t sourceOffsets[D3D12_IA_VERTEX_INPUT_STRUCTURE_ELEMENT_COUNT];
+    uint32_t destOffsets[D3D12_IA_VERTEX_INPUT_STRUCTURE_ELEMENT_COUNT];
+    uint32_t strides[D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+    ComputeInputLayout({sourceElements.data(), (uint32_t)sourceElements.size()}, sourceOffsets, strides);
+    const uint32_t sourceStride = strides[0];
+    ComputeInputLayout({destElements.data(), (uint32_t)destElements.size()}, destOffsets, strides);
+    destStride = strides[0];
+
+    const size_t vertexCount = source.size() / sourceStride;
+    Utility::ByteArray dest = std::make_shared<std::vector<byte>>(vertexCount * destStride);
+
+    for (size_t e = 0; e < destElements.size(); ++e)
+    {
+        const D3D12_INPUT_ELEMENT_DESC& element = destElements[e];
+        const uint32_t elementSize = ElementSize(element.Format);
+
+        const byte* src = nullptr;
+        size_t srcStride = elementSize;
+        for (const EncodedElement& enc : encoded)
+        {
+            if (strcmp(enc.semantic, element.SemanticName) == 0 && enc.semanticIndex == element.SemanticIndex)
+                src = (const byte*)enc.data;
+        }
+        for (size_t s = 0; src == nullptr && s < sourceElements.size(); ++s)
+        {
+            if (strcmp(sourceElements[s].SemanticName, element.SemanticName) == 0 &&
+                sourceElements[s].SemanticIndex == element.SemanticIndex)
+            {
+                ASSERT(sourceElements[s].Format == element.Format);
+                src = source.data() + sourceOffsets[s];
+                srcStride = sourceStride;
+            }
+        }
+        ASSERT(src != nullptr, "Vertex element %s%u has no source", element.SemanticName, element.SemanticIndex);
+
+        byte* dst = dest->data() + destOffsets[e];
+        for (size_t v = 0; v < vertexCount; ++v)
+            std::memcpy(dst + v * destStride, src + v * srcStride, elementSize);
+    }
+
+    return dest;
 }
 
+void QuantizeVertices(Renderer::Primitive& prim, uint32_t quantization, const AxisAlignedBox& bounds,
+    Renderer::VertexQuantizationReport& report)
+{
+    using namespace PSOFlags;
+
+    report.bytesBefore += prim.VB->size() + prim.DepthVB->size();
+
+    std::vector<D3D12_INPUT_ELEMENT_DESC> elements, depthElements;
+    GetVertexElements(prim.psoFlags, elements);
+    GetDepthVertexElements(prim.psoFlags, depthElements);
+
+    const size_t vertexCount = prim.VB->size() / prim.vertexStride;
+    const size_t depthVertexCount = prim.DepthVB->size() / prim.depthVertexStride;
+
+    VBReader vbr;
+    vbr.Initialize({elements.data(), (uint32_t)elements.size()});
+    ASSERT_SUCCEEDED(vbr.AddStream(prim.VB->data(), vertexCount, 0, prim.vertexStride));
+
+    uint16_t psoFlags = prim.psoFlags;
+    std::vector<EncodedElement> encoded;
+    std::vector<EncodedElement> depthEncoded;
+
+    std::vector<uint16_t> positionCodes;
+    std::vector<uint16_t> depthPositionCodes;
+    if (quantization & Renderer::VertexQuantization::kPositions)
+    {
+        psoFlags |= kQuantizedPosition;
+
+        std::unique_ptr<XMFLOAT3[]> positions(new XMFLOAT3[std::max(vertexCount, depthVertexCount)]);
+        ASSERT_SUCCEEDED(vbr.Read(positions.get(), "POSITION", 0, vertexCount));
+        QuantizePositions(positions.get(), vertexCount, bounds, positionCodes, report.maxPositionError);
+        encoded.push_back({"POSITION", 0, positionCodes.data()});
+
+        // Both streams quantize the same way, so the depth pass produces exactly the same depths as the color pass
+        VBReader dvbr;
+        dvbr.Initialize({depthElements.data(), (uint32_t)depthElements.size()});
+        ASSERT_SUCCEEDED(dvbr.AddStream(prim.DepthVB->data(), depthVertexCount, 0, prim.depthVertexStride));
+        ASSERT_SUCCEEDED(dvbr.Read(positions.get(), "POSITION", 0, depthVertexCount));
+        QuantizePositions(positions.get(), depthVertexCount, bounds, depthPositionCodes, report.maxPositionError);
+        depthEncoded.push_back({"POSITION", 0, depthPositionCodes.data()});
+    }
+
+    // Normal in xy and tangent in zw.  The tangent's x coordinate gives up a bit to carry the handedness
+    // in its sign, so it is stored as a magnitude of 1 to 127.  DecodeOctahedralTangent() in Common.hlsli
+    // reverses this.
+    std::vector<int8_t> normalCodes;
+    if (quantization & Renderer::VertexQuantization::kNormals)
+    {
+        psoFlags |= kOctahedralNormal;
+
+        std::unique_ptr<XMFLOAT3[]> normals(new XMFLOAT3[vertexCount]);
+        std::unique_ptr<XMFLOAT4[]> tangents;
+        ASSERT_SUCCEEDED(vbr.Read(normals.get(), "NORMAL", 0, vertexCount, true));
+        if (prim.psoFlags & kHasTangent)
+        {
+            tangents.reset(new XMFLOAT4[vertexCount]);
+            ASSERT_SUCCEEDED(vbr.Read(tangents.get(), "TANGENT", 0, vertexCount, true));
+        }
+
+        normalCodes.resize(vertexCount * 4, 0);
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            uint32_t x, y;
+            const XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&normals[v]));
+            report.maxNormalError = std::max(report.maxNormalError, AngleInDegrees(n, EncodeOctahedral(n, 254, 254, x, y)));
+            normalCodes[v * 4 + 0] = (int8_t)((int)x - 127);
+            normalCodes[v * 4 + 1] = (int8_t)((int)y - 127);
+
+            if (tangents)
+            {
+                const XMVECTOR t = XMVector3Normalize(XMLoadFloat4(&tangents[v]));
+                report.maxTangentError = std::max(report.maxTangentError, AngleInDegrees(t, EncodeOctahedral(t, 126, 254, x, y)));
+                normalCodes[v * 4 + 2] = (int8_t)(tangents[v].w < 0.0f ? -(int)(x + 1) : (int)(x + 1));
+                normalCodes[v * 4 + 3] = (int8_t)((int)y - 127);
+            }
+        }
+        encoded.push_back({"NORMAL", 0, normalCodes.data()});
+    }
+
+    // UNORM can only hold texture coordinates that don't wrap, and every set must fit since they share a format
+    std::vector<uint16_t> texcoordCodes[2];
+    const uint32_t texcoordFlags[2] = { kHasUV0, kHasUV1 };
+    if ((quantization & Renderer::VertexQuantization::kTexcoords) && (prim.psoFlags & (kHasUV0 | kHasUV1)))
+    {
+        std::unique_ptr<XMFLOAT2[]> texcoords[2];
+        bool fits = true;
+        for (uint32_t set = 0; set < 2; ++set)
+        {
+            if ((prim.psoFlags & texcoordFlags[set]) == 0)
+                continue;
+
+            texcoords[set].reset(new XMFLOAT2[vertexCount]);
+            ASSERT_SUCCEEDED(vbr.Read(texcoords[set].get(), "TEXCOORD", set, vertexCount));
+            for (size_t v = 0; v < vertexCount && fits; ++v)
+            {
+                const XMFLOAT2& uv = texcoords[set][v];
+                fits = uv.x >= 0.0f && uv.x <= 1.0f && uv.y >= 0.0f && uv.y <= 1.0f;
+            }
+        }
+
+        if (fits)
+        {
+            psoFlags |= kUNormTexcoord;
+            for (uint32_t set = 0; set < 2; ++set)
+            {
+                if (!texcoords[set])
+                    continue;
+
+                texcoordCodes[set].resize(vertexCount * 2);
+                for (size_t v = 0; v < vertexCount; ++v)
+                {
+                    const XMFLOAT2& uv = texcoords[set][v];
+                    const uint16_t u = (uint16_t)(uv.x * 65535.0f + 0.5f);
+                    const uint16_t w = (uint16_t)(uv.y * 65535.0f + 0.5f);
+                    texcoordCodes[set][v * 2 + 0] = u;
+                    texcoordCodes[set][v * 2 + 1] = w;
+                    report.maxTexcoordError = std::max(report.maxTexcoordError,
+                        std::max(fabsf(u / 65535.0f - uv.x), fabsf(w / 65535.0f - uv.y)));
+                }
+                encoded.push_back({"TEXCOORD", set, texcoordCodes[set].data()});
+            }
+        }
+        else
+        {
+            ++report.texcoordsKept;
+        }
+    }
+
+    if (psoFlags != prim.psoFlags)
+    {
+        std::vector<D3D12_INPUT_ELEMENT_DESC> newElements, newDepthElements;
+        GetVertexElements(psoFlags, newElements);
+        GetDepthVertexElements(psoFlags, newDepthElements);
+
+        uint32_t stride, depthStride;
+        prim.VB = RewriteVertices(*prim.VB, elements, newElements, encoded, stride);
+        prim.DepthVB = RewriteVertices(*prim.DepthVB, depthElements, newDepthElements, depthEncoded, depthStride);
+        prim.vertexStride = (uint16_t)stride;
+        prim.depthVertexStride = (uint16_t)depthStride;
+        prim.psoFlags = psoFlags;
+    }
+
+    report.bytesAfter += prim.VB->size() + prim.DepthVB->size();
+}
@@ -14,11 +14,14 @@
 #pragma once
 
 #include "glTF.h"
+#include "Model.h"
+#include "ModelLoader.h"
 #include "../Core/Math/BoundingSphere.h"
 #include "../Core/Math/BoundingBox.h"
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 namespace Renderer
 {
@@ -33,7 +36,9 @@ namespace Renderer
         Utility::ByteArray VB;
         Utility::ByteArray IB;
         Utility::ByteArray DepthVB;
+        Utility::ByteArray DepthIB;    // Same format and triangle order as IB, but indexes DepthVB
         uint32_t primCount;
+        uint32_t lodPrimCount[Mesh::kNumLODs - 1];  // Coarser LODs follow primCount indices in IB and DepthIB
         union
         {
             uint32_t hash;
@@ -44,7 +49,15 @@ namespace Renderer
             };
         };
         uint16_t vertexStride;
+        uint16_t depthVertexStride;
+        std::vector<MeshCluster> clusters;  // startIndex is relative to this primitive's first index
     };
 }
 
-void OptimizeMesh( Renderer::Primitive& outPrim, const glTF::Primitive& inPrim, const Math::Matrix4& localToObject );
\ No newline at end of file
+void OptimizeMesh( Renderer::Primitive& outPrim, const glTF::Primitive& inPrim, const Math::Matrix4& localToObject );
+
+// Converts a primitive's vertex streams to the formats selected by 'quantization' (VertexQuantization options)
+// and updates its PSO flags and strides to match.  Positions are stored relative to 'bounds', which must contain
+// the primitive and be shared by every primitive drawn with the same MeshConstants.
+void QuantizeVertices( Renderer::Primitive& prim, uint32_t quantization, const Math::AxisAlignedBox& bounds,
+    Renderer::VertexQuantizationReport& report );
@@ -0,0 +1,278 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+// Edge collapse simplification driven by quadric error metrics, after Garland and Heckbert, "Surface
+// Simplification Using Quadric Error Metrics" (SIGGRAPH 1997).  Collapses are restricted to existing
+// vertices (no new positions are solved for) so that the vertex buffer can be shared by every LOD.
+//
+
+#include "../Core/Utility.h"
+
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "MeshSimplify.h"
+
+namespace
+{
+    // Symmetric 4x4 matrix stored as its upper triangle
+    struct Quadric
+    {
+        double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+        void AddPlane(double a, double b, double c, double d, double weight)
+        {
+            a2 += weight * a * a; ab += weight * a * b; ac += weight * a * c; ad += weight * a * d;
+            b2 += weight * b * b; bc += weight * b * c; bd += weight * b * d;
+            c2 += weight * c * c; cd += weight * c * d;
+            d2 += weight * d * d;
+        }
+
+        void Add(const Quadric& q)
+        {
+            a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+            b2 += q.b2; bc += q.bc; bd += q.bd;
+            c2 += q.c2; cd += q.cd;
+            d2 += q.d2;
+        }
+
+        // Sum of squared distances from p to every accumulated plane
+        double Evaluate(const float* p) const
+        {
+            const double x = p[0], y = p[1], z = p[2];
+            return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                + c2 * z * z + 2 * cd * z
+                + d2;
+        }
+    };
+
+    struct Collapse
+    {
+        float cost;
+        uint32_t from;
+        uint32_t to;
+
+        bool operator<(const Collapse& rhs) const { return cost < rhs.cost; }
+    };
+
+    inline void Cross(const float* u, const float* v, float* out)
+    {
+        out[0] = u[1] * v[2] - u[2] * v[1];
+        out[1] = u[2] * v[0] - u[0] * v[2];
+        out[2] = u[0] * v[1] - u[1] * v[0];
+    }
+
+    inline void TriangleNormal(const float* p0, const float* p1, const float* p2, float* n)
+    {
+        const float e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        const float e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        Cross(e0, e1, n);
+    }
+
+    class PositionStream
+    {
+    public:
+        PositionStream(const void* data, size_t stride) : m_Data((const uint8_t*)data), m_Stride(stride) {}
+        const float* operator[](size_t i) const { return (const float*)(m_Data + i * m_Stride); }
+
+    private:
+        const uint8_t* m_Data;
+        size_t m_Stride;
+    };
+
+    // Returns true if moving 'from' onto 'to' would flip or collapse any triangle that survives
+    bool CollapseFoldsTriangles(const PositionStream& positions, const uint32_t* indices,
+        const uint32_t* triangles, uint32_t triangleCount, uint32_t from, uint32_t to)
+    {
+        for (uint32_t t = 0; t < triangleCount; ++t)
+        {
+            const uint32_t* tri = indices + triangles[t] * 3;
+
+            // Triangles sharing the edge disappear
+            if (tri[0] == to || tri[1] == to || tri[2] == to)
+                continue;
+
+            float before[3], after[3];
+            TriangleNormal(positions[tri[0]], positions[tri[1]], positions[tri[2]], before);
+            TriangleNormal(
+                positions[tri[0] == from ? to : tri[0]],
+                positions[tri[1] == from ? to : tri[1]],
+                positions[tri[2] == from ? to : tri[2]], after);
+
+            const float dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+            if (dot <= 0.0f)
+                return true;
+        }
+        return false;
+    }
+}
+
+void SimplifyMesh(const uint32_t* indexList, size_t indexCount, const void* positionData, size_t vertexCount,
+    size_t positionStride, size_t targetIndexCount, std::vector<uint32_t>& newIndexList)
+{
+    ASSERT(indexCount % 3 == 0);
+
+    newIndexList.assign(indexList, indexList + indexCount);
+    if (indexCount <= targetIndexCount)
+        return;
+
+    const PositionStream positions(positionData, positionStride);
+
+    // Accumulate the planes of every triangle into its vertices, weighted by area
+    std::vector<Quadric> quadrics(vertexCount, Quadric());
+    for (size_t i = 0; i < indexCount; i += 3)
+    {
+        const float* p0 = positions[indexList[i]];
+        float n[3];
+        TriangleNormal(p0, positions[indexList[i + 1]], positions[indexList[i + 2]], n);
+
+        const float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0f)
+            continue;
+
+        const double a = n[0] / length, b = n[1] / length, c = n[2] / length;
+        const double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+        for (size_t j = 0; j < 3; ++j)
+            quadrics[indexList[i + j]].AddPlane(a, b, c, d, length * 0.5);
+    }
+
+    // Lock every vertex touching an edge that isn't shared by exactly two triangles
+    std::vector<uint8_t> locked(vertexCount, 0);
+    {
+        std::unordered_map<uint64_t, uint32_t> edgeUseCount;
+        edgeUseCount.reserve(indexCount);
+        for (size_t i = 0; i < indexCount; i += 3)
+        {
+            for (size_t j = 0; j < 3; ++j)
+            {
+                const uint32_t v0 = indexList[i + j];
+                const uint32_t v1 = indexList[i + (j + 1) % 3];
+                const uint64_t key = v0 < v1 ? (uint64_t)v0 << 32 | v1 : (uint64_t)v1 << 32 | v0;
+                ++edgeUseCount[key];
+            }
+        }
+
+        for (const auto& edge : edgeUseCount)
+        {
+            if (edge.second != 2)
+            {
+                locked[edge.first >> 32] = 1;
+                locked[edge.first & 0xFFFFFFFF] = 1;
+            }
+        }
+    }
+
+    std::vector<Collapse> candidates;
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1);
+    std::vector<uint32_t> vertexTriangles;
+    std::vector<uint8_t> touched(vertexCount);
+    std::vector<uint32_t> remap(vertexCount);
+
+    while (newIndexList.size() > targetIndexCount)
+    {
+        const uint32_t* indices = newIndexList.data();
+        const uint32_t triangleCount = (uint32_t)(newIndexList.size() / 3);
+
+        // Vertex to triangle adjacency for the current list
+        std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+        for (uint32_t index : newIndexList)
+            ++triangleOffsets[index + 1];
+        for (size_t v = 0; v < vertexCount; ++v)
+            triangleOffsets[v + 1] += triangleOffsets[v];
+        vertexTriangles.resize(newIndexList.size());
+        {
+            std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+            for (uint32_t t = 0; t < triangleCount; ++t)
+                for (uint32_t j = 0; j < 3; ++j)
+                    vertexTriangles[fill[indices[t * 3 + j]]++] = t;
+        }
+
+        // Every directed edge is a candidate, costed at the destination vertex
+        candidates.clear();
+        for (uint32_t t = 0; t < triangleCount; ++t)
+        {
+            for (uint32_t j = 0; j < 3; ++j)
+            {
+                const uint32_t from = indices[t * 3 + j];
+                const uint32_t to = indices[t * 3 + (j + 1) % 3];
+                if (locked[from])
+                    continue;
+
+                Quadric q = quadrics[from];
+                q.Add(quadrics[to]);
+                candidates.push_back({ (float)q.Evaluate(positions[to]), from, to });
+            }
+        }
+
+        if (candidates.empty())
+            break;
+
+        std::sort(candidates.begin(), candidates.end());
+
+        // Each collapse removes about two triangles.  Take the cheapest collapses whose neighborhoods don't
+        // overlap, so that every decision in this pass is made against up-to-date geometry.
+        size_t collapsesWanted = std::max<size_t>(1, (newIndexList.size() - targetIndexCount) / 6);
+        size_t collapsesMade = 0;
+
+        std::fill(touched.begin(), touched.end(), 0);
+        for (uint32_t v = 0; v < vertexCount; ++v)
+            remap[v] = v;
+
+        for (const Collapse& c : candidates)
+        {
+            if (collapsesMade == collapsesWanted)
+                break;
+
+            if (touched[c.from] || touched[c.to])
+                continue;
+
+            const uint32_t* fromTriangles = vertexTriangles.data() + triangleOffsets[c.from];
+            const uint32_t fromTriangleCount = triangleOffsets[c.from + 1] - triangleOffsets[c.from];
+            if (CollapseFoldsTriangles(positions, indices, fromTriangles, fromTriangleCount, c.from, c.to))
+                continue;
+
+            remap[c.from] = c.to;
+            quadrics[c.to].Add(quadrics[c.from]);
+            ++collapsesMade;
+
+            // Freeze the whole neighborhood of the moved vertex for the rest of this pass
+            for (uint32_t t = 0; t < fromTriangleCount; ++t)
+            {
+                const uint32_t* tri = indices + fromTriangles[t] * 3;
+                touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+            }
+        }
+
+        if (collapsesMade == 0)
+            break;
+
+        // Apply the collapses and drop triangles that became degenerate
+        size_t writeIdx = 0;
+        for (size_t i = 0; i < newIndexList.size(); i += 3)
+        {
+            const uint32_t i0 = remap[newIndexList[i]];
+            const uint32_t i1 = remap[newIndexList[i + 1]];
+            const uint32_t i2 = remap[newIndexList[i + 2]];
+            if (i0 == i1 || i1 == i2 || i2 == i0)
+                continue;
+
+            newIndexList[writeIdx++] = i0;
+            newIndexList[writeIdx++] = i1;
+            newIndexList[writeIdx++] = i2;
+        }
+        newIndexList.resize(writeIdx);
+    }
+}
@@ -0,0 +1,46 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//  SimplifyMesh
+//-----------------------------------------------------------------------------
+//  Reduces a triangle list by collapsing edges in order of quadric error.
+//  Vertices are only ever collapsed onto other existing vertices, so the
+//  result indexes the same vertex buffer as the input.  Vertices on open or
+//  non-manifold edges never move, which keeps mesh borders and attribute
+//  seams (where vertices are split) intact.
+//
+//  Parameters:
+//      indexList
+//          input triangle list
+//      indexCount
+//          the number of indices in the list
+//      positions
+//          the first vertex position (three floats)
+//      vertexCount
+//          the number of vertices
+//      positionStride
+//          bytes between consecutive positions
+//      targetIndexCount
+//          stop once the list has this many indices or fewer
+//      newIndexList
+//          receives the simplified list, which may stop short of the target
+//          if no more edges can be collapsed without folding triangles over
+//-----------------------------------------------------------------------------
+void SimplifyMesh(const uint32_t* indexList, size_t indexCount, const void* positions, size_t vertexCount,
+    size_t positionStride, size_t targetIndexCount, std::vector<uint32_t>& newIndexList);
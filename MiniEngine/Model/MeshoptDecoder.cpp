@@ -0,0 +1,638 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+// Decoders for the bitstreams defined by EXT_meshopt_compression (version 0 of the vertex codec and
+// versions 0 and 1 of the index codecs).  The vertex codec stores each byte of an element as a separate
+// stream of zigzag-encoded deltas, so the delta and prefix sum for 16 vertices at a time run in SSE2.
+//
+
+#include "../Core/Utility.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <emmintrin.h>
+
+#include "MeshoptDecoder.h"
+
+using namespace MeshoptDecoder;
+
+namespace
+{
+    const uint8_t kVertexHeader = 0xA0;
+    const uint8_t kIndexHeader = 0xE0;
+    const uint8_t kSequenceHeader = 0xD0;
+
+    const size_t kVertexBlockSizeBytes = 8192;
+    const size_t kVertexBlockMaxSize = 256;
+    const size_t kByteGroupSize = 16;
+    const size_t kByteGroupDecodeLimit = 24;
+    const size_t kTailMinSize = 32;
+
+    size_t GetVertexBlockSize(size_t stride)
+    {
+        size_t result = (kVertexBlockSizeBytes / stride) & ~(kByteGroupSize - 1);
+        return result < kVertexBlockMaxSize ? result : kVertexBlockMaxSize;
+    }
+
+    // 16 values of 0, 2, 4 or 8 bits.  With 2 or 4 bits, the all-ones value means the real byte follows
+    // the packed bits.
+    const uint8_t* DecodeBytesGroup(const uint8_t* data, uint8_t* dest, int bitsLog2)
+    {
+        switch (bitsLog2)
+        {
+        case 0:
+            memset(dest, 0, kByteGroupSize);
+            return data;
+
+        case 1:
+        case 2:
+        {
+            const uint32_t bits = 1u << bitsLog2;
+            const uint32_t sentinel = (1u << bits) - 1;
+            const uint8_t* extra = data + bits * 2;
+            for (size_t i = 0; i < kByteGroupSize; ++i)
+            {
+                const uint32_t shift = 8 - bits - (uint32_t)(i * bits % 8);
+                const uint32_t value = data[i * bits / 8] >> shift & sentinel;
+                dest[i] = value == sentinel ? *extra++ : (uint8_t)value;
+            }
+            return extra;
+        }
+
+        default:
+            memcpy(dest, data, kByteGroupSize);
+            return data + kByteGroupSize;
+        }
+    }
+
+    const uint8_t* DecodeBytes(const uint8_t* data, const uint8_t* dataEnd, uint8_t* dest, size_t count)
+    {
+        ASSERT(count % kByteGroupSize == 0);
+
+        // Two bits per group select its encoding
+        const uint8_t* header = data;
+        const size_t headerSize = (count / kByteGroupSize + 3) / 4;
+        if ((size_t)(dataEnd - data) < headerSize)
+            return nullptr;
+
+        data += headerSize;
+
+        for (size_t i = 0; i < count; i += kByteGroupSize)
+        {
+            if ((size_t)(dataEnd - data) < kByteGroupDecodeLimit)
+                return nullptr;
+
+            const size_t group = i / kByteGroupSize;
+            const int bitsLog2 = header[group / 4] >> (group % 4 * 2) & 3;
+            data = DecodeBytesGroup(data, dest + i, bitsLog2);
+        }
+
+        return data;
+    }
+
+    // Undo the zigzag encoding and integrate the deltas, 16 bytes at a time.  'last' carries the running
+    // value between groups.
+    uint8_t UnzigzagPrefixSum(uint8_t* bytes, size_t count, uint8_t last)
+    {
+        const __m128i one = _mm_set1_epi8(1);
+        const __m128i lowSevenBits = _mm_set1_epi8(0x7F);
+
+        for (size_t i = 0; i < count; i += kByteGroupSize)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(bytes + i));
+
+            // (v >> 1) ^ -(v & 1), with the byte shift built from a 16-bit shift
+            const __m128i sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(v, one));
+            v = _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(v, 1), lowSevenBits), sign);
+
+            v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+            v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+            v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+            v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+            v = _mm_add_epi8(v, _mm_set1_epi8((char)last));
+
+            _mm_storeu_si128((__m128i*)(bytes + i), v);
+            last = bytes[i + kByteGroupSize - 1];
+        }
+
+        return last;
+    }
+
+    const uint8_t* DecodeVertexBlock(const uint8_t* data, const uint8_t* dataEnd, uint8_t* dest,
+        size_t count, size_t stride, uint8_t lastVertex[256])
+    {
+        __declspec(align(16)) uint8_t bytes[kVertexBlockMaxSize];
+        const size_t alignedCount = (count + kByteGroupSize - 1) & ~(kByteGroupSize - 1);
+
+        for (size_t k = 0; k < stride; ++k)
+        {
+            data = DecodeBytes(data, dataEnd, bytes, alignedCount);
+            if (data == nullptr)
+                return nullptr;
+
+            UnzigzagPrefixSum(bytes, alignedCount, lastVertex[k]);
+
+            uint8_t* out = dest + k;
+            for (size_t i = 0; i < count; ++i, out += stride)
+                *out = bytes[i];
+
+            lastVertex[k] = bytes[count - 1];
+        }
+
+        return data;
+    }
+
+    bool DecodeVertexBuffer(uint8_t* dest, size_t count, size_t stride, const uint8_t* source, size_t sourceSize)
+    {
+        if (stride == 0 || stride > 256 || stride % 4 != 0)
+            return false;
+
+        const uint8_t* data = source;
+        const uint8_t* dataEnd = source + sourceSize;
+        if (sourceSize < 1 + stride)
+            return false;
+
+        if ((*data & 0xF0) != kVertexHeader || (*data & 0x0F) > 0)
+            return false;
+        ++data;
+
+        // The first vertex is predicted from the tail of the stream
+        uint8_t lastVertex[256];
+        memcpy(lastVertex, dataEnd - stride, stride);
+
+        const size_t blockSize = GetVertexBlockSize(stride);
+        for (size_t offset = 0; offset < count; offset += blockSize)
+        {
+            const size_t blockCount = offset + blockSize < count ? blockSize : count - offset;
+            data = DecodeVertexBlock(data, dataEnd, dest + offset * stride, blockCount, stride, lastVertex);
+            if (data == nullptr)
+                return false;
+        }
+
+        const size_t tailSize = stride < kTailMinSize ? kTailMinSize : stride;
+        return (size_t)(dataEnd - data) == tailSize;
+    }
+
+    inline uint32_t DecodeVByte(const uint8_t*& data)
+    {
+        uint8_t lead = *data++;
+        if (lead < 128)
+            return lead;
+
+        uint32_t result = lead & 127;
+        uint32_t shift = 7;
+        for (int i = 0; i < 4; ++i)
+        {
+            uint8_t group = *data++;
+            result |= (uint32_t)(group & 127) << shift;
+            shift += 7;
+            if (group < 128)
+                break;
+        }
+        return result;
+    }
+
+    inline uint32_t DecodeIndex(const uint8_t*& data, uint32_t last)
+    {
+        const uint32_t v = DecodeVByte(data);
+        return last + ((v >> 1) ^ (0u - (v & 1)));
+    }
+
+    inline void WriteTriangle(void* dest, size_t offset, size_t indexSize, uint32_t a, uint32_t b, uint32_t c)
+    {
+        if (indexSize == 2)
+        {
+            uint16_t* out = (uint16_t*)dest + offset;
+            out[0] = (uint16_t)a;
+            out[1] = (uint16_t)b;
+            out[2] = (uint16_t)c;
+        }
+        else
+        {
+            uint32_t* out = (uint32_t*)dest + offset;
+            out[0] = a;
+            out[1] = b;
+            out[2] = c;
+        }
+    }
+
+    class IndexFifos
+    {
+    public:
+        IndexFifos() : m_EdgeOffset(0), m_VertexOffset(0)
+        {
+            memset(m_Edges, -1, sizeof(m_Edges));
+            memset(m_Vertices, -1, sizeof(m_Vertices));
+        }
+
+        void PushEdge(uint32_t a, uint32_t b)
+        {
+            m_Edges[m_EdgeOffset][0] = a;
+            m_Edges[m_EdgeOffset][1] = b;
+            m_EdgeOffset = (m_EdgeOffset + 1) & 15;
+        }
+
+        void PushVertex(uint32_t v, bool advance = true)
+        {
+            m_Vertices[m_VertexOffset] = v;
+            m_VertexOffset = (m_VertexOffset + (advance ? 1 : 0)) & 15;
+        }
+
+        // Edges are looked up relative to the newest one, vertices relative to the next free slot
+        const uint32_t* Edge(uint32_t i) const { return m_Edges[(m_EdgeOffset - 1 - i) & 15]; }
+        uint32_t Vertex(uint32_t i) const { return m_Vertices[(m_VertexOffset - i) & 15]; }
+
+    private:
+        uint32_t m_Edges[16][2];
+        uint32_t m_Vertices[16];
+        size_t m_EdgeOffset;
+        size_t m_VertexOffset;
+    };
+
+    bool DecodeIndexBuffer(void* dest, size_t count, size_t indexSize, const uint8_t* source, size_t sourceSize)
+    {
+        // Header, one code per triangle, and the 16-byte auxiliary code table
+        if (count % 3 != 0 || sourceSize < 1 + count / 3 + 16)
+            return false;
+
+        if ((source[0] & 0xF0) != kIndexHeader)
+            return false;
+        const uint32_t version = source[0] & 0x0F;
+        if (version > 1)
+            return false;
+
+        IndexFifos fifos;
+        uint32_t next = 0;
+        uint32_t last = 0;
+        const uint32_t fecMax = version >= 1 ? 13 : 15;
+
+        const uint8_t* code = source + 1;
+        const uint8_t* data = code + count / 3;
+        const uint8_t* dataSafeEnd = source + sourceSize - 16;
+        const uint8_t* codeAuxTable = dataSafeEnd;
+
+        for (size_t i = 0; i < count; i += 3)
+        {
+            // A triangle reads at most 16 bytes, which the code table at the end makes safe
+            if (data > dataSafeEnd)
+                return false;
+
+            const uint8_t codeTri = *code++;
+
+            if (codeTri < 0xF0)
+            {
+                // Edge from the FIFO plus one vertex
+                const uint32_t* edge = fifos.Edge(codeTri >> 4);
+                const uint32_t a = edge[0];
+                const uint32_t b = edge[1];
+                const uint32_t fec = codeTri & 15;
+                uint32_t c;
+
+                if (fec < fecMax)
+                {
+                    c = fec == 0 ? next++ : fifos.Vertex(fec + 1);
+                    fifos.PushVertex(c, fec == 0);
+                }
+                else
+                {
+                    // 13 and 14 are -1 and +1 from the last free index (version 1 only)
+                    if (fec == 15)
+                        c = DecodeIndex(data, last);
+                    else
+                        c = last + (fec == 13 ? 0xFFFFFFFF : 1);
+                    last = c;
+                    fifos.PushVertex(c);
+                }
+
+                WriteTriangle(dest, i, indexSize, a, b, c);
+                fifos.PushEdge(c, b);
+                fifos.PushEdge(a, c);
+            }
+            else
+            {
+                uint32_t a, b, c;
+                uint32_t feb, fec;
+
+                if (codeTri < 0xFE)
+                {
+                    // Three vertices described by an entry in the code table
+                    const uint8_t codeAux = codeAuxTable[codeTri & 15];
+                    feb = codeAux >> 4;
+                    fec = codeAux & 15;
+
+                    a = next++;
+                    b = feb == 0 ? next++ : fifos.Vertex(feb);
+                    c = fec == 0 ? next++ : fifos.Vertex(fec);
+                }
+                else
+                {
+                    // Three vertices described by an explicit byte, any of which may be a free index
+                    const uint8_t codeAux = *data++;
+                    const uint32_t fea = codeTri == 0xFE ? 0 : 15;
+                    feb = codeAux >> 4;
+                    fec = codeAux & 15;
+
+                    if (codeAux == 0)
+                        next = 0;
+
+                    a = fea == 0 ? next++ : 0;
+                    b = feb == 0 ? next++ : fifos.Vertex(feb);
+                    c = fec == 0 ? next++ : fifos.Vertex(fec);
+
+                    if (fea == 15)
+                        last = a = DecodeIndex(data, last);
+                    if (feb == 15)
+                        last = b = DecodeIndex(data, last);
+                    if (fec == 15)
+                        last = c = DecodeIndex(data, last);
+                }
+
+                WriteTriangle(dest, i, indexSize, a, b, c);
+                fifos.PushVertex(a);
+                fifos.PushVertex(b, feb == 0 || feb == 15);
+                fifos.PushVertex(c, fec == 0 || fec == 15);
+                fifos.PushEdge(b, a);
+                fifos.PushEdge(c, b);
+                fifos.PushEdge(a, c);
+            }
+        }
+
+        return data == dataSafeEnd;
+    }
+
+    bool DecodeIndexSequence(void* dest, size_t count, size_t indexSize, const uint8_t* source, size_t sourceSize)
+    {
+        // Header, at least a byte per index, and a 4-byte tail
+        if (sourceSize < 1 + count + 4)
+            return false;
+
+        if ((source[0] & 0xF0) != kSequenceHeader || (source[0] & 0x0F) > 1)
+            return false;
+
+        const uint8_t* data = source + 1;
+        const uint8_t* dataSafeEnd = source + sourceSize - 4;
+
+        // Two baselines, selected by the low bit of each code
+        uint32_t last[2] = { 0, 0 };
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (data >= dataSafeEnd)
+                return false;
+
+            uint32_t v = DecodeVByte(data);
+            const uint32_t baseline = v & 1;
+            v >>= 1;
+
+            const uint32_t index = last[baseline] + ((v >> 1) ^ (0u - (v & 1)));
+            last[baseline] = index;
+
+            if (indexSize == 2)
+                ((uint16_t*)dest)[i] = (uint16_t)index;
+            else
+                ((uint32_t*)dest)[i] = index;
+        }
+
+        return data == dataSafeEnd;
+    }
+
+    inline int RoundToInt(float f)
+    {
+        return (int)(f + (f >= 0.0f ? 0.5f : -0.5f));
+    }
+
+    template <typename T>
+    void FilterOctahedral(T* data, size_t count)
+    {
+        const float maxValue = (float)((1 << (sizeof(T) * 8 - 1)) - 1);
+
+        for (size_t i = 0; i < count; ++i, data += 4)
+        {
+            // z is stored as the encoding of 1.0 at the same precision
+            float x = (float)data[0];
+            float y = (float)data[1];
+            const float z = (float)data[2] - fabsf(x) - fabsf(y);
+
+            // Unfold the lower hemisphere
+            const float t = z < 0.0f ? z : 0.0f;
+            x += x >= 0.0f ? t : -t;
+            y += y >= 0.0f ? t : -t;
+
+            const float scale = maxValue / sqrtf(x * x + y * y + z * z);
+            data[0] = (T)RoundToInt(x * scale);
+            data[1] = (T)RoundToInt(y * scale);
+            data[2] = (T)RoundToInt(z * scale);
+        }
+    }
+
+    void FilterQuaternion(int16_t* data, size_t count)
+    {
+        const float kScale = 1.0f / sqrtf(2.0f);
+
+        for (size_t i = 0; i < count; ++i, data += 4)
+        {
+            // The fourth component holds the scale in its high bits and the index of the dropped (largest)
+            // component in its low two bits
+            const int scaleBits = data[3] | 3;
+            const float s = kScale / (float)scaleBits;
+
+            const float x = (float)data[0] * s;
+            const float y = (float)data[1] * s;
+            const float z = (float)data[2] * s;
+            const float ww = 1.0f - x * x - y * y - z * z;
+            const float w = sqrtf(ww >= 0.0f ? ww : 0.0f);
+
+            const int xi = RoundToInt(x * 32767.0f);
+            const int yi = RoundToInt(y * 32767.0f);
+            const int zi = RoundToInt(z * 32767.0f);
+            const int wi = (int)(w * 32767.0f + 0.5f);
+
+            const int qc = data[3] & 3;
+            data[(qc + 1) & 3] = (int16_t)xi;
+            data[(qc + 2) & 3] = (int16_t)yi;
+            data[(qc + 3) & 3] = (int16_t)zi;
+            data[(qc + 0) & 3] = (int16_t)wi;
+        }
+    }
+
+    void FilterExponential(uint32_t* data, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            // Signed 24-bit mantissa and signed 8-bit exponent:  ldexp(mantissa, exponent)
+            const int32_t mantissa = (int32_t)(data[i] << 8) >> 8;
+            const int32_t exponent = (int32_t)data[i] >> 24;
+
+            union { float f; uint32_t u; } bits;
+            bits.u = (uint32_t)(exponent + 127) << 23;
+            bits.f *= (float)mantissa;
+            data[i] = bits.u;
+        }
+    }
+
+    // The encoder side of FilterOctahedral, following meshopt_encodeFilterOct at full precision
+    int QuantizeSnorm(float v, int bits)
+    {
+        const float scale = (float)((1 << (bits - 1)) - 1);
+        v = v < -1.0f ? -1.0f : v > 1.0f ? 1.0f : v;
+        return (int)(v * scale + (v >= 0.0f ? 0.5f : -0.5f));
+    }
+
+    template <typename T>
+    void EncodeOctahedral(T* data, float x, float y, float z, float w)
+    {
+        const int bits = sizeof(T) * 8;
+        const float length = fabsf(x) + fabsf(y) + fabsf(z);
+        x /= length;
+        y /= length;
+
+        // Fold the lower hemisphere over the diagonals
+        const float u = z >= 0.0f ? x : (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        const float v = z >= 0.0f ? y : (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+
+        data[0] = (T)QuantizeSnorm(u, bits);
+        data[1] = (T)QuantizeSnorm(v, bits);
+        data[2] = (T)QuantizeSnorm(1.0f, bits);
+        data[3] = (T)QuantizeSnorm(w, bits);
+    }
+
+    // Round trips unit vectors covering both hemispheres and returns the number outside maxError
+    template <typename T>
+    uint32_t ValidateOctahedral(float maxError, float& worstError)
+    {
+        const uint32_t kNumRings = 17;
+        const uint32_t kNumSegments = 32;
+        const float kPi = 3.14159265f;
+
+        float vectors[kNumRings * kNumSegments + 8][4];
+        uint32_t numVectors = 0;
+
+        // The poles and the equator's corners, where the unfold meets the diagonals
+        const float kAxes[8][4] =
+        {
+            { 0.0f, 0.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, -1.0f, -1.0f },
+            { 1.0f, 0.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 0.0f, -1.0f },
+            { 0.0f, 1.0f, 0.0f, 1.0f }, { 0.0f, -1.0f, 0.0f, -1.0f },
+            { 0.57735027f, -0.57735027f, -0.57735027f, 1.0f }, { -0.57735027f, 0.57735027f, 0.57735027f, -1.0f }
+        };
+        for (const float* axis : kAxes)
+        {
+            memcpy(vectors[numVectors++], axis, sizeof(float) * 4);
+        }
+
+        for (uint32_t ring = 0; ring < kNumRings; ++ring)
+        {
+            const float theta = kPi * (ring + 0.5f) / kNumRings;
+            for (uint32_t segment = 0; segment < kNumSegments; ++segment)
+            {
+                const float phi = 2.0f * kPi * (segment + 0.25f) / kNumSegments;
+                float* vector = vectors[numVectors++];
+                vector[0] = sinf(theta) * cosf(phi);
+                vector[1] = sinf(theta) * sinf(phi);
+                vector[2] = cosf(theta);
+                vector[3] = segment & 1 ? 1.0f : -1.0f;
+            }
+        }
+
+        T data[_countof(vectors)][4];
+        for (uint32_t i = 0; i < numVectors; ++i)
+            EncodeOctahedral(data[i], vectors[i][0], vectors[i][1], vectors[i][2], vectors[i][3]);
+
+        FilterOctahedral(&data[0][0], numVectors);
+
+        const float maxValue = (float)((1 << (sizeof(T) * 8 - 1)) - 1);
+        uint32_t numFailures = 0;
+
+        for (uint32_t i = 0; i < numVectors; ++i)
+        {
+            float error = 0.0f;
+            for (uint32_t c = 0; c < 3; ++c)
+                error = fmaxf(error, fabsf(data[i][c] / maxValue - vectors[i][c]));
+
+            worstError = fmaxf(worstError, error);
+            if (error > maxError || data[i][3] != (T)QuantizeSnorm(vectors[i][3], sizeof(T) * 8))
+                ++numFailures;
+        }
+
+        return numFailures;
+    }
+}
+
+bool MeshoptDecoder::Decode(void* dest, size_t count, size_t stride, Mode mode, Filter filter,
+    const uint8_t* source, size_t sourceSize)
+{
+    switch (mode)
+    {
+    case kAttributes:
+        if (!DecodeVertexBuffer((uint8_t*)dest, count, stride, source, sourceSize))
+            return false;
+        break;
+
+    case kTriangles:
+        if (stride != 2 && stride != 4)
+            return false;
+        return DecodeIndexBuffer(dest, count, stride, source, sourceSize);
+
+    case kIndices:
+        if (stride != 2 && stride != 4)
+            return false;
+        return DecodeIndexSequence(dest, count, stride, source, sourceSize);
+
+    default:
+        return false;
+    }
+
+    switch (filter)
+    {
+    case kFilterOctahedral:
+        if (stride == 4)
+            FilterOctahedral((int8_t*)dest, count);
+        else if (stride == 8)
+            FilterOctahedral((int16_t*)dest, count);
+        else
+            return false;
+        break;
+
+    case kFilterQuaternion:
+        if (stride != 8)
+            return false;
+        FilterQuaternion((int16_t*)dest, count);
+        break;
+
+    case kFilterExponential:
+        FilterExponential((uint32_t*)dest, count * stride / 4);
+        break;
+
+    default:
+        break;
+    }
+
+    return true;
+}
+
+void MeshoptDecoder::Validate(void)
+{
+    float worstError8 = 0.0f, worstError16 = 0.0f;
+    const uint32_t numFailures8 = ValidateOctahedral<int8_t>(0.02f, worstError8);
+    const uint32_t numFailures16 = ValidateOctahedral<int16_t>(0.0002f, worstError16);
+
+    if (numFailures8 == 0 && numFailures16 == 0)
+    {
+        LOG_INFOF("Meshopt octahedral filter passed:  max error %.5f at 8 bits, %.6f at 16 bits", worstError8, worstError16);
+    }
+    else
+    {
+        LOG_WARNF("Meshopt octahedral filter failed:  %u vectors at 8 bits (max error %.5f), %u at 16 bits (max error %.6f)",
+            numFailures8, worstError8, numFailures16, worstError16);
+    }
+}
@@ -0,0 +1,61 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace MeshoptDecoder
+{
+    // EXT_meshopt_compression "mode"
+    enum Mode
+    {
+        kAttributes,    // vertex codec:  byte-wise deltas between consecutive elements
+        kTriangles,     // index codec:  triangle list with edge and vertex FIFOs
+        kIndices        // index sequence codec:  delta coded indices of any topology
+    };
+
+    // EXT_meshopt_compression "filter", applied after decoding in kAttributes mode
+    enum Filter
+    {
+        kFilterNone,
+        kFilterOctahedral,  // normals and tangents as 4 x int8 or 4 x int16
+        kFilterQuaternion,  // unit quaternions as 4 x int16
+        kFilterExponential  // floats as a shared exponent and a 24-bit mantissa
+    };
+
+    //-----------------------------------------------------------------------------
+    //  Decode
+    //-----------------------------------------------------------------------------
+    //  Decompresses an EXT_meshopt_compression buffer view.
+    //
+    //  Parameters:
+    //      dest
+    //          receives count * stride bytes
+    //      count
+    //          the number of elements (vertices or indices)
+    //      stride
+    //          bytes per element.  Indices must be 2 or 4 bytes.
+    //      source, sourceSize
+    //          the compressed bytes
+    //
+    //  Returns false if the data is malformed or has an unsupported version.
+    //-----------------------------------------------------------------------------
+    bool Decode(void* dest, size_t count, size_t stride, Mode mode, Filter filter,
+        const uint8_t* source, size_t sourceSize);
+
+    // Round trips unit vectors from both hemispheres through the octahedral filter at 8 and 16 bits
+    // and logs the results
+    void Validate(void);
+}
@@ -14,6 +14,11 @@
 #include "Model.h"
 #include "Renderer.h"
 #include "ConstantBuffers.h"
+#include "SphereCulling.h"
+#include "../Core/Hash.h"
+
+#include <algorithm>
+#include <ppl.h>
 
 using namespace Math;
 using namespace Renderer;
@@ -25,43 +30,286 @@ void Model::Destroy()
     m_MaterialConstants.Destroy();
     m_NumNodes = 0;
     m_NumMeshes = 0;
+    m_NumAnimations = 0;
+    m_NumJoints = 0;
     m_MeshData = nullptr;
     m_SceneGraph = nullptr;
+    m_KeyFrameData = nullptr;
+    m_CurveData = nullptr;
+    m_Animations = nullptr;
+    m_JointIndices = nullptr;
+    m_JointIBMs = nullptr;
+    m_NumClusters = 0;
+    m_Clusters = nullptr;
+    m_NodeParents.clear();
+    m_LevelOrder.clear();
+    m_LevelOffsets.clear();
+    m_MappedFile = nullptr;
+    m_HeapData = nullptr;
+}
+
+void Model::BuildHierarchy(void)
+{
+    m_NodeParents.assign(m_NumNodes, kNoParent);
+    std::vector<uint32_t> depths(m_NumNodes, 0);
+    std::vector<uint32_t> parentStack;
+    uint32_t parent = kNoParent;
+    uint32_t numVisited = 0;
+    uint32_t maxDepth = 0;
+
+    // Recover each node's parent from the depth-first sibling and child flags.  The stack only
+    // holds parents that still have children to visit, and it grows as deep as the graph does.
+    for (uint32_t i = 0; i < m_NumNodes; ++i)
+    {
+        const GraphNode& node = m_SceneGraph[i];
+        m_NodeParents[i] = parent;
+        depths[i] = parent == kNoParent ? 0 : depths[parent] + 1;
+        maxDepth = std::max(maxDepth, depths[i]);
+        numVisited = i + 1;
+
+        if (node.hasChildren)
+        {
+            if (node.hasSibling)
+                parentStack.push_back(parent);
+            parent = i;
+        }
+        else if (!node.hasSibling)
+        {
+            if (parentStack.empty())
+                break;
+
+            parent = parentStack.back();
+            parentStack.pop_back();
+        }
+    }
+
+    // Counting sort by depth, which keeps depth-first order within each level
+    m_LevelOffsets.assign(maxDepth + 2, 0);
+    for (uint32_t i = 0; i < numVisited; ++i)
+        ++m_LevelOffsets[depths[i] + 1];
+    for (uint32_t level = 1; level < m_LevelOffsets.size(); ++level)
+        m_LevelOffsets[level] += m_LevelOffsets[level - 1];
+
+    std::vector<uint32_t> cursor(m_LevelOffsets.begin(), m_LevelOffsets.end() - 1);
+    m_LevelOrder.resize(numVisited);
+    for (uint32_t i = 0; i < numVisited; ++i)
+        m_LevelOrder[cursor[depths[i]]++] = i;
+}
+
+// Picks a level of detail from the sphere's projected radius, as a fraction of half the viewport height.
+// Full detail is used down to LODScreenSize, and each step after that halves the threshold.
+static uint32_t SelectLOD(const BoundingSphere& sphereVS, float projScale, bool orthographic, uint32_t lodBias)
+{
+    const float depth = orthographic ? 1.0f : Max(-sphereVS.GetCenter().GetZ(), 1e-4f);
+    const float projectedRadius = sphereVS.GetRadius() * projScale / depth;
+
+    uint32_t lod = 0;
+    float threshold = LODScreenSize;
+    while (lod < Mesh::kNumLODs - 1 && projectedRadius < threshold)
+    {
+        ++lod;
+        threshold *= 0.5f;
+    }
+
+    lod += lodBias;
+    return lod < Mesh::kNumLODs ? lod : Mesh::kNumLODs - 1;
+}
+
+// Produces one draw per draw group at the requested LOD, or the coarsest one it has if that is finer
+static void GatherLODDraws(const Mesh& mesh, uint32_t lod, std::vector<Mesh::Draw>& lodDraws)
+{
+    lodDraws.clear();
+
+    for (uint32_t i = 0; i < mesh.numDraws; ++i)
+    {
+        Mesh::Draw draw = mesh.draw[i];
+        uint32_t startIndex = draw.startIndex + draw.primCount;
+        for (uint32_t level = 1; level <= lod && draw.lodPrimCount[level - 1] > 0; ++level)
+        {
+            draw.startIndex = startIndex;
+            draw.primCount = draw.lodPrimCount[level - 1];
+            startIndex += draw.primCount;
+        }
+        lodDraws.push_back(draw);
+    }
+}
+
+void Model::GatherVisibleClusters(
+    const Mesh& mesh,
+    const ScaleAndTranslation& sphereXform,
+    const AffineTransform& viewMat,
+    const Frustum& frustum,
+    bool cullBackfaces,
+    bool orthographic,
+    std::vector<Mesh::Draw>& visibleDraws ) const
+{
+    visibleDraws.clear();
+
+    const Matrix3& viewRotation = viewMat.GetBasis();
+    const Vector3 viewDirection = -Vector3(kZUnitVector);
+
+    const MeshCluster* cluster = m_Clusters + mesh.firstCluster;
+    for (uint32_t i = 0; i < mesh.numClusters; ++i, ++cluster)
+    {
+        BoundingSphere sphereWS = sphereXform * BoundingSphere((const XMFLOAT4*)cluster->bounds);
+        BoundingSphere sphereVS = BoundingSphere(viewMat * sphereWS.GetCenter(), sphereWS.GetRadius());
+        if (!frustum.IntersectSphere(sphereVS))
+            continue;
+
+        if (cullBackfaces && cluster->coneCutoff < 1.0f)
+        {
+            // The caller only culls backfaces when sphereXform is the whole transform, and translation
+            // and uniform scale don't change directions, so only the view rotates the axis
+            Vector3 axisVS = viewRotation * Vector3(*(const XMFLOAT3*)cluster->coneAxis);
+            Vector3 toApex = viewDirection;
+            if (!orthographic)
+            {
+                BoundingSphere apexWS = sphereXform * BoundingSphere(Vector3(*(const XMFLOAT3*)cluster->coneApex), Scalar(kZero));
+                toApex = Normalize(viewMat * apexWS.GetCenter());
+            }
+            if ((float)Dot(toApex, axisVS) >= cluster->coneCutoff)
+                continue;
+        }
+
+        // Merge with the previous draw when the index ranges are contiguous
+        const Mesh::Draw& source = mesh.draw[cluster->drawIdx];
+        if (!visibleDraws.empty())
+        {
+            Mesh::Draw& last = visibleDraws.back();
+            if (last.baseVertex == source.baseVertex && last.startIndex + last.primCount == cluster->startIndex)
+            {
+                last.primCount += cluster->primCount;
+                continue;
+            }
+        }
+
+        Mesh::Draw draw = source;
+        draw.startIndex = cluster->startIndex;
+        draw.primCount = cluster->primCount;
+        visibleDraws.push_back(draw);
+    }
 }
 
 void Model::Render(
     MeshSorter& sorter,
     const GpuBuffer& meshConstants,
     const ScaleAndTranslation sphereTransforms[],
+    const uint8_t sphereRotated[],
     const Joint* skeleton ) const
 {
     // Pointer to current mesh
-    const uint8_t* pMesh = m_MeshData.get();
+    const uint8_t* pMesh = m_MeshData;
 
     const Frustum& frustum = sorter.GetViewFrustum();
     const AffineTransform& viewMat = (const AffineTransform&)sorter.GetViewMatrix();
 
+    // Orthographic projections (directional shadows) view everything along the same direction at the same
+    // scale.  Their last column is (0, 0, 0, 1) where a perspective projection has (0, 0, z, 0).
+    const Matrix4& projMat = sorter.GetProjMatrix();
+    const bool orthographic = (float)projMat.GetW().GetW() != 0.0f;
+    const float projScale = projMat.GetY().GetY();
+    const uint32_t lodBias = sorter.GetBatchType() == MeshSorter::kShadows ? (uint32_t)(int)ShadowLODBias : 0;
+
+    const bool cullClusters = sorter.IsCullEnabled() && ClusterCulling && m_Clusters != nullptr;
+
+    // Gather every mesh's world space bounding sphere and cull them all in one batch
+    MeshSorter::CollectScratch& scratch = sorter.GetCollectScratch();
+    SphereCulling::SphereList& spheres = scratch.spheres;
+    std::vector<const Mesh*>& meshes = scratch.meshes;
+    std::vector<uint32_t>& visibleMask = scratch.visibleMask;
+
+    spheres.Clear();
+    meshes.clear();
     for (uint32_t i = 0; i < m_NumMeshes; ++i)
     {
         const Mesh& mesh = *(const Mesh*)pMesh;
+        spheres.Push(sphereTransforms[mesh.meshCBV] * BoundingSphere((const XMFLOAT4*)mesh.bounds));
+        meshes.push_back(&mesh);
+        pMesh += sizeof(Mesh) + (mesh.numDraws - 1) * sizeof(Mesh::Draw);
+    }
 
-        const ScaleAndTranslation& sphereXform = sphereTransforms[mesh.meshCBV];
-        BoundingSphere sphereLS((const XMFLOAT4*)mesh.bounds);
-        BoundingSphere sphereWS = sphereXform * sphereLS;
-        BoundingSphere sphereVS = BoundingSphere(viewMat * sphereWS.GetCenter(), sphereWS.GetRadius());
+    visibleMask.resize(SphereCulling::MaskSize(m_NumMeshes));
+    if (!sorter.IsCullEnabled())
+        std::fill(visibleMask.begin(), visibleMask.end(), 0xFFFFFFFFu);
+    else if (sorter.GetNumCasterPlanes() > 0)
+        SphereCulling::CullSpheres(sorter.GetCasterPlanes(), sorter.GetNumCasterPlanes(), spheres, visibleMask.data());
+    else
+        SphereCulling::CullSpheres(sorter.GetWorldFrustum(), spheres, visibleMask.data());
 
-        //if (frustum.IntersectSphere(sphereVS))
-        if (!sorter.IsCullEnabled() || frustum.IntersectSphere(sphereVS))
+    // Selects the detail of each visible mesh in [begin, end) and adds its draws to 'bucket'
+    auto CollectMeshes = [&](MeshSorter& bucket, uint32_t begin, uint32_t end)
+    {
+        std::vector<Mesh::Draw>& visibleDraws = bucket.GetCollectScratch().visibleDraws;
+
+        for (uint32_t i = begin; i < end; ++i)
         {
+            if ((visibleMask[i / 32] & (1u << (i % 32))) == 0)
+                continue;
+
+            const Mesh& mesh = *meshes[i];
+            const ScaleAndTranslation& sphereXform = sphereTransforms[mesh.meshCBV];
+            const Vector3 centerWS(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]);
+            const BoundingSphere sphereVS(viewMat * centerWS, spheres.radius[i]);
+
             float distance = -sphereVS.GetCenter().GetZ() - sphereVS.GetRadius();
-            sorter.AddMesh(mesh, distance,
+
+            const Mesh::Draw* draws = nullptr;
+            uint32_t numDraws = 0;
+            const uint32_t lod = EnableLODs ? SelectLOD(sphereVS, projScale, orthographic, lodBias) : 0;
+            if (lod > 0)
+            {
+                // Clusters only cover full detail, so coarser levels are drawn whole
+                GatherLODDraws(mesh, lod, visibleDraws);
+                draws = visibleDraws.data();
+                numDraws = (uint32_t)visibleDraws.size();
+            }
+            else if (cullClusters && mesh.numClusters > 0)
+            {
+                // Cones describe the bind pose and only one side of each triangle, so skinned and two-sided
+                // meshes are only culled against the frustum.  So are meshes whose sphere transform leaves
+                // out a rotation, a mirror, or a non-uniform scale, since their cones would point the wrong way.
+                const bool cullBackfaces = (mesh.psoFlags & (PSOFlags::kHasSkin | PSOFlags::kTwoSided)) == 0 &&
+                    !sphereRotated[mesh.meshCBV];
+
+                GatherVisibleClusters(mesh, sphereXform, viewMat, frustum, cullBackfaces, orthographic, visibleDraws);
+                if (visibleDraws.empty())
+                    continue;
+
+                draws = visibleDraws.data();
+                numDraws = (uint32_t)visibleDraws.size();
+            }
+
+            bucket.AddMesh(mesh, distance,
                 meshConstants.GetGpuVirtualAddress() + sizeof(MeshConstants) * mesh.meshCBV,
                 m_MaterialConstants.GetGpuVirtualAddress() + sizeof(MaterialConstants) * mesh.materialCBV,
-                m_DataBuffer.GetGpuVirtualAddress(), skeleton);
+                m_DataBuffer.GetGpuVirtualAddress(), skeleton, draws, numDraws);
         }
+    };
 
-        pMesh += sizeof(Mesh) + (mesh.numDraws - 1) * sizeof(Mesh::Draw);
+    static const uint32_t kMeshesPerTask = 256;
+
+    if (!ParallelCollection || m_NumMeshes < kMeshesPerTask * 2)
+    {
+        CollectMeshes(sorter, 0, m_NumMeshes);
+        return;
     }
+
+    // Each range of meshes fills its own bucket.  The buckets are appended in range order, which gives
+    // the same objects, keys and pass counts as adding every mesh to the sorter one after another.
+    const uint32_t numTasks = (m_NumMeshes + kMeshesPerTask - 1) / kMeshesPerTask;
+    std::vector<std::unique_ptr<MeshSorter>>& buckets = scratch.buckets;
+    while (buckets.size() < numTasks)
+        buckets.emplace_back(new MeshSorter(sorter.GetBatchType()));
+
+    Concurrency::parallel_for(0u, numTasks, [&](uint32_t task)
+    {
+        MeshSorter& bucket = *buckets[task];
+        bucket.Reset(sorter.GetBatchType());
+        CollectMeshes(bucket, task * kMeshesPerTask, std::min((task + 1) * kMeshesPerTask, m_NumMeshes));
+    });
+
+    for (uint32_t task = 0; task < numTasks; ++task)
+        sorter.Append(*buckets[task]);
 }
 
 void ModelInstance::Render(MeshSorter& sorter) const
@@ -70,10 +318,71 @@ void ModelInstance::Render(MeshSorter& sorter) const
     {
         //const Frustum& frustum = sorter.GetWorldFrustum();
         m_Model->Render(sorter, m_MeshConstantsGPU, (const ScaleAndTranslation*)m_BoundingSphereTransforms.get(),
-            m_Skeleton.get());
+            m_SphereRotated.data(), m_Skeleton.get());
     }
 }
 
+void ModelInstance::Render(MeshSorter* const* sorters, size_t numSorters) const
+{
+    if (!ParallelCollection)
+    {
+        for (size_t i = 0; i < numSorters; ++i)
+            Render(*sorters[i]);
+        return;
+    }
+
+    // Views don't share any state, and each one may split its meshes across more tasks
+    Concurrency::parallel_for(size_t(0), numSorters, [&](size_t i)
+    {
+        Render(*sorters[i]);
+    });
+}
+
+size_t ModelInstance::HashMeshesInFrustum(const Frustum& frustum, size_t hash)
+{
+    if (m_Model == nullptr)
+        return hash;
+
+    ASSERT(!m_TransformsDirty, "Mesh bounds are out of date");
+
+    const uint32_t numMeshes = m_Model->m_NumMeshes;
+
+    if (m_WorldSpheresVersion != m_TransformVersion || m_WorldSpheres.Size() != numMeshes)
+    {
+        const ScaleAndTranslation* sphereTransforms = (const ScaleAndTranslation*)m_BoundingSphereTransforms.get();
+        const uint8_t* pMesh = m_Model->m_MeshData;
+
+        m_WorldSpheres.Clear();
+        m_WorldSphereMeshes.clear();
+        for (uint32_t i = 0; i < numMeshes; ++i)
+        {
+            const Mesh& mesh = *(const Mesh*)pMesh;
+            m_WorldSpheres.Push(sphereTransforms[mesh.meshCBV] * BoundingSphere((const XMFLOAT4*)mesh.bounds));
+            m_WorldSphereMeshes.push_back(&mesh);
+            pMesh += sizeof(Mesh) + (mesh.numDraws - 1) * sizeof(Mesh::Draw);
+        }
+        m_WorldSpheresVersion = m_TransformVersion;
+    }
+
+    m_WorldSphereMask.resize(SphereCulling::MaskSize(numMeshes));
+    SphereCulling::CullSpheres(frustum, m_WorldSpheres, m_WorldSphereMask.data());
+
+    const MeshConstants* cb = (const MeshConstants*)m_MeshConstantsCache.get();
+    for (uint32_t i = 0; i < numMeshes; ++i)
+    {
+        if ((m_WorldSphereMask[i / 32] & (1u << (i % 32))) == 0)
+            continue;
+
+        const Mesh& mesh = *m_WorldSphereMeshes[i];
+        hash = Utility::HashState(&i, 1, hash);
+        hash = Utility::HashState(&cb[mesh.meshCBV].World, 1, hash);
+        if (mesh.numJoints > 0)
+            hash = Utility::HashState(m_Skeleton.get() + mesh.startJoint, mesh.numJoints, hash);
+    }
+
+    return hash;
+}
+
 ModelInstance::ModelInstance( std::shared_ptr<const Model> sourceModel )
     : m_Model(sourceModel), m_Locator(kIdentity)
 {
@@ -83,6 +392,11 @@ ModelInstance::ModelInstance( std::shared_ptr<const Model> sourceModel )
         m_MeshConstantsCPU.Destroy();
         m_MeshConstantsGPU.Destroy();
         m_BoundingSphereTransforms = nullptr;
+        m_MeshConstantsCache = nullptr;
+        m_NodeDirty.clear();
+        m_ConstantsDirty.clear();
+        m_SphereRotated.clear();
+        m_TransformsDirty = false;
         m_AnimGraph = nullptr;
         m_AnimState.clear();
         m_Skeleton = nullptr;
@@ -91,13 +405,19 @@ ModelInstance::ModelInstance( std::shared_ptr<const Model> sourceModel )
     {
         m_MeshConstantsCPU.Create(L"Mesh Constant Upload Buffer", sourceModel->m_NumNodes * sizeof(MeshConstants));
         m_MeshConstantsGPU.Create(L"Mesh Constant GPU Buffer", sourceModel->m_NumNodes, sizeof(MeshConstants));
+        m_MeshConstantsCache.reset(new __m128[sourceModel->m_NumNodes * sizeof(MeshConstants) / sizeof(__m128)]);
+        m_NodeDirty.assign(sourceModel->m_NumNodes, 1);
+        m_ConstantsDirty.assign(sourceModel->m_NumNodes, 0);
+        m_SphereRotated.assign(sourceModel->m_NumNodes, 0);
+        m_TransformsDirty = true;
+        InitMeshConstants();
         m_BoundingSphereTransforms.reset(new __m128[sourceModel->m_NumNodes]);
         m_Skeleton.reset(new Joint[sourceModel->m_NumJoints]);
 
         if (sourceModel->m_NumAnimations > 0)
         {
             m_AnimGraph.reset(new GraphNode[sourceModel->m_NumNodes]);
-            std::memcpy(m_AnimGraph.get(), sourceModel->m_SceneGraph.get(), sourceModel->m_NumNodes * sizeof(GraphNode));
+            std::memcpy(m_AnimGraph.get(), sourceModel->m_SceneGraph, sourceModel->m_NumNodes * sizeof(GraphNode));
             m_AnimState.resize(sourceModel->m_NumAnimations);
         }
         else
@@ -122,6 +442,11 @@ ModelInstance& ModelInstance::operator=( std::shared_ptr<const Model> sourceMode
         m_MeshConstantsCPU.Destroy();
         m_MeshConstantsGPU.Destroy();
         m_BoundingSphereTransforms = nullptr;
+        m_MeshConstantsCache = nullptr;
+        m_NodeDirty.clear();
+        m_ConstantsDirty.clear();
+        m_SphereRotated.clear();
+        m_TransformsDirty = false;
         m_AnimGraph = nullptr;
         m_AnimState.clear();
         m_Skeleton = nullptr;
@@ -130,13 +455,19 @@ ModelInstance& ModelInstance::operator=( std::shared_ptr<const Model> sourceMode
     {
         m_MeshConstantsCPU.Create(L"Mesh Constant Upload Buffer", sourceModel->m_NumNodes * sizeof(MeshConstants));
         m_MeshConstantsGPU.Create(L"Mesh Constant GPU Buffer", sourceModel->m_NumNodes, sizeof(MeshConstants));
+        m_MeshConstantsCache.reset(new __m128[sourceModel->m_NumNodes * sizeof(MeshConstants) / sizeof(__m128)]);
+        m_NodeDirty.assign(sourceModel->m_NumNodes, 1);
+        m_ConstantsDirty.assign(sourceModel->m_NumNodes, 0);
+        m_SphereRotated.assign(sourceModel->m_NumNodes, 0);
+        m_TransformsDirty = true;
+        InitMeshConstants();
         m_BoundingSphereTransforms.reset(new __m128[sourceModel->m_NumNodes]);
         m_Skeleton.reset(new Joint[sourceModel->m_NumJoints]);
 
         if (sourceModel->m_NumAnimations > 0)
         {
             m_AnimGraph.reset(new GraphNode[sourceModel->m_NumNodes]);
-            std::memcpy(m_AnimGraph.get(), sourceModel->m_SceneGraph.get(), sourceModel->m_NumNodes * sizeof(GraphNode));
+            std::memcpy(m_AnimGraph.get(), sourceModel->m_SceneGraph, sourceModel->m_NumNodes * sizeof(GraphNode));
             m_AnimState.resize(sourceModel->m_NumAnimations);
         }
         else
@@ -148,96 +479,172 @@ ModelInstance& ModelInstance::operator=( std::shared_ptr<const Model> sourceMode
     return *this;
 }
 
+// The position decode constants never change, so they are written once here rather than in every Update()
+void ModelInstance::InitMeshConstants(void)
+{
+    MeshConstants* cb = (MeshConstants*)m_MeshConstantsCache.get();
+
+    for (uint32_t i = 0; i < m_Model->m_NumNodes; ++i)
+    {
+        cb[i].PosScale = Vector3(kIdentity);
+        cb[i].PosBias = Vector3(kZero);
+    }
+
+    const uint8_t* pMesh = m_Model->m_MeshData;
+    for (uint32_t i = 0; i < m_Model->m_NumMeshes; ++i)
+    {
+        const Mesh& mesh = *(const Mesh*)pMesh;
+        cb[mesh.meshCBV].PosScale = Vector3(mesh.posScale[0], mesh.posScale[1], mesh.posScale[2]);
+        cb[mesh.meshCBV].PosBias = Vector3(mesh.posBias[0], mesh.posBias[1], mesh.posBias[2]);
+        pMesh += sizeof(Mesh) + (mesh.numDraws - 1) * sizeof(Mesh::Draw);
+    }
+}
+
 void ModelInstance::Update(GraphicsContext& gfxContext, float deltaTime)
 {
-    if (m_Model == nullptr)
+    if (m_AnimGraph)
+        UpdateAnimations(deltaTime);
+
+    UpdateTransforms(gfxContext);
+}
+
+void ModelInstance::UpdateTransforms(GraphicsContext& gfxContext)
+{
+    // Nothing moved, so the GPU copy of the constants is still current
+    if (m_Model == nullptr || !m_TransformsDirty)
         return;
 
-    static const size_t kMaxStackDepth = 32;
+    // Levels with fewer nodes than this are not worth splitting across threads
+    static const uint32_t kNodesPerTask = 256;
 
-    size_t stackIdx = 0;
-    Matrix4 matrixStack[kMaxStackDepth];
-    Matrix4 ParentMatrix = Matrix4((AffineTransform)m_Locator);
+    // Dirty ranges separated by fewer clean entries than this are uploaded as one copy
+    static const uint32_t kMaxCopyGap = 4;
 
+    const GraphNode* sceneGraph = m_AnimGraph ? m_AnimGraph.get() : m_Model->m_SceneGraph;
+    const uint32_t* parents = m_Model->m_NodeParents.data();
+    const uint32_t* levelOrder = m_Model->m_LevelOrder.data();
+    const Matrix4 locator = Matrix4((AffineTransform)m_Locator);
+
+    MeshConstants* cb = (MeshConstants*)m_MeshConstantsCache.get();
     ScaleAndTranslation* boundingSphereTransforms = (ScaleAndTranslation*)m_BoundingSphereTransforms.get();
-    MeshConstants* cb = (MeshConstants*)m_MeshConstantsCPU.Map();
+    uint8_t* dirty = m_NodeDirty.data();
+    uint8_t* constantsDirty = m_ConstantsDirty.data();
+    uint8_t* sphereRotated = m_SphereRotated.data();
 
-    if (m_AnimGraph)
+    // A node is recomputed when it changed or its parent did.  Parents are always on an earlier
+    // level, so their flags and matrices are final by the time their children are visited.
+    auto UpdateNode = [&](uint32_t nodeIdx)
     {
-        UpdateAnimations(deltaTime);
+        const uint32_t parentIdx = parents[nodeIdx];
+        if (parentIdx != Model::kNoParent && dirty[parentIdx])
+            dirty[nodeIdx] = 1;
+        if (!dirty[nodeIdx])
+            return;
+
+        const GraphNode& node = sceneGraph[nodeIdx];
+        const Matrix4& parentMatrix = parentIdx == Model::kNoParent ? locator : cb[sceneGraph[parentIdx].matrixIdx].World;
+        const Matrix4 xform = node.skeletonRoot ? node.xform : parentMatrix * node.xform;
+
+        MeshConstants& cbv = cb[node.matrixIdx];
+        constantsDirty[node.matrixIdx] = 1;
+        cbv.World = xform;
+        cbv.WorldIT = InverseTranspose(xform.Get3x3());
+
+        // The squared lengths of the parent's basis vectors, all at once
+        const XMMATRIX basis = XMMatrixTranspose(parentMatrix);
+        const XMVECTOR lengthSq = XMVectorMultiplyAdd(basis.r[0], basis.r[0],
+            XMVectorMultiplyAdd(basis.r[1], basis.r[1], XMVectorMultiply(basis.r[2], basis.r[2])));
+        const XMVECTOR maxLengthSq = XMVectorMax(XMVectorSplatX(lengthSq), XMVectorMax(XMVectorSplatY(lengthSq), XMVectorSplatZ(lengthSq)));
+        boundingSphereTransforms[node.matrixIdx] = ScaleAndTranslation((Vector3)parentMatrix.GetW(), Scalar(XMVectorSqrt(maxLengthSq)));
+
+        // Whether the parent's basis is anything other than a positive uniform scale, which the sphere
+        // transform can't express
+        XMFLOAT3X3 b;
+        XMStoreFloat3x3(&b, parentMatrix);
+        const float scale = (b._11 + b._22 + b._33) * (1.0f / 3.0f);
+        const float deviation = fabsf(b._12) + fabsf(b._13) + fabsf(b._21) + fabsf(b._23) + fabsf(b._31) + fabsf(b._32) +
+            fabsf(b._11 - scale) + fabsf(b._22 - scale) + fabsf(b._33 - scale);
+        sphereRotated[node.matrixIdx] = scale <= 0.0f || deviation > scale * 1e-3f;
+    };
+
+    const std::vector<uint32_t>& levelOffsets = m_Model->m_LevelOffsets;
+    for (size_t level = 0; level + 1 < levelOffsets.size(); ++level)
+    {
+        const uint32_t begin = levelOffsets[level];
+        const uint32_t end = levelOffsets[level + 1];
 
-        for (uint32_t i = 0; i < m_Model->m_NumNodes; ++i)
+        if (end - begin < kNodesPerTask * 2)
         {
-            GraphNode& node = m_AnimGraph[i];
-
-            // Regenerate the 3x3 matrix if it has scale or rotation
-            if (node.staleMatrix)
+            for (uint32_t i = begin; i < end; ++i)
+                UpdateNode(levelOrder[i]);
+        }
+        else
+        {
+            const uint32_t numTasks = (end - begin + kNodesPerTask - 1) / kNodesPerTask;
+            Concurrency::parallel_for(0u, numTasks, [&](uint32_t task)
             {
-                node.staleMatrix = false;
-                node.xform.Set3x3(Matrix3(node.rotation) * Matrix3::MakeScale(node.scale));
-            }
+                const uint32_t taskEnd = std::min(begin + (task + 1) * kNodesPerTask, end);
+                for (uint32_t i = begin + task * kNodesPerTask; i < taskEnd; ++i)
+                    UpdateNode(levelOrder[i]);
+            });
         }
     }
 
-    const GraphNode* sceneGraph = m_AnimGraph ? m_AnimGraph.get() : m_Model->m_SceneGraph.get();
+    std::fill(m_NodeDirty.begin(), m_NodeDirty.end(), (uint8_t)0);
+    m_TransformsDirty = false;
+    ++m_TransformVersion;
 
-    // Traverse the scene graph in depth first order.  This is the same as linear order
-    // for how the nodes are stored in memory.  Uses a matrix stack instead of recursion.
-    for (const GraphNode* Node = sceneGraph; ; ++Node)
+    // Update skeletal joints that moved
+    for (uint32_t i = 0; i < m_Model->m_NumJoints; ++i)
     {
-        Matrix4 xform = Node->xform;
-        if (!Node->skeletonRoot)
-            xform = ParentMatrix * xform;
+        const uint32_t jointIdx = m_Model->m_JointIndices[i];
+        if (!constantsDirty[jointIdx])
+            continue;
+
+        Joint& joint = m_Skeleton[i];
+        joint.posXform = cb[jointIdx].World * m_Model->m_JointIBMs[i];
+        joint.nrmXform = InverseTranspose(joint.posXform.Get3x3());
+    }
+
+    // Stream each dirty range to the upload buffer and copy just those ranges to the GPU.  Clean
+    // entries inside a merged range are still current in the upload buffer, because every change
+    // to an entry is written there.
+    uint8_t* upload = (uint8_t*)m_MeshConstantsCPU.Map();
+    gfxContext.TransitionResource(m_MeshConstantsGPU, D3D12_RESOURCE_STATE_COPY_DEST, true);
 
-        // Concatenate the transform with the parent's matrix and update the matrix list
+    const uint32_t numConstants = m_Model->m_NumNodes;
+    for (uint32_t first = 0; first < numConstants; )
+    {
+        if (!constantsDirty[first])
         {
-            // Scoped so that I don't forget that I'm pointing to write-combined memory and
-            // should not read from it.
-            MeshConstants& cbv = cb[Node->matrixIdx];
-            cbv.World = xform;
-            cbv.WorldIT = InverseTranspose(xform.Get3x3());
-
-            Scalar scaleXSqr = LengthSquare((Vector3)ParentMatrix.GetX());
-            Scalar scaleYSqr = LengthSquare((Vector3)ParentMatrix.GetY());
-            Scalar scaleZSqr = LengthSquare((Vector3)ParentMatrix.GetZ());
-            Scalar sphereScale = Sqrt(Max(Max(scaleXSqr, scaleYSqr), scaleZSqr));
-            boundingSphereTransforms[Node->matrixIdx] = ScaleAndTranslation((Vector3)ParentMatrix.GetW(), sphereScale);
+            ++first;
+            continue;
         }
 
-        // If the next node will be a descendent, replace the parent matrix with our new matrix
-        if (Node->hasChildren)
+        uint32_t end = first + 1;
+        for (uint32_t gap = 0; end + gap < numConstants && gap <= kMaxCopyGap; )
         {
-            // ...but if we have siblings, make sure to backup our current parent matrix on the stack
-            if (Node->hasSibling)
+            if (constantsDirty[end + gap])
+            {
+                end += gap + 1;
+                gap = 0;
+            }
+            else
             {
-                ASSERT(stackIdx < kMaxStackDepth, "Overflowed the matrix stack");
-                matrixStack[stackIdx++] = ParentMatrix;
+                ++gap;
             }
-            ParentMatrix = xform;
         }
-        else if (!Node->hasSibling)
-        {
-            // There are no more siblings.  If the stack is empty, we are done.  Otherwise, pop
-            // a matrix off the stack and continue.
-            if (stackIdx == 0)
-                break;
 
-            ParentMatrix = matrixStack[--stackIdx];
-        }
-    }
+        const size_t offset = first * sizeof(MeshConstants);
+        const size_t size = (end - first) * sizeof(MeshConstants);
+        std::memcpy(upload + offset, (const uint8_t*)cb + offset, size);
+        gfxContext.GetCommandList()->CopyBufferRegion(m_MeshConstantsGPU.GetResource(), offset, m_MeshConstantsCPU.GetResource(), offset, size);
 
-    // Update skeletal joints
-    for (uint32_t i = 0; i < m_Model->m_NumJoints; ++i)
-    {
-        Joint& joint = m_Skeleton[i];
-        joint.posXform = cb[m_Model->m_JointIndices[i]].World * m_Model->m_JointIBMs[i];
-        joint.nrmXform = InverseTranspose(joint.posXform.Get3x3());
+        std::fill(constantsDirty + first, constantsDirty + end, (uint8_t)0);
+        first = end;
     }
 
     m_MeshConstantsCPU.Unmap();
-
-    gfxContext.TransitionResource(m_MeshConstantsGPU, D3D12_RESOURCE_STATE_COPY_DEST, true);
-    gfxContext.GetCommandList()->CopyBufferRegion(m_MeshConstantsGPU.GetResource(), 0, m_MeshConstantsCPU.GetResource(), 0, m_MeshConstantsCPU.GetBufferSize());
     gfxContext.TransitionResource(m_MeshConstantsGPU, D3D12_RESOURCE_STATE_GENERIC_READ);
 }
 
@@ -247,6 +654,8 @@ void ModelInstance::Resize( float newRadius )
         return;
 
     m_Locator.SetScale(newRadius / m_Model->m_BoundingSphere.GetRadius());
+    std::fill(m_NodeDirty.begin(), m_NodeDirty.end(), (uint8_t)1);
+    m_TransformsDirty = true;
 }
 
 Vector3 ModelInstance::GetCenter() const
@@ -14,12 +14,14 @@
 #pragma once
 
 #include "Animation.h"
+#include "SphereCulling.h"
 #include "../Core/GpuBuffer.h"
 #include "../Core/VectorMath.h"
 #include "../Core/Camera.h"
 #include "../Core/CommandContext.h"
 #include "../Core/UploadBuffer.h"
 #include "../Core/TextureManager.h"
+#include "../Core/FileUtility.h"
 #include "../Core/Math/BoundingBox.h"
 #include "../Core/Math/BoundingSphere.h"
 #include <cstdint>
@@ -37,27 +39,38 @@ namespace PSOFlags
 {
     enum : uint16_t
     { 
-        kHasPosition    = 0x001,  // Required
-        kHasNormal      = 0x002,  // Required
-        kHasTangent     = 0x004,
-        kHasUV0         = 0x008,  // Required (for now)
-        kHasUV1         = 0x010,
-        kAlphaBlend     = 0x020,
-        kAlphaTest      = 0x040,
-        kTwoSided       = 0x080,
-        kHasSkin        = 0x100,  // Implies having indices and weights
+        kHasPosition       = 0x001,  // Required
+        kHasNormal         = 0x002,  // Required
+        kHasTangent        = 0x004,
+        kHasUV0            = 0x008,  // Required (for now)
+        kHasUV1            = 0x010,
+        kAlphaBlend        = 0x020,
+        kAlphaTest         = 0x040,
+        kTwoSided          = 0x080,
+        kHasSkin           = 0x100,  // Implies having indices and weights
+        kQuantizedPosition = 0x200,  // 16-bit UNORM positions within the bounds given by Mesh::posScale/posBias
+        kOctahedralNormal  = 0x400,  // Normal and tangent share one octahedral-encoded R8G8B8A8_SNORM element
+        kUNormTexcoord     = 0x800,  // R16G16_UNORM texture coordinates instead of R16G16_FLOAT
     };
 }
 
 struct Mesh
 {
+    static const uint32_t kNumLODs = 4;  // Full detail plus three coarser levels
+
     float    bounds[4];     // A bounding sphere
+    float    posScale[3];   // Decodes quantized positions as position * posScale + posBias.  Identity
+    float    posBias[3];    // when unquantized, and the same for every mesh sharing a meshCBV.
     uint32_t vbOffset;      // BufferLocation - Buffer.GpuVirtualAddress
     uint32_t vbSize;        // SizeInBytes
     uint32_t vbDepthOffset; // BufferLocation - Buffer.GpuVirtualAddress
     uint32_t vbDepthSize;   // SizeInBytes
     uint32_t ibOffset;      // BufferLocation - Buffer.GpuVirtualAddress
     uint32_t ibSize;        // SizeInBytes
+    uint32_t ibDepthOffset; // BufferLocation - Buffer.GpuVirtualAddress
+    uint32_t ibDepthSize;   // SizeInBytes
+    uint32_t firstCluster;  // Index of first MeshCluster in Model::m_Clusters
+    uint32_t numClusters;   // 0 if the mesh was not split into clusters
     uint8_t  vbStride;      // StrideInBytes
     uint8_t  ibFormat;      // DXGI_FORMAT
     uint16_t meshCBV;       // Index of mesh constant buffer
@@ -75,10 +88,24 @@ struct Mesh
         uint32_t primCount;   // Number of indices = 3 * number of triangles
         uint32_t startIndex;  // Offset to first index in index buffer 
         uint32_t baseVertex;  // Offset to first vertex in vertex buffer
+        uint32_t depthBaseVertex; // Offset to first vertex in depth vertex buffer (depth indices share startIndex)
+        uint32_t lodPrimCount[kNumLODs - 1]; // Indices in each coarser LOD, stored in order after this one (0 = none)
     };
     Draw draw[1];           // Actually 1 or more draws
 };
 
+// A small run of triangles within a mesh that can be culled on its own
+struct MeshCluster
+{
+    float    bounds[4];     // A bounding sphere in the same space as Mesh::bounds
+    float    coneApex[3];   // Apex of the backface cone
+    float    coneCutoff;    // Back-facing when dot(normalize(apex - eye), axis) >= cutoff.  Over 1 never culls.
+    float    coneAxis[3];   // Average facing direction of the triangles
+    uint32_t startIndex;    // Offset to first index in the mesh's index buffer
+    uint16_t primCount;     // Number of indices = 3 * number of triangles
+    uint16_t drawIdx;       // Draw group supplying the base vertex
+};
+
 struct GraphNode // 96 bytes
 {
     Math::Matrix4 xform;
@@ -102,11 +129,20 @@ class Model
 {
 public:
 
+    Model() : m_NumNodes(0), m_NumMeshes(0), m_NumAnimations(0), m_NumJoints(0),
+        m_MeshData(nullptr), m_SceneGraph(nullptr), m_KeyFrameData(nullptr), m_CurveData(nullptr),
+        m_Animations(nullptr), m_JointIndices(nullptr), m_JointIBMs(nullptr), m_NumClusters(0), m_Clusters(nullptr) {}
     ~Model() { Destroy(); }
 
+    enum : uint32_t { kNoParent = 0xFFFFFFFF };
+
+    // Derives the level-ordered hierarchy below from the depth-first scene graph
+    void BuildHierarchy(void);
+
     void Render(Renderer::MeshSorter& sorter,
         const GpuBuffer& meshConstants,
         const Math::ScaleAndTranslation sphereTransforms[],
+        const uint8_t sphereRotated[],
         const Joint* skeleton) const;
 
     Math::BoundingSphere m_BoundingSphere; // Object-space bounding sphere
@@ -117,17 +153,41 @@ public:
     uint32_t m_NumMeshes;
     uint32_t m_NumAnimations;
     uint32_t m_NumJoints;
-    std::unique_ptr<uint8_t[]> m_MeshData;
-    std::unique_ptr<GraphNode[]> m_SceneGraph;
     std::vector<TextureRef> textures;
-    std::unique_ptr<uint8_t[]> m_KeyFrameData;
-    std::unique_ptr<AnimationCurve[]> m_CurveData;
-    std::unique_ptr<AnimationSet[]> m_Animations;
-    std::unique_ptr<uint16_t[]> m_JointIndices;
-    std::unique_ptr<Math::Matrix4[]> m_JointIBMs;
+
+    // These point into either the memory-mapped .mini file or m_HeapData.  Neither is owned directly.
+    uint8_t* m_MeshData;
+    GraphNode* m_SceneGraph;
+    uint8_t* m_KeyFrameData;
+    AnimationCurve* m_CurveData;
+    AnimationSet* m_Animations;
+    uint16_t* m_JointIndices;
+    Math::Matrix4* m_JointIBMs;
+    uint32_t m_NumClusters;
+    MeshCluster* m_Clusters;
+
+    // The scene graph in breadth-first order.  Every node of a level depends only on nodes of
+    // earlier levels, so each level can be updated as one (possibly parallel) batch.
+    std::vector<uint32_t> m_NodeParents;    // Per node, or kNoParent for a root
+    std::vector<uint32_t> m_LevelOrder;     // Node indices sorted by depth
+    std::vector<uint32_t> m_LevelOffsets;   // Where each level starts in m_LevelOrder, plus the end
+
+    // Backing storage for the arrays above
+    std::unique_ptr<Utility::MappedFile> m_MappedFile;
+    std::unique_ptr<uint8_t[]> m_HeapData;
 
 protected:
     void Destroy();
+
+    // Appends a draw for each run of clusters that survive frustum and backface culling
+    void GatherVisibleClusters(
+        const Mesh& mesh,
+        const Math::ScaleAndTranslation& sphereXform,
+        const Math::AffineTransform& viewMat,
+        const Math::Frustum& frustum,
+        bool cullBackfaces,
+        bool orthographic,
+        std::vector<Mesh::Draw>& visibleDraws ) const;
 };
 
 class ModelInstance
@@ -145,8 +205,12 @@ public:
 
     bool IsNull(void) const { return m_Model == nullptr; }
 
+    // Equivalent to UpdateAnimations() followed by UpdateTransforms()
     void Update(GraphicsContext& gfxContext, float deltaTime);
+    void UpdateTransforms(GraphicsContext& gfxContext);
     void Render(Renderer::MeshSorter& sorter) const;
+    // Collects the draws of several views at once, such as the main view and its shadow views
+    void Render(Renderer::MeshSorter* const* sorters, size_t numSorters) const;
 
     void Resize(float newRadius);
     Math::Vector3 GetCenter() const;
@@ -160,15 +224,39 @@ public:
     void ResetAnimation(uint32_t animIdx);
     void StopAnimation(uint32_t animIdx);
     void UpdateAnimations(float deltaTime);
+    // Animates many instances in parallel.  Follow with UpdateTransforms() on each of them.
+    static void UpdateAnimations(ModelInstance* const* instances, size_t numInstances, float deltaTime);
     void LoopAllAnimations(void);
 
     const Model* GetModel() const { return m_Model.get(); }
 
+    // Changes whenever UpdateTransforms() moves anything
+    uint32_t GetTransformVersion() const { return m_TransformVersion; }
+
+    // Folds into 'hash' which meshes intersect the world space frustum, along with their transforms and
+    // joints.  The result changes whenever a mesh enters or leaves the frustum or one inside it moves.
+    // Call after UpdateTransforms().
+    size_t HashMeshesInFrustum(const Math::Frustum& frustum, size_t hash);
+
 private:
+    void InitMeshConstants(void);
+
     std::shared_ptr<const Model> m_Model;
     UploadBuffer m_MeshConstantsCPU;
     ByteAddressBuffer m_MeshConstantsGPU;
     std::unique_ptr<__m128[]> m_BoundingSphereTransforms;
+    std::unique_ptr<__m128[]> m_MeshConstantsCache;  // Computed in cached memory, then streamed to the upload buffer
+    std::vector<uint8_t> m_NodeDirty;               // Nodes whose transform changed since the last UpdateTransforms()
+    std::vector<uint8_t> m_ConstantsDirty;          // Per MeshConstants entry, rewritten by the current UpdateTransforms()
+    std::vector<uint8_t> m_SphereRotated;           // Per MeshConstants entry, the bounding sphere transform drops a rotation
+    bool m_TransformsDirty = false;                 // Any node is dirty
+    uint32_t m_TransformVersion = 0;
+
+    // World space mesh bounds for HashMeshesInFrustum(), rebuilt when the transform version changes
+    SphereCulling::SphereList m_WorldSpheres;
+    std::vector<const Mesh*> m_WorldSphereMeshes;
+    std::vector<uint32_t> m_WorldSphereMask;
+    uint32_t m_WorldSpheresVersion = 0;
     Math::UniformTransform m_Locator;
 
     std::unique_ptr<GraphNode[]> m_AnimGraph;   // A copy of the scene graph when instancing animation
@@ -22,13 +22,16 @@
 #include "glTF.h"
 #include "TextureConvert.h"
 #include "MeshConvert.h"
+#include "AnimationCompress.h"
 #include "TextureManager.h"
 #include "GraphicsCommon.h"
 #include "../Core/Utility.h"
 #include "../Core/Math/Common.h"
 
+#include <algorithm>
 #include <fstream>
 #include <map>
+#include <ppl.h>
 #include <unordered_map>
 
 using namespace DirectX;
@@ -42,14 +45,21 @@ static inline Vector3 SafeNormalize(Vector3 x)
     return lenSq < 1e-10f ? Vector3(kXUnitVector) : x * RecipSqrt(lenSq);
 }
 
-void Renderer::CompileMesh(
+// Packs optimized primitives into mesh records and appends their vertex and index data to bufferMemory.
+// This is kept separate from optimization so that primitives can be optimized in parallel while still
+// being packed in a fixed order.
+static void PackMesh(
     std::vector<Mesh*>& meshList,
+    std::vector<MeshCluster>& clusterList,
     std::vector<byte>& bufferMemory,
-    glTF::Mesh& srcMesh,
+    const glTF::Mesh& srcMesh,
     uint32_t matrixIdx,
-    const Matrix4& localToObject,
+    std::vector<Primitive>& primitives,
     BoundingSphere& boundingSphere,
-    AxisAlignedBox& boundingBox
+    AxisAlignedBox& boundingBox,
+    uint32_t quantization,
+    const AxisAlignedBox& quantizationBounds,
+    VertexQuantizationReport& report
     )
 {
     // We still have a lot of work to do.  Now that we know about all of the primitives in this mesh
@@ -57,17 +67,27 @@ void Renderer::CompileMesh(
     // have the same vertex format and material.  These can share a PSO and Vertex/Index buffer views.
     // There may be more than one draw call per group due to 16-bit indices.
 
+    // Primitives that couldn't be converted (such as line and point topologies) have no buffers
+    primitives.erase(std::remove_if(primitives.begin(), primitives.end(),
+        [](const Primitive& prim) { return prim.VB == nullptr; }), primitives.end());
+
+    // Quantize before grouping, since the vertex format is part of each primitive's hash
+    if (quantization != 0)
+    {
+        for (auto& prim : primitives)
+            QuantizeVertices(prim, quantization, quantizationBounds, report);
+    }
+
     size_t totalVertexSize = 0;
     size_t totalDepthVertexSize = 0;
     size_t totalIndexSize = 0;
+    size_t totalDepthIndexSize = 0;
 
     BoundingSphere sphereOS(kZero);
     AxisAlignedBox bboxOS(kZero);
 
-    std::vector<Primitive> primitives(srcMesh.primitives.size());
     for (uint32_t i = 0; i < primitives.size(); ++i)
     {
-        OptimizeMesh(primitives[i], srcMesh.primitives[i], localToObject);
         sphereOS = sphereOS.Union(primitives[i].m_BoundsOS);
         bboxOS.AddBoundingBox(primitives[i].m_BBoxOS);
     }
@@ -88,16 +108,20 @@ void Renderer::CompileMesh(
     for (auto& iter : renderMeshes)
     {
         uint32_t meshIndexSize = 0;
+        uint32_t meshDepthIndexSize = 0;
         // for each sub-mesh (a draw)
         for (auto& draw : iter.second)
         {
             meshIndexSize += (uint32_t)draw->IB->size();
+            meshDepthIndexSize += (uint32_t)draw->DepthIB->size();
         }
 
         totalIndexSize += Math::AlignUp(meshIndexSize, 4);
+        totalDepthIndexSize += Math::AlignUp(meshDepthIndexSize, 4);
     }
 
-    uint32_t totalBufferSize = (uint32_t)Math::AlignUp(totalVertexSize + totalDepthVertexSize, 4) + (uint32_t)totalIndexSize;
+    uint32_t totalBufferSize = (uint32_t)Math::AlignUp(totalVertexSize + totalDepthVertexSize, 4) +
+        (uint32_t)(totalIndexSize + totalDepthIndexSize);
 
     Utility::ByteArray stagingBuffer;
     stagingBuffer.reset(new std::vector<byte>(totalBufferSize));
@@ -106,6 +130,7 @@ void Renderer::CompileMesh(
     uint32_t curVBOffset = 0;
     uint32_t curDepthVBOffset = (uint32_t)totalVertexSize;
     uint32_t curIBOffset = Math::AlignUp(curDepthVBOffset + (uint32_t)totalDepthVertexSize, 4);
+    uint32_t curDepthIBOffset = curIBOffset + (uint32_t)totalIndexSize;
 
     // for each mesh
     for (auto& iter : renderMeshes)
@@ -115,6 +140,8 @@ void Renderer::CompileMesh(
         size_t vbSize = 0;
         size_t vbDepthSize = 0;
         size_t ibSize = 0;
+        size_t ibDepthSize = 0;
+        bool hasClusters = false;
 
         // Compute local space bounding sphere for all submeshes
         BoundingSphere collectiveSphere(kZero);
@@ -125,21 +152,39 @@ void Renderer::CompileMesh(
             vbSize += draw->VB->size();
             vbDepthSize += draw->DepthVB->size();
             ibSize += draw->IB->size();
+            ibDepthSize += draw->DepthIB->size();
+            hasClusters |= !draw->clusters.empty();
             collectiveSphere = collectiveSphere.Union(draw->m_BoundsOS);
         }
 
         ibSize = (uint32_t)Math::AlignUp(ibSize, 4);
+        ibDepthSize = (uint32_t)Math::AlignUp(ibDepthSize, 4);
 
         mesh->bounds[0] = collectiveSphere.GetCenter().GetX();
         mesh->bounds[1] = collectiveSphere.GetCenter().GetY();
         mesh->bounds[2] = collectiveSphere.GetCenter().GetZ();
         mesh->bounds[3] = collectiveSphere.GetRadius();
+
+        // Every mesh of a node shares its MeshConstants, so they all decode positions with the same bounds
+        const bool quantizedPositions = (iter.second[0]->psoFlags & PSOFlags::kQuantizedPosition) != 0;
+        const Vector3 posScale = quantizedPositions ? quantizationBounds.GetDimensions() : Vector3(kIdentity);
+        const Vector3 posBias = quantizedPositions ? quantizationBounds.GetMin() : Vector3(kZero);
+        mesh->posScale[0] = posScale.GetX();
+        mesh->posScale[1] = posScale.GetY();
+        mesh->posScale[2] = posScale.GetZ();
+        mesh->posBias[0] = posBias.GetX();
+        mesh->posBias[1] = posBias.GetY();
+        mesh->posBias[2] = posBias.GetZ();
         mesh->vbOffset = (uint32_t)bufferMemory.size() + curVBOffset;
         mesh->vbSize = (uint32_t)vbSize;
         mesh->vbDepthOffset = (uint32_t)bufferMemory.size() + curDepthVBOffset;
         mesh->vbDepthSize = (uint32_t)vbDepthSize;
         mesh->ibOffset = (uint32_t)bufferMemory.size() + curIBOffset;
         mesh->ibSize = (uint32_t)ibSize;
+        mesh->ibDepthOffset = (uint32_t)bufferMemory.size() + curDepthIBOffset;
+        mesh->ibDepthSize = (uint32_t)ibDepthSize;
+        mesh->firstCluster = (uint32_t)clusterList.size();
+        mesh->numClusters = 0;
         mesh->vbStride = (uint8_t)iter.second[0]->vertexStride;
         mesh->ibFormat = uint8_t(iter.second[0]->index32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT);
         mesh->meshCBV = (uint16_t)matrixIdx;
@@ -163,6 +208,7 @@ void Renderer::CompileMesh(
         uint32_t curVertOffset = 0;
         uint32_t curDepthVertOffset = 0;
         uint32_t curIndexOffset = 0;
+        uint32_t curDepthIndexOffset = 0;
 
         // for each sub-mesh (a draw)
         for (auto& draw : iter.second)
@@ -171,6 +217,35 @@ void Renderer::CompileMesh(
             d.primCount = draw->primCount;
             d.baseVertex = curVertOffset / draw->vertexStride;
             d.startIndex = curIndexOffset >> (draw->index32 + 1);
+            d.depthBaseVertex = curDepthVertOffset / draw->depthVertexStride;
+            std::memcpy(d.lodPrimCount, draw->lodPrimCount, sizeof(d.lodPrimCount));
+
+            // Once any draw is clustered, every draw must be, since culled meshes are drawn cluster by cluster.
+            // Unclustered primitives are covered by their bounding sphere and a cone that never culls.
+            if (hasClusters && draw->clusters.empty())
+            {
+                MeshCluster whole = {};
+                whole.bounds[0] = draw->m_BoundsOS.GetCenter().GetX();
+                whole.bounds[1] = draw->m_BoundsOS.GetCenter().GetY();
+                whole.bounds[2] = draw->m_BoundsOS.GetCenter().GetZ();
+                whole.bounds[3] = draw->m_BoundsOS.GetRadius();
+                whole.coneCutoff = 2.0f;
+                whole.drawIdx = (uint16_t)(drawIdx - 1);
+
+                // primCount is 16 bits, so very large primitives take several entries
+                for (uint32_t first = 0; first < d.primCount; first += 0xFFFF)
+                {
+                    whole.startIndex = d.startIndex + first;
+                    whole.primCount = (uint16_t)std::min<uint32_t>(d.primCount - first, 0xFFFF);
+                    clusterList.push_back(whole);
+                }
+            }
+            for (const MeshCluster& cluster : draw->clusters)
+            {
+                clusterList.push_back(cluster);
+                clusterList.back().startIndex += d.startIndex;
+                clusterList.back().drawIdx = (uint16_t)(drawIdx - 1);
+            }
 
             std::memcpy(uploadMem + curVBOffset + curVertOffset, draw->VB->data(), draw->VB->size());
             curVertOffset += (uint32_t)draw->VB->size();
@@ -180,11 +255,17 @@ void Renderer::CompileMesh(
 
             std::memcpy(uploadMem + curIBOffset + curIndexOffset, draw->IB->data(), draw->IB->size());
             curIndexOffset += (uint32_t)draw->IB->size();
+
+            std::memcpy(uploadMem + curDepthIBOffset + curDepthIndexOffset, draw->DepthIB->data(), draw->DepthIB->size());
+            curDepthIndexOffset += (uint32_t)draw->DepthIB->size();
         }
 
         curVBOffset += (uint32_t)vbSize;
         curDepthVBOffset += (uint32_t)vbDepthSize;
         curIBOffset += (uint32_t)ibSize;
+        curDepthIBOffset += (uint32_t)ibDepthSize;
+
+        mesh->numClusters = (uint32_t)clusterList.size() - mesh->firstCluster;
 
         meshList.push_back(mesh);
     }
@@ -192,13 +273,42 @@ void Renderer::CompileMesh(
     bufferMemory.insert(bufferMemory.end(), stagingBuffer->begin(), stagingBuffer->end());
 }
 
+void Renderer::CompileMesh(
+    std::vector<Mesh*>& meshList,
+    std::vector<MeshCluster>& clusterList,
+    std::vector<byte>& bufferMemory,
+    glTF::Mesh& srcMesh,
+    uint32_t matrixIdx,
+    const Matrix4& localToObject,
+    BoundingSphere& boundingSphere,
+    AxisAlignedBox& boundingBox,
+    uint32_t quantization,
+    const AxisAlignedBox& quantizationBounds,
+    VertexQuantizationReport& report
+    )
+{
+    std::vector<Primitive> primitives(srcMesh.primitives.size());
+    concurrency::parallel_for(size_t(0), primitives.size(), [&](size_t i)
+    {
+        OptimizeMesh(primitives[i], srcMesh.primitives[i], localToObject);
+    });
+
+    PackMesh(meshList, clusterList, bufferMemory, srcMesh, matrixIdx, primitives, boundingSphere, boundingBox,
+        quantization, quantizationBounds, report);
+}
+
+// A mesh referenced by the scene graph, recorded while walking it so that it can be compiled afterward
+struct MeshInstance
+{
+    Matrix4 localToObject;
+    const glTF::Mesh* mesh;
+    uint32_t matrixIdx;
+};
+
 
 static uint32_t WalkGraph(
     std::vector<GraphNode>& sceneGraph,
-    BoundingSphere& modelBSphere,
-    AxisAlignedBox& modelBBox,
-    std::vector<Mesh*>& meshList,
-    std::vector<byte>& bufferMemory,
+    std::vector<MeshInstance>& meshInstances,
     const std::vector<glTF::Node*>& siblings,
     uint32_t curPos,
     const Matrix4& xform
@@ -237,11 +347,11 @@ static uint32_t WalkGraph(
 
         if (!curNode->pointsToCamera && curNode->mesh != nullptr)
         {
-            BoundingSphere sphereOS;
-            AxisAlignedBox boxOS;
-            CompileMesh(meshList, bufferMemory, *curNode->mesh, curPos, LocalXform, sphereOS, boxOS);
-            modelBSphere = modelBSphere.Union(sphereOS);
-            modelBBox.AddBoundingBox(boxOS);
+            MeshInstance instance;
+            instance.localToObject = LocalXform;
+            instance.mesh = curNode->mesh;
+            instance.matrixIdx = curPos;
+            meshInstances.push_back(instance);
         }
 
         uint32_t nextPos = curPos + 1;
@@ -249,7 +359,7 @@ static uint32_t WalkGraph(
         if (curNode->children.size() > 0)
         {
             thisGraphNode.hasChildren = 1;
-            nextPos = WalkGraph(sceneGraph, modelBSphere, modelBBox, meshList, bufferMemory, curNode->children, nextPos, LocalXform);
+            nextPos = WalkGraph(sceneGraph, meshInstances, curNode->children, nextPos, LocalXform);
         }
 
         // Are there more siblings?
@@ -345,6 +455,8 @@ void BuildMaterials(ModelData& model, const glTF::Asset& asset)
         SetTextureOptions(textureOptions, srcMat.textures[kNormal], TextureOptions(false));
     }
 
+    std::vector<TextureCookRequest> cookRequests;
+
     model.m_TextureOptions.clear();
     for (auto name : model.m_TextureNames)
     {
@@ -352,12 +464,14 @@ void BuildMaterials(ModelData& model, const glTF::Asset& asset)
         if (iter != textureOptions.end())
         {
             model.m_TextureOptions.push_back(iter->second);
-            CompileTextureOnDemand(asset.m_basePath + Utility::UTF8ToWideString(iter->first), iter->second);
+            cookRequests.push_back({ asset.m_basePath + Utility::UTF8ToWideString(iter->first), iter->second });
         }
         else
             model.m_TextureOptions.push_back(0xFF);
     }
     ASSERT(model.m_TextureOptions.size() == model.m_TextureNames.size());
+
+    CompileTexturesOnDemand(cookRequests);
 }
 
 void BuildAnimations(ModelData& model, const glTF::Asset& asset)
@@ -368,60 +482,13 @@ void BuildAnimations(ModelData& model, const glTF::Asset& asset)
 
     model.m_Animations.resize(numAnimations);
     uint32_t animIdx = 0;
+    size_t sourceBytes = 0;
 
     for (const glTF::Animation& anim : asset.m_animations)
-    {
-        AnimationSet& animSet = model.m_Animations[animIdx++];
-        animSet.duration = 0.0f;
-        animSet.firstCurve = (uint32_t)model.m_AnimationCurves.size();
-        animSet.numCurves = (uint32_t)anim.m_channels.size();
-
-        for (size_t i = 0; i < animSet.numCurves; ++i)
-        {
-            const glTF::AnimChannel& channel = anim.m_channels[i];
-            const glTF::AnimSampler& sampler = *channel.m_sampler;
-
-            ASSERT(channel.m_target->linearIdx >= 0);
-
-            AnimationCurve curve;
-            curve.targetNode = channel.m_target->linearIdx;
-            curve.targetPath = channel.m_path;
-            curve.interpolation = sampler.m_interpolation;
-            curve.keyFrameOffset = model.m_AnimationKeyFrameData.size();
-            curve.keyFrameFormat = std::min<uint32_t>(sampler.m_output->componentType, AnimationCurve::kFloat);
-            curve.numSegments = sampler.m_output->count - 1.0f;
-
-            // In glTF, stride==0 means "packed tightly"
-            if (sampler.m_output->stride == 0)
-            {
-                uint32_t numComponents = sampler.m_output->type + 1;
-                uint32_t bytesPerComponent = sampler.m_output->componentType / 2 + 1;
-                curve.keyFrameStride = numComponents * bytesPerComponent / 4;
-            }
-            else
-            {
-                ASSERT(sampler.m_output->stride <= 16 && sampler.m_output->stride % 4 == 0);
-                curve.keyFrameStride = sampler.m_output->stride / 4;
-            }
-
-            // Determine start and stop time stamps
-            const float* timeStamps = (float*)sampler.m_input->dataPtr;
-            curve.startTime = timeStamps[0];
-
-            const float endTime = timeStamps[sampler.m_output->count - 1];
-            curve.rangeScale = curve.numSegments / (endTime - curve.startTime);
-
-            animSet.duration = std::max<float>(animSet.duration, endTime);
+        sourceBytes += CompressAnimation(anim, model.m_Animations[animIdx++], model.m_AnimationCurves, model.m_AnimationKeyFrameData);
 
-            // Append this curve data
-            model.m_AnimationKeyFrameData.insert(
-                model.m_AnimationKeyFrameData.end(),
-                sampler.m_output->dataPtr,
-                sampler.m_output->dataPtr + sampler.m_output->count * curve.keyFrameStride * 4);
-
-            model.m_AnimationCurves.push_back(curve);
-        }
-    }
+    LOG_INFOF("Compressed %zu animations from %zu to %zu bytes", numAnimations, sourceBytes,
+        model.m_AnimationKeyFrameData.size() + model.m_AnimationCurves.size() * sizeof(AnimationCurve));
 }
 
 void BuildSkins(ModelData& model, const glTF::Asset& asset)
@@ -447,11 +514,11 @@ void BuildSkins(ModelData& model, const glTF::Asset& asset)
             model.m_JointIndices.push_back((uint16_t)joint->linearIdx);
         }
 
-        // Append IBMs
-        Matrix4* IBMstart = (Matrix4*)skin.inverseBindMatrices->dataPtr;
-        Matrix4* IBMend = IBMstart + skin.inverseBindMatrices->count;
+        // Append IBMs.  They may point straight into a mapped buffer, which glTF only aligns to 4 bytes.
+        const XMFLOAT4X4* IBMs = (const XMFLOAT4X4*)skin.inverseBindMatrices->dataPtr;
         ASSERT(skin.inverseBindMatrices->count == numJoints);
-        model.m_JointIBMs.insert(model.m_JointIBMs.end(), IBMstart, IBMend);
+        for (uint32_t i = 0; i < skin.inverseBindMatrices->count; ++i)
+            model.m_JointIBMs.push_back(Matrix4(XMLoadFloat4x4(&IBMs[i])));
     }
 
     // Assign skinned meshes the proper joint offset and count
@@ -468,21 +535,67 @@ void BuildSkins(ModelData& model, const glTF::Asset& asset)
 
 bool Renderer::BuildModel(ModelData& model, const glTF::Asset& asset, int sceneIdx)
 {
+    // Assets that failed to parse have no scene
+    const glTF::Scene* scene = sceneIdx < 0 ? asset.m_scene : &asset.m_scenes[sceneIdx];
+    if (scene == nullptr)
+        return false;
+
     BuildMaterials(model, asset);
 
     // Generate scene graph and meshes
     model.m_SceneGraph.resize(asset.m_nodes.size());
-    const glTF::Scene* scene = sceneIdx < 0 ? asset.m_scene : &asset.m_scenes[sceneIdx];
-    if (scene == nullptr)
-        return false;
 
-    // Aggregate all of the vertex and index buffers in this unified buffer
+    std::vector<MeshInstance> meshInstances;
+    uint32_t numNodes = WalkGraph(model.m_SceneGraph, meshInstances, scene->nodes, 0, Matrix4(kIdentity));
+    model.m_SceneGraph.resize(numNodes);
+
+    // Every primitive is optimized independently, so spread them all across the worker pool.
+    struct PrimitiveJob
+    {
+        uint32_t instanceIdx;
+        uint32_t primitiveIdx;
+    };
+
+    std::vector<std::vector<Primitive>> primitives(meshInstances.size());
+    std::vector<PrimitiveJob> jobs;
+    for (uint32_t i = 0; i < meshInstances.size(); ++i)
+    {
+        const uint32_t numPrimitives = (uint32_t)meshInstances[i].mesh->primitives.size();
+        primitives[i].resize(numPrimitives);
+        for (uint32_t j = 0; j < numPrimitives; ++j)
+            jobs.push_back({ i, j });
+    }
+
+    concurrency::parallel_for(size_t(0), jobs.size(), [&](size_t i)
+    {
+        const MeshInstance& instance = meshInstances[jobs[i].instanceIdx];
+        OptimizeMesh(primitives[jobs[i].instanceIdx][jobs[i].primitiveIdx],
+            instance.mesh->primitives[jobs[i].primitiveIdx], instance.localToObject);
+    });
+
+    // Pack the results in scene graph order so the output matches a serial build byte for byte.
+    // Aggregate all of the vertex and index buffers in this unified buffer.
     std::vector<byte>& bufferMemory = model.m_GeometryData;
 
     model.m_BoundingSphere = BoundingSphere(kZero);
     model.m_BoundingBox = AxisAlignedBox(kZero);
-    uint32_t numNodes = WalkGraph(model.m_SceneGraph, model.m_BoundingSphere, model.m_BoundingBox, model.m_Meshes, bufferMemory, scene->nodes, 0, Matrix4(kIdentity));
-    model.m_SceneGraph.resize(numNodes);
+    for (uint32_t i = 0; i < meshInstances.size(); ++i)
+    {
+        // Quantized positions are relative to the bounds of the whole mesh, since its primitives share a node
+        AxisAlignedBox boxLS(kZero);
+        for (const Primitive& prim : primitives[i])
+            boxLS.AddBoundingBox(prim.m_BBoxLS);
+
+        BoundingSphere sphereOS;
+        AxisAlignedBox boxOS;
+        PackMesh(model.m_Meshes, model.m_Clusters, bufferMemory, *meshInstances[i].mesh, meshInstances[i].matrixIdx, primitives[i], sphereOS, boxOS,
+            model.m_VertexQuantization, boxLS, model.m_QuantizationReport);
+        model.m_BoundingSphere = model.m_BoundingSphere.Union(sphereOS);
+        model.m_BoundingBox.AddBoundingBox(boxOS);
+
+        // Release the optimized streams as soon as they have been copied
+        primitives[i].clear();
+    }
 
     BuildAnimations(model, asset);
     BuildSkins(model, asset);
@@ -490,7 +603,7 @@ bool Renderer::BuildModel(ModelData& model, const glTF::Asset& asset, int sceneI
     return true;
 }
 
-bool Renderer::SaveModel(const std::wstring& filePath, const ModelData& data)
+bool Renderer::SaveModel(const std::wstring& filePath, const ModelData& data, bool compress)
 {
     std::ofstream outFile(filePath, std::ios::out | std::ios::binary);
     if (!outFile)
@@ -499,18 +612,11 @@ bool Renderer::SaveModel(const std::wstring& filePath, const ModelData& data)
     FileHeader header;
     std::memcpy(header.id, "MINI", 4);
     header.version = CURRENT_MINI_FILE_VERSION;
+    header.numSections = MiniSection::kCount;
     header.numNodes = (uint32_t)data.m_SceneGraph.size();
     header.numMeshes = (uint32_t)data.m_Meshes.size();
     header.numMaterials = (uint32_t)data.m_MaterialConstants.size();
-    header.meshDataSize = 0;
-    for (const Mesh* mesh : data.m_Meshes)
-        header.meshDataSize += (uint32_t)sizeof(Mesh) + (mesh->numDraws - 1) * (uint32_t)sizeof(Mesh::Draw);
     header.numTextures = (uint32_t)data.m_TextureNames.size();
-    header.stringTableSize = 0;
-    for (const std::string& str : data.m_TextureNames)
-        header.stringTableSize += (uint32_t)str.size() + 1;
-    header.geometrySize = (uint32_t)data.m_GeometryData.size();
-    header.keyFrameDataSize = (uint32_t)data.m_AnimationKeyFrameData.size();
     header.numAnimationCurves = (uint32_t)data.m_AnimationCurves.size();
     header.numAnimations = (uint32_t)data.m_Animations.size();
     header.numJoints = (uint32_t)data.m_JointIndices.size();
@@ -524,36 +630,92 @@ bool Renderer::SaveModel(const std::wstring& filePath, const ModelData& data)
     header.maxPos[0] = data.m_BoundingBox.GetMax().GetX();
     header.maxPos[1] = data.m_BoundingBox.GetMax().GetY();
     header.maxPos[2] = data.m_BoundingBox.GetMax().GetZ();
-
-    outFile.write((char*)&header, sizeof(FileHeader));
-    outFile.write((char*)data.m_GeometryData.data(), header.geometrySize);
-    outFile.write((char*)data.m_SceneGraph.data(), header.numNodes * sizeof(GraphNode));
-    for (const Mesh* mesh : data.m_Meshes)
-        outFile.write((char*)mesh, sizeof(Mesh) + (mesh->numDraws - 1) * sizeof(Mesh::Draw));
-    outFile.write((char*)data.m_MaterialConstants.data(), header.numMaterials * sizeof(MaterialConstantData));
-    outFile.write((char*)data.m_MaterialTextures.data(), header.numMaterials * sizeof(MaterialTextureData));
-    for (uint32_t i = 0; i < header.numTextures; ++i)
-        outFile << data.m_TextureNames[i] << '\0';
-    outFile.write((char*)data.m_TextureOptions.data(), header.numTextures * sizeof(uint8_t));
+    header.vertexQuantization = data.m_VertexQuantization;
 
     if (header.numAnimations > 0)
+        ASSERT(data.m_AnimationKeyFrameData.size() > 0 && header.numAnimationCurves > 0);
+    else
+        ASSERT(data.m_AnimationKeyFrameData.size() == 0 && header.numAnimationCurves == 0);
+
+    ASSERT(header.numJoints == (uint32_t)data.m_JointIBMs.size());
+
+    // Mesh records and texture names are variable-length, so flatten them first
+    std::vector<byte> meshData;
+    for (const Mesh* mesh : data.m_Meshes)
     {
-        ASSERT(header.keyFrameDataSize > 0 && header.numAnimationCurves > 0);
-        outFile.write((char*)data.m_AnimationKeyFrameData.data(), header.keyFrameDataSize);
-        outFile.write((char*)data.m_AnimationCurves.data(), header.numAnimationCurves * sizeof(AnimationCurve));
-        outFile.write((char*)data.m_Animations.data(), header.numAnimations * sizeof(AnimationSet));
+        const byte* meshBytes = (const byte*)mesh;
+        meshData.insert(meshData.end(), meshBytes, meshBytes + sizeof(Mesh) + (mesh->numDraws - 1) * sizeof(Mesh::Draw));
     }
-    else
+
+    std::vector<byte> stringTable;
+    for (const std::string& str : data.m_TextureNames)
+        stringTable.insert(stringTable.end(), str.c_str(), str.c_str() + str.size() + 1);
+
+    struct SectionSource
+    {
+        const void* data;
+        size_t size;
+    };
+
+    SectionSource sources[MiniSection::kCount];
+    sources[MiniSection::kGeometry] = { data.m_GeometryData.data(), data.m_GeometryData.size() };
+    sources[MiniSection::kSceneGraph] = { data.m_SceneGraph.data(), header.numNodes * sizeof(GraphNode) };
+    sources[MiniSection::kMeshData] = { meshData.data(), meshData.size() };
+    sources[MiniSection::kMaterialConstants] = { data.m_MaterialConstants.data(), header.numMaterials * sizeof(MaterialConstantData) };
+    sources[MiniSection::kMaterialTextures] = { data.m_MaterialTextures.data(), header.numMaterials * sizeof(MaterialTextureData) };
+    sources[MiniSection::kStringTable] = { stringTable.data(), stringTable.size() };
+    sources[MiniSection::kTextureOptions] = { data.m_TextureOptions.data(), header.numTextures * sizeof(uint8_t) };
+    sources[MiniSection::kKeyFrameData] = { data.m_AnimationKeyFrameData.data(), data.m_AnimationKeyFrameData.size() };
+    sources[MiniSection::kAnimationCurves] = { data.m_AnimationCurves.data(), header.numAnimationCurves * sizeof(AnimationCurve) };
+    sources[MiniSection::kAnimations] = { data.m_Animations.data(), header.numAnimations * sizeof(AnimationSet) };
+    sources[MiniSection::kJointIndices] = { data.m_JointIndices.data(), header.numJoints * sizeof(uint16_t) };
+    sources[MiniSection::kJointIBMs] = { data.m_JointIBMs.data(), header.numJoints * sizeof(Matrix4) };
+    sources[MiniSection::kClusters] = { data.m_Clusters.data(), data.m_Clusters.size() * sizeof(MeshCluster) };
+
+    // Encode each section and lay them out after the section table
+    SectionDesc sections[MiniSection::kCount];
+    Utility::ByteArray compressed[MiniSection::kCount];
+    uint64_t offset = sizeof(FileHeader) + sizeof(sections);
+
+    for (uint32_t i = 0; i < MiniSection::kCount; ++i)
     {
-        ASSERT(header.keyFrameDataSize == 0 && header.numAnimationCurves == 0);
+        const void* storedData = sources[i].data;
+        SectionDesc& section = sections[i];
+        section.size = sources[i].size;
+        section.storedSize = sources[i].size;
+        section.codec = SectionCodec::kRaw;
+
+        if (compress)
+            compressed[i] = Utility::CompressBuffer(sources[i].data, sources[i].size);
+
+        if (compressed[i] != nullptr && compressed[i] != Utility::NullFile)
+        {
+            storedData = compressed[i]->data();
+            section.storedSize = compressed[i]->size();
+            section.codec = SectionCodec::kZlib;
+        }
+
+        offset = Math::AlignUp(offset, kMiniSectionAlignment);
+        section.offset = offset;
+        section.crc = Utility::ComputeCrc32(storedData, (size_t)section.storedSize);
+        offset += section.storedSize;
     }
 
-    if (header.numJoints)
+    outFile.write((char*)&header, sizeof(FileHeader));
+    outFile.write((char*)sections, sizeof(sections));
+
+    static const char padding[kMiniSectionAlignment] = {};
+    uint64_t filePos = sizeof(FileHeader) + sizeof(sections);
+
+    for (uint32_t i = 0; i < MiniSection::kCount; ++i)
     {
-        ASSERT(header.numJoints == (uint32_t)data.m_JointIBMs.size());
-        outFile.write((char*)data.m_JointIndices.data(), header.numJoints * sizeof(uint16_t));
-        outFile.write((char*)data.m_JointIBMs.data(), header.numJoints * sizeof(Matrix4));
+        const SectionDesc& section = sections[i];
+        const void* storedData = section.codec == SectionCodec::kZlib ? compressed[i]->data() : sources[i].data;
+
+        outFile.write(padding, (std::streamsize)(section.offset - filePos));
+        outFile.write((const char*)storedData, (std::streamsize)section.storedSize);
+        filePos = section.offset + section.storedSize;
     }
 
-    return true;
+    return !!outFile;
 }
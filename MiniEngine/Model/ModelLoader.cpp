@@ -22,13 +22,49 @@
 #include "TextureManager.h"
 #include "TextureConvert.h"
 #include "GraphicsCommon.h"
+#include "Util/CommandLineArg.h"
 
+#include <algorithm>
 #include <fstream>
 #include <unordered_map>
 
 using namespace Renderer;
 using namespace Graphics;
 
+namespace Renderer
+{
+    BoolVar MapModelFiles("Renderer/Memory-Map Models", true);
+    BoolVar CompressModelFiles("Renderer/Compress Model Files", false);
+    BoolVar VerifyModelFiles("Renderer/Verify Model Checksums", false);
+
+    const char* VertexQuantizationLabels[] = { "Full Precision", "Positions", "Positions + Normals", "Compact" };
+    EnumVar VertexQuantizationProfile("Renderer/Vertex Quantization", 0, _countof(VertexQuantizationLabels), VertexQuantizationLabels);
+}
+
+// The profile named by -vertex_quantization if given, otherwise the tuning variable's
+uint32_t Renderer::GetVertexQuantization(void)
+{
+    using namespace VertexQuantization;
+
+    static const uint32_t kProfiles[] = { 0, kPositions, kPositions | kNormals, kPositions | kNormals | kTexcoords };
+    static_assert(_countof(kProfiles) == _countof(VertexQuantizationLabels), "One set of options per profile");
+
+    uint32_t profile = (uint32_t)(int32_t)VertexQuantizationProfile;
+    CommandLineArgs::GetInteger(L"vertex_quantization", profile);
+    return kProfiles[std::min<uint32_t>(profile, _countof(kProfiles) - 1)];
+}
+
+static void LogQuantizationReport(const std::wstring& fileName, const VertexQuantizationReport& report)
+{
+    const size_t saved = report.bytesBefore - report.bytesAfter;
+    LOG_INFOF("%s: vertex quantization saved %zu of %zu bytes (%.1f%%).  Max error: position %g, normal %.3f deg, "
+        "tangent %.3f deg, texcoord %g.  %u primitives kept float16 texcoords.",
+        Utility::WideStringToUTF8(fileName).c_str(), saved, report.bytesBefore,
+        report.bytesBefore > 0 ? 100.0 * saved / report.bytesBefore : 0.0,
+        report.maxPositionError, report.maxNormalError, report.maxTangentError, report.maxTexcoordError,
+        report.texcoordsKept);
+}
+
 std::unordered_map<uint32_t, uint32_t> g_SamplerPermutations;
 
 D3D12_CPU_DESCRIPTOR_HANDLE GetSampler(uint32_t addressModes)
@@ -40,9 +76,10 @@ D3D12_CPU_DESCRIPTOR_HANDLE GetSampler(uint32_t addressModes)
 }
 
 void LoadMaterials(Model& model,
-    const std::vector<MaterialTextureData>& materialTextures,
+    const MaterialTextureData* materialTextures,
+    uint32_t numMaterials,
     const std::vector<std::wstring>& textureNames,
-    const std::vector<uint8_t>& textureOptions,
+    const uint8_t* textureOptions,
     const std::wstring& basePath)
 {
     static_assert((sizeof(MaterialConstants) % 256) == 0, "CBVs need 256 byte alignment");
@@ -50,17 +87,22 @@ void LoadMaterials(Model& model,
     // Load textures
     const uint32_t numTextures = (uint32_t)textureNames.size();
     model.textures.resize(numTextures);
+
+    std::vector<TextureCookRequest> cookRequests(numTextures);
     for (size_t ti = 0; ti < numTextures; ++ti)
     {
-        std::wstring originalFile = basePath + textureNames[ti];
-        CompileTextureOnDemand(originalFile, textureOptions[ti]);
+        cookRequests[ti].originalFile = basePath + textureNames[ti];
+        cookRequests[ti].flags = textureOptions[ti];
+    }
+    CompileTexturesOnDemand(cookRequests);
 
-        std::wstring ddsFile = Utility::RemoveExtension(originalFile) + L".dds";
+    for (size_t ti = 0; ti < numTextures; ++ti)
+    {
+        std::wstring ddsFile = Utility::RemoveExtension(cookRequests[ti].originalFile) + L".dds";
         model.textures[ti] = TextureManager::LoadDDSFromFile(ddsFile);
     }
 
     // Generate descriptor tables and record offsets for each material
-    const uint32_t numMaterials = (uint32_t)materialTextures.size();
     std::vector<uint32_t> tableOffsets(numMaterials);
 
     for (uint32_t matIdx = 0; matIdx < numMaterials; ++matIdx)
@@ -122,7 +164,7 @@ void LoadMaterials(Model& model,
     }
 
     // Update table offsets for each mesh
-    uint8_t* meshPtr = model.m_MeshData.get();
+    uint8_t* meshPtr = model.m_MeshData;
     for (uint32_t i = 0; i < model.m_NumMeshes; ++i)
     {
         Mesh& mesh = *(Mesh*)meshPtr;
@@ -134,119 +176,242 @@ void LoadMaterials(Model& model,
     }
 }
 
-std::shared_ptr<Model> Renderer::LoadModel(const std::wstring& filePath, bool forceRebuild)
+// Reads the header and section table of a .mini file and decodes individual sections on request, either
+// from a memory-mapped view or from a stream.
+class MiniFileReader
 {
-    const std::wstring miniFileName = Utility::RemoveExtension(filePath) + L".mini";
-    const std::wstring fileName = Utility::RemoveBasePath(filePath);
+public:
+    MiniFileReader() : m_FileSize(0)
+    {
+        std::memset(&m_Header, 0, sizeof(FileHeader));
+        std::memset(m_Sections, 0, sizeof(m_Sections));
+    }
 
-    struct _stat64 sourceFileStat;
-    struct _stat64 miniFileStat;
-    std::ifstream inFile;
-    FileHeader header;
+    bool Open(const std::wstring& fileName, bool mapFile);
+    void Close(void) { m_MappedFile = nullptr; m_File.close(); }
 
-    bool sourceFileMissing = _wstat64(filePath.c_str(), &sourceFileStat) == -1;
-    bool miniFileMissing = _wstat64(miniFileName.c_str(), &miniFileStat) == -1;
+    const FileHeader& GetHeader(void) const { return m_Header; }
+    const SectionDesc& GetSection(uint32_t id) const { return m_Sections[id]; }
 
-    if (sourceFileMissing)
-        forceRebuild = false;
+    // Returns a pointer to a raw section within the mapped file, or nullptr if it must be read with ReadSection()
+    uint8_t* MapSection(uint32_t id);
 
-    if (sourceFileMissing && miniFileMissing)
+    // Decodes a section into a buffer of at least GetSection(id).size bytes
+    bool ReadSection(uint32_t id, void* dest);
+
+    std::unique_ptr<Utility::MappedFile> ReleaseMapping(void) { return std::move(m_MappedFile); }
+
+private:
+    FileHeader m_Header;
+    SectionDesc m_Sections[MiniSection::kCount];
+    std::unique_ptr<Utility::MappedFile> m_MappedFile;
+    std::ifstream m_File;
+    uint64_t m_FileSize;
+};
+
+bool MiniFileReader::Open(const std::wstring& fileName, bool mapFile)
+{
+    Close();
+
+    if (mapFile)
     {
-        LOG_ERRORF("Error: Could not find %s.", Utility::WideStringToUTF8(fileName).c_str());
-        return nullptr;
+        m_MappedFile.reset(new Utility::MappedFile);
+        if (!m_MappedFile->Open(fileName) || m_MappedFile->GetSize() < sizeof(FileHeader))
+            return false;
+        m_FileSize = m_MappedFile->GetSize();
+        std::memcpy(&m_Header, m_MappedFile->GetData(), sizeof(FileHeader));
+    }
+    else
+    {
+        m_File.open(fileName, std::ios::in | std::ios::binary | std::ios::ate);
+        if (!m_File)
+            return false;
+        m_FileSize = (uint64_t)m_File.tellg();
+        m_File.seekg(0);
+        m_File.read((char*)&m_Header, sizeof(FileHeader));
+        if (!m_File)
+            return false;
     }
 
-    bool needBuild = forceRebuild;
+    if (strncmp(m_Header.id, "MINI", 4) != 0 || m_Header.version != CURRENT_MINI_FILE_VERSION)
+        return false;
 
-    // Check if .mini file exists and it is newer than source file
-    if (miniFileMissing || !sourceFileMissing && sourceFileStat.st_mtime > miniFileStat.st_mtime)
-        needBuild = true;
+    // Tables from newer writers may have more sections than we know about; older ones may have fewer
+    const uint64_t tableSize = m_Header.numSections * sizeof(SectionDesc);
+    if (sizeof(FileHeader) + tableSize > m_FileSize)
+        return false;
 
-    // Check if it's an older version of .mini
-    if (!needBuild)
+    const uint32_t numKnownSections = std::min<uint32_t>(m_Header.numSections, MiniSection::kCount);
+    if (m_MappedFile)
     {
-        inFile = std::ifstream(miniFileName, std::ios::in | std::ios::binary);
-        inFile.read((char*)&header, sizeof(FileHeader));
-        if (strncmp(header.id, "MINI", 4) != 0 || header.version != CURRENT_MINI_FILE_VERSION)
-        {
-            LOG_INFOF("Model version deprecated.  Rebuilding %s...", Utility::WideStringToUTF8(fileName).c_str());
-            needBuild = true;
-            inFile.close();
-        }
+        std::memcpy(m_Sections, m_MappedFile->GetData() + sizeof(FileHeader), numKnownSections * sizeof(SectionDesc));
+    }
+    else
+    {
+        m_File.read((char*)m_Sections, numKnownSections * sizeof(SectionDesc));
+        if (!m_File)
+            return false;
     }
 
-    if (needBuild)
+    for (uint32_t i = 0; i < numKnownSections; ++i)
     {
-        if (sourceFileMissing)
-        {
-            LOG_ERRORF("Error: Could not find %s.", Utility::WideStringToUTF8(fileName).c_str());
-            return nullptr;
-        }
+        const SectionDesc& section = m_Sections[i];
+        if (section.offset + section.storedSize > m_FileSize ||
+            section.codec == SectionCodec::kRaw && section.storedSize != section.size ||
+            section.codec > SectionCodec::kZlib)
+            return false;
+    }
+
+    return true;
+}
+
+uint8_t* MiniFileReader::MapSection(uint32_t id)
+{
+    const SectionDesc& section = m_Sections[id];
+    if (!m_MappedFile || section.codec != SectionCodec::kRaw || section.size == 0)
+        return nullptr;
 
-        ModelData modelData;
+    uint8_t* data = m_MappedFile->GetData() + section.offset;
 
-        const std::wstring fileExt = Utility::ToLower(Utility::GetFileExtension(filePath));
+    // Checksumming faults in every page, so by default we trust raw mapped data
+    if (VerifyModelFiles && Utility::ComputeCrc32(data, (size_t)section.storedSize) != section.crc)
+        return nullptr;
 
-        if (fileExt == L"gltf" || fileExt == L"glb")
-        {
-            glTF::Asset asset(filePath);
-            if (!BuildModel(modelData, asset))
-                return nullptr;
-        }
-        else if (fileExt == L"h3d")
-        {
-            ModelH3D modelh3d;
-            const std::wstring basePath = Utility::GetBasePath(filePath);
-            if (!modelh3d.Load(filePath) || !modelh3d.BuildModel(modelData, basePath))
-                return nullptr;
-        }
-        else
+    return data;
+}
+
+bool MiniFileReader::ReadSection(uint32_t id, void* dest)
+{
+    const SectionDesc& section = m_Sections[id];
+    if (section.size == 0)
+        return true;
+
+    const uint8_t* stored = nullptr;
+    std::unique_ptr<uint8_t[]> streamedData;
+
+    if (m_MappedFile)
+    {
+        stored = m_MappedFile->GetData() + section.offset;
+    }
+    else
+    {
+        // Raw sections stream straight into the destination
+        uint8_t* readTarget = (uint8_t*)dest;
+        if (section.codec != SectionCodec::kRaw)
         {
-            LOG_ERRORF("Unsupported model file extension: %s.", Utility::WideStringToUTF8(fileExt).c_str());
-            return nullptr;
+            streamedData.reset(new uint8_t[(size_t)section.storedSize]);
+            readTarget = streamedData.get();
         }
+        m_File.seekg((std::streamoff)section.offset);
+        m_File.read((char*)readTarget, (std::streamsize)section.storedSize);
+        if (!m_File)
+            return false;
+        stored = readTarget;
+    }
 
-        if (!SaveModel(miniFileName, modelData))
-            return nullptr;
+    if (Utility::ComputeCrc32(stored, (size_t)section.storedSize) != section.crc)
+        return false;
 
-        inFile = std::ifstream(miniFileName, std::ios::in | std::ios::binary);
-        inFile.read((char*)&header, sizeof(FileHeader));
-    }
+    if (section.codec == SectionCodec::kZlib)
+        return Utility::DecompressBuffer(stored, (size_t)section.storedSize, dest, (size_t)section.size);
 
-    if (!inFile)
-        return nullptr;
+    if (stored != dest)
+        std::memcpy(dest, stored, (size_t)section.size);
 
-    ASSERT(strncmp(header.id, "MINI", 4) == 0 && header.version == CURRENT_MINI_FILE_VERSION);
+    return true;
+}
+
+// Creates the model from an open .mini file.  Returns nullptr if a section fails its integrity check.
+static std::shared_ptr<Model> ReadMiniFile(MiniFileReader& reader, const std::wstring& filePath,
+    const std::wstring& miniFileName, bool skipAnimation)
+{
+    const FileHeader& header = reader.GetHeader();
 
     std::wstring basePath = Utility::GetBasePath(filePath);
 
     std::shared_ptr<Model> model(new Model);
 
-    model->m_NumNodes = header.numNodes;
-    model->m_SceneGraph.reset(new GraphNode[header.numNodes]);
-    model->m_NumMeshes = header.numMeshes;
-    model->m_MeshData.reset(new uint8_t[header.meshDataSize]);
-
-	if (header.geometrySize > 0)
+    const SectionDesc& geometry = reader.GetSection(MiniSection::kGeometry);
+	if (geometry.size > 0)
 	{
 		UploadBuffer modelData;
-		modelData.Create(L"Model Data Upload", header.geometrySize);
-		inFile.read((char*)modelData.Map(), header.geometrySize);
+		modelData.Create(L"Model Data Upload", (size_t)geometry.size);
+		bool geometryValid = reader.ReadSection(MiniSection::kGeometry, modelData.Map());
 		modelData.Unmap();
-		model->m_DataBuffer.Create(L"Model Data", header.geometrySize, 1, modelData);
+		if (!geometryValid)
+		{
+			LOG_ERRORF("Error: Corrupt geometry in %s.", Utility::WideStringToUTF8(miniFileName).c_str());
+			return nullptr;
+		}
+		model->m_DataBuffer.Create(L"Model Data", (uint32_t)geometry.size, 1, modelData);
 	}
 
-    inFile.read((char*)model->m_SceneGraph.get(), header.numNodes * sizeof(GraphNode));
-    inFile.read((char*)model->m_MeshData.get(), header.meshDataSize);
+    // Everything else stays resident on the CPU.  Raw sections of a mapped file are used in place and their
+    // pages are only faulted in as they are touched.  The rest are decoded into a single heap block.
+    const bool loadAnimation = header.numAnimations > 0 && !skipAnimation;
+    const bool loadJoints = header.numJoints > 0;
+
+    uint8_t* sectionData[MiniSection::kCount] = {};
+    bool loadSection[MiniSection::kCount] = {};
+    for (uint32_t i = MiniSection::kSceneGraph; i < MiniSection::kCount; ++i)
+        loadSection[i] = reader.GetSection(i).size > 0;
+    loadSection[MiniSection::kKeyFrameData] &= loadAnimation;
+    loadSection[MiniSection::kAnimationCurves] &= loadAnimation;
+    loadSection[MiniSection::kAnimations] &= loadAnimation;
+    loadSection[MiniSection::kJointIndices] &= loadJoints;
+    loadSection[MiniSection::kJointIBMs] &= loadJoints;
+
+    size_t heapSize = 0;
+    for (uint32_t i = 0; i < MiniSection::kCount; ++i)
+    {
+        if (!loadSection[i])
+            continue;
+
+        sectionData[i] = reader.MapSection(i);
+        if (sectionData[i] == nullptr)
+            heapSize += Math::AlignUp((size_t)reader.GetSection(i).size, 16);
+    }
+
+    if (heapSize > 0)
+    {
+        model->m_HeapData.reset(new uint8_t[heapSize]);
+        uint8_t* heapPtr = model->m_HeapData.get();
+
+        for (uint32_t i = 0; i < MiniSection::kCount; ++i)
+        {
+            if (!loadSection[i] || sectionData[i] != nullptr)
+                continue;
+
+            if (!reader.ReadSection(i, heapPtr))
+            {
+                LOG_ERRORF("Error: Corrupt section %u in %s.", i, Utility::WideStringToUTF8(miniFileName).c_str());
+                return nullptr;
+            }
+
+            sectionData[i] = heapPtr;
+            heapPtr += Math::AlignUp((size_t)reader.GetSection(i).size, 16);
+        }
+    }
+
+    model->m_MappedFile = reader.ReleaseMapping();
+
+    model->m_NumNodes = header.numNodes;
+    model->m_SceneGraph = (GraphNode*)sectionData[MiniSection::kSceneGraph];
+    model->BuildHierarchy();
+    model->m_NumMeshes = header.numMeshes;
+    model->m_MeshData = sectionData[MiniSection::kMeshData];
+    model->m_NumClusters = (uint32_t)(reader.GetSection(MiniSection::kClusters).size / sizeof(MeshCluster));
+    model->m_Clusters = (MeshCluster*)sectionData[MiniSection::kClusters];
 
 	if (header.numMaterials > 0)
 	{
+		const MaterialConstantData* srcConstants = (const MaterialConstantData*)sectionData[MiniSection::kMaterialConstants];
 		UploadBuffer materialConstants;
 		materialConstants.Create(L"Material Constant Upload", header.numMaterials * sizeof(MaterialConstants));
 		MaterialConstants* materialCBV = (MaterialConstants*)materialConstants.Map();
 		for (uint32_t i = 0; i < header.numMaterials; ++i)
 		{
-			inFile.read((char*)materialCBV, sizeof(MaterialConstantData));
+			std::memcpy(materialCBV, srcConstants + i, sizeof(MaterialConstantData));
 			materialCBV++;
 		}
 		materialConstants.Unmap();
@@ -254,47 +419,156 @@ std::shared_ptr<Model> Renderer::LoadModel(const std::wstring& filePath, bool fo
 	}
 
     // Read material texture and sampler properties so we can load the material
-    std::vector<MaterialTextureData> materialTextures(header.numMaterials);
-    inFile.read((char*)materialTextures.data(), header.numMaterials * sizeof(MaterialTextureData));
+    const MaterialTextureData* materialTextures = (const MaterialTextureData*)sectionData[MiniSection::kMaterialTextures];
 
     std::vector<std::wstring> textureNames(header.numTextures);
-    for (uint32_t i = 0; i < header.numTextures; ++i)
+    const char* stringTable = (const char*)sectionData[MiniSection::kStringTable];
+    const char* stringTableEnd = stringTable + reader.GetSection(MiniSection::kStringTable).size;
+    for (uint32_t i = 0; i < header.numTextures && stringTable < stringTableEnd; ++i)
     {
-        std::string utf8TextureName;
-        std::getline(inFile, utf8TextureName, '\0');
-        textureNames[i] = Utility::UTF8ToWideString(utf8TextureName);
+        size_t length = strnlen(stringTable, stringTableEnd - stringTable);
+        textureNames[i] = Utility::UTF8ToWideString(std::string(stringTable, length));
+        stringTable += length + 1;
     }
 
-    std::vector<uint8_t> textureOptions(header.numTextures);
-    inFile.read((char*)textureOptions.data(), header.numTextures * sizeof(uint8_t));
+    const uint8_t* textureOptions = sectionData[MiniSection::kTextureOptions];
 
-    LoadMaterials(*model, materialTextures, textureNames, textureOptions, basePath);
+    LoadMaterials(*model, materialTextures, header.numMaterials, textureNames, textureOptions, basePath);
 
     model->m_BoundingSphere = BoundingSphere(*(XMFLOAT4*)header.boundingSphere);
     model->m_BoundingBox = AxisAlignedBox(Vector3(*(XMFLOAT3*)header.minPos), Vector3(*(XMFLOAT3*)header.maxPos));
 
     // Load animation data
-    model->m_NumAnimations = header.numAnimations;
+    if (loadAnimation)
+    {
+        ASSERT(sectionData[MiniSection::kKeyFrameData] != nullptr && header.numAnimationCurves > 0);
+        model->m_NumAnimations = header.numAnimations;
+        model->m_KeyFrameData = sectionData[MiniSection::kKeyFrameData];
+        model->m_CurveData = (AnimationCurve*)sectionData[MiniSection::kAnimationCurves];
+        model->m_Animations = (AnimationSet*)sectionData[MiniSection::kAnimations];
+    }
 
-    if (header.numAnimations > 0)
+    if (loadJoints)
     {
-        ASSERT(header.keyFrameDataSize > 0 && header.numAnimationCurves > 0);
-        model->m_KeyFrameData.reset(new uint8_t[header.keyFrameDataSize]);
-        inFile.read((char*)model->m_KeyFrameData.get(), header.keyFrameDataSize);
-        model->m_CurveData.reset(new AnimationCurve[header.numAnimationCurves]);
-        inFile.read((char*)model->m_CurveData.get(), header.numAnimationCurves * sizeof(AnimationCurve));
-        model->m_Animations.reset(new AnimationSet[header.numAnimations]);
-        inFile.read((char*)model->m_Animations.get(), header.numAnimations * sizeof(AnimationSet));
+        model->m_NumJoints = header.numJoints;
+        model->m_JointIndices = (uint16_t*)sectionData[MiniSection::kJointIndices];
+        model->m_JointIBMs = (Matrix4*)sectionData[MiniSection::kJointIBMs];
     }
 
-    model->m_NumJoints = header.numJoints;
+    return model;
+}
+
+// Compiles the source model into a .mini file
+static bool BuildMiniFile(const std::wstring& filePath, const std::wstring& miniFileName, uint32_t vertexQuantization)
+{
+    const std::wstring fileName = Utility::RemoveBasePath(filePath);
+
+    ModelData modelData;
+    modelData.m_VertexQuantization = vertexQuantization;
 
-    if (header.numJoints > 0)
+    const std::wstring fileExt = Utility::ToLower(Utility::GetFileExtension(filePath));
+
+    if (fileExt == L"gltf" || fileExt == L"glb")
+    {
+        // Mapping the binary buffers is the default; -gltf_map_buffers 0 reads them into memory instead
+        uint32_t mapBuffers = 1;
+        CommandLineArgs::GetInteger(L"gltf_map_buffers", mapBuffers);
+
+        glTF::Asset asset(filePath, glTF::Asset::kStreaming,
+            mapBuffers != 0 ? glTF::Asset::kMapBuffers : glTF::Asset::kReadBuffers);
+        if (!BuildModel(modelData, asset))
+            return false;
+    }
+    else if (fileExt == L"h3d")
     {
-        model->m_JointIndices.reset(new uint16_t[header.numJoints]);
-        inFile.read((char*)model->m_JointIndices.get(), header.numJoints * sizeof(uint16_t));
-        model->m_JointIBMs.reset(new Matrix4[header.numJoints]);
-        inFile.read((char*)model->m_JointIBMs.get(), header.numJoints * sizeof(Matrix4));
+        ModelH3D modelh3d;
+        const std::wstring basePath = Utility::GetBasePath(filePath);
+        if (!modelh3d.Load(filePath) || !modelh3d.BuildModel(modelData, basePath))
+            return false;
+    }
+    else
+    {
+        LOG_ERRORF("Unsupported model file extension: %s.", Utility::WideStringToUTF8(fileExt).c_str());
+        return false;
+    }
+
+    if (vertexQuantization != 0)
+        LogQuantizationReport(fileName, modelData.m_QuantizationReport);
+
+    return SaveModel(miniFileName, modelData, CompressModelFiles);
+}
+
+std::shared_ptr<Model> Renderer::LoadModel(const std::wstring& filePath, bool forceRebuild, bool skipAnimation)
+{
+    const std::wstring miniFileName = Utility::RemoveExtension(filePath) + L".mini";
+    const std::wstring fileName = Utility::RemoveBasePath(filePath);
+
+    struct _stat64 sourceFileStat;
+    struct _stat64 miniFileStat;
+    MiniFileReader reader;
+
+    bool sourceFileMissing = _wstat64(filePath.c_str(), &sourceFileStat) == -1;
+    bool miniFileMissing = _wstat64(miniFileName.c_str(), &miniFileStat) == -1;
+
+    if (sourceFileMissing)
+        forceRebuild = false;
+
+    if (sourceFileMissing && miniFileMissing)
+    {
+        LOG_ERRORF("Error: Could not find %s.", Utility::WideStringToUTF8(fileName).c_str());
+        return nullptr;
+    }
+
+    bool needBuild = forceRebuild;
+
+    // Check if .mini file exists and it is newer than source file
+    if (miniFileMissing || !sourceFileMissing && sourceFileStat.st_mtime > miniFileStat.st_mtime)
+        needBuild = true;
+
+    // Check if it's an older version of .mini
+    if (!needBuild && !reader.Open(miniFileName, MapModelFiles))
+    {
+        LOG_INFOF("Model version deprecated.  Rebuilding %s...", Utility::WideStringToUTF8(fileName).c_str());
+        needBuild = true;
+
+        // Release the file so that it can be overwritten
+        reader.Close();
+    }
+
+    const uint32_t vertexQuantization = GetVertexQuantization();
+
+    // Check if it was built with a different vertex format
+    if (!needBuild && !sourceFileMissing && reader.GetHeader().vertexQuantization != vertexQuantization)
+    {
+        LOG_INFOF("Vertex quantization changed.  Rebuilding %s...", Utility::WideStringToUTF8(fileName).c_str());
+        needBuild = true;
+        reader.Close();
+    }
+
+    if (needBuild)
+    {
+        if (sourceFileMissing)
+        {
+            LOG_ERRORF("Error: Could not find %s.", Utility::WideStringToUTF8(fileName).c_str());
+            return nullptr;
+        }
+
+        if (!BuildMiniFile(filePath, miniFileName, vertexQuantization) || !reader.Open(miniFileName, MapModelFiles))
+            return nullptr;
+    }
+
+    std::shared_ptr<Model> model = ReadMiniFile(reader, filePath, miniFileName, skipAnimation);
+
+    // A damaged cache is rebuilt the same way as a stale one
+    if (model == nullptr && !needBuild && !sourceFileMissing)
+    {
+        LOG_INFOF("Model file corrupt.  Rebuilding %s...", Utility::WideStringToUTF8(fileName).c_str());
+        reader.Close();
+
+        if (!BuildMiniFile(filePath, miniFileName, vertexQuantization) || !reader.Open(miniFileName, MapModelFiles))
+            return nullptr;
+
+        model = ReadMiniFile(reader, filePath, miniFileName, skipAnimation);
     }
 
     return model;
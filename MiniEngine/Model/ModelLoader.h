@@ -24,12 +24,47 @@
 
 namespace glTF { class Asset; struct Mesh; }
 
-#define CURRENT_MINI_FILE_VERSION 13
+#define CURRENT_MINI_FILE_VERSION 20
 
 namespace Renderer
 {
     using namespace Math;
 
+    // When set, .mini files are memory-mapped and used in place rather than read into heap copies
+    extern BoolVar MapModelFiles;
+    // When set, newly built .mini files have their sections zlib-compressed
+    extern BoolVar CompressModelFiles;
+    // When set, raw sections of mapped files are checksummed too, which touches every page up front
+    extern BoolVar VerifyModelFiles;
+
+    // Vertex quantization options.  A model is built with a combination of these, and each one that can be
+    // applied to a primitive sets the matching PSOFlags bit so that its input layout follows.
+    namespace VertexQuantization
+    {
+        enum : uint32_t
+        {
+            kPositions = 0x1,   // 16-bit positions relative to the mesh's bounding box
+            kNormals   = 0x2,   // 8-bit octahedral normals and tangents
+            kTexcoords = 0x4,   // 16-bit UNORM texture coordinates, when they lie within [0, 1]
+        };
+    }
+
+    // Profile used when building .mini files.  Files built with a different one are rebuilt on load.
+    extern EnumVar VertexQuantizationProfile;
+    uint32_t GetVertexQuantization( void );
+
+    // What quantization saved and what it cost, accumulated over every primitive of a model
+    struct VertexQuantizationReport
+    {
+        size_t bytesBefore;         // Both vertex streams in the default format
+        size_t bytesAfter;
+        float maxPositionError;     // Object space distance
+        float maxNormalError;       // Degrees
+        float maxTangentError;      // Degrees
+        float maxTexcoordError;
+        uint32_t texcoordsKept;     // Primitives whose texture coordinates didn't fit in UNORM
+    };
+
     // Unaligned mirror of MaterialConstants
     struct MaterialConstantData
     {
@@ -62,43 +97,95 @@ namespace Renderer
         std::vector<MaterialTextureData> m_MaterialTextures;
         std::vector<MaterialConstantData> m_MaterialConstants;
         std::vector<Mesh*> m_Meshes;
+        std::vector<MeshCluster> m_Clusters;
         std::vector<GraphNode> m_SceneGraph;
         std::vector<std::string> m_TextureNames;
         std::vector<uint8_t> m_TextureOptions;
+        uint32_t m_VertexQuantization = 0;
+        VertexQuantizationReport m_QuantizationReport = {};
+    };
+
+    // The sections of a .mini file.  Each has an entry in the section table, so new sections can be appended
+    // without invalidating existing files.  Readers ignore sections they don't know about and treat sections
+    // missing from an older table as empty.
+    namespace MiniSection
+    {
+        enum : uint32_t
+        {
+            kGeometry,
+            kSceneGraph,
+            kMeshData,
+            kMaterialConstants,
+            kMaterialTextures,
+            kStringTable,
+            kTextureOptions,
+            kKeyFrameData,
+            kAnimationCurves,
+            kAnimations,
+            kJointIndices,
+            kJointIBMs,
+            kClusters,
+
+            kCount
+        };
+    }
+
+    namespace SectionCodec
+    {
+        enum : uint32_t
+        {
+            kRaw,       // Stored as-is and can be used in place when the file is memory-mapped
+            kZlib,      // A zlib stream that must be decompressed when loaded
+        };
+    }
+
+    // Raw sections start on this boundary so that mapped data can hold aligned types like Matrix4
+    static const uint32_t kMiniSectionAlignment = 64;
+
+    struct SectionDesc
+    {
+        uint64_t offset;        // From the start of the file
+        uint64_t storedSize;    // Bytes on disk
+        uint64_t size;          // Bytes after decoding
+        uint32_t codec;         // SectionCodec
+        uint32_t crc;           // CRC-32 of the stored bytes
     };
 
     struct FileHeader
     {
         char     id[4];   // "MINI"
         uint32_t version; // CURRENT_MINI_FILE_VERSION
+        uint32_t numSections;   // Entries in the SectionDesc table that immediately follows the header
         uint32_t numNodes;
         uint32_t numMeshes;
         uint32_t numMaterials;
-        uint32_t meshDataSize;
         uint32_t numTextures;
-        uint32_t stringTableSize;
-        uint32_t geometrySize;
-        uint32_t keyFrameDataSize;      // Animation data
         uint32_t numAnimationCurves;
         uint32_t numAnimations;
         uint32_t numJoints;     // All joints for all skins
         float    boundingSphere[4];
         float    minPos[3];
         float    maxPos[3];
+        uint32_t vertexQuantization;    // VertexQuantization options the meshes were built with
     };
 
     void CompileMesh(
         std::vector<Mesh*>& meshList,
+        std::vector<MeshCluster>& clusterList,
         std::vector<byte>& bufferMemory,
         glTF::Mesh& srcMesh,
         uint32_t matrixIdx,
         const Matrix4& localToObject,
         Math::BoundingSphere& boundingSphere,
-        Math::AxisAlignedBox& boundingBox
+        Math::AxisAlignedBox& boundingBox,
+        uint32_t quantization,
+        const Math::AxisAlignedBox& quantizationBounds,
+        VertexQuantizationReport& report
     );
 
     bool BuildModel( ModelData& model, const glTF::Asset& asset, int sceneIdx = -1 );
-    bool SaveModel( const std::wstring& filePath, const ModelData& model );
+    bool SaveModel( const std::wstring& filePath, const ModelData& model, bool compress = false );
     
-    std::shared_ptr<Model> LoadModel( const std::wstring& filePath, bool forceRebuild = false );
+    // Static models can pass skipAnimation to leave keyframes and curves on disk
+    std::shared_ptr<Model> LoadModel( const std::wstring& filePath, bool forceRebuild = false, bool skipAnimation = false );
 }
\ No newline at end of file
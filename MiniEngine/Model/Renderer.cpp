@@ -24,6 +24,8 @@
 #include "../Core/GraphicsCommon.h"
 #include "../Core/BufferManager.h"
 #include "../Core/ShadowCamera.h"
+#include "../Core/SystemTime.h"
+#include "../Core/Math/Random.h"
 
 #include "CompiledShaders/DefaultVS.h"
 #include "CompiledShaders/DefaultSkinVS.h"
@@ -37,6 +39,14 @@
 #include "CompiledShaders/DefaultNoTangentNoUV1VS.h"
 #include "CompiledShaders/DefaultNoTangentNoUV1SkinVS.h"
 #include "CompiledShaders/DefaultNoTangentNoUV1PS.h"
+#include "CompiledShaders/DefaultOctVS.h"
+#include "CompiledShaders/DefaultSkinOctVS.h"
+#include "CompiledShaders/DefaultNoUV1OctVS.h"
+#include "CompiledShaders/DefaultNoUV1SkinOctVS.h"
+#include "CompiledShaders/DefaultNoTangentOctVS.h"
+#include "CompiledShaders/DefaultNoTangentSkinOctVS.h"
+#include "CompiledShaders/DefaultNoTangentNoUV1OctVS.h"
+#include "CompiledShaders/DefaultNoTangentNoUV1SkinOctVS.h"
 #include "CompiledShaders/DepthOnlyVS.h"
 #include "CompiledShaders/DepthOnlySkinVS.h"
 #include "CompiledShaders/CutoutDepthVS.h"
@@ -56,6 +66,11 @@ namespace Renderer
     float DebugFlag = 0.0f;
 
     BoolVar SeparateZPass("Renderer/Separate Z Pass", true);
+    BoolVar ClusterCulling("Renderer/Cluster Culling", true);
+    BoolVar EnableLODs("Renderer/LOD/Enable", true);
+    BoolVar ParallelCollection("Renderer/Parallel Draw Collection", true);
+    NumVar LODScreenSize("Renderer/LOD/Full Detail Size", 0.25f, 0.01f, 2.0f, 0.05f);
+    IntVar ShadowLODBias("Renderer/LOD/Shadow Bias", 1, 0, Mesh::kNumLODs - 1);
 
     bool s_Initialized = false;
 
@@ -269,6 +284,25 @@ void Renderer::Initialize(void)
 
     ASSERT(sm_PSOs.size() == 16);
 
+    // Quantized position PSOs
+
+    // 16-31:  The same depth and shadow PSOs in the same order, reading 16-bit positions
+    const D3D12_INPUT_ELEMENT_DESC* depthLayouts[] = { posOnly, posAndUV, skinPos, skinPosAndUV };
+    const uint32_t depthLayoutSizes[] = { _countof(posOnly), _countof(posAndUV), _countof(skinPos), _countof(skinPosAndUV) };
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        std::vector<D3D12_INPUT_ELEMENT_DESC> layout(depthLayouts[i & 3], depthLayouts[i & 3] + depthLayoutSizes[i & 3]);
+        layout[0].Format = DXGI_FORMAT_R16G16B16A16_UNORM;
+
+        GraphicsPSO QuantizedDepthPSO(L"Renderer: Quantized Depth PSO");
+        QuantizedDepthPSO = sm_PSOs[i];
+        QuantizedDepthPSO.SetInputLayout((uint32_t)layout.size(), layout.data());
+        QuantizedDepthPSO.Finalize();
+        sm_PSOs.push_back(QuantizedDepthPSO);
+    }
+
+    ASSERT(sm_PSOs.size() == 32);
+
     // Default PSO
 
     m_DefaultPSO.SetRootSignature(m_RootSig);
@@ -482,19 +516,27 @@ uint8_t Renderer::GetPSO(uint16_t psoFlags)
     uint16_t Requirements = kHasPosition | kHasNormal;
     ASSERT((psoFlags & Requirements) == Requirements);
 
+    const DXGI_FORMAT PositionFormat = (psoFlags & kQuantizedPosition) ? DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R32G32B32_FLOAT;
+    const DXGI_FORMAT TexcoordFormat = (psoFlags & kUNormTexcoord) ? DXGI_FORMAT_R16G16_UNORM : DXGI_FORMAT_R16G16_FLOAT;
+
     std::vector<D3D12_INPUT_ELEMENT_DESC> vertexLayout;
     if (psoFlags & kHasPosition)
-        vertexLayout.push_back({"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, D3D12_APPEND_ALIGNED_ELEMENT});
-    if (psoFlags & kHasNormal)
-        vertexLayout.push_back({"NORMAL",   0, DXGI_FORMAT_R10G10B10A2_UNORM,  0, D3D12_APPEND_ALIGNED_ELEMENT});
-    if (psoFlags & kHasTangent)
-        vertexLayout.push_back({"TANGENT",  0, DXGI_FORMAT_R10G10B10A2_UNORM,  0, D3D12_APPEND_ALIGNED_ELEMENT});
+        vertexLayout.push_back({"POSITION", 0, PositionFormat,                 0, D3D12_APPEND_ALIGNED_ELEMENT});
+    if (psoFlags & kOctahedralNormal)
+        vertexLayout.push_back({"NORMAL",   0, DXGI_FORMAT_R8G8B8A8_SNORM,     0, D3D12_APPEND_ALIGNED_ELEMENT});
+    else
+    {
+        if (psoFlags & kHasNormal)
+            vertexLayout.push_back({"NORMAL",   0, DXGI_FORMAT_R10G10B10A2_UNORM,  0, D3D12_APPEND_ALIGNED_ELEMENT});
+        if (psoFlags & kHasTangent)
+            vertexLayout.push_back({"TANGENT",  0, DXGI_FORMAT_R10G10B10A2_UNORM,  0, D3D12_APPEND_ALIGNED_ELEMENT});
+    }
     if (psoFlags & kHasUV0)
-        vertexLayout.push_back({"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       0, D3D12_APPEND_ALIGNED_ELEMENT});
+        vertexLayout.push_back({"TEXCOORD", 0, TexcoordFormat,                 0, D3D12_APPEND_ALIGNED_ELEMENT});
     else
         vertexLayout.push_back({"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       1, D3D12_APPEND_ALIGNED_ELEMENT});
     if (psoFlags & kHasUV1)
-        vertexLayout.push_back({"TEXCOORD", 1, DXGI_FORMAT_R16G16_FLOAT,       0, D3D12_APPEND_ALIGNED_ELEMENT});
+        vertexLayout.push_back({"TEXCOORD", 1, TexcoordFormat,                 0, D3D12_APPEND_ALIGNED_ELEMENT});
     if (psoFlags & kHasSkin)
     {
         vertexLayout.push_back({ "BLENDINDICES", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
@@ -503,18 +545,25 @@ uint8_t Renderer::GetPSO(uint16_t psoFlags)
 
     ColorPSO.SetInputLayout((uint32_t)vertexLayout.size(), vertexLayout.data());
 
+    // Octahedral normals use a variant of each vertex shader, named with an "Oct" suffix
+#define SetDefaultVS(Name) \
+    if (psoFlags & kOctahedralNormal) \
+        ColorPSO.SetVertexShader(g_p##Name##OctVS, sizeof(g_p##Name##OctVS)); \
+    else \
+        ColorPSO.SetVertexShader(g_p##Name##VS, sizeof(g_p##Name##VS))
+
     if (psoFlags & kHasSkin)
     {
         if (psoFlags & kHasTangent)
         {
             if (psoFlags & kHasUV1)
             {
-                ColorPSO.SetVertexShader(g_pDefaultSkinVS, sizeof(g_pDefaultSkinVS));
+                SetDefaultVS(DefaultSkin);
                 ColorPSO.SetPixelShader(g_pDefaultPS, sizeof(g_pDefaultPS));
             }
             else
             {
-                ColorPSO.SetVertexShader(g_pDefaultNoUV1SkinVS, sizeof(g_pDefaultNoUV1SkinVS));
+                SetDefaultVS(DefaultNoUV1Skin);
                 ColorPSO.SetPixelShader(g_pDefaultNoUV1PS, sizeof(g_pDefaultNoUV1PS));
             }
         }
@@ -522,12 +571,12 @@ uint8_t Renderer::GetPSO(uint16_t psoFlags)
         {
             if (psoFlags & kHasUV1)
             {
-                ColorPSO.SetVertexShader(g_pDefaultNoTangentSkinVS, sizeof(g_pDefaultNoTangentSkinVS));
+                SetDefaultVS(DefaultNoTangentSkin);
                 ColorPSO.SetPixelShader(g_pDefaultNoTangentPS, sizeof(g_pDefaultNoTangentPS));
             }
             else
             {
-                ColorPSO.SetVertexShader(g_pDefaultNoTangentNoUV1SkinVS, sizeof(g_pDefaultNoTangentNoUV1SkinVS));
+                SetDefaultVS(DefaultNoTangentNoUV1Skin);
                 ColorPSO.SetPixelShader(g_pDefaultNoTangentNoUV1PS, sizeof(g_pDefaultNoTangentNoUV1PS));
             }
         }
@@ -538,12 +587,12 @@ uint8_t Renderer::GetPSO(uint16_t psoFlags)
         {
             if (psoFlags & kHasUV1)
             {
-                ColorPSO.SetVertexShader(g_pDefaultVS, sizeof(g_pDefaultVS));
+                SetDefaultVS(Default);
                 ColorPSO.SetPixelShader(g_pDefaultPS, sizeof(g_pDefaultPS));
             }
             else
             {
-                ColorPSO.SetVertexShader(g_pDefaultNoUV1VS, sizeof(g_pDefaultNoUV1VS));
+                SetDefaultVS(DefaultNoUV1);
                 ColorPSO.SetPixelShader(g_pDefaultNoUV1PS, sizeof(g_pDefaultNoUV1PS));
             }
         }
@@ -551,17 +600,19 @@ uint8_t Renderer::GetPSO(uint16_t psoFlags)
         {
             if (psoFlags & kHasUV1)
             {
-                ColorPSO.SetVertexShader(g_pDefaultNoTangentVS, sizeof(g_pDefaultNoTangentVS));
+                SetDefaultVS(DefaultNoTangent);
                 ColorPSO.SetPixelShader(g_pDefaultNoTangentPS, sizeof(g_pDefaultNoTangentPS));
             }
             else
             {
-                ColorPSO.SetVertexShader(g_pDefaultNoTangentNoUV1VS, sizeof(g_pDefaultNoTangentNoUV1VS));
+                SetDefaultVS(DefaultNoTangentNoUV1);
                 ColorPSO.SetPixelShader(g_pDefaultNoTangentNoUV1PS, sizeof(g_pDefaultNoTangentNoUV1PS));
             }
         }
     }
 
+#undef SetDefaultVS
+
     if (psoFlags & kAlphaBlend)
     {
         ColorPSO.SetBlendState(BlendTraditional);
@@ -638,7 +689,9 @@ void MeshSorter::AddMesh( const Mesh& mesh, float distance,
     D3D12_GPU_VIRTUAL_ADDRESS meshCBV,
     D3D12_GPU_VIRTUAL_ADDRESS materialCBV,
     D3D12_GPU_VIRTUAL_ADDRESS bufferPtr,
-    const Joint* skeleton)
+    const Joint* skeleton,
+    const Mesh::Draw* draws,
+    uint32_t numDraws)
 {
     SortKey key;
     key.value = m_SortObjects.size();
@@ -648,7 +701,9 @@ void MeshSorter::AddMesh( const Mesh& mesh, float distance,
     bool skinned = (mesh.psoFlags & PSOFlags::kHasSkin) == PSOFlags::kHasSkin;
     bool twoSided = (mesh.psoFlags & PSOFlags::kTwoSided) == PSOFlags::kTwoSided;
 
-    uint64_t depthPSO = (skinned ? 2 : 0) + (alphaTest ? 1 : 0) + (twoSided ? 4 : 0);
+    bool quantized = (mesh.psoFlags & PSOFlags::kQuantizedPosition) == PSOFlags::kQuantizedPosition;
+
+    uint64_t depthPSO = (skinned ? 2 : 0) + (alphaTest ? 1 : 0) + (twoSided ? 4 : 0) + (quantized ? 16 : 0);
     uint64_t shadowedDepthPSO = depthPSO + 8;
 
     union float_or_int { float f; uint32_t u; } dist;
@@ -696,14 +751,221 @@ void MeshSorter::AddMesh( const Mesh& mesh, float distance,
         m_PassCounts[kOpaque]++;
     }
 
-    SortObject object = { &mesh, skeleton, meshCBV, materialCBV, bufferPtr };
+    SortObject object = { &mesh, skeleton, meshCBV, materialCBV, bufferPtr, (uint32_t)m_Draws.size(), numDraws };
     m_SortObjects.push_back(object);
+    m_Draws.insert(m_Draws.end(), draws, draws + numDraws);
+}
+
+// Sorts 64-bit keys one byte at a time from least to most significant.  All eight histograms are built
+// in one read of the keys, and bytes that are the same in every key (such as the high bits of the object
+// index, or the pass of a shadow batch) cost nothing beyond that.
+static void RadixSortKeys( std::vector<uint64_t>& keys, std::vector<uint64_t>& scratch )
+{
+    const size_t count = keys.size();
+
+    // Clearing the histograms costs more than a comparison sort of a handful of keys
+    if (count < 256)
+    {
+        std::sort(keys.begin(), keys.end());
+        return;
+    }
+
+    uint32_t histograms[8][256] = {};
+    for (uint64_t key : keys)
+    {
+        for (uint32_t digit = 0; digit < 8; ++digit)
+            ++histograms[digit][(key >> (digit * 8)) & 0xFF];
+    }
+
+    scratch.resize(count);
+    uint64_t* src = keys.data();
+    uint64_t* dst = scratch.data();
+
+    for (uint32_t digit = 0; digit < 8; ++digit)
+    {
+        uint32_t* histogram = histograms[digit];
+        const uint32_t shift = digit * 8;
+
+        if (histogram[(src[0] >> shift) & 0xFF] == count)
+            continue;
+
+        // Bucket counts become the position of each bucket's next key
+        uint32_t offset = 0;
+        for (uint32_t bucket = 0; bucket < 256; ++bucket)
+        {
+            const uint32_t bucketSize = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketSize;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const uint64_t key = src[i];
+            dst[histogram[(key >> shift) & 0xFF]++] = key;
+        }
+
+        std::swap(src, dst);
+    }
+
+    // Both arrays keep their capacity whichever one ends up holding the result
+    if (src != keys.data())
+        keys.swap(scratch);
 }
 
 void MeshSorter::Sort()
 {
-    struct { bool operator()(uint64_t a, uint64_t b) const { return a < b; } } Cmp;
-    std::sort(m_SortKeys.begin(), m_SortKeys.end(), Cmp);
+    RadixSortKeys(m_SortKeys, m_SortScratch);
+}
+
+void MeshSorter::BenchmarkSort(uint32_t iterations)
+{
+    if (iterations == 0)
+        return;
+
+    RandomNumberGenerator rng(1);
+
+    static const uint32_t kCounts[] = { 10000, 50000, 100000, 500000 };
+
+    for (uint32_t count : kCounts)
+    {
+        // Keys as AddMesh() builds them for a main view with a separate Z pass
+        std::vector<uint64_t> source(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            union float_or_int { float f; uint32_t u; } dist;
+            dist.f = rng.NextFloat(0.0f, 1000.0f);
+
+            SortKey key;
+            key.value = i & 0xFFFF;
+            key.passID = rng.NextInt((uint32_t)kTransparent);
+            key.psoIdx = rng.NextInt(63u);
+            key.key = key.passID == kTransparent ? ~dist.u : dist.u;
+            source[i] = key.value;
+        }
+
+        std::vector<uint64_t> comparisonKeys, radixKeys, scratch;
+        int64_t comparisonTicks = 0, radixTicks = 0;
+
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            comparisonKeys = source;
+            int64_t startTick = SystemTime::GetCurrentTick();
+            std::sort(comparisonKeys.begin(), comparisonKeys.end());
+            comparisonTicks += SystemTime::GetCurrentTick() - startTick;
+
+            radixKeys = source;
+            startTick = SystemTime::GetCurrentTick();
+            RadixSortKeys(radixKeys, scratch);
+            radixTicks += SystemTime::GetCurrentTick() - startTick;
+        }
+
+        const double comparisonMs = SystemTime::TicksToMillisecs(comparisonTicks) / iterations;
+        const double radixMs = SystemTime::TicksToMillisecs(radixTicks) / iterations;
+
+        LOG_INFOF("Sorting %u draws:  std::sort %.3f ms, radix sort %.3f ms (%.1fx)%s",
+            count, comparisonMs, radixMs, comparisonMs / radixMs,
+            comparisonKeys == radixKeys ? "" : ", RESULTS DIFFER");
+    }
+}
+
+void MeshSorter::SetCasterCulling(const BaseCamera& receiverCamera)
+{
+    ASSERT(m_Camera != nullptr, "Set the shadow camera before the caster volume");
+
+    // Nothing outside the shadow frustum can be rasterized into the shadow map
+    const Frustum& shadowFrustum = m_Camera->GetWorldSpaceFrustum();
+    m_NumCasterPlanes = 0;
+    for (int i = 0; i < 6; ++i)
+        m_CasterPlanes[m_NumCasterPlanes++] = shadowFrustum.GetFrustumPlane((Frustum::PlaneID)i);
+
+    // A mesh casts onto a receiver when moving it along the light's direction of travel can bring it inside
+    // the receiver frustum.  Receiver planes facing into the light still bound such meshes, and the rest
+    // are replaced by planes through the silhouette edges of the frustum, parallel to the light.
+    const Frustum& receivers = receiverCamera.GetWorldSpaceFrustum();
+    const Vector3 lightDir = m_Camera->GetForwardVec();
+
+    bool keepPlane[6];
+    for (int i = 0; i < 6; ++i)
+    {
+        const BoundingPlane plane = receivers.GetFrustumPlane((Frustum::PlaneID)i);
+        keepPlane[i] = Dot(plane.GetNormal(), lightDir) <= 0.0f;
+        if (keepPlane[i])
+            m_CasterPlanes[m_NumCasterPlanes++] = plane;
+    }
+
+    static const struct { Frustum::CornerID a, b; Frustum::PlaneID p, q; } kEdges[] =
+    {
+        { Frustum::kNearLowerLeft,  Frustum::kNearUpperLeft,  Frustum::kNearPlane,  Frustum::kLeftPlane },
+        { Frustum::kNearLowerRight, Frustum::kNearUpperRight, Frustum::kNearPlane,  Frustum::kRightPlane },
+        { Frustum::kNearUpperLeft,  Frustum::kNearUpperRight, Frustum::kNearPlane,  Frustum::kTopPlane },
+        { Frustum::kNearLowerLeft,  Frustum::kNearLowerRight, Frustum::kNearPlane,  Frustum::kBottomPlane },
+        { Frustum::kFarLowerLeft,   Frustum::kFarUpperLeft,   Frustum::kFarPlane,   Frustum::kLeftPlane },
+        { Frustum::kFarLowerRight,  Frustum::kFarUpperRight,  Frustum::kFarPlane,   Frustum::kRightPlane },
+        { Frustum::kFarUpperLeft,   Frustum::kFarUpperRight,  Frustum::kFarPlane,   Frustum::kTopPlane },
+        { Frustum::kFarLowerLeft,   Frustum::kFarLowerRight,  Frustum::kFarPlane,   Frustum::kBottomPlane },
+        { Frustum::kNearUpperLeft,  Frustum::kFarUpperLeft,   Frustum::kLeftPlane,  Frustum::kTopPlane },
+        { Frustum::kNearLowerLeft,  Frustum::kFarLowerLeft,   Frustum::kLeftPlane,  Frustum::kBottomPlane },
+        { Frustum::kNearUpperRight, Frustum::kFarUpperRight,  Frustum::kRightPlane, Frustum::kTopPlane },
+        { Frustum::kNearLowerRight, Frustum::kFarLowerRight,  Frustum::kRightPlane, Frustum::kBottomPlane },
+    };
+
+    Vector3 center(kZero);
+    for (int i = 0; i < 8; ++i)
+        center += receivers.GetFrustumCorner((Frustum::CornerID)i);
+    center = center * 0.125f;
+
+    for (const auto& edge : kEdges)
+    {
+        if (keepPlane[edge.p] == keepPlane[edge.q])
+            continue;
+
+        const Vector3 a = receivers.GetFrustumCorner(edge.a);
+        const Vector3 b = receivers.GetFrustumCorner(edge.b);
+        Vector3 normal = Cross(b - a, lightDir);
+
+        // An edge parallel to the light adds nothing that its neighbors don't already cover
+        if (LengthSquare(normal) <= 1e-6f * LengthSquare(b - a))
+            continue;
+
+        BoundingPlane plane(a, normal);
+        if (plane.DistanceFromPoint(center) < 0.0f)
+            plane = BoundingPlane(a, -normal);
+
+        m_CasterPlanes[m_NumCasterPlanes++] = plane;
+    }
+}
+
+void MeshSorter::Append(const MeshSorter& bucket)
+{
+    ASSERT(bucket.m_BatchType == m_BatchType);
+
+    // Sort keys refer to objects by a 16-bit index
+    const uint32_t objectBase = (uint32_t)m_SortObjects.size();
+    const uint32_t drawBase = (uint32_t)m_Draws.size();
+    ASSERT(objectBase + bucket.m_SortObjects.size() <= 0x10000, "Too many meshes for one sorter");
+
+    for (SortObject object : bucket.m_SortObjects)
+    {
+        object.firstDraw += drawBase;
+        m_SortObjects.push_back(object);
+    }
+    m_Draws.insert(m_Draws.end(), bucket.m_Draws.begin(), bucket.m_Draws.end());
+
+    for (uint64_t key : bucket.m_SortKeys)
+        m_SortKeys.push_back(key + objectBase);
+
+    for (uint32_t pass = 0; pass < kNumPasses; ++pass)
+        m_PassCounts[pass] += bucket.m_PassCounts[pass];
+}
+
+MeshSorter& MeshSorterPool::Acquire(MeshSorter::BatchType type)
+{
+    if (m_NumInUse == m_Sorters.size())
+        m_Sorters.emplace_back(new MeshSorter(type));
+    else
+        m_Sorters[m_NumInUse]->Reset(type);
+
+    return *m_Sorters[m_NumInUse++];
 }
 
 void MeshSorter::RenderMeshes(
@@ -833,6 +1095,8 @@ void MeshSorter::RenderMeshes(
             key.value = m_SortKeys[m_CurrentDraw];
             const SortObject& object = m_SortObjects[key.objectIdx];
             const Mesh& mesh = *object.mesh;
+            const Mesh::Draw* draws = object.numDraws > 0 ? &m_Draws[object.firstDraw] : mesh.draw;
+            const uint32_t numDraws = object.numDraws > 0 ? object.numDraws : mesh.numDraws;
 
             context.SetConstantBuffer(kMeshConstants, object.meshCBV);
             context.SetConstantBuffer(kMaterialConstants, object.materialCBV);
@@ -848,20 +1112,24 @@ void MeshSorter::RenderMeshes(
             if (m_CurrentPass == kZPass)
             {
                 bool alphaTest = (mesh.psoFlags & PSOFlags::kAlphaTest) == PSOFlags::kAlphaTest;
-                uint32_t stride = alphaTest ? 16u : 12u;
+                bool quantized = (mesh.psoFlags & PSOFlags::kQuantizedPosition) == PSOFlags::kQuantizedPosition;
+                uint32_t stride = (quantized ? 8u : 12u) + (alphaTest ? 4u : 0u);
                 if (mesh.numJoints > 0)
                     stride += 16;
                 context.SetVertexBuffer(0, {object.bufferPtr + mesh.vbDepthOffset, mesh.vbDepthSize, stride});
+                context.SetIndexBuffer({object.bufferPtr + mesh.ibDepthOffset, mesh.ibDepthSize, (DXGI_FORMAT)mesh.ibFormat});
+
+                for (uint32_t i = 0; i < numDraws; ++i)
+                    context.DrawIndexed(draws[i].primCount, draws[i].startIndex, draws[i].depthBaseVertex);
             }
             else
             {
                 context.SetVertexBuffer(0, {object.bufferPtr + mesh.vbOffset, mesh.vbSize, mesh.vbStride});
-            }
+                context.SetIndexBuffer({object.bufferPtr + mesh.ibOffset, mesh.ibSize, (DXGI_FORMAT)mesh.ibFormat});
 
-            context.SetIndexBuffer({object.bufferPtr + mesh.ibOffset, mesh.ibSize, (DXGI_FORMAT)mesh.ibFormat});
-
-            for (uint32_t i = 0; i < mesh.numDraws; ++i)
-                context.DrawIndexed(mesh.draw[i].primCount, mesh.draw[i].startIndex, mesh.draw[i].baseVertex);
+                for (uint32_t i = 0; i < numDraws; ++i)
+                    context.DrawIndexed(draws[i].primCount, draws[i].startIndex, draws[i].baseVertex);
+            }
 
             ++m_CurrentDraw;
         }
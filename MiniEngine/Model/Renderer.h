@@ -19,6 +19,8 @@
 #include "../Core/CommandContext.h"
 #include "../Core/UploadBuffer.h"
 #include "../Core/TextureManager.h"
+#include "Model.h"
+#include "SphereCulling.h"
 #include <cstdint>
 #include <vector>
 #include "VRS.h"
@@ -30,13 +32,16 @@ class DescriptorHeap;
 class ShadowCamera;
 class ShadowBuffer;
 struct GlobalConstants;
-struct Mesh;
-struct Joint;
 
 namespace Renderer
 {
     extern float DebugFlag;
     extern BoolVar SeparateZPass;
+    extern BoolVar ClusterCulling;
+    extern BoolVar EnableLODs;
+    extern BoolVar ParallelCollection;
+    extern NumVar LODScreenSize;
+    extern IntVar ShadowLODBias;
 
     using namespace Math;
 
@@ -85,6 +90,12 @@ namespace Renderer
         enum DrawPass { kZPass, kOpaque, kTransparent, kNumPasses };
 
 		MeshSorter(BatchType type)
+		{
+			Reset(type);
+		}
+
+        // Returns the sorter to its just-constructed state while keeping the capacity of its arrays
+		void Reset(BatchType type)
 		{
 			m_BatchType = type;
 			m_Camera = nullptr;
@@ -94,10 +105,12 @@ namespace Renderer
 			m_DSV = nullptr;
 			m_SortObjects.clear();
 			m_SortKeys.clear();
+			m_Draws.clear();
 			std::memset(m_PassCounts, 0, sizeof(m_PassCounts));
 			m_CurrentPass = kZPass;
 			m_CurrentDraw = 0;
             m_CullEnabled = true;
+            m_NumCasterPlanes = 0;
 		}
 
 		void SetCamera( const BaseCamera& camera ) { m_Camera = &camera; }
@@ -113,20 +126,54 @@ namespace Renderer
         const Frustum& GetWorldFrustum() const { return m_Camera->GetWorldSpaceFrustum(); }
         const Frustum& GetViewFrustum() const { return m_Camera->GetViewSpaceFrustum(); }
         const Matrix4& GetViewMatrix() const { return m_Camera->GetViewMatrix(); }
+        const Matrix4& GetProjMatrix() const { return m_Camera->GetProjMatrix(); }
+        BatchType GetBatchType() const { return m_BatchType; }
 
         void AddMesh( const Mesh& mesh, float distance,
             D3D12_GPU_VIRTUAL_ADDRESS meshCBV,
             D3D12_GPU_VIRTUAL_ADDRESS materialCBV,
             D3D12_GPU_VIRTUAL_ADDRESS bufferPtr,
-            const Joint* skeleton = nullptr);
+            const Joint* skeleton = nullptr,
+            const Mesh::Draw* draws = nullptr,
+            uint32_t numDraws = 0);
 
+        // Orders draws by pass, then depth, then PSO with an LSD radix sort of the 64-bit keys
         void Sort();
 
+        // Times Sort() against std::sort on 10K to 500K draws and logs the results
+        static void BenchmarkSort(uint32_t iterations);
+
         void RenderMeshes(DrawPass pass, GraphicsContext& context, GlobalConstants& globals);
 
 	    bool IsCullEnabled() const { return m_CullEnabled; }
         void SetCullEnabled(bool enabled) { m_CullEnabled = enabled; }
 
+        // For a directional light's shadow view, culls against the volume of possible shadow casters
+        // rather than the shadow camera's frustum alone.  That volume is what 'receiverCamera' sees,
+        // extruded toward the light and clipped to the shadow frustum.  Call after SetCamera() with a
+        // shadow camera looking along the light's direction of travel.
+        void SetCasterCulling(const BaseCamera& receiverCamera);
+
+        // Inward-facing world space planes of the caster volume, if there is one
+        uint32_t GetNumCasterPlanes() const { return m_NumCasterPlanes; }
+        const BoundingPlane* GetCasterPlanes() const { return m_CasterPlanes; }
+
+        // Appends the draws gathered by another sorter of the same batch type, as if they had been added
+        // here directly.  Appending buckets in a fixed order reproduces the serial draw order exactly.
+        void Append(const MeshSorter& bucket);
+
+        // Working memory for Model::Render().  It lives with the sorter rather than the thread so that
+        // views can be collected in parallel, and it keeps its capacity when the sorter is reused.
+        struct CollectScratch
+        {
+            SphereCulling::SphereList spheres;
+            std::vector<const Mesh*> meshes;
+            std::vector<uint32_t> visibleMask;
+            std::vector<Mesh::Draw> visibleDraws;
+            std::vector<std::unique_ptr<MeshSorter>> buckets;   // One per range of meshes
+        };
+        CollectScratch& GetCollectScratch() { return m_CollectScratch; }
+
     private:
 
         struct SortKey
@@ -151,10 +198,15 @@ namespace Renderer
             D3D12_GPU_VIRTUAL_ADDRESS meshCBV;
             D3D12_GPU_VIRTUAL_ADDRESS materialCBV;
             D3D12_GPU_VIRTUAL_ADDRESS bufferPtr;
+            uint32_t firstDraw;     // Into m_Draws when numDraws > 0.  Otherwise the mesh's own draws are used.
+            uint32_t numDraws;
         };
 
         std::vector<SortObject> m_SortObjects;
+        std::vector<Mesh::Draw> m_Draws;
         std::vector<uint64_t> m_SortKeys;
+        std::vector<uint64_t> m_SortScratch;    // Second buffer for the radix sort passes
+        CollectScratch m_CollectScratch;
 		BatchType m_BatchType;
         uint32_t m_PassCounts[kNumPasses];
         DrawPass m_CurrentPass;
@@ -169,6 +221,26 @@ namespace Renderer
         
         // If culling is enabled.
         bool m_CullEnabled;
+
+        BoundingPlane m_CasterPlanes[SphereCulling::kMaxPlanes];
+        uint32_t m_NumCasterPlanes;
 	};
 
+    // Hands out sorters that keep their arrays from frame to frame, so that steady-state frames
+    // allocate nothing while gathering and sorting draws.  Call BeginFrame() once per frame; the
+    // sorters acquired during the previous frame are then reused in the same order.
+    class MeshSorterPool
+    {
+    public:
+        void BeginFrame() { m_NumInUse = 0; }
+
+        MeshSorter& Acquire(MeshSorter::BatchType type);
+
+        void Destroy() { m_Sorters.clear(); m_NumInUse = 0; }
+
+    private:
+        std::vector<std::unique_ptr<MeshSorter>> m_Sorters;
+        uint32_t m_NumInUse = 0;
+    };
+
 } // namespace Renderer
\ No newline at end of file
@@ -0,0 +1,53 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+
+#include "SelfTests.h"
+#include "Renderer.h"
+#include "SphereCulling.h"
+#include "LightGridCPU.h"
+#include "MeshoptDecoder.h"
+#include "glTF.h"
+#include "../Core/Util/CommandLineArg.h"
+
+void SelfTests::Run( const std::wstring& modelFile )
+{
+    uint32_t cullBenchmarkIterations;
+    if (CommandLineArgs::GetInteger(L"cull_benchmark", cullBenchmarkIterations))
+        SphereCulling::Benchmark(cullBenchmarkIterations);
+
+    uint32_t sortBenchmarkIterations;
+    if (CommandLineArgs::GetInteger(L"sort_benchmark", sortBenchmarkIterations))
+        Renderer::MeshSorter::BenchmarkSort(sortBenchmarkIterations);
+
+    uint32_t lightGridTest;
+    if (CommandLineArgs::GetInteger(L"light_grid_test", lightGridTest) && lightGridTest != 0)
+        LightGridCPU::Validate();
+
+    uint32_t lightGridBenchmarkIterations;
+    if (CommandLineArgs::GetInteger(L"light_grid_benchmark", lightGridBenchmarkIterations))
+        LightGridCPU::Benchmark(lightGridBenchmarkIterations);
+
+    uint32_t meshoptTest;
+    if (CommandLineArgs::GetInteger(L"meshopt_test", meshoptTest) && meshoptTest != 0)
+        MeshoptDecoder::Validate();
+
+    uint32_t parseBenchmarkIterations;
+    if (CommandLineArgs::GetInteger(L"gltf_parse_benchmark", parseBenchmarkIterations))
+    {
+        const std::wstring fileExt = Utility::ToLower(Utility::GetFileExtension(modelFile));
+        if (fileExt == L"gltf" || fileExt == L"glb")
+            glTF::Asset::BenchmarkParse(modelFile, parseBenchmarkIterations);
+        else
+            LOG_WARNF("-gltf_parse_benchmark needs a .gltf or .glb model, not %s.", Utility::WideStringToUTF8(modelFile).c_str());
+    }
+}
@@ -0,0 +1,34 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+// The validation routines and benchmarks of the model library, run on request from the command line:
+//
+//   -cull_benchmark N           scalar and SIMD sphere culling
+//   -sort_benchmark N           MeshSorter's radix sort against std::sort
+//   -light_grid_test 1          CPU light grid against its scalar reference
+//   -light_grid_benchmark N     CPU light grid binning
+//   -meshopt_test 1             EXT_meshopt_compression filter round trips
+//   -gltf_parse_benchmark N     streaming and DOM parsing of the model file
+//
+// N is the number of iterations.  Results are logged.
+//
+
+#pragma once
+
+#include <string>
+
+namespace SelfTests
+{
+    // Runs whichever tests and benchmarks the command line asks for.  modelFile is the model the
+    // application loads, used by the tests that need an asset.
+    void Run( const std::wstring& modelFile );
+}
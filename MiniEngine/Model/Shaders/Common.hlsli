@@ -44,6 +44,23 @@ SamplerComparisonState shadowSampler : register(s11);
 SamplerState cubeMapSampler : register(s12);
 SamplerState clampSampler : register(s13);
 
+// Inverse of the octahedral mapping used for quantized normals (see OctahedralUnwrap() in MeshConvert.cpp)
+float3 OctahedralDecode(float2 f)
+{
+    float3 n = float3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = saturate(-n.z);
+    n.xy += n.xy >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// A quantized tangent keeps its handedness in the sign of x, with the x coordinate itself stored as a
+// magnitude of 1 to 127 (in 1/127 units).
+float4 DecodeOctahedralTangent(float2 f)
+{
+    float x = (abs(f.x) * 127.0 - 1.0) / 63.0 - 1.0;
+    return float4(OctahedralDecode(float2(x, f.y)), f.x < 0.0 ? -1.0 : 1.0);
+}
+
 #ifndef ENABLE_TRIANGLE_ID
     #define ENABLE_TRIANGLE_ID 0
 #endif
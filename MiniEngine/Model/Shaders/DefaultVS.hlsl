@@ -21,6 +21,8 @@ cbuffer MeshConstants : register(b0)
 {
     float4x4 WorldMatrix;   // Object to world
     float3x3 WorldIT;       // Object normal to world normal
+    float3 PosScale;        // Decodes quantized positions (identity otherwise)
+    float3 PosBias;
 };
 
 cbuffer GlobalConstants : register(b1)
@@ -45,9 +47,13 @@ StructuredBuffer<Joint> Joints : register(t20);
 struct VSInput
 {
     float3 position : POSITION;
+#ifdef OCTAHEDRAL_NORMALS
+    float4 normal : NORMAL;     // Octahedral normal in xy and tangent in zw
+#else
     float3 normal : NORMAL;
 #ifndef NO_TANGENT_FRAME
     float4 tangent : TANGENT;
+#endif
 #endif
     float2 uv0 : TEXCOORD0;
 #ifndef NO_SECOND_UV
@@ -79,11 +85,18 @@ VSOutput main(VSInput vsInput)
 {
     VSOutput vsOutput;
 
-    float4 position = float4(vsInput.position, 1.0);
+    float4 position = float4(vsInput.position * PosScale + PosBias, 1.0);
+#ifdef OCTAHEDRAL_NORMALS
+    float3 normal = OctahedralDecode(vsInput.normal.xy);
+#ifndef NO_TANGENT_FRAME
+    float4 tangent = DecodeOctahedralTangent(vsInput.normal.zw);
+#endif
+#else
     float3 normal = vsInput.normal * 2 - 1;
 #ifndef NO_TANGENT_FRAME
     float4 tangent = vsInput.tangent * 2 - 1;
 #endif
+#endif
 
 #ifdef ENABLE_SKINNING
     // I don't like this hack.  The weights should be normalized already, but something is fishy.
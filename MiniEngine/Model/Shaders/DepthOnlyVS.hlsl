@@ -21,6 +21,8 @@ cbuffer MeshConstants : register(b0)
 {
     float4x4 WorldMatrix;   // Object to world
     float3x3 WorldIT;       // Object normal to world normal
+    float3 PosScale;        // Decodes quantized positions (identity otherwise)
+    float3 PosBias;
 };
 
 cbuffer GlobalConstants : register(b1)
@@ -63,7 +65,8 @@ VSOutput main(VSInput vsInput)
 {
     VSOutput vsOutput;
 
-    float4 position = float4(vsInput.position, 1.0);
+    // Must match DefaultVS exactly so that the depth prepass and the color pass produce the same depths
+    float4 position = float4(vsInput.position * PosScale + PosBias, 1.0);
 
 #ifdef ENABLE_SKINNING
     // I don't like this hack.  The weights should be normalized already, but something is fishy.
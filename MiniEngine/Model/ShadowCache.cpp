@@ -0,0 +1,82 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+
+#include "ShadowCache.h"
+#include "Model.h"
+#include "LightManager.h"
+#include "../Core/Camera.h"
+#include "../Core/Hash.h"
+
+#include <algorithm>
+
+const std::vector<uint32_t>& ShadowCache::Update(ModelInstance& scene, uint32_t maxRefreshes)
+{
+    const uint32_t numLights = Lighting::MaxLights;
+
+    if (m_MatrixHash.size() != numLights)
+    {
+        m_MatrixHash.assign(numLights, 0);
+        m_SceneHash.assign(numLights, 0);
+        m_RenderedHash.assign(numLights, 0);
+        m_Rendered.assign(numLights, 0);
+        m_Model = nullptr;
+    }
+
+    // Recreated lights or shadow buffers leave nothing worth keeping
+    if (Lighting::GetShadowVersion() != m_ShadowVersion)
+    {
+        m_ShadowVersion = Lighting::GetShadowVersion();
+        Invalidate();
+    }
+
+    // The meshes in a light's frustum can only change when something moved.  Otherwise only lights
+    // whose matrix changed are hashed again.
+    const bool sceneChanged = scene.GetModel() != m_Model || scene.GetTransformVersion() != m_TransformVersion;
+    m_Model = scene.GetModel();
+    m_TransformVersion = scene.GetTransformVersion();
+
+    for (uint32_t i = 0; i < numLights; ++i)
+    {
+        const size_t matrixHash = Utility::HashState(&Lighting::m_LightShadowMatrix[i]);
+        if (!sceneChanged && matrixHash == m_MatrixHash[i])
+            continue;
+
+        m_MatrixHash[i] = matrixHash;
+        m_SceneHash[i] = scene.HashMeshesInFrustum(Lighting::GetShadowCamera(i).GetWorldSpaceFrustum(), matrixHash);
+    }
+
+    m_LightsToRender.clear();
+    maxRefreshes = std::min(maxRefreshes, kMaxRefreshesPerFrame);
+
+    for (uint32_t n = 0; n < numLights && m_LightsToRender.size() < maxRefreshes; ++n)
+    {
+        const uint32_t i = (m_NextLight + n) % numLights;
+        if (m_Rendered[i] && m_RenderedHash[i] == m_SceneHash[i])
+            continue;
+
+        m_RenderedHash[i] = m_SceneHash[i];
+        m_Rendered[i] = 1;
+        m_LightsToRender.push_back(i);
+    }
+
+    // Continue after the last light refreshed so that every stale light gets its turn
+    if (!m_LightsToRender.empty())
+        m_NextLight = (m_LightsToRender.back() + 1) % numLights;
+
+    return m_LightsToRender;
+}
+
+void ShadowCache::Invalidate(void)
+{
+    std::fill(m_Rendered.begin(), m_Rendered.end(), (uint8_t)0);
+}
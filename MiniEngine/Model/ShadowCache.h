@@ -0,0 +1,56 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+// Keeps the spot light shadow maps in Lighting::m_LightShadowArray for as long as they stay valid.
+// Each light is summarized by a hash of its shadow matrix and of the meshes inside its frustum with
+// their transforms.  A shadow map is only rendered again once that hash differs from the one it was
+// rendered with, so a static scene stops drawing light shadows entirely once they have all been
+// rendered.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class Model;
+class ModelInstance;
+
+class ShadowCache
+{
+public:
+    // Most shadow maps that may be refreshed in one frame
+    static const uint32_t kMaxRefreshesPerFrame = 16;
+
+    ShadowCache() : m_Model(nullptr), m_TransformVersion(0), m_ShadowVersion(0), m_NextLight(0) {}
+
+    // Returns the lights whose shadow maps are out of date and must be rendered this frame, at most
+    // 'maxRefreshes' of them.  Lights are visited round robin so that none waits indefinitely when more
+    // are stale than the budget allows.  The returned lights are considered up to date afterward.  All
+    // of them are stale again once the lights or shadow buffers change Lighting::GetShadowVersion().
+    const std::vector<uint32_t>& Update(ModelInstance& scene, uint32_t maxRefreshes);
+
+private:
+    // Forgets every shadow map, once the lights or the shadow buffers have been recreated
+    void Invalidate(void);
+
+    std::vector<size_t> m_MatrixHash;       // Per light, hash of its shadow matrix
+    std::vector<size_t> m_SceneHash;        // Per light, m_MatrixHash plus the meshes in its frustum
+    std::vector<size_t> m_RenderedHash;     // Per light, m_SceneHash when its shadow map was rendered
+    std::vector<uint8_t> m_Rendered;        // Per light, whether its shadow map was ever rendered
+    std::vector<uint32_t> m_LightsToRender;
+
+    const Model* m_Model;                   // The model and transforms the scene hashes were made from
+    uint32_t m_TransformVersion;
+    uint32_t m_ShadowVersion;               // Lighting::GetShadowVersion() the shadow maps were rendered into
+    uint32_t m_NextLight;
+};
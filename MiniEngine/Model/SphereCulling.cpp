@@ -0,0 +1,230 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+
+#include "SphereCulling.h"
+#include "../Core/Camera.h"
+#include "../Core/SystemTime.h"
+#include "../Core/Utility.h"
+#include "../Core/Math/Random.h"
+
+#include <intrin.h>
+#include <immintrin.h>
+#include <cstring>
+
+using namespace Math;
+
+namespace
+{
+    // Plane coefficients (normal and distance), one array per component
+    struct PlaneSet
+    {
+        float x[SphereCulling::kMaxPlanes], y[SphereCulling::kMaxPlanes], z[SphereCulling::kMaxPlanes], w[SphereCulling::kMaxPlanes];
+        uint32_t count;
+
+        PlaneSet( const BoundingPlane* planes, uint32_t numPlanes ) : count(numPlanes)
+        {
+            ASSERT(numPlanes <= SphereCulling::kMaxPlanes, "Too many culling planes (%u)", numPlanes);
+
+            for (uint32_t i = 0; i < numPlanes; ++i)
+            {
+                XMFLOAT4 plane;
+                XMStoreFloat4(&plane, Vector4(planes[i]));
+                x[i] = plane.x;
+                y[i] = plane.y;
+                z[i] = plane.z;
+                w[i] = plane.w;
+            }
+        }
+    };
+
+    // AVX needs both CPU support and an OS that saves the upper halves of the registers
+    bool DetectAVX( void )
+    {
+        int info[4];
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        return osxsave && avx && (_xgetbv(0) & 6) == 6;
+    }
+
+    const bool s_HasAVX = DetectAVX();
+}
+
+// Handles the spheres left over after the last full vector
+static void CullTail( const PlaneSet& planes, const SphereCulling::SphereList& spheres, uint32_t first, uint32_t* visibleMask )
+{
+    for (uint32_t i = first; i < spheres.Size(); ++i)
+    {
+        bool inside = true;
+        for (uint32_t p = 0; p < planes.count; ++p)
+        {
+            const float d = planes.x[p] * spheres.centerX[i] + planes.y[p] * spheres.centerY[i] +
+                planes.z[p] * spheres.centerZ[i] + planes.w[p] + spheres.radius[i];
+            inside &= d >= 0.0f;
+        }
+        if (inside)
+            visibleMask[i / 32] |= 1u << (i % 32);
+    }
+}
+
+static uint32_t CullSpheresSSE( const PlaneSet& planes, const SphereCulling::SphereList& spheres, uint32_t* visibleMask )
+{
+    const uint32_t count = spheres.Size() & ~3u;
+    const __m128 zero = _mm_setzero_ps();
+
+    for (uint32_t i = 0; i < count; i += 4)
+    {
+        const __m128 cx = _mm_loadu_ps(&spheres.centerX[i]);
+        const __m128 cy = _mm_loadu_ps(&spheres.centerY[i]);
+        const __m128 cz = _mm_loadu_ps(&spheres.centerZ[i]);
+        const __m128 r = _mm_loadu_ps(&spheres.radius[i]);
+
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (uint32_t p = 0; p < planes.count; ++p)
+        {
+            __m128 d = _mm_add_ps(_mm_set1_ps(planes.w[p]), r);
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes.x[p]), cx));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes.y[p]), cy));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes.z[p]), cz));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+        }
+
+        visibleMask[i / 32] |= (uint32_t)_mm_movemask_ps(inside) << (i % 32);
+    }
+
+    return count;
+}
+
+static uint32_t CullSpheresAVX( const PlaneSet& planes, const SphereCulling::SphereList& spheres, uint32_t* visibleMask )
+{
+    const uint32_t count = spheres.Size() & ~7u;
+    const __m256 zero = _mm256_setzero_ps();
+
+    __m256 px[SphereCulling::kMaxPlanes], py[SphereCulling::kMaxPlanes], pz[SphereCulling::kMaxPlanes], pw[SphereCulling::kMaxPlanes];
+    for (uint32_t p = 0; p < planes.count; ++p)
+    {
+        px[p] = _mm256_set1_ps(planes.x[p]);
+        py[p] = _mm256_set1_ps(planes.y[p]);
+        pz[p] = _mm256_set1_ps(planes.z[p]);
+        pw[p] = _mm256_set1_ps(planes.w[p]);
+    }
+
+    for (uint32_t i = 0; i < count; i += 8)
+    {
+        const __m256 cx = _mm256_loadu_ps(&spheres.centerX[i]);
+        const __m256 cy = _mm256_loadu_ps(&spheres.centerY[i]);
+        const __m256 cz = _mm256_loadu_ps(&spheres.centerZ[i]);
+        const __m256 r = _mm256_loadu_ps(&spheres.radius[i]);
+
+        __m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+        for (uint32_t p = 0; p < planes.count; ++p)
+        {
+            __m256 d = _mm256_add_ps(pw[p], r);
+            d = _mm256_add_ps(d, _mm256_mul_ps(px[p], cx));
+            d = _mm256_add_ps(d, _mm256_mul_ps(py[p], cy));
+            d = _mm256_add_ps(d, _mm256_mul_ps(pz[p], cz));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, zero, _CMP_GE_OQ));
+        }
+
+        visibleMask[i / 32] |= (uint32_t)_mm256_movemask_ps(inside) << (i % 32);
+    }
+
+    // Avoid the penalty for mixing AVX with the SSE code that follows
+    _mm256_zeroupper();
+    return count;
+}
+
+void SphereCulling::CullSpheres( const Frustum& frustum, const SphereList& spheres, uint32_t* visibleMask )
+{
+    BoundingPlane planes[6];
+    for (int i = 0; i < 6; ++i)
+        planes[i] = frustum.GetFrustumPlane((Frustum::PlaneID)i);
+
+    CullSpheres(planes, 6, spheres, visibleMask);
+}
+
+void SphereCulling::CullSpheres( const BoundingPlane* cullPlanes, uint32_t numPlanes, const SphereList& spheres, uint32_t* visibleMask )
+{
+    std::memset(visibleMask, 0, MaskSize(spheres.Size()) * sizeof(uint32_t));
+
+    const PlaneSet planes(cullPlanes, numPlanes);
+    const uint32_t numDone = s_HasAVX ? CullSpheresAVX(planes, spheres, visibleMask) : CullSpheresSSE(planes, spheres, visibleMask);
+    CullTail(planes, spheres, numDone, visibleMask);
+}
+
+void SphereCulling::CullSpheresScalar( const Frustum& frustum, const SphereList& spheres, uint32_t* visibleMask )
+{
+    std::memset(visibleMask, 0, MaskSize(spheres.Size()) * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < spheres.Size(); ++i)
+    {
+        const BoundingSphere sphere(Vector3(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]), spheres.radius[i]);
+        if (frustum.IntersectSphere(sphere))
+            visibleMask[i / 32] |= 1u << (i % 32);
+    }
+}
+
+bool SphereCulling::UsesAVX( void )
+{
+    return s_HasAVX;
+}
+
+void SphereCulling::Benchmark( uint32_t iterations )
+{
+    if (iterations == 0)
+        return;
+
+    // A typical view into a field of objects, some of which straddle the frustum planes
+    Camera camera;
+    camera.SetEyeAtUp(Vector3(0.0f, 50.0f, 0.0f), Vector3(100.0f, 0.0f, 100.0f), Vector3(kYUnitVector));
+    camera.SetPerspectiveMatrix(XM_PIDIV4, 9.0f / 16.0f, 1.0f, 2000.0f);
+    camera.Update();
+    const Frustum& frustum = camera.GetWorldSpaceFrustum();
+
+    RandomNumberGenerator rng(1);
+
+    static const uint32_t kCounts[] = { 10000, 100000, 1000000 };
+
+    for (uint32_t count : kCounts)
+    {
+        SphereList spheres;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            spheres.Push(BoundingSphere(Vector3(rng.NextFloat(-2000.0f, 2000.0f), rng.NextFloat(-200.0f, 200.0f),
+                rng.NextFloat(-2000.0f, 2000.0f)), rng.NextFloat(0.5f, 20.0f)));
+        }
+
+        std::vector<uint32_t> scalarMask(MaskSize(count));
+        std::vector<uint32_t> simdMask(MaskSize(count));
+
+        int64_t startTick = SystemTime::GetCurrentTick();
+        for (uint32_t i = 0; i < iterations; ++i)
+            CullSpheresScalar(frustum, spheres, scalarMask.data());
+        const double scalarMs = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - startTick) / iterations;
+
+        startTick = SystemTime::GetCurrentTick();
+        for (uint32_t i = 0; i < iterations; ++i)
+            CullSpheres(frustum, spheres, simdMask.data());
+        const double simdMs = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - startTick) / iterations;
+
+        uint32_t numVisible = 0, numMismatched = 0;
+        for (uint32_t i = 0; i < MaskSize(count); ++i)
+        {
+            numVisible += __popcnt(simdMask[i]);
+            numMismatched += __popcnt(simdMask[i] ^ scalarMask[i]);
+        }
+
+        LOG_INFOF("Sphere culling of %u spheres (%u visible):  scalar %.3f ms, %s %.3f ms (%.1fx), %u mismatches",
+            count, numVisible, scalarMs, s_HasAVX ? "AVX" : "SSE", simdMs, scalarMs / simdMs, numMismatched);
+    }
+}
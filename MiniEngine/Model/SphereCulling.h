@@ -0,0 +1,78 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Developed by Minigraph
+//
+// Author:  James Stanard
+//
+// Frustum culling of many bounding spheres at once.  Spheres are kept as a structure of arrays so
+// that the kernels can load four (SSE) or eight (AVX) of each component with one instruction, and
+// every sphere is tested against all of the planes without branching.
+//
+
+#pragma once
+
+#include "../Core/Math/BoundingPlane.h"
+#include "../Core/Math/BoundingSphere.h"
+#include "../Core/Math/Frustum.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace SphereCulling
+{
+    // Most planes a convex cull volume may have
+    static const uint32_t kMaxPlanes = 24;
+
+    struct SphereList
+    {
+        std::vector<float> centerX;
+        std::vector<float> centerY;
+        std::vector<float> centerZ;
+        std::vector<float> radius;
+
+        uint32_t Size( void ) const { return (uint32_t)radius.size(); }
+
+        void Clear( void )
+        {
+            centerX.clear();
+            centerY.clear();
+            centerZ.clear();
+            radius.clear();
+        }
+
+        void Push( const Math::BoundingSphere& sphere )
+        {
+            centerX.push_back(sphere.GetCenter().GetX());
+            centerY.push_back(sphere.GetCenter().GetY());
+            centerZ.push_back(sphere.GetCenter().GetZ());
+            radius.push_back(sphere.GetRadius());
+        }
+    };
+
+    // Number of 32-bit words in the visibility mask of 'count' spheres
+    inline uint32_t MaskSize( uint32_t count ) { return (count + 31) / 32; }
+
+    // Sets bit (i % 32) of visibleMask[i / 32] when sphere i intersects the frustum, with the same
+    // result as Frustum::IntersectSphere().  Spheres and frustum must be in the same space.  Uses
+    // AVX when the CPU supports it and SSE otherwise.
+    void CullSpheres( const Math::Frustum& frustum, const SphereList& spheres, uint32_t* visibleMask );
+
+    // The same for any convex volume given by up to kMaxPlanes inward-facing planes
+    void CullSpheres( const Math::BoundingPlane* planes, uint32_t numPlanes, const SphereList& spheres, uint32_t* visibleMask );
+
+    // One sphere at a time with Frustum::IntersectSphere(), kept for validation and benchmarking
+    void CullSpheresScalar( const Math::Frustum& frustum, const SphereList& spheres, uint32_t* visibleMask );
+
+    // Whether the SIMD paths here and in other batch kernels may use AVX
+    bool UsesAVX( void );
+
+    // Times the scalar and SIMD paths on 10K to 1M random spheres, checks that they agree, and logs
+    // the results
+    void Benchmark( uint32_t iterations );
+}
@@ -16,33 +16,235 @@
 
 #include "TextureConvert.h"
 #include "../Core/Utility.h"
+#include "../Core/FileUtility.h"
 #include "DirectXTex.h"
 
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ppl.h>
+
 using namespace DirectX;
 
 #define GetFlag(f) ((Flags & f) != 0)
 
-void CompileTextureOnDemand(const std::wstring& originalFile, uint32_t flags)
+namespace
 {
-    std::wstring ddsFile = Utility::RemoveExtension(originalFile) + L".dds";
+    // What a DDS file was built from.  The source size and time let us skip hashing unchanged files.
+    struct ManifestEntry
+    {
+        uint64_t contentHash;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        uint32_t flags;
+    };
+
+    // One manifest per texture directory, keyed by lower-case DDS file name
+    struct TextureManifest
+    {
+        std::map<std::wstring, ManifestEntry> entries;
+        bool dirty = false;
+    };
 
-    struct _stat64 ddsFileStat, srcFileStat;
+    std::mutex s_ManifestMutex;
+    std::map<std::wstring, TextureManifest> s_Manifests;
 
-    bool srcFileMissing = _wstat64(originalFile.c_str(), &srcFileStat) == -1;
-    bool ddsFileMissing = _wstat64(ddsFile.c_str(), &ddsFileStat) == -1;
+    const wchar_t* kManifestFileName = L"TextureCache.manifest";
 
-    if (srcFileMissing && ddsFileMissing)
+    TextureManifest& GetManifest(const std::wstring& directory)
     {
-        LOG_ERRORF("Texture %s is missing.", Utility::WideStringToUTF8(Utility::RemoveBasePath(originalFile)).c_str());
-        return;
+        auto iter = s_Manifests.find(directory);
+        if (iter != s_Manifests.end())
+            return iter->second;
+
+        TextureManifest& manifest = s_Manifests[directory];
+
+        // Each line is "<hash> <flags> <size> <time> <name>", with the name running to the end of the line
+        std::ifstream file(directory + kManifestFileName);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            ManifestEntry entry;
+            unsigned long long hash, size;
+            long long time;
+            int nameStart = 0;
+            if (sscanf_s(line.c_str(), "%llx %x %llu %lld %n", &hash, &entry.flags, &size, &time, &nameStart) != 4 || nameStart == 0)
+                continue;
+            entry.contentHash = hash;
+            entry.sourceSize = size;
+            entry.sourceTime = time;
+            manifest.entries[Utility::UTF8ToWideString(line.substr(nameStart))] = entry;
+        }
+
+        return manifest;
+    }
+
+    void SaveManifests(void)
+    {
+        for (auto& iter : s_Manifests)
+        {
+            TextureManifest& manifest = iter.second;
+            if (!manifest.dirty)
+                continue;
+
+            std::ofstream file(iter.first + kManifestFileName);
+            for (auto& entry : manifest.entries)
+            {
+                char prefix[80];
+                sprintf_s(prefix, "%016llx %x %llu %lld ", (unsigned long long)entry.second.contentHash, entry.second.flags,
+                    (unsigned long long)entry.second.sourceSize, (long long)entry.second.sourceTime);
+                file << prefix << Utility::WideStringToUTF8(entry.first) << '\n';
+            }
+
+            if (file)
+                manifest.dirty = false;
+        }
+    }
+
+    bool LookupManifest(const std::wstring& ddsFile, ManifestEntry& entry)
+    {
+        std::lock_guard<std::mutex> lock(s_ManifestMutex);
+        TextureManifest& manifest = GetManifest(Utility::GetBasePath(ddsFile));
+        auto iter = manifest.entries.find(Utility::ToLower(Utility::RemoveBasePath(ddsFile)));
+        if (iter == manifest.entries.end())
+            return false;
+        entry = iter->second;
+        return true;
+    }
+
+    void UpdateManifest(const std::wstring& ddsFile, const ManifestEntry& entry)
+    {
+        std::lock_guard<std::mutex> lock(s_ManifestMutex);
+        TextureManifest& manifest = GetManifest(Utility::GetBasePath(ddsFile));
+        manifest.entries[Utility::ToLower(Utility::RemoveBasePath(ddsFile))] = entry;
+        manifest.dirty = true;
+    }
+
+    // 64-bit FNV-1a of a file's contents.  Returns false if the file can't be read.
+    bool HashFileContents(const std::wstring& fileName, uint64_t& hash)
+    {
+        Utility::MappedFile file;
+        if (!file.Open(fileName))
+            return false;
+
+        const byte* data = file.GetData();
+        const size_t size = file.GetSize();
+
+        hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i)
+            hash = (hash ^ data[i]) * 1099511628211ull;
+
+        return true;
+    }
+
+    void CookTexture(const TextureCookRequest& request)
+    {
+        const std::wstring& originalFile = request.originalFile;
+        const std::wstring ddsFile = Utility::RemoveExtension(originalFile) + L".dds";
+
+        // DDS sources are used as-is
+        if (Utility::ToLower(ddsFile) == Utility::ToLower(originalFile))
+            return;
+
+        struct _stat64 ddsFileStat, srcFileStat;
+
+        bool srcFileMissing = _wstat64(originalFile.c_str(), &srcFileStat) == -1;
+        bool ddsFileMissing = _wstat64(ddsFile.c_str(), &ddsFileStat) == -1;
+
+        if (srcFileMissing && ddsFileMissing)
+        {
+            LOG_ERRORF("Texture %s is missing.", Utility::WideStringToUTF8(Utility::RemoveBasePath(originalFile)).c_str());
+            return;
+        }
+
+        // Without a source there is nothing to rebuild from
+        if (srcFileMissing)
+            return;
+
+        ManifestEntry source;
+        source.flags = request.flags;
+        source.sourceSize = (uint64_t)srcFileStat.st_size;
+        source.sourceTime = (int64_t)srcFileStat.st_mtime;
+        source.contentHash = 0;
+
+        ManifestEntry recorded;
+        const bool hasEntry = LookupManifest(ddsFile, recorded);
+
+        if (!ddsFileMissing && hasEntry && recorded.flags == source.flags &&
+            recorded.sourceSize == source.sourceSize && recorded.sourceTime == source.sourceTime)
+            return;
+
+        if (!HashFileContents(originalFile, source.contentHash))
+        {
+            LOG_ERRORF("Could not read texture %s.", Utility::WideStringToUTF8(Utility::RemoveBasePath(originalFile)).c_str());
+            return;
+        }
+
+        if (!ddsFileMissing)
+        {
+            // Same contents and flags, just a new timestamp (e.g. from a fresh checkout).  Adopt it.
+            // DDS files that predate the manifest are trusted if they are newer than their source.
+            if (hasEntry && recorded.flags == source.flags && recorded.contentHash == source.contentHash ||
+                !hasEntry && ddsFileStat.st_mtime >= srcFileStat.st_mtime)
+            {
+                UpdateManifest(ddsFile, source);
+                return;
+            }
+        }
+
+        LOG_INFOF("DDS texture %s missing or out of date.  Rebuilding.", Utility::WideStringToUTF8(Utility::RemoveBasePath(originalFile)).c_str());
+
+        if (ConvertToDDS(originalFile, request.flags))
+            UpdateManifest(ddsFile, source);
     }
+}
 
-    // If we can find the source texture and the DDS file is older, reconvert.
-    if (ddsFileMissing || !srcFileMissing && ddsFileStat.st_mtime < srcFileStat.st_mtime)
+void CompileTextureOnDemand(const std::wstring& originalFile, uint32_t flags)
+{
+    CompileTexturesOnDemand({ { originalFile, flags } });
+}
+
+void CompileTexturesOnDemand(const std::vector<TextureCookRequest>& requests)
+{
+    // Two jobs writing the same DDS file would collide, so there is one job per output file.  Requests for
+    // the same source combine their flags.  Sources that only differ by extension can't both be cooked.
+    std::vector<TextureCookRequest> textures;
+    std::map<std::wstring, size_t> uniqueFiles;
+    for (const TextureCookRequest& request : requests)
     {
-        LOG_INFOF("DDS texture %s missing or older than source.  Rebuilding.", Utility::WideStringToUTF8(Utility::RemoveBasePath(originalFile)).c_str());
-        ConvertToDDS(originalFile, flags);
+        const std::wstring ddsFile = Utility::ToLower(Utility::RemoveExtension(request.originalFile) + L".dds");
+        auto inserted = uniqueFiles.emplace(ddsFile, textures.size());
+        if (inserted.second)
+        {
+            textures.push_back(request);
+            continue;
+        }
+
+        TextureCookRequest& existing = textures[inserted.first->second];
+        if (Utility::ToLower(existing.originalFile) == Utility::ToLower(request.originalFile))
+        {
+            existing.flags |= request.flags;
+        }
+        else
+        {
+            LOG_WARNF("Textures %s and %s both convert to the same DDS file.  Only the first is used.",
+                Utility::WideStringToUTF8(existing.originalFile).c_str(), Utility::WideStringToUTF8(request.originalFile).c_str());
+        }
     }
+
+    concurrency::parallel_for(size_t(0), textures.size(), [&](size_t i)
+    {
+        // WIC requires COM on whichever thread does the decoding
+        HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+        CookTexture(textures[i]);
+
+        if (SUCCEEDED(hr))
+            CoUninitialize();
+    });
+
+    std::lock_guard<std::mutex> lock(s_ManifestMutex);
+    SaveManifests();
 }
 
 bool ConvertToDDS( const std::wstring& filePath, uint32_t Flags )
@@ -15,6 +15,7 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 enum TexConversionFlags
 {
@@ -32,9 +33,20 @@ inline uint8_t TextureOptions(bool sRGB, bool hasAlpha=false, bool invertY=false
     return (sRGB ? kSRGB : 0) | (hasAlpha ? kPreserveAlpha : 0) | (invertY ? kFlipVertical : 0);
 }
 
-// If the DDS version of the texture specified does not exist or is older than the source texture, reconvert it.
+struct TextureCookRequest
+{
+    std::wstring originalFile;
+    uint32_t flags;
+};
+
+// If the DDS version of the texture specified does not exist or was built from different source contents
+// or flags, reconvert it.  What each DDS file was built from is recorded in a manifest in its directory
+// (TextureCache.manifest), so touching a source file without changing it does not trigger a rebuild.
 void CompileTextureOnDemand(const std::wstring& originalFile, uint32_t flags);
 
+// Same as above for a batch of textures, which are checked and converted in parallel
+void CompileTexturesOnDemand(const std::vector<TextureCookRequest>& requests);
+
 // Loads a non-DDS texture such as TGA, PNG, or JPG, then converts it to a more optimal
 // DDS format with a full mip chain.  Resultant file has the same path with the file extension
 // changed to "DDS".
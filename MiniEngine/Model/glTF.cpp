@@ -18,10 +18,19 @@
 #include "../Core/UploadBuffer.h"
 #include "../Core/GraphicsCore.h"
 #include "../Core/FileUtility.h"
+#include "../Core/AsyncFileIO.h"
+#include "../Core/SystemTime.h"
+#include "JsonReader.h"
+#include "MeshoptDecoder.h"
 
+#include <atomic>
 #include <fstream>
 #include <iostream>
 
+#ifdef _DEBUG
+#include <crtdbg.h>
+#endif
+
 using namespace glTF;
 using namespace Graphics;
 using namespace Utility;
@@ -199,12 +208,15 @@ void glTF::Asset::ProcessAccessors( json& accessors )
         json& thisAccessor = it.value();
 
         glTF::BufferView& bufferView = m_bufferViews[thisAccessor.at("bufferView")];
-        accessor.dataPtr = m_buffers[bufferView.buffer]->data() + bufferView.byteOffset;
+        accessor.dataPtr = m_buffers[bufferView.buffer].data + bufferView.byteOffset;
         accessor.stride = bufferView.byteStride;
         if (thisAccessor.find("byteOffset") != thisAccessor.end())
             accessor.dataPtr += thisAccessor.at("byteOffset");
         accessor.count = thisAccessor.at("count");
         accessor.componentType = thisAccessor.at("componentType").get<uint16_t>() - 5120;
+        accessor.normalized = false;
+        if (thisAccessor.find("normalized") != thisAccessor.end())
+            accessor.normalized = thisAccessor.at("normalized");
 
         char type[8];
         strcpy_s(type, thisAccessor.at("type").get<std::string>().c_str());
@@ -459,9 +471,101 @@ bool ReadFile(const wstring& fileName, void* Dest, size_t Size)
     return true;
 }
 
-void glTF::Asset::ProcessBuffers( json& buffers, ByteArray chunk1bin )
+static Buffer MakeBuffer( ByteArray bytes )
+{
+    Buffer buffer;
+    buffer.bytes = bytes;
+    buffer.data = bytes->data();
+    buffer.size = bytes->size();
+    return buffer;
+}
+
+static Buffer MakeBuffer( const std::shared_ptr<MappedFile>& mapping, size_t offset, size_t size )
+{
+    Buffer buffer;
+    buffer.mapping = mapping;
+    buffer.data = mapping->GetData() + offset;
+    buffer.size = size;
+    return buffer;
+}
+
+// An external buffer being read by the AsyncFileIO threads
+struct glTF::Asset::BufferRead
+{
+    uint32_t bufferIdx;
+    wstring filepath;
+    AsyncFileIO::RequestHandle request;
+    concurrency::task<ByteArray> data;
+};
+
+// Returns the buffer if it is already available.  Otherwise starts reading it and returns an empty buffer
+// that FinishBufferReads() fills in, so that all of the external buffers are read at once.
+Buffer glTF::Asset::LoadBuffer( uint32_t bufferIdx, std::string& uri, std::vector<BufferRead>& reads )
+{
+    if (m_preloadedBuffers != nullptr && bufferIdx < m_preloadedBuffers->size())
+        return (*m_preloadedBuffers)[bufferIdx];
+
+    DecodeURI(uri);
+
+    wstring filepath = m_basePath + Utility::UTF8ToWideString(uri);
+
+    if (m_storage == kMapBuffers)
+    {
+        std::shared_ptr<MappedFile> mapping = std::make_shared<MappedFile>();
+        if (mapping->Open(filepath, false))
+            return MakeBuffer(mapping, 0, mapping->GetSize());
+    }
+
+    // Also the fallback for buffers that only exist as .gz.  Geometry is needed before anything can be
+    // drawn, so it goes ahead of other reads.
+    BufferRead read;
+    read.bufferIdx = bufferIdx;
+    read.filepath = filepath;
+    read.data = ReadFileAsync(filepath, AsyncFileIO::kPriorityHigh, read.request);
+    reads.push_back(read);
+    return Buffer();
+}
+
+// Waits for the reads started by LoadBuffer().  Returns false if any buffer can't be read.
+bool glTF::Asset::FinishBufferReads( std::vector<BufferRead>& reads )
+{
+    for (size_t i = 0; i < reads.size(); ++i)
+    {
+        ByteArray ba = reads[i].data.get();
+        if (ba->size() == 0)
+        {
+            // The asset can't be used, so don't bother finishing the other reads
+            for (size_t j = i + 1; j < reads.size(); ++j)
+                AsyncFileIO::Cancel(reads[j].request);
+
+            LOG_ERRORF("Error:  Missing glTF buffer %s.", Utility::WideStringToUTF8(reads[i].filepath).c_str());
+            return false;
+        }
+
+        m_buffers[reads[i].bufferIdx] = MakeBuffer(ba);
+    }
+
+    return true;
+}
+
+static bool IsFallbackBuffer( json& buffer )
+{
+    json::iterator extensions = buffer.find("extensions");
+    if (extensions == buffer.end())
+        return false;
+
+    json::iterator meshopt = extensions.value().find("EXT_meshopt_compression");
+    if (meshopt == extensions.value().end())
+        return false;
+
+    json::iterator fallback = meshopt.value().find("fallback");
+    return fallback != meshopt.value().end() && fallback.value().get<bool>();
+}
+
+bool glTF::Asset::ProcessBuffers( json& buffers, const Buffer& chunk1bin )
 {
     m_buffers.reserve(buffers.size());
+    std::vector<BufferRead> reads;
 
     for (json::iterator it = buffers.begin(); it != buffers.end(); ++it)
     {
@@ -470,21 +574,85 @@ void glTF::Asset::ProcessBuffers( json& buffers, ByteArray chunk1bin )
         if (thisBuffer.find("uri") != thisBuffer.end())
         {
             string uri = thisBuffer.at("uri");
-            DecodeURI(uri);
-
-            wstring filepath = m_basePath + Utility::UTF8ToWideString(uri);
-
-            ByteArray ba = ReadFileSync(filepath);
-            ASSERT(ba->size() > 0, "Missing bin file %ws", filepath.c_str());
-            m_buffers.push_back(ba);
+            m_buffers.push_back(LoadBuffer((uint32_t)m_buffers.size(), uri, reads));
+        }
+        else if (IsFallbackBuffer(thisBuffer))
+        {
+            // Only referenced by compressed views, which are decoded into their own buffers
+            m_buffers.push_back(Buffer());
         }
         else
         {
             ASSERT(it == buffers.begin(), "Only the 1st buffer allowed to be internal");
-            ASSERT(chunk1bin->size() > 0, "GLB chunk1 missing data or not a GLB file");
+            ASSERT(chunk1bin.size > 0, "GLB chunk1 missing data or not a GLB file");
             m_buffers.push_back(chunk1bin);
         }
     }
+
+    return FinishBufferReads(reads);
+}
+
+// EXT_meshopt_compression parameters of a buffer view
+struct glTF::Asset::CompressedView
+{
+    uint32_t buffer;
+    uint32_t byteOffset;
+    uint32_t byteLength;
+    uint32_t byteStride;
+    uint32_t count;
+    MeshoptDecoder::Mode mode;
+    MeshoptDecoder::Filter filter;
+};
+
+static MeshoptDecoder::Mode CompressionMode( const JsonReader::StringRef& mode )
+{
+    if (mode == "TRIANGLES")
+        return MeshoptDecoder::kTriangles;
+    else if (mode == "INDICES")
+        return MeshoptDecoder::kIndices;
+    else
+        return MeshoptDecoder::kAttributes;
+}
+
+static MeshoptDecoder::Filter CompressionFilter( const JsonReader::StringRef& filter )
+{
+    if (filter == "OCTAHEDRAL")
+        return MeshoptDecoder::kFilterOctahedral;
+    else if (filter == "QUATERNION")
+        return MeshoptDecoder::kFilterQuaternion;
+    else if (filter == "EXPONENTIAL")
+        return MeshoptDecoder::kFilterExponential;
+    else
+        return MeshoptDecoder::kFilterNone;
+}
+
+static JsonReader::StringRef MakeStringRef( const string& str )
+{
+    JsonReader::StringRef ref = { str.c_str(), (uint32_t)str.size() };
+    return ref;
+}
+
+// Decodes the view into a buffer of its own and points the view at it.  The uncompressed (fallback) buffer
+// the view nominally refers to is never read.
+void glTF::Asset::DecompressBufferView( BufferView& bufferView, const CompressedView& compressed )
+{
+    ASSERT(compressed.buffer < m_buffers.size());
+    const Buffer& source = m_buffers[compressed.buffer];
+    ASSERT(source.data != nullptr && (size_t)compressed.byteOffset + compressed.byteLength <= source.size,
+        "Compressed buffer view is out of range");
+
+    ByteArray decoded = make_shared<vector<byte>>((size_t)compressed.count * compressed.byteStride);
+    if (!MeshoptDecoder::Decode(decoded->data(), compressed.count, compressed.byteStride, compressed.mode,
+        compressed.filter, source.data + compressed.byteOffset, compressed.byteLength))
+    {
+        LOG_ERROR("Error:  Unable to decode EXT_meshopt_compression buffer view.");
+        decoded->assign(decoded->size(), 0);
+    }
+
+    bufferView.buffer = (uint32_t)m_buffers.size();
+    bufferView.byteOffset = 0;
+    bufferView.byteLength = (uint32_t)decoded->size();
+    m_buffers.push_back(MakeBuffer(decoded));
 }
 
 void glTF::Asset::ProcessBufferViews( json& bufferViews )
@@ -512,6 +680,23 @@ void glTF::Asset::ProcessBufferViews( json& bufferViews )
         if (thisBufferView.find("target") != thisBufferView.end() && thisBufferView.at("target") == 34963)
             bufferView.elementArrayBuffer = true;
 
+        json::iterator extensions = thisBufferView.find("extensions");
+        if (extensions != thisBufferView.end() &&
+            extensions.value().find("EXT_meshopt_compression") != extensions.value().end())
+        {
+            json& meshopt = extensions.value().at("EXT_meshopt_compression");
+
+            CompressedView compressed;
+            compressed.buffer = meshopt.at("buffer");
+            compressed.byteOffset = meshopt.value("byteOffset", 0u);
+            compressed.byteLength = meshopt.at("byteLength");
+            compressed.byteStride = meshopt.at("byteStride");
+            compressed.count = meshopt.at("count");
+            compressed.mode = CompressionMode(MakeStringRef(meshopt.at("mode").get<string>()));
+            compressed.filter = CompressionFilter(MakeStringRef(meshopt.value("filter", string("NONE"))));
+            DecompressBufferView(bufferView, compressed);
+        }
+
         m_bufferViews.push_back(bufferView);
     }
 }
@@ -690,62 +875,116 @@ void glTF::Asset::ProcessAnimations(json& animations)
     }
 }
 
-void glTF::Asset::Parse(const std::wstring& filepath)
+
+bool glTF::Asset::ReadSourceFile( const std::wstring& filepath, BufferStorage storage, ByteArray& gltfFile, Buffer& chunk1Bin )
 {
-    // TODO:  add GLB support by extracting JSON section and BIN sections
     //https://github.com/KhronosGroup/glTF/blob/master/specification/2.0/README.md#glb-file-format-specification
 
-    ByteArray gltfFile;
-    ByteArray chunk1Bin;
-
     std::wstring fileExt = Utility::ToLower(Utility::GetFileExtension(filepath));
 
     if (fileExt == L"glb")
     {
-        ifstream glbFile(filepath, ios::in | ios::binary);
         struct GLBHeader
         {
             char magic[4];
             uint32_t version;
             uint32_t length;
         } header;
-        glbFile.read((char*)&header, sizeof(GLBHeader));
+
+        struct GLBChunkHeader
+        {
+            uint32_t length;
+            char type[4];
+        } chunk0, chunk1;
+
+        // Only the JSON chunk is copied out of a mapped GLB.  The BIN chunk is used where it lies.
+        std::shared_ptr<MappedFile> mapping;
+        ifstream glbFile;
+
+        if (storage == kMapBuffers)
+        {
+            mapping = std::make_shared<MappedFile>();
+            if (!mapping->Open(filepath, false))
+                mapping = nullptr;
+            else if (mapping->GetSize() < sizeof(GLBHeader) + sizeof(GLBChunkHeader))
+            {
+                LOG_ERROR("Error:  Invalid glTF binary format.");
+                return false;
+            }
+        }
+
+        if (mapping)
+            memcpy(&header, mapping->GetData(), sizeof(GLBHeader));
+        else
+        {
+            glbFile.open(filepath, ios::in | ios::binary);
+            glbFile.read((char*)&header, sizeof(GLBHeader));
+        }
+
         if (strncmp(header.magic, "glTF", 4) != 0)
         {
             LOG_ERROR("Error:  Invalid glTF binary format.");
-            return;
+            return false;
         }
         if (header.version != 2)
         {
             LOG_ERROR("Error:  Only glTF 2.0 is supported.");
-            return;
+            return false;
         }
 
-        uint32_t chunk0Length;
-        char chunk0Type[4];
-        glbFile.read((char*)&chunk0Length, 4);
-        glbFile.read((char*)&chunk0Type, 4);
-        if (strncmp(chunk0Type, "JSON", 4) != 0)
+        size_t offset = sizeof(GLBHeader);
+        if (mapping)
+            memcpy(&chunk0, mapping->GetData() + offset, sizeof(GLBChunkHeader));
+        else
+            glbFile.read((char*)&chunk0, sizeof(GLBChunkHeader));
+        offset += sizeof(GLBChunkHeader);
+
+        if (strncmp(chunk0.type, "JSON", 4) != 0)
         {
             LOG_ERROR("Error: Expected chunk0 to contain JSON.");
-            return;
+            return false;
+        }
+        if (mapping && offset + chunk0.length + sizeof(GLBChunkHeader) > mapping->GetSize())
+        {
+            LOG_ERROR("Error:  Truncated glTF binary file.");
+            return false;
         }
-        gltfFile = make_shared<vector<byte>>( chunk0Length + 1 );
-        glbFile.read((char*)gltfFile->data(), chunk0Length);
-        (*gltfFile)[chunk0Length] = '\0';
 
-        uint32_t chunk1Length;
-        char chunk1Type[4];
-        glbFile.read((char*)&chunk1Length, 4);
-        glbFile.read((char*)&chunk1Type, 4);
-        if (strncmp(chunk1Type, "BIN", 3) != 0)
+        gltfFile = make_shared<vector<byte>>( chunk0.length + 1 );
+        if (mapping)
+            memcpy(gltfFile->data(), mapping->GetData() + offset, chunk0.length);
+        else
+            glbFile.read((char*)gltfFile->data(), chunk0.length);
+        (*gltfFile)[chunk0.length] = '\0';
+        offset += chunk0.length;
+
+        if (mapping)
+            memcpy(&chunk1, mapping->GetData() + offset, sizeof(GLBChunkHeader));
+        else
+            glbFile.read((char*)&chunk1, sizeof(GLBChunkHeader));
+        offset += sizeof(GLBChunkHeader);
+
+        if (strncmp(chunk1.type, "BIN", 3) != 0)
         {
             LOG_ERROR("Error: Expected chunk1 to contain BIN.");
-            return;
-       }
+            return false;
+        }
 
-        chunk1Bin = make_shared<vector<byte>>(chunk1Length);
-        glbFile.read((char*)chunk1Bin->data(), chunk1Length);
+        if (mapping)
+        {
+            if (offset + chunk1.length > mapping->GetSize())
+            {
+                LOG_ERROR("Error:  Truncated glTF binary file.");
+                return false;
+            }
+            chunk1Bin = MakeBuffer(mapping, offset, chunk1.length);
+        }
+        else
+        {
+            ByteArray bin = make_shared<vector<byte>>(chunk1.length);
+            glbFile.read((char*)bin->data(), chunk1.length);
+            chunk1Bin = MakeBuffer(bin);
+        }
     }
     else 
     {
@@ -754,26 +993,25 @@ void glTF::Asset::Parse(const std::wstring& filepath)
         // Null terminate the string (just in case)
         gltfFile = ReadFileSync(filepath);
         if (gltfFile->size() == 0)
-            return;
+            return false;
 
         gltfFile->push_back('\0');
-        chunk1Bin = make_shared<vector<byte>>(0);
+        chunk1Bin = MakeBuffer(make_shared<vector<byte>>(0));
     }
 
-    json root = json::parse((const char*)gltfFile->data());
-    if (!root.is_object())
-    {
-        LOG_ERRORF("Invalid glTF file: %s.", Utility::WideStringToUTF8(filepath).c_str());
-        return;
-    }
+    return true;
+}
 
-    // Strip off file name to get root path to other related files
-    m_basePath = Utility::GetBasePath(filepath);
+bool glTF::Asset::ParseDOM( const char* text, const Buffer& chunk1Bin )
+{
+    json root = json::parse(text);
+    if (!root.is_object())
+        return false;
 
     // Parse all state
 
-    if (root.find("buffers") != root.end())
-        ProcessBuffers(root.at("buffers"), chunk1Bin);
+    if (root.find("buffers") != root.end() && !ProcessBuffers(root.at("buffers"), chunk1Bin))
+        return false;
     if (root.find("bufferViews") != root.end())
         ProcessBufferViews(root.at("bufferViews"));
     if (root.find("accessors") != root.end())
@@ -802,4 +1040,1074 @@ void glTF::Asset::Parse(const std::wstring& filepath)
         ProcessAnimations(root.at("animations"));
     if (root.find("scene") != root.end())
         m_scene = &m_scenes[root.at("scene")];
+
+    return true;
+}
+
+//
+// Streaming parser
+//
+// Every top-level array is sized before any of them is read, so references between arrays resolve
+// directly to pointers that never move.  Sections are then read in the same dependency order as the
+// DOM path, straight from the JSON text into the output structures.
+//
+
+struct glTF::Asset::AccessorBounds
+{
+    // Only the first three components matter:  the POSITION box and the min/max index
+    double min[3];
+    double max[3];
+};
+
+template <typename T>
+static T* Lookup( std::vector<T>& list, uint32_t index )
+{
+    ASSERT(index < list.size(), "glTF index out of range");
+    return index < list.size() ? &list[index] : nullptr;
+}
+
+bool glTF::Asset::ReadBuffers( JsonReader& reader, const Buffer& chunk1bin )
+{
+    JsonReader::StringRef key;
+    uint32_t bufferIdx = 0;
+    std::vector<BufferRead> reads;
+
+    reader.BeginArray();
+    while (reader.NextElement())
+    {
+        string uri;
+        bool hasURI = false;
+        bool fallback = false;
+
+        reader.BeginObject();
+        while (reader.NextMember(key))
+        {
+            if (key == "uri")
+            {
+                uri = reader.ReadString();
+                hasURI = true;
+            }
+            else if (key == "extensions")
+            {
+                reader.BeginObject();
+                while (reader.NextMember(key))
+                {
+                    if (!(key == "EXT_meshopt_compression"))
+                    {
+                        reader.SkipValue();
+                        continue;
+                    }
+
+                    reader.BeginObject();
+                    while (reader.NextMember(key))
+                    {
+                        if (key == "fallback")
+                            fallback = reader.ReadBool();
+                        else
+                            reader.SkipValue();
+                    }
+                }
+            }
+            else
+                reader.SkipValue();
+        }
+
+        if (hasURI)
+        {
+            m_buffers[bufferIdx] = LoadBuffer(bufferIdx, uri, reads);
+        }
+        else if (fallback)
+        {
+            // Only referenced by compressed views, which are decoded into their own buffers
+            m_buffers[bufferIdx] = Buffer();
+        }
+        else
+        {
+            ASSERT(bufferIdx == 0, "Only the 1st buffer allowed to be internal");
+            ASSERT(chunk1bin.size > 0, "GLB chunk1 missing data or not a GLB file");
+            m_buffers[bufferIdx] = chunk1bin;
+        }
+        ++bufferIdx;
+    }
+
+    return FinishBufferReads(reads);
+}
+
+void glTF::Asset::ReadBufferViews( JsonReader& reader )
+{
+    JsonReader::StringRef key;
+    uint32_t viewIdx = 0;
+
+    reader.BeginArray();
+    while (reader.NextElement())
+    {
+        glTF::BufferView& bufferView = m_bufferViews[viewIdx++];
+        bufferView.buffer = 0;
+        bufferView.byteLength = 0;
+        bufferView.byteOffset = 0;
+        bufferView.byteStride = 0;
+        bufferView.elementArrayBuffer = false;
+
+        CompressedView compressed = {};
+        bool isCompressed = false;
+
+        reader.BeginObject();
+        while (reader.NextMember(key))
+        {
+            if (key == "buffer")
+                bufferView.buffer = reader.ReadUInt();
+            else if (key == "byteLength")
+                bufferView.byteLength = reader.ReadUInt();
+            else if (key == "byteOffset")
+                bufferView.byteOffset = reader.ReadUInt();
+            else if (key == "byteStride")
+                bufferView.byteStride = (uint16_t)reader.ReadUInt();
+            else if (key == "target")
+                bufferView.elementArrayBuffer = reader.ReadUInt() == 34963; // ELEMENT_ARRAY_BUFFER
+            else if (key == "extensions")
+            {
+                reader.BeginObject();
+                while (reader.NextMember(key))
+                {
+                    if (!(key == "EXT_meshopt_compression"))
+                    {
+                        reader.SkipValue();
+                        continue;
+                    }
+
+                    isCompressed = true;
+                    reader.BeginObject();
+                    while (reader.NextMember(key))
+                    {
+                        if (key == "buffer")
+                            compressed.buffer = reader.ReadUInt();
+                        else if (key == "byteOffset")
+                            compressed.byteOffset = reader.ReadUInt();
+                        else if (key == "byteLength")
+                            compressed.byteLength = reader.ReadUInt();
+                        else if (key == "byteStride")
+                            compressed.byteStride = reader.ReadUInt();
+                        else if (key == "count")
+                            compressed.count = reader.ReadUInt();
+                        else if (key == "mode")
+                            compressed.mode = CompressionMode(reader.ReadStringRef());
+                        else if (key == "filter")
+                            compressed.filter = CompressionFilter(reader.ReadStringRef());
+                        else
+                            reader.SkipValue();
+                    }
+                }
+            }
+            else
+                reader.SkipValue();
+        }
+
+        if (isCompressed)
+            DecompressBufferView(bufferView, compressed);
+    }
+}
+
+void glTF::Asset::ReadAccessors( JsonReader& reader, std::vector<AccessorBounds>& bounds )
+{
+    JsonReader::StringRef key;
+    uint32_t accessorIdx = 0;
+
+    reader.BeginArray();
+    while (reader.NextElement())
+    {
+        AccessorBounds& accessorBounds = bounds[accessorIdx];
+        glTF::Accessor& accessor = m_accessors[accessorIdx++];
+        uint32_t bufferViewIdx = 0xFFFFFFFF;
+        uint32_t byteOffset = 0;
+
+        accessor.dataPtr = nullptr;
+        accessor.stride = 0;
+        accessor.count = 0;
+        accessor.componentType = Accessor::kFloat;
+        accessor.type = Accessor::kScalar;
+        accessor.normalized = false;
+        memset(&accessorBounds, 0, sizeof(AccessorBounds));
+
+        reader.BeginObject();
+        while (reader.NextMember(key))
+        {
+            if (key == "bufferView")
+                bufferViewIdx = reader.ReadUInt();
+            else if (key == "byteOffset")
+                byteOffset = reader.ReadUInt();
+            else if (key == "count")
+                accessor.count = reader.ReadUInt();
+            else if (key == "componentType")
+                accessor.componentType = (uint16_t)(reader.ReadUInt() - 5120);
+            else if (key == "normalized")
+                accessor.normalized = reader.ReadBool();
+            else if (key == "type")
+            {
+                // Compare the raw characters instead of copying the string
+                JsonReader::StringRef type = reader.ReadStringRef();
+                char typeStr[8] = {};
+                memcpy(typeStr, type.str, type.length < 7 ? type.length : 7);
+                accessor.type = TypeToEnum(typeStr);
+            }
+            else if (key == "min")
+                reader.ReadNumbers(accessorBounds.min, 3);
+            else if (key == "max")
+                reader.ReadNumbers(accessorBounds.max, 3);
+            else
+                reader.SkipValue();
+        }
+
+        // Accessors without a buffer view (all zeros or sparse) are left without data
+        if (bufferViewIdx < m_bufferViews.size())
+        {
+            const BufferView& bufferView = m_bufferViews[bufferViewIdx];
+            accessor.dataPtr = m_buffers[bufferView.buffer].data + bufferView.byteOffset + byteOffset;
+            accessor.stride = bufferView.byteStride;
+        }
+    }
+}
+
+void glTF::Asset::ReadImages( JsonReader& reader )
+{
+    JsonReader::StringRef key;
+    uint32_t imageIdx = 0;
+
+    reader.BeginArray();
+    while (reader.NextElement())
+    {
+        glTF::Image& image = m_images[imageIdx++];
+        int32_t bufferView = -1;
+        JsonReader::StringRef mimeType = { "", 0 };
+        bool hasURI = false;
+
+        reader.BeginObject();
+        while (reader.NextMember(key))
+        {
+            if (key == "uri")
+            {
+                image.path = reader.ReadString();
+                DecodeURI(image.path);
+                hasURI = true;
+            }
+            else if (key == "bufferView")
+                bufferView = reader.ReadInt();
+            else if (key == "mimeType")
+                mimeType = reader.ReadStringRef();
+            else
+                reader.SkipValue();
+        }
+
+        if (!hasURI)
+        {
+            ASSERT(bufferView >= 0);
+            LOG_INFOF("GLB image at buffer view %d with mime type %.*s.", bufferView, (int)mimeType.length, mimeType.str);
+        }
+    }
+}
+
+void glTF::Asset::ReadSamplers( JsonReader& reader )
+{
+    JsonReader::StringRef key;
+    uint32_t samplerIdx = 0;
+
+    reader.BeginArray();
+    while (reader.NextElement())
+    {
+        glTF::Sampler& sampler = m_samplers[samplerIdx++];
+        sampler.filter = D3D12_FILTER_ANISOTROPIC;
+        sampler.wrapS = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+        sampler.wrapT = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+
+        // Filter modes are ignored, as in ProcessSamplers()
+        reader.BeginObject();
+        while (reader.NextMember(key))
+        {
+            if (key == "wrapS")
+                sampler.wrapS = GLtoD3DTextureAddressMode(reader.ReadInt());
+            else if (key == "wrapT")
+                sampler.wrapT = GLtoD3DTextureAddressMode(reader.ReadInt());
+            else
+                reader.SkipValue();
+        }
+    }
+}
+
+void glTF::Asset::ReadTextures( JsonReader& reader )
+{
+    JsonReader::StringRef key;
+    uint32_t texIdx = 0;
+
+    reader.BeginArray();
+    while (reader.NextElement())
+    {
+        glTF::Texture& texture = m_textures[texIdx++];
+        texture.source = nullptr;
+        texture.sampler = nullptr;
+
+        reader.BeginObject();
+        while (reader.NextMember(key))
+        {
+            if (key == "source")
+                texture.source = Lookup(m_images, reader.ReadUInt());
+            else if (key == "sampler")
+                texture.sampler = Lookup(m_samplers, reader.ReadUInt());
+            else
+                reader.SkipValue();
+        }
+    }
+}
+
+uint32_t glTF::Asset::ReadTextureInfo( JsonReader& reader, glTF::Texture* &info )
+{
+    JsonReader::StringRef key;
+    uint32_t texCoord = 0;
+    info = nullptr;
+
+    reader.BeginObject();
+    while (reader.NextMember(key))
+    {
+        if (key == "index")
+            info = Lookup(m_textures, reader.ReadUInt());
+        else if (key == "texCoord")
+            texCoord = reader.ReadUInt();
+        else
+            reader.SkipValue();
+    }
+
+    return texCoord;
+}
+
+void glTF::Asset::ReadMaterials( JsonReader& reader )
+{
+    JsonReader::StringRef key;
+    uint32_t materialIdx = 0;
+
+    reader.BeginArray();
+    while (reader.NextElement())
+    {
+        glTF::Material& material = m_materials[materialIdx];
+
+        material.index = materialIdx++;
+        material.flags = 0;
+        material.alphaCutoff = floatToHalf(0.5f);
+        material.normalTextureScale = 1.0f;
+        material.emissiveFactor[0] = 0.0f;
+        material.emissiveFactor[1] = 0.0f;
+        material.emissiveFactor[2] = 0.0f;
+        material.baseColorFactor[0] = 1.0f;
+        material.baseColorFactor[1] = 1.0f;
+        material.baseColorFactor[2] = 1.0f;
+        material.baseColorFactor[3] = 1.0f;
+        material.metallicFactor = 1.0f;
+        material.roughnessFactor = 1.0f;
+        for (uint32_t i = 0; i < Material::kNumTextures; ++i)
+            material.textures[i] = nullptr;
+
+        reader.BeginObject();
+        while (reader.NextMember(key))
+        {
+            if (key == "alphaMode")
+            {
+                JsonReader::StringRef alphaMode = reader.ReadStringRef();
+                if (alphaMode == "BLEND")
+                    material.alphaBlend = true;
+                else if (alphaMode == "MASK")
+                    material.alphaTest = true;
+            }
+            else if (key == "alphaCutoff")
+                material.alphaCutoff = floatToHalf(reader.ReadFloat());
+            else if (key == "pbrMetallicRoughness")
+            {
+                reader.BeginObject();
+                while (reader.NextMember(key))
+                {
+                    if (key == "baseColorFactor")
+                        reader.ReadFloats(material.baseColorFactor, 4);
+                    else if (key == "metallicFactor")
+                        material.metallicFactor = reader.ReadFloat();
+                    else if (key == "roughnessFactor")
+                        material.roughnessFactor = reader.ReadFloat();
+                    else if (key == "baseColorTexture")
+                        material.baseColorUV = ReadTextureInfo(reader, material.textures[Material::kBaseColor]);
+                    else if (key == "metallicRoughnessTexture")
+                        material.metallicRoughnessUV = ReadTextureInfo(reader, material.textures[Material::kMetallicRoughness]);
+                    else
+                        reader.SkipValue();
+                }
+            }
+            else if (key == "doubleSided")
+                material.twoSided = reader.ReadBool();
+            else if (key == "normalTextureScale")
+                material.normalTextureScale = reader.ReadFloat();
+            else if (key == "emissiveFactor")
+                reader.ReadFloats(material.emissiveFactor, 3);
+            else if (key == "occlusionTexture")
+                material.occlusionUV = ReadTextureInfo(reader, material.textures[Material::kOcclusion]);
+            else if (key == "emissiveTexture")
+                material.emissiveUV = ReadTextureInfo(reader, material.textures[Material::kEmissive]);
+            else if (key == "normalTexture")
+                material.normalUV = ReadTextureInfo(reader, material.textures[Material::kNormal]);
+            else
+                reader.SkipValue();
+        }
+    }
+}
+
+void glTF::Asset::ReadMeshes( JsonReader& reader, const std::vector<AccessorBounds>& bounds )
+{
+    static const char* kAttribNames[Primitive::kNumAttribs] =
+    {
+        "POSITION", "NORMAL", "TANGENT", "TEXCOORD_0", "TEXCOORD_1", "COLOR_0", "JOINTS_0", "WEIGHTS_0"
+    };
+
+    JsonReader::StringRef key;
+    uint32_t meshIdx = 0;
+
+    reader.BeginArray();
+    while (reader.NextElement())
+    {
+        glTF::Mesh& mesh = m_meshes[meshIdx++];
+        mesh.skin = -1;
+
+        reader.BeginObject();
+        while (reader.NextMember(key))
+        {
+            if (!(key == "primitives"))
+            {
+                reader.SkipValue();
+                continue;
+            }
+
+            mesh.primitives.resize(reader.CountElements());
+            uint32_t primIdx = 0;
+
+            reader.BeginArray();
+            while (reader.NextElement())
+            {
+                glTF::Primitive& prim = mesh.primitives[primIdx++];
+                uint32_t positionIdx = 0xFFFFFFFF;
+                uint32_t indicesIdx = 0xFFFFFFFF;
+
+                prim.attribMask = 0;
+                for (uint32_t i = 0; i < Primitive::kNumAttribs; ++i)
+                    prim.attributes[i] = nullptr;
+                prim.indices = nullptr;
+                prim.material = nullptr;
+                prim.minIndex = 0;
+                prim.maxIndex = 0;
+                prim.mode = 4;
+
+                reader.BeginObject();
+                while (reader.NextMember(key))
+                {
+                    if (key == "attributes")
+                    {
+                        reader.BeginObject();
+                        while (reader.NextMember(key))
+                        {
+                            uint32_t type = 0;
+                            while (type < Primitive::kNumAttribs && !key.Equals(kAttribNames[type]))
+                                ++type;
+
+                            if (type == Primitive::kNumAttribs)
+                            {
+                                reader.SkipValue();
+                                continue;
+                            }
+
+                            const uint32_t accessorIdx = reader.ReadUInt();
+                            prim.attributes[type] = Lookup(m_accessors, accessorIdx);
+                            prim.attribMask |= 1 << type;
+                            if (type == Primitive::kPosition)
+                                positionIdx = accessorIdx;
+                        }
+                    }
+                    else if (key == "indices")
+                    {
+                        indicesIdx = reader.ReadUInt();
+                        prim.indices = Lookup(m_accessors, indicesIdx);
+                    }
+                    else if (key == "material")
+                        prim.material = Lookup(m_materials, reader.ReadUInt());
+                    else if (key == "mode")
+                        prim.mode = (uint16_t)reader.ReadUInt();
+                    else
+                        reader.SkipValue(); // TODO:  Add morph targets
+                }
+
+                // Read position AABB
+                ASSERT(positionIdx < bounds.size(), "Primitive has no POSITION attribute");
+                if (positionIdx < bounds.size())
+                {
+                    for (uint32_t i = 0; i < 3; ++i)
+                    {
+                        prim.minPos[i] = (float)bounds[positionIdx].min[i];
+                        prim.maxPos[i] = (float)bounds[positionIdx].max[i];
+                    }
+                }
+
+                if (indicesIdx < bounds.size())
+                {
+                    prim.minIndex = (uint32_t)bounds[indicesIdx].min[0];
+                    prim.maxIndex = (uint32_t)bounds[indicesIdx].max[0];
+                }
+            }
+        }
+    }
+}
+
+void glTF::Asset::ReadCameras( JsonReader& reader )
+{
+    JsonReader::StringRef key;
+    uint32_t cameraIdx = 0;
+
+    reader.BeginArray();
+    while (reader.NextElement())
+    {
+        glTF::Camera& camera = m_cameras[cameraIdx++];
+
+        // "type" may come after the projection, so read both kinds and pick one at the end
+        float perspective[4] = { 0.0f, 0.0f, 0.0f, 0.0f }; // aspectRatio, yfov, znear, zfar
+        float orthographic[4] = { 0.0f, 0.0f, 0.0f, 0.0f }; // xmag, ymag, znear, zfar
+        bool isPerspective = false;
+
+        reader.BeginObject();
+        while (reader.NextMember(key))
+        {
+            if (key == "type")
+                isPerspective = reader.ReadStringRef() == "perspective";
+            else if (key == "perspective")
+            {
+                reader.BeginObject();
+                while (reader.NextMember(key))
+                {
+                    if (key == "aspectRatio")
+                        perspective[0] = reader.ReadFloat();
+                    else if (key == "yfov")
+                        perspective[1] = reader.ReadFloat();
+                    else if (key == "znear")
+                        perspective[2] = reader.ReadFloat();
+                    else if (key == "zfar")
+                        perspective[3] = reader.ReadFloat();
+                    else
+                        reader.SkipValue();
+                }
+            }
+            else if (key == "orthographic")
+            {
+                reader.BeginObject();
+                while (reader.NextMember(key))
+                {
+                    if (key == "xmag")
+                        orthographic[0] = reader.ReadFloat();
+                    else if (key == "ymag")
+                        orthographic[1] = reader.ReadFloat();
+                    else if (key == "znear")
+                        orthographic[2] = reader.ReadFloat();
+                    else if (key == "zfar")
+                        orthographic[3] = reader.ReadFloat();
+                    else
+                        reader.SkipValue();
+                }
+            }
+            else
+                reader.SkipValue();
+        }
+
+        if (isPerspective)
+        {
+            camera.type = Camera::kPerspective;
+            camera.aspectRatio = perspective[0];
+            camera.yfov = perspective[1];
+            camera.znear = perspective[2];
+            camera.zfar = perspective[3];
+        }
+        else
+        {
+            camera.type = Camera::kOrthographic;
+            camera.xmag = orthographic[0];
+            camera.ymag = orthographic[1];
+            camera.znear = orthographic[2];
+            camera.zfar = orthographic[3];
+            ASSERT(camera.zfar > camera.znear);
+        }
+    }
+}
+
+void glTF::Asset::ReadNodes( JsonReader& reader )
+{
+    JsonReader::StringRef key;
+    uint32_t nodeIdx = 0;
+
+    reader.BeginArray();
+    while (reader.NextElement())
+    {
+        glTF::Node& node = m_nodes[nodeIdx++];
+        int32_t cameraIdx = -1;
+        int32_t meshIdx = -1;
+        int32_t skinIdx = -1;
+
+        node.flags = 0;
+        node.mesh = nullptr;
+        node.linearIdx = -1;
+        node.scale[0] = 1.0f;
+        node.scale[1] = 1.0f;
+        node.scale[2] = 1.0f;
+        node.rotation[0] = 0.0f;
+        node.rotation[1] = 0.0f;
+        node.rotation[2] = 0.0f;
+        node.rotation[3] = 1.0f;
+        node.translation[0] = 0.0f;
+        node.translation[1] = 0.0f;
+        node.translation[2] = 0.0f;
+
+        reader.BeginObject();
+        while (reader.NextMember(key))
+        {
+            if (key == "camera")
+                cameraIdx = reader.ReadInt();
+            else if (key == "mesh")
+                meshIdx = reader.ReadInt();
+            else if (key == "skin")
+                skinIdx = reader.ReadInt();
+            else if (key == "children")
+            {
+                node.children.reserve(reader.CountElements());
+                reader.BeginArray();
+                while (reader.NextElement())
+                    node.children.push_back(Lookup(m_nodes, reader.ReadUInt()));
+            }
+            else if (key == "matrix")
+            {
+                // TODO:  Should check for negative determinant to reverse triangle winding
+                reader.ReadFloats(node.matrix, 16);
+                node.hasMatrix = true;
+            }
+            // The matrix shares storage with TRS and takes precedence, whichever comes first
+            else if (key == "scale" && !node.hasMatrix)
+                reader.ReadFloats(node.scale, 3);
+            else if (key == "rotation" && !node.hasMatrix)
+                reader.ReadFloats(node.rotation, 4);
+            else if (key == "translation" && !node.hasMatrix)
+                reader.ReadFloats(node.translation, 3);
+            else
+                reader.SkipValue();
+        }
+
+        if (cameraIdx >= 0)
+        {
+            node.camera = Lookup(m_cameras, (uint32_t)cameraIdx);
+            node.pointsToCamera = true;
+        }
+        else if (meshIdx >= 0)
+        {
+            node.mesh = Lookup(m_meshes, (uint32_t)meshIdx);
+        }
+
+        if (skinIdx >= 0)
+        {
+            ASSERT(node.mesh != nullptr);
+            node.mesh->skin = skinIdx;
+        }
+    }
+}
+
+void glTF::Asset::ReadSkins( JsonReader& reader )
+{
+    JsonReader::StringRef key;
+    uint32_t skinIdx = 0;
+
+    reader.BeginArray();
+    while (reader.NextElement())
+    {
+        glTF::Skin& skin = m_skins[skinIdx++];
+        skin.inverseBindMatrices = nullptr;
+        skin.skeleton = nullptr;
+
+        reader.BeginObject();
+        while (reader.NextMember(key))
+        {
+            if (key == "inverseBindMatrices")
+                skin.inverseBindMatrices = Lookup(m_accessors, reader.ReadUInt());
+            else if (key == "skeleton")
+            {
+                skin.skeleton = Lookup(m_nodes, reader.ReadUInt());
+                if (skin.skeleton != nullptr)
+                    skin.skeleton->skeletonRoot = true;
+            }
+            else if (key == "joints")
+            {
+                skin.joints.reserve(reader.CountElements());
+                reader.BeginArray();
+                while (reader.NextElement())
+                    skin.joints.push_back(Lookup(m_nodes, reader.ReadUInt()));
+            }
+            else
+                reader.SkipValue();
+        }
+    }
+}
+
+void glTF::Asset::ReadScenes( JsonReader& reader )
+{
+    JsonReader::StringRef key;
+    uint32_t sceneIdx = 0;
+
+    reader.BeginArray();
+    while (reader.NextElement())
+    {
+        glTF::Scene& scene = m_scenes[sceneIdx++];
+
+        reader.BeginObject();
+        while (reader.NextMember(key))
+        {
+            if (key == "nodes")
+            {
+                scene.nodes.reserve(reader.CountElements());
+                reader.BeginArray();
+                while (reader.NextElement())
+                    scene.nodes.push_back(Lookup(m_nodes, reader.ReadUInt()));
+            }
+            else
+                reader.SkipValue();
+        }
+    }
+}
+
+void glTF::Asset::ReadAnimations( JsonReader& reader )
+{
+    JsonReader::StringRef key;
+    uint32_t animIdx = 0;
+
+    // Channels refer to samplers by index, and may be listed first
+    std::vector<uint32_t> channelSamplers;
+
+    reader.BeginArray();
+    while (reader.NextElement())
+    {
+        glTF::Animation& animation = m_animations[animIdx++];
+        channelSamplers.clear();
+
+        reader.BeginObject();
+        while (reader.NextMember(key))
+        {
+            if (key == "samplers")
+            {
+                animation.m_samplers.resize(reader.CountElements());
+                uint32_t samplerIdx = 0;
+
+                reader.BeginArray();
+                while (reader.NextElement())
+                {
+                    glTF::AnimSampler& sampler = animation.m_samplers[samplerIdx++];
+                    sampler.m_input = nullptr;
+                    sampler.m_output = nullptr;
+                    sampler.m_interpolation = AnimSampler::kLinear;
+
+                    reader.BeginObject();
+                    while (reader.NextMember(key))
+                    {
+                        if (key == "input")
+                            sampler.m_input = Lookup(m_accessors, reader.ReadUInt());
+                        else if (key == "output")
+                            sampler.m_output = Lookup(m_accessors, reader.ReadUInt());
+                        else if (key == "interpolation")
+                        {
+                            JsonReader::StringRef interpolation = reader.ReadStringRef();
+                            if (interpolation == "LINEAR")
+                                sampler.m_interpolation = AnimSampler::kLinear;
+                            else if (interpolation == "STEP")
+                                sampler.m_interpolation = AnimSampler::kStep;
+                            else if (interpolation == "CATMULLROMSPLINE")
+                                sampler.m_interpolation = AnimSampler::kCatmullRomSpline;
+                            else if (interpolation == "CUBICSPLINE")
+                                sampler.m_interpolation = AnimSampler::kCubicSpline;
+                        }
+                        else
+                            reader.SkipValue();
+                    }
+                }
+            }
+            else if (key == "channels")
+            {
+                animation.m_channels.resize(reader.CountElements());
+                channelSamplers.resize(animation.m_channels.size(), 0);
+                uint32_t channelIdx = 0;
+
+                reader.BeginArray();
+                while (reader.NextElement())
+                {
+                    glTF::AnimChannel& channel = animation.m_channels[channelIdx];
+                    channel.m_sampler = nullptr;
+                    channel.m_target = nullptr;
+                    channel.m_path = AnimChannel::kTranslation;
+
+                    reader.BeginObject();
+                    while (reader.NextMember(key))
+                    {
+                        if (key == "sampler")
+                            channelSamplers[channelIdx] = reader.ReadUInt();
+                        else if (key == "target")
+                        {
+                            reader.BeginObject();
+                            while (reader.NextMember(key))
+                            {
+                                if (key == "node")
+                                    channel.m_target = Lookup(m_nodes, reader.ReadUInt());
+                                else if (key == "path")
+                                {
+                                    JsonReader::StringRef path = reader.ReadStringRef();
+                                    if (path == "translation")
+                                        channel.m_path = AnimChannel::kTranslation;
+                                    else if (path == "rotation")
+                                        channel.m_path = AnimChannel::kRotation;
+                                    else if (path == "scale")
+                                        channel.m_path = AnimChannel::kScale;
+                                    else if (path == "weights")
+                                        channel.m_path = AnimChannel::kWeights;
+                                }
+                                else
+                                    reader.SkipValue();
+                            }
+                        }
+                        else
+                            reader.SkipValue();
+                    }
+                    ++channelIdx;
+                }
+            }
+            else
+                reader.SkipValue();
+        }
+
+        for (size_t i = 0; i < animation.m_channels.size(); ++i)
+            animation.m_channels[i].m_sampler = Lookup(animation.m_samplers, channelSamplers[i]);
+    }
+}
+
+bool glTF::Asset::ParseStreaming( const char* text, size_t length, const Buffer& chunk1bin )
+{
+    enum
+    {
+        kBuffers, kBufferViews, kAccessors, kImages, kSamplers, kTextures, kMaterials,
+        kMeshes, kCameras, kNodes, kSkins, kScenes, kAnimations, kNumSections
+    };
+    static const char* kSectionNames[kNumSections] =
+    {
+        "buffers", "bufferViews", "accessors", "images", "samplers", "textures", "materials",
+        "meshes", "cameras", "nodes", "skins", "scenes", "animations"
+    };
+
+    const char* sectionStart[kNumSections] = {};
+    uint32_t sectionSize[kNumSections] = {};
+    int32_t defaultScene = -1;
+
+    JsonReader reader(text, length);
+    JsonReader::StringRef key;
+
+    // Pass 1:  locate and count the top-level arrays
+    if (!reader.BeginObject())
+        return false;
+
+    while (reader.NextMember(key))
+    {
+        uint32_t section = 0;
+        while (section < kNumSections && !key.Equals(kSectionNames[section]))
+            ++section;
+
+        if (section < kNumSections)
+        {
+            sectionStart[section] = reader.GetPosition();
+            sectionSize[section] = reader.SkipArray();
+        }
+        else if (key == "scene")
+            defaultScene = reader.ReadInt();
+        else
+            reader.SkipValue();
+    }
+
+    if (reader.HasError())
+        return false;
+
+    m_buffers.resize(sectionSize[kBuffers]);
+    m_bufferViews.resize(sectionSize[kBufferViews]);
+    m_accessors.resize(sectionSize[kAccessors]);
+    m_images.resize(sectionSize[kImages]);
+    m_samplers.resize(sectionSize[kSamplers]);
+    m_textures.resize(sectionSize[kTextures]);
+    m_materials.resize(sectionSize[kMaterials]);
+    m_meshes.resize(sectionSize[kMeshes]);
+    m_cameras.resize(sectionSize[kCameras]);
+    m_nodes.resize(sectionSize[kNodes]);
+    m_skins.resize(sectionSize[kSkins]);
+    m_scenes.resize(sectionSize[kScenes]);
+    m_animations.resize(sectionSize[kAnimations]);
+
+    std::vector<AccessorBounds> accessorBounds(sectionSize[kAccessors]);
+
+    // Pass 2:  read each section in dependency order
+    for (uint32_t section = 0; section < kNumSections; ++section)
+    {
+        if (sectionStart[section] == nullptr)
+            continue;
+
+        reader.SetPosition(sectionStart[section]);
+
+        switch (section)
+        {
+        case kBuffers:
+            // Nothing else can be read without the buffers
+            if (!ReadBuffers(reader, chunk1bin))
+                return false;
+            break;
+        case kBufferViews:  ReadBufferViews(reader); break;
+        case kAccessors:    ReadAccessors(reader, accessorBounds); break;
+        case kImages:       ReadImages(reader); break;
+        case kSamplers:     ReadSamplers(reader); break;
+        case kTextures:     ReadTextures(reader); break;
+        case kMaterials:    ReadMaterials(reader); break;
+        case kMeshes:       ReadMeshes(reader, accessorBounds); break;
+        case kCameras:      ReadCameras(reader); break;
+        case kNodes:        ReadNodes(reader); break;
+        case kSkins:        ReadSkins(reader); break;
+        case kScenes:       ReadScenes(reader); break;
+        case kAnimations:   ReadAnimations(reader); break;
+        }
+    }
+
+    if (defaultScene >= 0)
+        m_scene = Lookup(m_scenes, (uint32_t)defaultScene);
+
+    return !reader.HasError();
+}
+
+void glTF::Asset::Parse(const std::wstring& filepath, ParseMethod method, BufferStorage storage)
+{
+    ByteArray gltfFile;
+    Buffer chunk1Bin;
+
+    m_storage = storage;
+    if (!ReadSourceFile(filepath, storage, gltfFile, chunk1Bin))
+        return;
+
+    // Strip off file name to get root path to other related files
+    m_basePath = Utility::GetBasePath(filepath);
+
+    const char* text = (const char*)gltfFile->data();
+    const bool parsed = method == kDOM ? ParseDOM(text, chunk1Bin) :
+        ParseStreaming(text, gltfFile->size() - 1, chunk1Bin);
+
+    if (!parsed)
+    {
+        // Without a scene, BuildModel() rejects whatever was read before the failure
+        m_scene = nullptr;
+        LOG_ERRORF("Invalid glTF file: %s.", Utility::WideStringToUTF8(filepath).c_str());
+    }
+}
+
+#ifdef _DEBUG
+static std::atomic<uint64_t> s_AllocationCount;
+
+static int CountAllocations( int allocType, void*, size_t, int, long, const unsigned char*, int )
+{
+    if (allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC)
+        ++s_AllocationCount;
+    return TRUE;
+}
+#endif
+
+void glTF::Asset::BenchmarkParse(const std::wstring& filepath, uint32_t iterations)
+{
+    ByteArray gltfFile;
+    Buffer chunk1Bin;
+
+    if (iterations == 0 || !ReadSourceFile(filepath, kReadBuffers, gltfFile, chunk1Bin))
+        return;
+
+    const char* text = (const char*)gltfFile->data();
+    const size_t length = gltfFile->size() - 1;
+    const std::string fileName = Utility::WideStringToUTF8(filepath);
+
+    // Load the external buffers once so that both methods are timed on JSON handling rather than disk reads
+    Asset reference[2];
+    reference[kStreaming].m_basePath = Utility::GetBasePath(filepath);
+    reference[kStreaming].m_storage = kReadBuffers;
+    if (!reference[kStreaming].ParseStreaming(text, length, chunk1Bin))
+    {
+        LOG_ERRORF("Invalid glTF file: %s.", fileName.c_str());
+        return;
+    }
+
+    static const char* kMethodNames[] = { "Streaming", "DOM" };
+
+    for (uint32_t method = kStreaming; method <= kDOM; ++method)
+    {
+#ifdef _DEBUG
+        s_AllocationCount = 0;
+        _CRT_ALLOC_HOOK prevHook = _CrtSetAllocHook(CountAllocations);
+#endif
+        const int64_t startTick = SystemTime::GetCurrentTick();
+
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            Asset asset;
+            asset.m_preloadedBuffers = &reference[kStreaming].m_buffers;
+            if (method == kDOM)
+                asset.ParseDOM(text, chunk1Bin);
+            else
+                asset.ParseStreaming(text, length, chunk1Bin);
+        }
+
+        const double totalMs = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - startTick);
+#ifdef _DEBUG
+        _CrtSetAllocHook(prevHook);
+        const uint64_t allocations = s_AllocationCount / iterations;
+#else
+        const uint64_t allocations = 0;
+#endif
+
+        LOG_INFOF("glTF %s parse of %s (%zu bytes):  %.3f ms, %llu allocations (average of %u)",
+            kMethodNames[method], fileName.c_str(), length, totalMs / iterations, allocations, iterations);
+    }
+
+    // Compare the output of the two methods
+    reference[kDOM].m_preloadedBuffers = &reference[kStreaming].m_buffers;
+    reference[kDOM].ParseDOM(text, chunk1Bin);
+
+    const Asset& a = reference[kStreaming];
+    const Asset& b = reference[kDOM];
+    if (a.m_accessors.size() != b.m_accessors.size() || a.m_bufferViews.size() != b.m_bufferViews.size() ||
+        a.m_meshes.size() != b.m_meshes.size() || a.m_materials.size() != b.m_materials.size() ||
+        a.m_nodes.size() != b.m_nodes.size() || a.m_animations.size() != b.m_animations.size())
+    {
+        LOG_WARN("glTF parse methods disagree on array sizes");
+        return;
+    }
+
+    for (size_t i = 0; i < a.m_accessors.size(); ++i)
+    {
+        const Accessor& x = a.m_accessors[i];
+        const Accessor& y = b.m_accessors[i];
+        // Decompressed views are decoded separately by each parse, so only compare whether data exists
+        if ((x.dataPtr == nullptr) != (y.dataPtr == nullptr) || x.stride != y.stride || x.count != y.count ||
+            x.componentType != y.componentType || x.type != y.type)
+        {
+            LOG_WARN("glTF parse methods disagree on accessors");
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < a.m_nodes.size(); ++i)
+    {
+        const Node& x = a.m_nodes[i];
+        const Node& y = b.m_nodes[i];
+        const bool sameTransform = x.hasMatrix ? memcmp(x.matrix, y.matrix, sizeof(x.matrix)) == 0 :
+            memcmp(x.scale, y.scale, sizeof(x.scale)) == 0 && memcmp(x.rotation, y.rotation, sizeof(x.rotation)) == 0 &&
+            memcmp(x.translation, y.translation, sizeof(x.translation)) == 0;
+        if (x.flags != y.flags || x.children.size() != y.children.size() || !sameTransform)
+        {
+            LOG_WARN("glTF parse methods disagree on nodes");
+            return;
+        }
+    }
 }
@@ -23,13 +23,28 @@
 #include "json.hpp"
 #pragma warning(pop)
 
+#include <memory>
 #include <string>
 
+class JsonReader;
+
 namespace glTF
 {
     using json = nlohmann::json;
     using Utility::ByteArray;
 
+    // The bytes behind a glTF buffer, either read into memory or left in a mapped file.  Either way they
+    // stay valid as long as the Buffer (and so the Asset) is alive.
+    struct Buffer
+    {
+        Buffer() : data(nullptr), size(0) {}
+
+        ByteArray bytes;
+        std::shared_ptr<Utility::MappedFile> mapping;
+        byte* data;
+        size_t size;
+    };
+
     struct BufferView
     {
         uint32_t buffer;
@@ -70,6 +85,7 @@ namespace glTF
         uint32_t count; // number of elements
         uint16_t componentType;
         uint16_t type;
+        bool normalized; // integer components map to [0,1] or [-1,1] (otherwise they convert as integers)
 
         // Nobody is doing this in the samples.  Seems dumb.
         //uint32_t sparseCount;   // Number of sparse elements
@@ -240,11 +256,25 @@ namespace glTF
     class Asset
     {
     public:
-        Asset() : m_scene(nullptr) {}
-        Asset(const std::wstring& filepath) : m_scene(nullptr) { Parse(filepath); }
+        // The streaming parser reads the glTF JSON in place.  The DOM parser builds a full nlohmann::json
+        // tree first; it is kept as a reference for validation and benchmarking.
+        enum ParseMethod { kStreaming, kDOM };
+
+        // Mapping leaves the GLB BIN chunk and external .bin files on disk, paging them in as accessors are
+        // read, instead of copying every vertex and index into memory up front.  Compressed (.gz) buffers
+        // are always read.
+        enum BufferStorage { kReadBuffers, kMapBuffers };
+
+        Asset() : m_scene(nullptr), m_storage(kMapBuffers), m_preloadedBuffers(nullptr) {}
+        Asset(const std::wstring& filepath, ParseMethod method = kStreaming, BufferStorage storage = kMapBuffers)
+            : m_scene(nullptr), m_storage(storage), m_preloadedBuffers(nullptr) { Parse(filepath, method, storage); }
         ~Asset() { m_meshes.clear(); }
 
-        void Parse(const std::wstring& filepath);
+        void Parse(const std::wstring& filepath, ParseMethod method = kStreaming, BufferStorage storage = kMapBuffers);
+
+        // Parses the file repeatedly with each method and logs the average time and heap allocation count
+        // (allocations are only counted in debug builds).  Also reports any difference in the parsed arrays.
+        static void BenchmarkParse(const std::wstring& filepath, uint32_t iterations);
 
         Scene* m_scene;
         std::wstring m_basePath;
@@ -258,13 +288,23 @@ namespace glTF
         std::vector<Accessor> m_accessors;
         std::vector<Skin> m_skins;
         std::vector<Material> m_materials;
-        std::vector<ByteArray> m_buffers;
+        std::vector<Buffer> m_buffers;
         std::vector<BufferView> m_bufferViews;
         std::vector<Animation> m_animations;
 
     private:
-        void ProcessBuffers( json& buffers, ByteArray chunk1bin );
+        struct AccessorBounds;
+        struct CompressedView;
+        struct BufferRead;
+
+        static bool ReadSourceFile( const std::wstring& filepath, BufferStorage storage, ByteArray& gltfFile, Buffer& chunk1bin );
+        Buffer LoadBuffer( uint32_t bufferIdx, std::string& uri, std::vector<BufferRead>& reads );
+        bool FinishBufferReads( std::vector<BufferRead>& reads );
+
+        bool ParseDOM( const char* text, const Buffer& chunk1bin );
+        bool ProcessBuffers( json& buffers, const Buffer& chunk1bin );
         void ProcessBufferViews( json& bufferViews );
+        void DecompressBufferView( BufferView& bufferView, const CompressedView& compressed );
         void ProcessAccessors( json& accessors );
         void ProcessMaterials( json& materials );
         void ProcessTextures( json& textures );
@@ -279,6 +319,27 @@ namespace glTF
         void FindAttribute( Primitive& prim, json& attributes, Primitive::eAttribType type, const std::string& name);
         uint32_t ReadTextureInfo( json& info_json, glTF::Texture* &info );
         void DecodeURI( std::string& uri );
+
+        bool ParseStreaming( const char* text, size_t length, const Buffer& chunk1bin );
+        bool ReadBuffers( JsonReader& reader, const Buffer& chunk1bin );
+        void ReadBufferViews( JsonReader& reader );
+        void ReadAccessors( JsonReader& reader, std::vector<AccessorBounds>& bounds );
+        void ReadImages( JsonReader& reader );
+        void ReadSamplers( JsonReader& reader );
+        void ReadTextures( JsonReader& reader );
+        void ReadMaterials( JsonReader& reader );
+        uint32_t ReadTextureInfo( JsonReader& reader, glTF::Texture* &info );
+        void ReadMeshes( JsonReader& reader, const std::vector<AccessorBounds>& bounds );
+        void ReadCameras( JsonReader& reader );
+        void ReadNodes( JsonReader& reader );
+        void ReadSkins( JsonReader& reader );
+        void ReadScenes( JsonReader& reader );
+        void ReadAnimations( JsonReader& reader );
+
+        BufferStorage m_storage;
+
+        // Buffers already loaded, used instead of reading the files again (see BenchmarkParse)
+        const std::vector<Buffer>* m_preloadedBuffers;
     };
 
 
@@ -48,6 +48,8 @@
 #include "ModelLoader.h"
 #include "LightManager.h"
 #include "ParticleEffects.h"
+#include "ShadowCache.h"
+#include "SelfTests.h"
 
 //VRS
 #include "VRS.h"
@@ -96,6 +98,14 @@ NumVar g_IBLBias("Viewer/Lighting/EnvironmentMap Blur", 0.0f, 0.0f, 10.0f, 0.1f,
 NumVar g_EnvRotX("Viewer/Lighting/Environment Rotation X", 3, 0, 3, 1);
 NumVar g_EnvRotY("Viewer/Lighting/Environment Rotation Y", 0, 0, 3, 1);
 
+IntVar g_ShadowRefreshBudget("Viewer/Lighting/Shadow Maps Refreshed Per Frame", 1, 1, ShadowCache::kMaxRefreshesPerFrame);
+
+// Sorters for every view of the scene, reused each frame so that their arrays keep their capacity
+static MeshSorterPool s_SorterPool;
+
+// Light shadow maps are only rendered again when something that could change them has
+static ShadowCache s_ShadowCache;
+
 
 void ChangeIBLBias(EngineVar::ActionType)
 {
@@ -158,15 +168,19 @@ void DemoApp::Startup()
     if (CommandLineArgs::GetInteger(L"rebuild", rebuildValue))
         forceRebuild = rebuildValue != 0;
 
+    // Leaves the keyframes on disk when the model is only meant to be viewed in its rest pose
+    bool skipAnimation = false;
+    uint32_t skipAnimationValue;
+    if (CommandLineArgs::GetInteger(L"skip_animation", skipAnimationValue))
+        skipAnimation = skipAnimationValue != 0;
+
     std::wstring gltfFileName;
     if (CommandLineArgs::GetString(L"model", gltfFileName) == false)
-    {
-        m_ModeInstance = Renderer::LoadModel(m_AssetRootDir + L"/Sponza/pbr/sponza2.gltf", forceRebuild);
-    }
-    else
-    {
-        m_ModeInstance = Renderer::LoadModel(gltfFileName, forceRebuild);
-    }
+        gltfFileName = m_AssetRootDir + L"/Sponza/pbr/sponza2.gltf";
+
+    m_ModeInstance = Renderer::LoadModel(gltfFileName, forceRebuild, skipAnimation);
+
+    SelfTests::Run(gltfFileName);
 
     if (!m_ModeInstance.IsNull())
     {
@@ -221,6 +235,7 @@ void DemoApp::Cleanup(void)
 
     m_ModeInstance = nullptr;
 
+    s_SorterPool.Destroy();
     Renderer::Shutdown();
 }
 
@@ -347,6 +362,8 @@ void DemoApp::RenderScene(void)
     const D3D12_VIEWPORT& viewport = m_MainViewport;
     const D3D12_RECT& scissor = m_MainScissor;
 
+    s_SorterPool.BeginFrame();
+
     if (ParticleEffectManager::Enable)
     {
         ParticleEffectManager::Update(gfxContext.GetComputeContext(), Graphics::GetFrameTime());
@@ -381,59 +398,69 @@ void DemoApp::RenderScene(void)
             gfxContext.BeginQuery(Renderer::m_queryHeap, D3D12_QUERY_TYPE_PIPELINE_STATISTICS, 0);
 #endif
 
-        // Lights shadow
+        // Set up every view of the frame first so that their draws can be collected in parallel
+        const std::vector<uint32_t>& staleLights = s_ShadowCache.Update(m_ModeInstance, (uint32_t)(int)g_ShadowRefreshBudget);
+        const bool renderSunShadow = !SSAO::DebugDraw;
+
+        MeshSorter* views[ShadowCache::kMaxRefreshesPerFrame + 2];
+        uint32_t numViews = 0;
+
+        // Spot light shadows only draw the meshes inside the light's frustum
+        for (uint32_t lightIndex : staleLights)
         {
-            using namespace Lighting;
+            MeshSorter& lightShadowSorter = s_SorterPool.Acquire(MeshSorter::kShadows);
+            lightShadowSorter.SetCamera(Lighting::GetShadowCamera(lightIndex));
+            lightShadowSorter.SetDepthStencilTarget(Lighting::m_LightShadowTempBuffer);
+            views[numViews++] = &lightShadowSorter;
+        }
 
-            static uint32_t LightIndex = 0;
-            if (LightIndex < MaxLights)
-            {
-                ScopedTimer _prof(L"Generate lights shadow", gfxContext);
+        MeshSorter& sorter = s_SorterPool.Acquire(MeshSorter::kDefault);
+        sorter.SetCamera(m_Camera);
+        sorter.SetViewport(viewport);
+        sorter.SetScissor(scissor);
+        sorter.SetDepthStencilTarget(g_SceneDepthBuffer);
+        sorter.AddRenderTarget(g_SceneColorBuffer);
+        views[numViews++] = &sorter;
 
-                m_LightShadowTempBuffer.BeginRendering(gfxContext);
-                {
-                    ShadowCamera lightShadowCamera;
-                    lightShadowCamera.SetPosition(m_Camera.GetPosition());
-                    lightShadowCamera.SetViewProjMatrix(m_LightShadowMatrix[LightIndex]);
+        MeshSorter& sunShadowSorter = s_SorterPool.Acquire(MeshSorter::kShadows);
+        // The sun shadow only draws meshes that can cast onto something the main camera sees
+        sunShadowSorter.SetCamera(m_SunShadowCamera);
+        sunShadowSorter.SetDepthStencilTarget(g_ShadowBuffer);
+        sunShadowSorter.SetCasterCulling(m_Camera);
+        if (renderSunShadow)
+            views[numViews++] = &sunShadowSorter;
 
-                    MeshSorter shadowSorter(MeshSorter::kShadows);
+        m_ModeInstance.Render(views, numViews);
 
-                    shadowSorter.SetCullEnabled(false);
-                    shadowSorter.SetCamera(lightShadowCamera);
-                    shadowSorter.SetDepthStencilTarget(m_LightShadowTempBuffer);
+        for (uint32_t i = 0; i < numViews; ++i)
+            views[i]->Sort();
 
-                    m_ModeInstance.Render(shadowSorter);
+        // Lights shadow
+        if (!staleLights.empty())
+        {
+            using namespace Lighting;
 
-                    shadowSorter.Sort();
-                    shadowSorter.RenderMeshes(MeshSorter::kZPass, gfxContext, globals);
-                }
+            ScopedTimer _prof(L"Generate lights shadow", gfxContext);
+
+            // The light shadow views come first in 'views'
+            for (size_t i = 0; i < staleLights.size(); ++i)
+            {
+                m_LightShadowTempBuffer.BeginRendering(gfxContext);
+                views[i]->RenderMeshes(MeshSorter::kZPass, gfxContext, globals);
 
                 gfxContext.TransitionResource(m_LightShadowTempBuffer, D3D12_RESOURCE_STATE_COPY_SOURCE);
                 gfxContext.TransitionResource(m_LightShadowArray, D3D12_RESOURCE_STATE_COPY_DEST);
 
-                gfxContext.CopySubresource(m_LightShadowArray, LightIndex, m_LightShadowTempBuffer, 0);
-
-                gfxContext.TransitionResource(m_LightShadowArray, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-
-                ++LightIndex;
+                gfxContext.CopySubresource(m_LightShadowArray, staleLights[i], m_LightShadowTempBuffer, 0);
             }
+
+            gfxContext.TransitionResource(m_LightShadowArray, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
         }
 
         // Begin rendering depth
         gfxContext.TransitionResource(g_SceneDepthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE, true);
         gfxContext.ClearDepth(g_SceneDepthBuffer);
 
-        MeshSorter sorter(MeshSorter::kDefault);
-        sorter.SetCamera(m_Camera);
-        sorter.SetViewport(viewport);
-        sorter.SetScissor(scissor);
-        sorter.SetDepthStencilTarget(g_SceneDepthBuffer);
-        sorter.AddRenderTarget(g_SceneColorBuffer);
-
-        m_ModeInstance.Render(sorter);
-
-        sorter.Sort();
-
         {
             ScopedTimer _prof(L"Depth Pre-Pass", gfxContext);
             sorter.RenderMeshes(MeshSorter::kZPass, gfxContext, globals);
@@ -497,16 +524,7 @@ void DemoApp::RenderScene(void)
 
             {
                 ScopedTimer _prof(L"Sun Shadow Map", gfxContext);
-
-                MeshSorter shadowSorter(MeshSorter::kShadows);
-                shadowSorter.SetCamera(m_SunShadowCamera);
-                shadowSorter.SetDepthStencilTarget(g_ShadowBuffer);
-                shadowSorter.SetCullEnabled(false);
-
-                m_ModeInstance.Render(shadowSorter);
-
-                shadowSorter.Sort();
-                shadowSorter.RenderMeshes(MeshSorter::kZPass, gfxContext, globals);
+                sunShadowSorter.RenderMeshes(MeshSorter::kZPass, gfxContext, globals);
             }
 
             gfxContext.TransitionResource(g_SceneColorBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET, true);